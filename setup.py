@@ -44,6 +44,17 @@ ext_modules = [
             'src/python_bindings.cpp',
             'src/vector_cluster_store.cpp',
             'src/kmeans_clustering.cpp',
+            'src/hierarchical_kmeans.cpp',
+            'src/distance.cpp',
+            'src/io_uring_engine.cpp',
+            'src/thread_pool.cpp',
+            'src/quantizer.cpp',
+            'src/vector_index.cpp',
+            'src/sharded_vector_store.cpp',
+            'src/cluster_cache.cpp',
+            'src/attribute_index.cpp',
+            'src/logger.cpp',
+            'src/store_metrics.cpp',
         ],
         include_dirs=[
             pybind11.get_include(),
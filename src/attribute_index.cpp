@@ -0,0 +1,332 @@
+#include "attribute_index.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+// Just enough JSON to pick a flat object's top-level values out of vector
+// metadata; anything nested is skipped over.
+class MetadataScanner {
+public:
+    MetadataScanner(const char* data, size_t size) : pos_(data), end_(data + size) {}
+
+    void skipSpace() {
+        while (pos_ < end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\n' || *pos_ == '\r')) {
+            pos_++;
+        }
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (pos_ < end_ && *pos_ == c) {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+
+    bool peek(char c) {
+        skipSpace();
+        return pos_ < end_ && *pos_ == c;
+    }
+
+    bool readString(std::string& out) {
+        out.clear();
+        if (!consume('"')) {
+            return false;
+        }
+        while (pos_ < end_) {
+            char c = *pos_++;
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos_ >= end_) {
+                return false;
+            }
+            switch (char escape = *pos_++) {
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t code;
+                    if (!readHex(code)) {
+                        return false;
+                    }
+                    // A surrogate pair spells one code point
+                    if (code >= 0xD800 && code < 0xDC00 && end_ - pos_ >= 6 && pos_[0] == '\\' &&
+                        pos_[1] == 'u') {
+                        pos_ += 2;
+                        uint32_t low;
+                        if (!readHex(low)) {
+                            return false;
+                        }
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default: out += escape; break;
+            }
+        }
+        return false;
+    }
+
+    // The next scalar's text (number, true, false or null)
+    std::string readLiteral() {
+        skipSpace();
+        const char* start = pos_;
+        while (pos_ < end_ && *pos_ != ',' && *pos_ != '}' && *pos_ != ']' && *pos_ != ' ' &&
+               *pos_ != '\t' && *pos_ != '\n' && *pos_ != '\r') {
+            pos_++;
+        }
+        return std::string(start, pos_);
+    }
+
+    bool skipValue() {
+        skipSpace();
+        if (pos_ >= end_) {
+            return false;
+        }
+        if (*pos_ == '"') {
+            std::string ignored;
+            return readString(ignored);
+        }
+        if (*pos_ != '{' && *pos_ != '[') {
+            return !readLiteral().empty();
+        }
+        // Nested: find the matching bracket, minding strings
+        size_t depth = 0;
+        while (pos_ < end_) {
+            char c = *pos_;
+            if (c == '"') {
+                std::string ignored;
+                if (!readString(ignored)) {
+                    return false;
+                }
+                continue;
+            }
+            pos_++;
+            if (c == '{' || c == '[') {
+                depth++;
+            } else if ((c == '}' || c == ']') && --depth == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const char* pos_;
+    const char* end_;
+
+    bool readHex(uint32_t& code) {
+        if (end_ - pos_ < 4) {
+            return false;
+        }
+        code = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = *pos_++;
+            code <<= 4;
+            if (c >= '0' && c <= '9') {
+                code |= c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                code |= c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                code |= c - 'A' + 10;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void appendUtf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+};
+
+// An INT attribute from a JSON scalar: an integer, a number with no
+// fraction, or true/false
+bool parseInt(const std::string& text, int64_t& value) {
+    if (text == "true" || text == "false") {
+        value = text == "true" ? 1 : 0;
+        return true;
+    }
+    if (text.empty()) {
+        return false;
+    }
+    char* end;
+    errno = 0;
+    long long whole = std::strtoll(text.c_str(), &end, 10);
+    if (*end == '\0' && errno == 0) {
+        value = whole;
+        return true;
+    }
+    double number = std::strtod(text.c_str(), &end);
+    if (*end != '\0' || !std::isfinite(number) || std::floor(number) != number ||
+        number < -9.2e18 || number > 9.2e18) {
+        return false;
+    }
+    value = static_cast<int64_t>(number);
+    return true;
+}
+
+}  // namespace
+
+void AttributeIndex::setFields(const std::vector<AttributeField>& fields) {
+    fields_ = fields;
+    columns_.assign(fields_.size(), Column());
+}
+
+void AttributeIndex::clear() {
+    for (Column& column : columns_) {
+        column = Column();
+    }
+}
+
+void AttributeIndex::reserve(size_t rows) {
+    for (Column& column : columns_) {
+        column.values.reserve(rows);
+        column.present.reserve(rows);
+    }
+}
+
+void AttributeIndex::addRow() {
+    for (Column& column : columns_) {
+        column.values.push_back(0);
+        column.present.push_back(0);
+    }
+}
+
+void AttributeIndex::moveRow(uint32_t from, uint32_t to) {
+    for (Column& column : columns_) {
+        column.values[to] = column.values[from];
+        column.present[to] = column.present[from];
+    }
+}
+
+void AttributeIndex::removeLastRow() {
+    for (Column& column : columns_) {
+        column.values.pop_back();
+        column.present.pop_back();
+    }
+}
+
+void AttributeIndex::clearRow(uint32_t row) {
+    for (Column& column : columns_) {
+        column.present[row] = 0;
+    }
+}
+
+void AttributeIndex::extract(uint32_t row, const char* metadata, size_t size) {
+    clearRow(row);
+    if (fields_.empty() || size == 0) {
+        return;
+    }
+
+    MetadataScanner scanner(metadata, size);
+    if (!scanner.consume('{') || scanner.consume('}')) {
+        return;
+    }
+    std::string key;
+    std::string text;
+    do {
+        if (!scanner.readString(key) || !scanner.consume(':')) {
+            return;
+        }
+        size_t field = 0;
+        while (field < fields_.size() && fields_[field].name != key) {
+            field++;
+        }
+        if (field == fields_.size()) {
+            if (!scanner.skipValue()) {
+                return;
+            }
+            continue;
+        }
+
+        // A value of another type leaves the field unset
+        Column& column = columns_[field];
+        column.present[row] = 0;
+        if (fields_[field].type == AttributeType::STRING) {
+            if (!scanner.peek('"')) {
+                if (!scanner.skipValue()) {
+                    return;
+                }
+                continue;
+            }
+            if (!scanner.readString(text)) {
+                return;
+            }
+            auto code = column.dictionary.emplace(text, static_cast<int64_t>(column.dictionary.size()));
+            column.values[row] = code.first->second;
+            column.present[row] = 1;
+        } else {
+            if (scanner.peek('"') || scanner.peek('{') || scanner.peek('[')) {
+                if (!scanner.skipValue()) {
+                    return;
+                }
+                continue;
+            }
+            int64_t value;
+            if (parseInt(scanner.readLiteral(), value)) {
+                column.values[row] = value;
+                column.present[row] = 1;
+            }
+        }
+    } while (scanner.consume(','));
+}
+
+bool AttributeIndex::compile(const AttributeFilter& filter, Compiled& compiled, std::string& error) const {
+    compiled.conditions.clear();
+    for (const AttributeFilter::Condition& condition : filter.conditions) {
+        size_t field = 0;
+        while (field < fields_.size() && fields_[field].name != condition.field) {
+            field++;
+        }
+        if (field == fields_.size()) {
+            error = "no attribute field named '" + condition.field + "'";
+            return false;
+        }
+        if (fields_[field].type != condition.type) {
+            error = "attribute field '" + condition.field + "' is " +
+                    (fields_[field].type == AttributeType::STRING ? "a string" : "an integer");
+            return false;
+        }
+
+        Compiled::Condition resolved{field, {}, condition.min, condition.max,
+                                     condition.type == AttributeType::STRING};
+        // A value never stored has no code and can match nothing
+        const Column& column = columns_[field];
+        for (const std::string& value : condition.values) {
+            auto it = column.dictionary.find(value);
+            if (it != column.dictionary.end()) {
+                resolved.codes.push_back(it->second);
+            }
+        }
+        std::sort(resolved.codes.begin(), resolved.codes.end());
+        compiled.conditions.push_back(std::move(resolved));
+    }
+    return true;
+}
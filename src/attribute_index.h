@@ -0,0 +1,125 @@
+#ifndef ATTRIBUTE_INDEX_H
+#define ATTRIBUTE_INDEX_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class AttributeType {
+    INT,     // integer (true/false as 1/0); dates as epoch seconds
+    STRING
+};
+
+// A top-level key of the vector metadata (a JSON object) indexed for
+// filtered search
+struct AttributeField {
+    std::string name;
+    AttributeType type = AttributeType::STRING;
+};
+
+// Conditions a vector's attributes must all meet to be a search result.
+// A vector without the field, or whose value has another type, meets no
+// condition on it.
+struct AttributeFilter {
+    struct Condition {
+        std::string field;
+        AttributeType type;
+        // STRING: the value is one of these
+        std::vector<std::string> values;
+        // INT: min <= value <= max
+        int64_t min = INT64_MIN;
+        int64_t max = INT64_MAX;
+    };
+    std::vector<Condition> conditions;
+
+    AttributeFilter& equals(const std::string& field, const std::string& value) {
+        return in(field, {value});
+    }
+    AttributeFilter& in(const std::string& field, const std::vector<std::string>& values) {
+        conditions.push_back({field, AttributeType::STRING, values, INT64_MIN, INT64_MAX});
+        return *this;
+    }
+    AttributeFilter& equals(const std::string& field, int64_t value) {
+        return range(field, value, value);
+    }
+    AttributeFilter& range(const std::string& field, int64_t min, int64_t max) {
+        conditions.push_back({field, AttributeType::INT, {}, min, max});
+        return *this;
+    }
+
+    bool empty() const { return conditions.empty(); }
+};
+
+// Typed attribute values of a store's vectors, one row per VectorIndex
+// slot, extracted from each vector's metadata when it is stored. Each field
+// is a dense column (strings as codes into a per-field dictionary), so
+// testing a vector against a filter touches a few integers and no device
+// data.
+//
+// Rows follow VectorIndex's slots: it adds, moves and drops them as slots
+// come and go. Not thread-safe; the store's lock guards it.
+class AttributeIndex {
+public:
+    // A filter resolved against the fields and dictionaries
+    struct Compiled {
+        struct Condition {
+            size_t column;
+            std::vector<int64_t> codes;  // STRING: sorted; empty matches nothing
+            int64_t min;
+            int64_t max;
+            bool string;
+        };
+        std::vector<Condition> conditions;
+    };
+
+    // Replaces the fields and drops every row
+    void setFields(const std::vector<AttributeField>& fields);
+    const std::vector<AttributeField>& fields() const { return fields_; }
+    bool empty() const { return fields_.empty(); }
+
+    void clear();
+    void reserve(size_t rows);
+    void addRow();
+    void moveRow(uint32_t from, uint32_t to);
+    void removeLastRow();
+    void clearRow(uint32_t row);
+
+    // Index the row's values from size bytes of metadata. Metadata that
+    // isn't a JSON object leaves the row without values.
+    void extract(uint32_t row, const char* metadata, size_t size);
+
+    // Resolve filter; false (with error set) if it names an unknown field
+    // or a condition of the wrong type for it
+    bool compile(const AttributeFilter& filter, Compiled& compiled, std::string& error) const;
+    bool matches(const Compiled& compiled, uint32_t row) const {
+        for (const Compiled::Condition& condition : compiled.conditions) {
+            const Column& column = columns_[condition.column];
+            if (!column.present[row]) {
+                return false;
+            }
+            const int64_t value = column.values[row];
+            if (condition.string ? !std::binary_search(condition.codes.begin(), condition.codes.end(), value)
+                                 : value < condition.min || value > condition.max) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Column {
+        std::vector<int64_t> values;   // STRING: dictionary codes
+        std::vector<uint8_t> present;
+        // STRING: each distinct value seen, by code. Values are never
+        // dropped, so codes stay valid while the store is open.
+        std::unordered_map<std::string, int64_t> dictionary;
+    };
+
+    std::vector<AttributeField> fields_;
+    std::vector<Column> columns_;
+};
+
+#endif // ATTRIBUTE_INDEX_H
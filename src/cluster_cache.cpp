@@ -0,0 +1,111 @@
+#include "cluster_cache.h"
+
+ClusterCache::ClusterCache(uint64_t budget_bytes) : budget_(budget_bytes) {}
+
+std::shared_ptr<const ClusterCache::Extent> ClusterCache::find(uint64_t start) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(start);
+    if (it == entries_.end()) {
+        stats_.misses++;
+        return nullptr;
+    }
+    it->second.referenced = true;
+    stats_.hits++;
+    return it->second.extent;
+}
+
+bool ClusterCache::admit(uint64_t start, uint64_t size) {
+    if (size == 0 || size > budget_ / MAX_ENTRY_FRACTION) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (doorkeeper_.erase(start) > 0) {
+        return true;
+    }
+    // Forget everything once full rather than track ages, as TinyLFU's
+    // doorkeeper does
+    if (doorkeeper_.size() >= DOORKEEPER_SIZE) {
+        doorkeeper_.clear();
+    }
+    doorkeeper_.insert(start);
+    return false;
+}
+
+std::shared_ptr<const ClusterCache::Extent> ClusterCache::insert(uint64_t start, std::vector<char> data) {
+    auto extent = std::make_shared<Extent>();
+    extent->start = start;
+    extent->data = std::move(data);
+    const uint64_t size = extent->data.size();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto existing = entries_.find(start);
+    if (existing != entries_.end()) {
+        return existing->second.extent;
+    }
+
+    // Sweep until the new extent fits. Every pass clears the bits it
+    // passes, so the second pass at the latest finds a victim.
+    while (!entries_.empty() && stats_.bytes + size > budget_) {
+        auto it = entries_.lower_bound(hand_);
+        if (it == entries_.end()) {
+            it = entries_.begin();
+        }
+        if (it->second.referenced) {
+            it->second.referenced = false;
+            auto next = std::next(it);
+            hand_ = next == entries_.end() ? 0 : next->first;
+            continue;
+        }
+        auto next = erase(it);
+        hand_ = next == entries_.end() ? 0 : next->first;
+        stats_.evictions++;
+    }
+
+    // An entry never overlaps another: one the new extent covers was
+    // dropped by the write that reused its space
+    Entry& entry = entries_[start];
+    entry.extent = extent;
+    stats_.bytes += size;
+    stats_.entries++;
+    stats_.admissions++;
+    return extent;
+}
+
+void ClusterCache::invalidate(uint64_t offset, uint64_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.empty() || size == 0) {
+        return;
+    }
+    // Entries starting before the write's end, walked back while they
+    // still reach into it
+    auto it = entries_.lower_bound(offset + size);
+    while (it != entries_.begin()) {
+        --it;
+        const Extent& extent = *it->second.extent;
+        if (extent.start + extent.data.size() <= offset) {
+            break;
+        }
+        // Admitted again on its next miss, without waiting for a second
+        doorkeeper_.insert(extent.start);
+        it = erase(it);
+    }
+}
+
+void ClusterCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    doorkeeper_.clear();
+    stats_.bytes = 0;
+    stats_.entries = 0;
+}
+
+CacheStats ClusterCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+std::map<uint64_t, ClusterCache::Entry>::iterator ClusterCache::erase(std::map<uint64_t, Entry>::iterator it) {
+    stats_.bytes -= it->second.extent->data.size();
+    stats_.entries--;
+    return entries_.erase(it);
+}
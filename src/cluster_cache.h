@@ -0,0 +1,92 @@
+#ifndef CLUSTER_CACHE_H
+#define CLUSTER_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+// Counters of a ClusterCache since the store was opened
+struct CacheStats {
+    uint64_t hits = 0;        // lookups served from memory
+    uint64_t misses = 0;      // lookups that went to the device
+    uint64_t admissions = 0;  // extents read in and cached
+    uint64_t evictions = 0;
+    uint64_t bytes = 0;       // held now
+    uint64_t entries = 0;
+};
+
+// In-process cache of cluster extents read from the data region, within a
+// byte budget. It is for stores opened with direct_io, whose reads bypass
+// the page cache, so a popular cluster would otherwise be read again by
+// every query that probes it.
+//
+// An entry is a copy of an extent's bytes, keyed by the extent's start
+// offset. A write to the data region drops every entry it overlaps, so an
+// entry always matches the device.
+//
+// Replacement is CLOCK: a hit sets an entry's reference bit, and the hand
+// sweeps the entries in address order, clearing set bits, until it finds an
+// unreferenced one to evict. An extent is only admitted on its second miss
+// among the last DOORKEEPER_SIZE distinct misses, so a one-off scan of a
+// cold cluster doesn't push out the hot ones.
+//
+// Thread-safe. Entries are shared and immutable; one stays valid for as
+// long as the caller holds it.
+class ClusterCache {
+public:
+    struct Extent {
+        uint64_t start;
+        std::vector<char> data;   // data.size() bytes from start
+
+        // The bytes [offset, offset + size), or null if not all held
+        const char* span(uint64_t offset, size_t size) const {
+            return offset >= start && offset + size <= start + data.size() ? data.data() + (offset - start)
+                                                                           : nullptr;
+        }
+    };
+
+    explicit ClusterCache(uint64_t budget_bytes);
+
+    uint64_t budget() const { return budget_; }
+
+    // The extent cached at start, counted as a hit, or null and a miss
+    std::shared_ptr<const Extent> find(uint64_t start);
+    // After a miss: whether to read the extent's size bytes and insert them
+    bool admit(uint64_t start, uint64_t size);
+    // Cache data as the extent at start, evicting as needed. Returns the
+    // entry (an existing one if another thread inserted first).
+    std::shared_ptr<const Extent> insert(uint64_t start, std::vector<char> data);
+
+    // The data region was written at [offset, offset + size)
+    void invalidate(uint64_t offset, uint64_t size);
+    void clear();
+
+    CacheStats stats() const;
+
+private:
+    // Distinct missed extents remembered for admission before starting over
+    static constexpr size_t DOORKEEPER_SIZE = 4096;
+    // Extents above this fraction of the budget are never cached
+    static constexpr uint64_t MAX_ENTRY_FRACTION = 4;
+
+    struct Entry {
+        std::shared_ptr<const Extent> extent;
+        bool referenced = false;
+    };
+
+    // Drop the entry at it; mutex_ held
+    std::map<uint64_t, Entry>::iterator erase(std::map<uint64_t, Entry>::iterator it);
+
+    const uint64_t budget_;
+    std::map<uint64_t, Entry> entries_;  // by start offset; extents don't overlap
+    uint64_t hand_ = 0;                  // CLOCK hand: next start offset swept
+    std::unordered_set<uint64_t> doorkeeper_;
+    CacheStats stats_;
+    mutable std::mutex mutex_;
+};
+
+#endif // CLUSTER_CACHE_H
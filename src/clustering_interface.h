@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <memory>
 #include <unordered_map>
@@ -10,6 +11,7 @@
 
 // Forward declaration
 class Logger;
+class ThreadPool;
 
 // Vector type definition
 using Vector = std::vector<float>;
@@ -18,9 +20,9 @@ using Vector = std::vector<float>;
 struct ClusterInfo {
     uint32_t cluster_id;
     Vector centroid;
-    uint64_t start_offset;  // Byte offset on device where this cluster begins
+    uint64_t start_offset;  // Byte offset on device of the cluster's current extent
     uint32_t vector_count;
-    uint32_t capacity;      // Maximum vectors this cluster can hold
+    uint32_t capacity;      // Vector slots in that extent, 0 if none reserved yet
     
     // Serialization helpers
     std::vector<uint8_t> serialize() const;
@@ -32,12 +34,41 @@ struct VectorEntry {
     uint32_t vector_id;
     uint32_t cluster_id;
     uint64_t offset;       // Byte offset on device where this vector is stored
-    
+    float norm = 0.0f;     // L2 norm of the stored vector, 0 if not known
+    // The store's quantized index holds a code for this vector. A new entry
+    // (insert or overwrite) starts without one until maintenance encodes it.
+    bool quantized = false;
+    // crc32 of the vector as written, which the store's log records cover
+    // (version 3 stores); 0 where unused
+    uint32_t data_crc = 0;
+
     // Metadata can be extended as needed
     std::string metadata;  // JSON string for flexible metadata
 };
 
-// Abstract base class for clustering strategies
+// Visits one stored vector: its id, vector_dim floats of data, and the
+// ThreadPool slot of the thread making the call
+using VectorVisitor = std::function<void(uint32_t vector_id, const float* data, size_t slot)>;
+
+// Calls the visitor once for every stored vector, possibly from several
+// threads of the strategy's pool at once. Returns false if reading failed.
+using VectorSource = std::function<bool(const VectorVisitor& visit)>;
+
+// Controls for ClusteringStrategy::train
+struct TrainingOptions {
+    // Sample vectors drawn for each mini-batch iteration
+    uint32_t batch_size = 1024;
+    uint32_t max_iterations = 200;
+    // Converged once an iteration moves the centroids by less than this
+    // (mean squared shift relative to the sample's mean squared norm)
+    float tolerance = 1e-4f;
+};
+
+// Abstract base class for clustering strategies.
+//
+// The const methods only read the model. VectorClusterStore calls them from
+// concurrent searches under a shared lock, so implementations must keep them
+// free of side effects (no lazily filled caches, no map operator[]).
 class ClusteringStrategy {
 public:
     virtual ~ClusteringStrategy() = default;
@@ -51,25 +82,71 @@ public:
     // Add vector to the strategy's model (for strategies that learn over time)
     virtual bool addVector(const Vector& vector, uint32_t vector_id) = 0;
     
-    // Remove vector from the strategy's model
-    virtual bool removeVector(uint32_t vector_id) = 0;
+    // Remove vector from the strategy's model. vector is the removed data
+    // when the caller has it; a strategy that keeps no copy of its vectors
+    // needs it to take the vector out of the centroid exactly.
+    virtual bool removeVector(uint32_t vector_id, const float* vector = nullptr) = 0;
     
     // Find N closest clusters to the query vector
     virtual std::vector<uint32_t> findClosestClusters(
-        const Vector& query, uint32_t n) = 0;
+        const Vector& query, uint32_t n) const = 0;
+    
+    // findClosestClusters for count queries (row-major, vector_dim floats
+    // each), ranking the centroids for all of them in one pass
+    virtual std::vector<std::vector<uint32_t>> findClosestClustersBatch(
+        const float* queries, size_t count, uint32_t n) const = 0;
+    
+    // Move vectors the model holds into cluster_id, e.g. when the store
+    // splits or merges clusters. vectors holds their data (vector_ids.size()
+    // rows of vector_dim floats), or is nullptr for a strategy that keeps
+    // its own copies. A cluster the moves leave without members is retired:
+    // placement skips it until vectors are moved into it again.
+    virtual bool moveVectors(const std::vector<uint32_t>& vector_ids, uint32_t cluster_id,
+                             const float* vectors) = 0;
+    
+    // Clusters without members, which a split can take over. None while
+    // the model still seeds new clusters from incoming vectors.
+    virtual std::vector<uint32_t> getEmptyClusters() const = 0;
     
     // Get centroid of a specific cluster
-    virtual Vector getClusterCentroid(uint32_t cluster_id) = 0;
+    virtual Vector getClusterCentroid(uint32_t cluster_id) const = 0;
     
     // Get count of vectors in a cluster
-    virtual uint32_t getClusterSize(uint32_t cluster_id) = 0;
+    virtual uint32_t getClusterSize(uint32_t cluster_id) const = 0;
+    
+    // Cluster the model placed a vector in, or UINT32_MAX if unknown. This
+    // can differ from assignToCluster() for the vector passed to addVector
+    // (e.g. when it seeds a new cluster), so callers that need to agree
+    // with the model ask after adding.
+    virtual uint32_t getVectorCluster(uint32_t vector_id) const = 0;
+    
+    // Record the on-device extent the storage layer reserved for a cluster
+    // (ClusterInfo::start_offset/capacity), so it persists with the model
+    virtual bool setClusterExtent(uint32_t cluster_id, uint64_t start_offset,
+                                  uint32_t capacity) = 0;
     
     // Get all clusters
-    virtual std::vector<ClusterInfo> getAllClusters() = 0;
+    virtual std::vector<ClusterInfo> getAllClusters() const = 0;
     
     // Rebalance/update clusters if needed
     virtual bool rebalance() = 0;
     
+    // Learn the centroids from a sample (count rows of vector_dim floats):
+    // k-means++ seeding, then mini-batch iterations until they settle.
+    // Vectors already in the model keep their clusters, and their clusters
+    // the trained centroids, until the next rebalance().
+    virtual bool train(const float* sample, size_t count, const TrainingOptions& options) = 0;
+    
+    // Worker pool to spread heavy passes (e.g. rebalance) over; owned by
+    // the caller, which keeps it alive while the strategy uses it. nullptr
+    // (the default) runs them on the calling thread.
+    virtual void setThreadPool(ThreadPool* pool) = 0;
+    
+    // Where rebalance() reads vectors from. With a source the strategy
+    // keeps no copy of the vectors it is given (streaming mode); without
+    // one it has to keep them. The caller keeps the source valid.
+    virtual void setVectorSource(VectorSource source) = 0;
+    
     // Serialize the clustering model to a byte array
     virtual std::vector<uint8_t> serialize() = 0;
     
@@ -0,0 +1,470 @@
+#include "distance.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VCS_DISTANCE_X86 1
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VCS_DISTANCE_NEON 1
+#endif
+
+namespace {
+
+// ---------------------------------------------------------------------------
+// Scalar fallback. Four independent accumulators so the compiler can keep
+// several multiply-adds in flight even without vectorizing the reduction.
+// ---------------------------------------------------------------------------
+
+float dotScalar(const float* a, const float* b, size_t dim) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= dim; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < dim; i++) {
+        s0 += a[i] * b[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+float l2SquaredScalar(const float* a, const float* b, size_t dim) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= dim; i += 4) {
+        float d0 = a[i] - b[i];
+        float d1 = a[i + 1] - b[i + 1];
+        float d2 = a[i + 2] - b[i + 2];
+        float d3 = a[i + 3] - b[i + 3];
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+        s2 += d2 * d2;
+        s3 += d3 * d3;
+    }
+    for (; i < dim; i++) {
+        float d = a[i] - b[i];
+        s0 += d * d;
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+void dotNormsScalar(const float* a, const float* b, size_t dim,
+                    float& dot, float& norm_a_sq, float& norm_b_sq) {
+    float d = 0.0f, na = 0.0f, nb = 0.0f;
+    for (size_t i = 0; i < dim; i++) {
+        d += a[i] * b[i];
+        na += a[i] * a[i];
+        nb += b[i] * b[i];
+    }
+    dot = d;
+    norm_a_sq = na;
+    norm_b_sq = nb;
+}
+
+float dotU8Scalar(const float* a, const uint8_t* codes, size_t dim) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= dim; i += 4) {
+        s0 += a[i] * codes[i];
+        s1 += a[i + 1] * codes[i + 1];
+        s2 += a[i + 2] * codes[i + 2];
+        s3 += a[i + 3] * codes[i + 3];
+    }
+    for (; i < dim; i++) {
+        s0 += a[i] * codes[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+#ifdef VCS_DISTANCE_X86
+
+// ---------------------------------------------------------------------------
+// AVX2 + FMA: 8 floats per register, two accumulators per reduction
+// ---------------------------------------------------------------------------
+
+__attribute__((target("avx2,fma")))
+inline float horizontalSum256(__m256 v) {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    __m128 shuf = _mm_movehdup_ps(lo);
+    __m128 sums = _mm_add_ps(lo, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+__attribute__((target("avx2,fma")))
+float dotAvx2(const float* a, const float* b, size_t dim) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= dim; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= dim; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    float sum = horizontalSum256(_mm256_add_ps(acc0, acc1));
+    for (; i < dim; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+float l2SquaredAvx2(const float* a, const float* b, size_t dim) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= dim; i += 16) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+    }
+    for (; i + 8 <= dim; i += 8) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+    }
+    float sum = horizontalSum256(_mm256_add_ps(acc0, acc1));
+    for (; i < dim; i++) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+float dotU8Avx2(const float* a, const uint8_t* codes, size_t dim) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= dim; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i));
+        __m256 c0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+        __m256 c1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), c0, acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), c1, acc1);
+    }
+    float sum = horizontalSum256(_mm256_add_ps(acc0, acc1));
+    for (; i < dim; i++) {
+        sum += a[i] * codes[i];
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+void dotNormsAvx2(const float* a, const float* b, size_t dim,
+                  float& dot, float& norm_a_sq, float& norm_b_sq) {
+    __m256 acc_dot = _mm256_setzero_ps();
+    __m256 acc_a = _mm256_setzero_ps();
+    __m256 acc_b = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= dim; i += 8) {
+        __m256 va = _mm256_loadu_ps(a + i);
+        __m256 vb = _mm256_loadu_ps(b + i);
+        acc_dot = _mm256_fmadd_ps(va, vb, acc_dot);
+        acc_a = _mm256_fmadd_ps(va, va, acc_a);
+        acc_b = _mm256_fmadd_ps(vb, vb, acc_b);
+    }
+    float d = horizontalSum256(acc_dot);
+    float na = horizontalSum256(acc_a);
+    float nb = horizontalSum256(acc_b);
+    for (; i < dim; i++) {
+        d += a[i] * b[i];
+        na += a[i] * a[i];
+        nb += b[i] * b[i];
+    }
+    dot = d;
+    norm_a_sq = na;
+    norm_b_sq = nb;
+}
+
+// ---------------------------------------------------------------------------
+// AVX-512: 16 floats per register; the tail is handled with a masked load
+// instead of a scalar loop
+// ---------------------------------------------------------------------------
+
+// GCC 12's AVX-512 headers self-initialize "undefined" registers, which
+// -Wuninitialized (and -Wmaybe-uninitialized, for the widening converts)
+// flags inside the intrinsics. The warning is in the header, not here.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+__attribute__((target("avx512f")))
+float dotAvx512(const float* a, const float* b, size_t dim) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= dim; i += 32) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+    }
+    for (; i + 16 <= dim; i += 16) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    }
+    if (i < dim) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (dim - i)) - 1);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                               _mm512_maskz_loadu_ps(mask, b + i), acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+float l2SquaredAvx512(const float* a, const float* b, size_t dim) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= dim; i += 32) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+    }
+    for (; i + 16 <= dim; i += 16) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+    }
+    if (i < dim) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (dim - i)) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                                 _mm512_maskz_loadu_ps(mask, b + i));
+        acc1 = _mm512_fmadd_ps(d, d, acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+float dotU8Avx512(const float* a, const uint8_t* codes, size_t dim) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= dim; i += 32) {
+        __m512 c0 = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i))));
+        __m512 c1 = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i + 16))));
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), c0, acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), c1, acc1);
+    }
+    for (; i + 16 <= dim; i += 16) {
+        __m512 c0 = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i))));
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), c0, acc0);
+    }
+    // Byte-granular masked loads need AVX-512BW, so the tail is scalar
+    float sum = _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+    for (; i < dim; i++) {
+        sum += a[i] * codes[i];
+    }
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+void dotNormsAvx512(const float* a, const float* b, size_t dim,
+                    float& dot, float& norm_a_sq, float& norm_b_sq) {
+    __m512 acc_dot = _mm512_setzero_ps();
+    __m512 acc_a = _mm512_setzero_ps();
+    __m512 acc_b = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= dim; i += 16) {
+        __m512 va = _mm512_loadu_ps(a + i);
+        __m512 vb = _mm512_loadu_ps(b + i);
+        acc_dot = _mm512_fmadd_ps(va, vb, acc_dot);
+        acc_a = _mm512_fmadd_ps(va, va, acc_a);
+        acc_b = _mm512_fmadd_ps(vb, vb, acc_b);
+    }
+    if (i < dim) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (dim - i)) - 1);
+        __m512 va = _mm512_maskz_loadu_ps(mask, a + i);
+        __m512 vb = _mm512_maskz_loadu_ps(mask, b + i);
+        acc_dot = _mm512_fmadd_ps(va, vb, acc_dot);
+        acc_a = _mm512_fmadd_ps(va, va, acc_a);
+        acc_b = _mm512_fmadd_ps(vb, vb, acc_b);
+    }
+    dot = _mm512_reduce_add_ps(acc_dot);
+    norm_a_sq = _mm512_reduce_add_ps(acc_a);
+    norm_b_sq = _mm512_reduce_add_ps(acc_b);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // VCS_DISTANCE_X86
+
+#ifdef VCS_DISTANCE_NEON
+
+// ---------------------------------------------------------------------------
+// NEON (AArch64): 4 floats per register, two accumulators per reduction
+// ---------------------------------------------------------------------------
+
+float dotNeon(const float* a, const float* b, size_t dim) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= dim; i += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < dim; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+float l2SquaredNeon(const float* a, const float* b, size_t dim) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= dim; i += 8) {
+        float32x4_t d0 = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        float32x4_t d1 = vsubq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        acc0 = vfmaq_f32(acc0, d0, d0);
+        acc1 = vfmaq_f32(acc1, d1, d1);
+    }
+    float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < dim; i++) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+float dotU8Neon(const float* a, const uint8_t* codes, size_t dim) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= dim; i += 8) {
+        uint16x8_t wide = vmovl_u8(vld1_u8(codes + i));
+        float32x4_t c0 = vcvtq_f32_u32(vmovl_u16(vget_low_u16(wide)));
+        float32x4_t c1 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(wide)));
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), c0);
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), c1);
+    }
+    float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < dim; i++) {
+        sum += a[i] * codes[i];
+    }
+    return sum;
+}
+
+void dotNormsNeon(const float* a, const float* b, size_t dim,
+                  float& dot, float& norm_a_sq, float& norm_b_sq) {
+    float32x4_t acc_dot = vdupq_n_f32(0.0f);
+    float32x4_t acc_a = vdupq_n_f32(0.0f);
+    float32x4_t acc_b = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 4 <= dim; i += 4) {
+        float32x4_t va = vld1q_f32(a + i);
+        float32x4_t vb = vld1q_f32(b + i);
+        acc_dot = vfmaq_f32(acc_dot, va, vb);
+        acc_a = vfmaq_f32(acc_a, va, va);
+        acc_b = vfmaq_f32(acc_b, vb, vb);
+    }
+    float d = vaddvq_f32(acc_dot);
+    float na = vaddvq_f32(acc_a);
+    float nb = vaddvq_f32(acc_b);
+    for (; i < dim; i++) {
+        d += a[i] * b[i];
+        na += a[i] * a[i];
+        nb += b[i] * b[i];
+    }
+    dot = d;
+    norm_a_sq = na;
+    norm_b_sq = nb;
+}
+
+#endif // VCS_DISTANCE_NEON
+
+// ---------------------------------------------------------------------------
+// Runtime dispatch
+// ---------------------------------------------------------------------------
+
+struct DistanceKernels {
+    float (*dot)(const float*, const float*, size_t);
+    float (*l2_squared)(const float*, const float*, size_t);
+    void (*dot_norms)(const float*, const float*, size_t, float&, float&, float&);
+    float (*dot_u8)(const float*, const uint8_t*, size_t);
+    const char* name;
+};
+
+DistanceKernels selectKernels() {
+    DistanceKernels kernels = {dotScalar, l2SquaredScalar, dotNormsScalar, dotU8Scalar, "scalar"};
+
+    const char* forced = std::getenv("VCS_DISTANCE_KERNEL");
+    if (forced != nullptr && strcmp(forced, "scalar") == 0) {
+        return kernels;
+    }
+
+#ifdef VCS_DISTANCE_X86
+    __builtin_cpu_init();
+    bool allow_avx512 = (forced == nullptr || strcmp(forced, "avx512") == 0);
+    if (allow_avx512 && __builtin_cpu_supports("avx512f")) {
+        return {dotAvx512, l2SquaredAvx512, dotNormsAvx512, dotU8Avx512, "avx512"};
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return {dotAvx2, l2SquaredAvx2, dotNormsAvx2, dotU8Avx2, "avx2"};
+    }
+#endif
+
+#ifdef VCS_DISTANCE_NEON
+    // NEON is part of the AArch64 baseline, no runtime check needed
+    return {dotNeon, l2SquaredNeon, dotNormsNeon, dotU8Neon, "neon"};
+#endif
+
+    return kernels;
+}
+
+const DistanceKernels& kernels() {
+    static const DistanceKernels selected = selectKernels();
+    return selected;
+}
+
+} // namespace
+
+float dotProduct(const float* a, const float* b, size_t dim) {
+    return kernels().dot(a, b, dim);
+}
+
+float l2DistanceSquared(const float* a, const float* b, size_t dim) {
+    return kernels().l2_squared(a, b, dim);
+}
+
+void dotProductAndNorms(const float* a, const float* b, size_t dim,
+                        float& dot, float& norm_a_sq, float& norm_b_sq) {
+    kernels().dot_norms(a, b, dim, dot, norm_a_sq, norm_b_sq);
+}
+
+float dotProductU8(const float* a, const uint8_t* codes, size_t dim) {
+    return kernels().dot_u8(a, codes, dim);
+}
+
+float cosineSimilarity(const float* a, const float* b, size_t dim) {
+    float dot, norm_a_sq, norm_b_sq;
+    kernels().dot_norms(a, b, dim, dot, norm_a_sq, norm_b_sq);
+
+    if (norm_a_sq == 0.0f || norm_b_sq == 0.0f) {
+        return 0.0f;
+    }
+
+    return dot / (std::sqrt(norm_a_sq) * std::sqrt(norm_b_sq));
+}
+
+const char* distanceKernelName() {
+    return kernels().name;
+}
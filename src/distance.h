@@ -0,0 +1,38 @@
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Distance kernels shared by the store, the clustering strategies and the
+// tools. Each function has scalar, AVX2, AVX-512 and NEON implementations;
+// the fastest one the CPU supports is picked once, on first use.
+//
+// All functions take raw float arrays of length dim so callers can score
+// vectors in place (e.g. straight out of an I/O buffer) without copying
+// them into a Vector first.
+
+// Sum of a[i] * b[i]
+float dotProduct(const float* a, const float* b, size_t dim);
+
+// Sum of (a[i] - b[i])^2. Take the square root for the Euclidean distance;
+// for ranking, the squared distance orders the same and is cheaper.
+float l2DistanceSquared(const float* a, const float* b, size_t dim);
+
+// Fused pass computing dot(a, b), |a|^2 and |b|^2 together
+void dotProductAndNorms(const float* a, const float* b, size_t dim,
+                        float& dot, float& norm_a_sq, float& norm_b_sq);
+
+// Sum of a[i] * codes[i], with the byte codes widened to float. Scores
+// scalar-quantized (SQ8) vectors without decoding them.
+float dotProductU8(const float* a, const uint8_t* codes, size_t dim);
+
+// dot(a, b) / (|a| * |b|), or 0 if either vector is all zeros
+float cosineSimilarity(const float* a, const float* b, size_t dim);
+
+// Name of the selected implementation: "avx512", "avx2", "neon" or "scalar".
+// VCS_DISTANCE_KERNEL=scalar (or =avx2) in the environment caps the choice,
+// which is useful for benchmarking and for checking results.
+const char* distanceKernelName();
+
+#endif // DISTANCE_H
@@ -1,3 +1,6 @@
+#include "distance.h"
+#include "logger.h"
+#include "vector_cluster_store.h"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -6,11 +9,17 @@
 #include <json/json.h>
 #include <cmath>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 // Configuration constants
 const std::string OLLAMA_API_URL = "http://127.0.0.1:11434/api/embed";
 const std::string EMBEDDING_MODEL = "nomic-embed-text";
 const int VECTOR_DIM = 768;
+const long REQUEST_TIMEOUT_SECONDS = 120;  // per request of up to batch_size texts
 
 // Structure to hold response data from curl
 struct HttpResponse {
@@ -24,91 +33,343 @@ static size_t WriteCallback(void* contents, size_t size, size_t nmemb, HttpRespo
     return totalSize;
 }
 
-// Get embedding from Ollama API
-std::vector<float> getEmbedding(const std::string& text) {
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        std::cerr << "Error: Failed to initialize curl" << std::endl;
-        return {};
-    }
-    
-    // Prepare JSON payload
-    Json::Value payload;
-    payload["model"] = EMBEDDING_MODEL;
-    payload["input"] = text;
-    
-    Json::StreamWriterBuilder builder;
-    std::string jsonPayload = Json::writeString(builder, payload);
-    
-    // Set up HTTP headers
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
+// Parse an /api/embed response holding `expected` embeddings
+static bool parseEmbeddings(const std::string& body, size_t expected, std::vector<std::vector<float>>& embeddings) {
+    Json::CharReaderBuilder readerBuilder;
+    Json::Value responseJson;
+    std::string errors;
     
-    HttpResponse response;
+    std::istringstream responseStream(body);
+    if (!Json::parseFromStream(readerBuilder, responseStream, &responseJson, &errors)) {
+        std::cerr << "Error: Failed to parse JSON response: " << errors << std::endl;
+        return false;
+    }
     
-    // Configure curl
-    curl_easy_setopt(curl, CURLOPT_URL, OLLAMA_API_URL.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonPayload.c_str());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L); // 30 second timeout
+    if (!responseJson.isMember("embeddings") || !responseJson["embeddings"].isArray() ||
+        responseJson["embeddings"].size() != expected) {
+        std::cerr << "Error: Invalid response format - expected " << expected << " embeddings" << std::endl;
+        return false;
+    }
     
-    // Perform the request
-    CURLcode res = curl_easy_perform(curl);
+    embeddings.clear();
+    embeddings.reserve(expected);
+    for (const auto& embedding : responseJson["embeddings"]) {
+        if (!embedding.isArray()) {
+            std::cerr << "Error: Embedding is not an array" << std::endl;
+            return false;
+        }
+        std::vector<float> result;
+        result.reserve(embedding.size());
+        for (const auto& value : embedding) {
+            if (!value.isNumeric()) {
+                std::cerr << "Error: Non-numeric value in embedding" << std::endl;
+                return false;
+            }
+            result.push_back(value.asFloat());
+        }
+        embeddings.push_back(std::move(result));
+    }
     
-    // Clean up
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    // Verify dimension
+    if (!embeddings.empty() && embeddings[0].size() != VECTOR_DIM) {
+        static bool warned = false;
+        if (!warned) {
+            std::cerr << "Warning: Embedding dimension mismatch. Expected " << VECTOR_DIM
+                      << ", got " << embeddings[0].size() << std::endl;
+            warned = true;
+        }
+    }
+    return true;
+}
+
+// Ollama client that keeps several /api/embed requests in flight on one
+// curl multi handle. Each request embeds a batch of texts (Ollama's
+// `input` array), and every request slot keeps its easy handle, so the
+// connections stay open from one batch to the next.
+class EmbeddingClient {
+public:
+    // Called on the embedding thread as each batch arrives, in completion
+    // order: embeddings[i] is texts[first + i]. Return false to stop.
+    using BatchCallback = std::function<bool(size_t first, std::vector<std::vector<float>>& embeddings)>;
+    
+    EmbeddingClient(const std::string& url, const std::string& model, size_t concurrency)
+        : url_(url), model_(model), multi_(curl_multi_init()), slots_(std::max<size_t>(1, concurrency)) {
+        headers_ = curl_slist_append(nullptr, "Content-Type: application/json");
+        if (multi_) {
+            curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(slots_.size()));
+        }
+        for (Request& request : slots_) {
+            request.easy = curl_easy_init();
+        }
+    }
     
-    if (res != CURLE_OK) {
-        std::cerr << "Error: HTTP request failed: " << curl_easy_strerror(res) << std::endl;
-        return {};
+    ~EmbeddingClient() {
+        for (Request& request : slots_) {
+            if (request.easy) {
+                if (request.active) {
+                    curl_multi_remove_handle(multi_, request.easy);
+                }
+                curl_easy_cleanup(request.easy);
+            }
+        }
+        if (multi_) {
+            curl_multi_cleanup(multi_);
+        }
+        curl_slist_free_all(headers_);
     }
     
-    // Parse JSON response
-    Json::CharReaderBuilder readerBuilder;
-    Json::Value responseJson;
-    std::string errors;
+    EmbeddingClient(const EmbeddingClient&) = delete;
+    EmbeddingClient& operator=(const EmbeddingClient&) = delete;
     
-    std::istringstream responseStream(response.data);
-    if (!Json::parseFromStream(readerBuilder, responseStream, &responseJson, &errors)) {
-        std::cerr << "Error: Failed to parse JSON response: " << errors << std::endl;
-        return {};
+    // Embed texts, batch_size to a request. Returns false if a request
+    // fails or on_batch stops it; batches delivered before then stand.
+    bool embed(const std::vector<std::string>& texts, size_t batch_size, const BatchCallback& on_batch) {
+        if (!multi_) {
+            std::cerr << "Error: Failed to initialize curl" << std::endl;
+            return false;
+        }
+        for (const Request& request : slots_) {
+            if (!request.easy) {
+                std::cerr << "Error: Failed to initialize curl" << std::endl;
+                return false;
+            }
+        }
+        batch_size = std::max<size_t>(1, batch_size);
+        
+        size_t next = 0;       // first text not yet sent
+        size_t in_flight = 0;
+        bool ok = true;
+        while (ok && (next < texts.size() || in_flight > 0)) {
+            for (Request& request : slots_) {
+                if (next >= texts.size()) {
+                    break;
+                }
+                if (!request.active) {
+                    const size_t count = std::min(batch_size, texts.size() - next);
+                    if (!start(request, texts, next, count)) {
+                        ok = false;
+                        break;
+                    }
+                    next += count;
+                    in_flight++;
+                }
+            }
+            
+            int running = 0;
+            if (curl_multi_perform(multi_, &running) != CURLM_OK) {
+                std::cerr << "Error: curl multi transfer failed" << std::endl;
+                ok = false;
+            }
+            
+            int queued = 0;
+            while (CURLMsg* message = curl_multi_info_read(multi_, &queued)) {
+                if (message->msg != CURLMSG_DONE) {
+                    continue;
+                }
+                Request* request = nullptr;
+                curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, reinterpret_cast<char**>(&request));
+                curl_multi_remove_handle(multi_, request->easy);
+                request->active = false;
+                in_flight--;
+                if (ok) {
+                    ok = finish(*request, message->data.result, on_batch);
+                }
+            }
+            
+            if (ok && in_flight > 0) {
+                curl_multi_poll(multi_, nullptr, 0, 1000, nullptr);
+            }
+        }
+        return ok;
     }
     
-    // Extract embedding from response
-    if (!responseJson.isMember("embeddings") || !responseJson["embeddings"].isArray() || 
-        responseJson["embeddings"].empty()) {
-        std::cerr << "Error: Invalid response format - missing embeddings" << std::endl;
-        return {};
+private:
+    struct Request {
+        CURL* easy = nullptr;
+        bool active = false;
+        size_t first = 0;
+        size_t count = 0;
+        std::string payload;
+        HttpResponse response;
+    };
+    
+    bool start(Request& request, const std::vector<std::string>& texts, size_t first, size_t count) {
+        Json::Value payload;
+        payload["model"] = model_;
+        Json::Value& input = payload["input"];
+        input = Json::Value(Json::arrayValue);
+        for (size_t i = first; i < first + count; i++) {
+            input.append(texts[i]);
+        }
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        request.payload = Json::writeString(builder, payload);
+        request.response.data.clear();
+        request.first = first;
+        request.count = count;
+        
+        // The handle keeps its connection between requests
+        CURL* curl = request.easy;
+        curl_easy_setopt(curl, CURLOPT_URL, url_.c_str());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request.payload.c_str());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(request.payload.size()));
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers_);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &request.response);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, REQUEST_TIMEOUT_SECONDS);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, &request);
+        if (curl_multi_add_handle(multi_, curl) != CURLM_OK) {
+            std::cerr << "Error: Failed to queue HTTP request" << std::endl;
+            return false;
+        }
+        request.active = true;
+        return true;
     }
     
-    const Json::Value& embedding = responseJson["embeddings"][0];
-    if (!embedding.isArray()) {
-        std::cerr << "Error: Embedding is not an array" << std::endl;
-        return {};
+    bool finish(Request& request, CURLcode result, const BatchCallback& on_batch) {
+        if (result != CURLE_OK) {
+            std::cerr << "Error: HTTP request failed: " << curl_easy_strerror(result) << std::endl;
+            return false;
+        }
+        long status = 0;
+        curl_easy_getinfo(request.easy, CURLINFO_RESPONSE_CODE, &status);
+        if (status != 200) {
+            std::cerr << "Error: Ollama returned HTTP " << status << ": " << request.response.data << std::endl;
+            return false;
+        }
+        std::vector<std::vector<float>> embeddings;
+        if (!parseEmbeddings(request.response.data, request.count, embeddings)) {
+            return false;
+        }
+        return on_batch(request.first, embeddings);
     }
     
-    std::vector<float> result;
-    result.reserve(embedding.size());
+    const std::string url_;
+    const std::string model_;
+    CURLM* multi_;
+    struct curl_slist* headers_;
+    std::vector<Request> slots_;
+};
+
+// Embedded batches waiting for the store. push() blocks while the queue
+// holds `capacity` of them, so embedding runs at most that far ahead of
+// the device writes.
+struct EmbeddedBatch {
+    size_t first = 0;
+    std::vector<std::vector<float>> embeddings;
+};
+
+class BatchQueue {
+public:
+    explicit BatchQueue(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+    
+    // False once the queue is closed
+    bool push(EmbeddedBatch batch) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [&] { return closed_ || batches_.size() < capacity_; });
+        if (closed_) {
+            return false;
+        }
+        batches_.push_back(std::move(batch));
+        not_empty_.notify_one();
+        return true;
+    }
     
-    for (const auto& value : embedding) {
-        if (value.isNumeric()) {
-            result.push_back(value.asFloat());
-        } else {
-            std::cerr << "Error: Non-numeric value in embedding" << std::endl;
-            return {};
+    // False once the queue is closed and drained
+    bool pop(EmbeddedBatch& batch) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [&] { return closed_ || !batches_.empty(); });
+        if (batches_.empty()) {
+            return false;
         }
+        batch = std::move(batches_.front());
+        batches_.pop_front();
+        not_full_.notify_one();
+        return true;
     }
     
-    // Verify dimension
-    if (result.size() != VECTOR_DIM) {
-        std::cerr << "Warning: Embedding dimension mismatch. Expected " << VECTOR_DIM 
-                  << ", got " << result.size() << std::endl;
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_full_.notify_all();
+        not_empty_.notify_all();
     }
     
-    return result;
+private:
+    const size_t capacity_;
+    std::deque<EmbeddedBatch> batches_;
+    bool closed_ = false;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+};
+
+struct IngestOptions {
+    std::string store_path;
+    uint32_t start_id = 0;
+    uint32_t clusters = 100;
+    size_t queue_batches = 8;
+};
+
+// Embed texts and store them as vectors start_id, start_id + 1, ... with
+// each text as its metadata. A store thread drains the queue into
+// storeVectors, so cluster assignment and device writes for one batch
+// overlap the requests for the next ones.
+static bool ingestTexts(EmbeddingClient& client, const std::vector<std::string>& texts, size_t batch_size,
+                        const IngestOptions& options, size_t& stored) {
+    Logger logger("fastcomp.log", LogLevel::WARNING, false);
+    VectorClusterStore store(logger);
+    BatchQueue queue(options.queue_batches);
+    bool store_ok = true;
+    stored = 0;
+    
+    std::thread writer([&] {
+        bool open = false;
+        EmbeddedBatch batch;
+        while (queue.pop(batch)) {
+            const uint32_t dim = static_cast<uint32_t>(batch.embeddings[0].size());
+            // The first batch to arrive gives the dimension for a new store
+            if (!open) {
+                if (!store.initialize(options.store_path, "kmeans", dim, options.clusters)) {
+                    std::cerr << "Error: Failed to open store " << options.store_path << std::endl;
+                    break;
+                }
+                open = true;
+            }
+            std::vector<uint32_t> ids;
+            std::vector<std::string> metadata;
+            std::vector<float> data;
+            data.reserve(batch.embeddings.size() * dim);
+            for (size_t i = 0; i < batch.embeddings.size(); i++) {
+                if (batch.embeddings[i].size() != store.getVectorDim()) {
+                    std::cerr << "Error: Embedding of text " << batch.first + i + 1 << " has dimension "
+                              << batch.embeddings[i].size() << ", store has " << store.getVectorDim() << std::endl;
+                    store_ok = false;
+                    break;
+                }
+                ids.push_back(options.start_id + static_cast<uint32_t>(batch.first + i));
+                metadata.push_back(texts[batch.first + i]);
+                data.insert(data.end(), batch.embeddings[i].begin(), batch.embeddings[i].end());
+            }
+            if (!store_ok || !store.storeVectors(ids, data.data(), metadata)) {
+                std::cerr << "Error: Failed to store texts " << batch.first + 1 << " to "
+                          << batch.first + batch.embeddings.size() << std::endl;
+                break;
+            }
+            stored += ids.size();
+        }
+        store_ok = store_ok && open && stored == texts.size();
+        // Stop the embedding side if we gave up early
+        queue.close();
+    });
+    
+    const bool embedded = client.embed(texts, batch_size, [&](size_t first, std::vector<std::vector<float>>& embeddings) {
+        return queue.push(EmbeddedBatch{first, std::move(embeddings)});
+    });
+    queue.close();
+    writer.join();
+    return embedded && store_ok;
 }
 
 // Calculate cosine distance between two vectors (1 - cosine similarity)
@@ -118,24 +379,14 @@ float calculateCosineDistance(const std::vector<float>& v1, const std::vector<fl
         return -1.0f;
     }
     
-    float dotProduct = 0.0f;
-    float norm1 = 0.0f;
-    float norm2 = 0.0f;
-    
-    for (size_t i = 0; i < v1.size(); ++i) {
-        dotProduct += v1[i] * v2[i];
-        norm1 += v1[i] * v1[i];
-        norm2 += v2[i] * v2[i];
-    }
-    
-    norm1 = std::sqrt(norm1);
-    norm2 = std::sqrt(norm2);
+    float dotProduct, norm1, norm2;
+    dotProductAndNorms(v1.data(), v2.data(), v1.size(), dotProduct, norm1, norm2);
     
     if (norm1 == 0.0f || norm2 == 0.0f) {
         return 1.0f; // Maximum distance for zero vectors
     }
     
-    float cosineSimilarity = dotProduct / (norm1 * norm2);
+    float cosineSimilarity = dotProduct / (std::sqrt(norm1) * std::sqrt(norm2));
     return 1.0f - cosineSimilarity; // Convert to distance
 }
 
@@ -146,13 +397,54 @@ float calculateEuclideanDistance(const std::vector<float>& v1, const std::vector
         return -1.0f;
     }
     
-    float sumSquares = 0.0f;
-    for (size_t i = 0; i < v1.size(); ++i) {
-        float diff = v1[i] - v2[i];
-        sumSquares += diff * diff;
+    return std::sqrt(l2DistanceSquared(v1.data(), v2.data(), v1.size()));
+}
+
+// Embed all texts, then print the distance of each from the first
+static int compareTexts(EmbeddingClient& client, const std::vector<std::string>& texts, size_t batch_size,
+                        const std::string& metric, std::chrono::high_resolution_clock::time_point start) {
+    std::vector<std::vector<float>> embeddings(texts.size());
+    const bool ok = client.embed(texts, batch_size, [&](size_t first, std::vector<std::vector<float>>& batch) {
+        for (size_t i = 0; i < batch.size(); i++) {
+            embeddings[first + i] = std::move(batch[i]);
+        }
+        return true;
+    });
+    if (!ok) {
+        std::cerr << "Error: Failed to get embeddings" << std::endl;
+        return 1;
+    }
+    
+    const std::vector<float>& basisVector = embeddings[0];
+    std::vector<float> distances;
+    
+    for (size_t i = 1; i < texts.size(); ++i) {
+        float distance;
+        if (metric == "cosine") {
+            distance = calculateCosineDistance(basisVector, embeddings[i]);
+        } else {
+            distance = calculateEuclideanDistance(basisVector, embeddings[i]);
+        }
+        
+        if (distance < 0) {
+            std::cerr << "Error: Failed to calculate distance" << std::endl;
+            return 1;
+        }
+        
+        distances.push_back(distance);
     }
     
-    return std::sqrt(sumSquares);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+    
+    // Output distances to stdout
+    for (float distance : distances) {
+        std::cout << distance << std::endl;
+    }
+    
+    // Output timing info to stderr (so it doesn't interfere with piped output)
+    std::cerr << "Processed " << texts.size() << " texts in " << duration.count() << "ms" << std::endl;
+    return 0;
 }
 
 // Print usage information
@@ -161,46 +453,101 @@ void printUsage(const char* programName) {
     std::cout << "Fast vector comparison tool for text embeddings" << std::endl;
     std::cout << std::endl;
     std::cout << "Options:" << std::endl;
-    std::cout << "  -h, --help     Show this help message" << std::endl;
-    std::cout << "  -m, --metric   Distance metric: cosine (default) or euclidean" << std::endl;
+    std::cout << "  -h, --help          Show this help message" << std::endl;
+    std::cout << "  -m, --metric        Distance metric: cosine (default) or euclidean" << std::endl;
+    std::cout << "  --model NAME        Embedding model (default: " << EMBEDDING_MODEL << ")" << std::endl;
+    std::cout << "  --url URL           Ollama embed endpoint (default: " << OLLAMA_API_URL << ")" << std::endl;
+    std::cout << "  -b, --batch-size N  Texts per embedding request (default: 32)" << std::endl;
+    std::cout << "  -j, --concurrency N Embedding requests in flight (default: 4)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Ingest (store embeddings instead of comparing them):" << std::endl;
+    std::cout << "  --store PATH        Store each text's embedding in this vector store" << std::endl;
+    std::cout << "  --start-id N        Vector id of the first text (default: 0)" << std::endl;
+    std::cout << "  --clusters N        Clusters for a new store (default: 100)" << std::endl;
+    std::cout << "  --queue N           Embedded batches buffered ahead of the store (default: 8)" << std::endl;
     std::cout << std::endl;
     std::cout << "Input format:" << std::endl;
     std::cout << "  Reads text from stdin, one line per text to compare" << std::endl;
     std::cout << "  First line is the basis vector (v0)" << std::endl;
     std::cout << "  Subsequent lines are compared against v0" << std::endl;
+    std::cout << "  With --store, every line is embedded and stored, with the line as metadata" << std::endl;
     std::cout << std::endl;
     std::cout << "Output:" << std::endl;
     std::cout << "  Prints distance values to stdout, one per line" << std::endl;
     std::cout << std::endl;
     std::cout << "Example:" << std::endl;
     std::cout << "  echo -e 'Michigan\\nDetroit\\nChicago\\nCalifornia' | " << programName << std::endl;
+    std::cout << "  " << programName << " --store ./vector_store.bin < documents.txt" << std::endl;
+}
+
+// Parse the value of a numeric option; false (with a message) if it isn't one
+static bool parseCount(const std::string& option, const char* text, unsigned long& value) {
+    try {
+        size_t used = 0;
+        value = std::stoul(text, &used);
+        if (used == std::string(text).size()) {
+            return true;
+        }
+    } catch (const std::exception&) {
+    }
+    std::cerr << "Error: " << option << " requires a number" << std::endl;
+    return false;
 }
 
 int main(int argc, char* argv[]) {
     // Parse command line arguments
     std::string metric = "cosine";
+    std::string model = EMBEDDING_MODEL;
+    std::string url = OLLAMA_API_URL;
+    unsigned long batch_size = 32;
+    unsigned long concurrency = 4;
+    IngestOptions ingest;
     
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "-h" || arg == "--help") {
             printUsage(argv[0]);
             return 0;
-        } else if (arg == "-m" || arg == "--metric") {
-            if (i + 1 < argc) {
-                metric = argv[++i];
-                if (metric != "cosine" && metric != "euclidean") {
-                    std::cerr << "Error: Invalid metric. Use 'cosine' or 'euclidean'" << std::endl;
-                    return 1;
-                }
-            } else {
-                std::cerr << "Error: --metric requires an argument" << std::endl;
-                return 1;
-            }
-        } else {
+        }
+        const bool takes_value = arg == "-m" || arg == "--metric" || arg == "--model" || arg == "--url" ||
+                                 arg == "-b" || arg == "--batch-size" || arg == "-j" || arg == "--concurrency" ||
+                                 arg == "--store" || arg == "--start-id" || arg == "--clusters" || arg == "--queue";
+        if (!takes_value) {
             std::cerr << "Error: Unknown option: " << arg << std::endl;
             printUsage(argv[0]);
             return 1;
         }
+        if (i + 1 >= argc) {
+            std::cerr << "Error: " << arg << " requires an argument" << std::endl;
+            return 1;
+        }
+        const char* value = argv[++i];
+        unsigned long number = 0;
+        if (arg == "-m" || arg == "--metric") {
+            metric = value;
+            if (metric != "cosine" && metric != "euclidean") {
+                std::cerr << "Error: Invalid metric. Use 'cosine' or 'euclidean'" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--model") {
+            model = value;
+        } else if (arg == "--url") {
+            url = value;
+        } else if (arg == "--store") {
+            ingest.store_path = value;
+        } else if (!parseCount(arg, value, number)) {
+            return 1;
+        } else if (arg == "-b" || arg == "--batch-size") {
+            batch_size = std::max(1ul, number);
+        } else if (arg == "-j" || arg == "--concurrency") {
+            concurrency = std::max(1ul, number);
+        } else if (arg == "--start-id") {
+            ingest.start_id = static_cast<uint32_t>(number);
+        } else if (arg == "--clusters") {
+            ingest.clusters = static_cast<uint32_t>(std::max(1ul, number));
+        } else if (arg == "--queue") {
+            ingest.queue_batches = std::max(1ul, number);
+        }
     }
     
     // Initialize curl globally
@@ -225,61 +572,31 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    if (texts.size() < 2) {
+    if (ingest.store_path.empty() && texts.size() < 2) {
         std::cerr << "Error: Need at least 2 texts to compare (basis + 1 comparison)" << std::endl;
         curl_global_cleanup();
         return 1;
     }
     
-    // Get embedding for basis vector (first text)
     auto start = std::chrono::high_resolution_clock::now();
-    std::vector<float> basisVector = getEmbedding(texts[0]);
-    
-    if (basisVector.empty()) {
-        std::cerr << "Error: Failed to get embedding for basis text" << std::endl;
-        curl_global_cleanup();
-        return 1;
-    }
-    
-    // Compare against each subsequent text
-    std::vector<float> distances;
-    
-    for (size_t i = 1; i < texts.size(); ++i) {
-        std::vector<float> compareVector = getEmbedding(texts[i]);
+    int status = 0;
+    {
+        // Scoped so the client's handles are freed before curl_global_cleanup
+        EmbeddingClient client(url, model, concurrency);
         
-        if (compareVector.empty()) {
-            std::cerr << "Error: Failed to get embedding for text " << i + 1 << std::endl;
-            curl_global_cleanup();
-            return 1;
-        }
-        
-        float distance;
-        if (metric == "cosine") {
-            distance = calculateCosineDistance(basisVector, compareVector);
+        if (!ingest.store_path.empty()) {
+            size_t stored = 0;
+            const bool ok = ingestTexts(client, texts, batch_size, ingest, stored);
+            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::high_resolution_clock::now() - start);
+            std::cerr << "Stored " << stored << " of " << texts.size() << " texts in " << duration.count()
+                      << "ms" << std::endl;
+            status = ok ? 0 : 1;
         } else {
-            distance = calculateEuclideanDistance(basisVector, compareVector);
-        }
-        
-        if (distance < 0) {
-            std::cerr << "Error: Failed to calculate distance" << std::endl;
-            curl_global_cleanup();
-            return 1;
+            status = compareTexts(client, texts, batch_size, metric, start);
         }
-        
-        distances.push_back(distance);
     }
     
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    
-    // Output distances to stdout
-    for (float distance : distances) {
-        std::cout << distance << std::endl;
-    }
-    
-    // Output timing info to stderr (so it doesn't interfere with piped output)
-    std::cerr << "Processed " << texts.size() << " texts in " << duration.count() << "ms" << std::endl;
-    
     curl_global_cleanup();
-    return 0;
-}
\ No newline at end of file
+    return status;
+}
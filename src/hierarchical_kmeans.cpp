@@ -0,0 +1,260 @@
+#include "hierarchical_kmeans.h"
+#include "distance.h"
+#include <algorithm>
+#include <set>
+#include <cmath>
+
+HierarchicalKMeansStrategy::HierarchicalKMeansStrategy(Logger& logger)
+    : KMeansClusteringStrategy(logger) {}
+
+bool HierarchicalKMeansStrategy::initialize(uint32_t vector_dim, uint32_t max_clusters) {
+    groups_.clear();
+    changes_since_build_ = 0;
+    return KMeansClusteringStrategy::initialize(vector_dim, max_clusters);
+}
+
+bool HierarchicalKMeansStrategy::addVector(const Vector& vector, uint32_t vector_id) {
+    const bool was_seeding = seeded_centroids_ < max_clusters_;
+    if (!KMeansClusteringStrategy::addVector(vector, vector_id)) {
+        return false;
+    }
+    // Until every cluster is seeded most centroids are still zero vectors,
+    // so the first grouping waits for the last seed
+    if (was_seeding) {
+        if (seeded_centroids_ >= max_clusters_) {
+            buildGroups();
+        }
+        return true;
+    }
+    noteChange();
+    return true;
+}
+
+bool HierarchicalKMeansStrategy::removeVector(uint32_t vector_id, const float* vector) {
+    if (!KMeansClusteringStrategy::removeVector(vector_id, vector)) {
+        return false;
+    }
+    noteChange();
+    return true;
+}
+
+bool HierarchicalKMeansStrategy::moveVectors(const std::vector<uint32_t>& vector_ids,
+                                             uint32_t cluster_id, const float* vectors) {
+    // A cluster that gains its first members, or loses its last, has a
+    // centroid its group no longer describes
+    auto empty = [this](uint32_t id) {
+        auto members = cluster_members_.find(id);
+        return members == cluster_members_.end() || members->second.empty();
+    };
+    std::set<uint32_t> sources;
+    for (uint32_t vector_id : vector_ids) {
+        auto it = vector_to_cluster_.find(vector_id);
+        if (it != vector_to_cluster_.end()) {
+            sources.insert(it->second);
+        }
+    }
+    const bool filled = empty(cluster_id);
+    
+    bool moved = KMeansClusteringStrategy::moveVectors(vector_ids, cluster_id, vectors);
+    bool emptied = std::any_of(sources.begin(), sources.end(), empty);
+    if (filled || emptied) {
+        buildGroups();
+    } else {
+        changes_since_build_ += vector_ids.size();
+        noteChange();
+    }
+    return moved;
+}
+
+bool HierarchicalKMeansStrategy::rebalance() {
+    bool changed = KMeansClusteringStrategy::rebalance();
+    buildGroups();
+    return changed;
+}
+
+bool HierarchicalKMeansStrategy::train(const float* sample, size_t count,
+                                       const TrainingOptions& options) {
+    if (!KMeansClusteringStrategy::train(sample, count, options)) {
+        return false;
+    }
+    buildGroups();
+    return true;
+}
+
+bool HierarchicalKMeansStrategy::deserialize(const std::vector<uint8_t>& data) {
+    groups_.clear();
+    if (!KMeansClusteringStrategy::deserialize(data)) {
+        return false;
+    }
+    buildGroups();
+    return true;
+}
+
+std::vector<uint32_t> HierarchicalKMeansStrategy::findClosestClusters(const Vector& query,
+                                                                      uint32_t n) const {
+    // Most of the clusters is cheaper to rank flat, and exact
+    if (groups_.empty() || query.size() != vector_dim_ ||
+        static_cast<size_t>(n) * 2 >= centroids_.size()) {
+        return KMeansClusteringStrategy::findClosestClusters(query, n);
+    }
+    std::vector<uint32_t> result;
+    for (const auto& [cluster_id, distance] : rankCoarse(query.data(), n, false)) {
+        result.push_back(cluster_id);
+    }
+    return result;
+}
+
+std::vector<std::vector<uint32_t>> HierarchicalKMeansStrategy::findClosestClustersBatch(
+    const float* queries, size_t count, uint32_t n) const {
+    if (groups_.empty() || static_cast<size_t>(n) * 2 >= centroids_.size()) {
+        return KMeansClusteringStrategy::findClosestClustersBatch(queries, count, n);
+    }
+    std::vector<std::vector<uint32_t>> result(count);
+    for (size_t q = 0; q < count; q++) {
+        for (const auto& [cluster_id, distance] : rankCoarse(queries + q * vector_dim_, n, false)) {
+            result[q].push_back(cluster_id);
+        }
+    }
+    return result;
+}
+
+uint32_t HierarchicalKMeansStrategy::findClosestCentroid(const float* vector) const {
+    if (!groups_.empty()) {
+        std::vector<std::pair<uint32_t, float>> closest = rankCoarse(vector, 1, true);
+        if (!closest.empty()) {
+            return closest.front().first;
+        }
+    }
+    return KMeansClusteringStrategy::findClosestCentroid(vector);
+}
+
+std::vector<std::pair<uint32_t, float>> HierarchicalKMeansStrategy::rankCoarse(
+    const float* query, uint32_t n, bool members_only) const {
+    std::vector<std::pair<uint32_t, float>> group_distances;
+    group_distances.reserve(groups_.size());
+    for (uint32_t g = 0; g < groups_.size(); g++) {
+        group_distances.push_back({g, l2DistanceSquared(query, groups_[g].centroid.data(), vector_dim_)});
+    }
+    std::sort(group_distances.begin(), group_distances.end(),
+              [](const auto& a, const auto& b) { return a.second < b.second; });
+
+    // Nearest groups first, until there are enough candidates to pick the
+    // n from. Squared distances rank the same as the flat ranking's.
+    const size_t wanted = static_cast<size_t>(n) * CANDIDATES_PER_RESULT;
+    std::vector<std::pair<uint32_t, float>> candidates;
+    uint32_t probed = 0;
+    for (const auto& [g, group_distance] : group_distances) {
+        if (probed >= MIN_GROUPS_PROBED && candidates.size() >= wanted) {
+            break;
+        }
+        for (uint32_t cluster_id : groups_[g].clusters) {
+            if (members_only && !isPlaceable(cluster_id)) {
+                continue;
+            }
+            auto centroid = centroids_.find(cluster_id);
+            if (centroid == centroids_.end()) {
+                continue;
+            }
+            candidates.push_back({cluster_id, l2DistanceSquared(query, centroid->second.data(), vector_dim_)});
+        }
+        probed++;
+    }
+
+    keepClosest(candidates, n);
+    return candidates;
+}
+
+void HierarchicalKMeansStrategy::buildGroups() {
+    groups_.clear();
+    changes_since_build_ = 0;
+    if (centroids_.size() < MIN_CLUSTERS) {
+        return;
+    }
+
+    // Sorted ids so the grouping doesn't depend on hash order
+    std::vector<uint32_t> ids;
+    ids.reserve(centroids_.size());
+    for (const auto& [cluster_id, centroid] : centroids_) {
+        ids.push_back(cluster_id);
+    }
+    std::sort(ids.begin(), ids.end());
+    std::vector<const float*> points;
+    points.reserve(ids.size());
+    for (uint32_t cluster_id : ids) {
+        points.push_back(centroids_.at(cluster_id).data());
+    }
+
+    // A small k-means over the centroids, seeded with evenly spaced ones
+    const size_t count = points.size();
+    const size_t group_count = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+    std::vector<Vector> group_centroids(group_count);
+    for (size_t g = 0; g < group_count; g++) {
+        const float* seed = points[g * count / group_count];
+        group_centroids[g].assign(seed, seed + vector_dim_);
+    }
+
+    std::vector<uint32_t> assignment(count, 0);
+    auto assign_all = [&]() {
+        forBlocks(count, GROUPING_BLOCK, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                float best = l2DistanceSquared(points[i], group_centroids[0].data(), vector_dim_);
+                uint32_t best_group = 0;
+                for (size_t g = 1; g < group_count; g++) {
+                    float distance = l2DistanceSquared(points[i], group_centroids[g].data(), vector_dim_);
+                    if (distance < best) {
+                        best = distance;
+                        best_group = static_cast<uint32_t>(g);
+                    }
+                }
+                assignment[i] = best_group;
+            }
+        });
+    };
+
+    for (uint32_t iteration = 0; iteration < COARSE_ITERATIONS; iteration++) {
+        assign_all();
+        // New means; a group left empty keeps its centroid
+        std::vector<std::vector<double>> sums(group_count, std::vector<double>(vector_dim_, 0.0));
+        std::vector<size_t> sizes(group_count, 0);
+        for (size_t i = 0; i < count; i++) {
+            std::vector<double>& sum = sums[assignment[i]];
+            for (size_t d = 0; d < vector_dim_; d++) {
+                sum[d] += points[i][d];
+            }
+            sizes[assignment[i]]++;
+        }
+        for (size_t g = 0; g < group_count; g++) {
+            if (sizes[g] == 0) {
+                continue;
+            }
+            for (size_t d = 0; d < vector_dim_; d++) {
+                group_centroids[g][d] = static_cast<float>(sums[g][d] / sizes[g]);
+            }
+        }
+    }
+    assign_all();
+
+    std::vector<CentroidGroup> groups(group_count);
+    for (size_t g = 0; g < group_count; g++) {
+        groups[g].centroid = std::move(group_centroids[g]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        groups[assignment[i]].clusters.push_back(ids[i]);
+    }
+    for (CentroidGroup& group : groups) {
+        if (!group.clusters.empty()) {
+            groups_.push_back(std::move(group));
+        }
+    }
+    logger_.debug("Grouped " + std::to_string(count) + " centroids into " +
+                  std::to_string(groups_.size()) + " groups");
+}
+
+void HierarchicalKMeansStrategy::noteChange() {
+    if (groups_.empty() && seeded_centroids_ < max_clusters_) {
+        return;
+    }
+    if (++changes_since_build_ >= centroids_.size() * REBUILD_CHANGES_PER_CLUSTER) {
+        buildGroups();
+    }
+}
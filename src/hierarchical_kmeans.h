@@ -0,0 +1,69 @@
+#ifndef HIERARCHICAL_KMEANS_H
+#define HIERARCHICAL_KMEANS_H
+
+#include "kmeans_clustering.h"
+#include <vector>
+
+// K-means with a second, coarse level over the centroids, for stores with
+// thousands of clusters. The centroids are themselves clustered into about
+// sqrt(clusters) groups; a query ranks the groups first and then only the
+// centroids of the nearest groups, so placing a vector or ranking a few
+// clusters costs O(sqrt(clusters)) distances instead of O(clusters).
+//
+// The clusters and their vectors are the same as KMeansClusteringStrategy's
+// and so is the serialized model; the coarse level is rebuilt from the
+// centroids after a load, a rebalance or training, when a split or merge
+// empties or fills a cluster, and once enough vectors have moved them.
+// Asking for most of the clusters ranks them all exactly.
+//
+// Registered as "hierarchical_kmeans" with createClusteringStrategy.
+class HierarchicalKMeansStrategy : public KMeansClusteringStrategy {
+public:
+    HierarchicalKMeansStrategy(Logger& logger);
+    ~HierarchicalKMeansStrategy() override = default;
+
+    bool initialize(uint32_t vector_dim, uint32_t max_clusters) override;
+    bool addVector(const Vector& vector, uint32_t vector_id) override;
+    bool removeVector(uint32_t vector_id, const float* vector = nullptr) override;
+    bool moveVectors(const std::vector<uint32_t>& vector_ids, uint32_t cluster_id,
+                     const float* vectors) override;
+    std::vector<uint32_t> findClosestClusters(const Vector& query, uint32_t n) const override;
+    std::vector<std::vector<uint32_t>> findClosestClustersBatch(const float* queries, size_t count,
+                                                                uint32_t n) const override;
+    bool rebalance() override;
+    bool train(const float* sample, size_t count, const TrainingOptions& options) override;
+    bool deserialize(const std::vector<uint8_t>& data) override;
+    std::string getName() const override { return "Hierarchical K-means"; }
+
+private:
+    // Below this many clusters a flat scan is as cheap; no coarse level
+    static constexpr size_t MIN_CLUSTERS = 256;
+    // Lloyd iterations when clustering the centroids
+    static constexpr uint32_t COARSE_ITERATIONS = 4;
+    // Centroids each grouping assignment task takes
+    static constexpr size_t GROUPING_BLOCK = 256;
+    // Groups always probed, and candidates gathered per cluster asked for
+    static constexpr uint32_t MIN_GROUPS_PROBED = 4;
+    static constexpr uint32_t CANDIDATES_PER_RESULT = 8;
+    // Rebuild once this many adds and removes per cluster have moved the
+    // centroids since the last build
+    static constexpr size_t REBUILD_CHANGES_PER_CLUSTER = 4;
+
+    struct CentroidGroup {
+        Vector centroid;
+        std::vector<uint32_t> clusters;
+    };
+    std::vector<CentroidGroup> groups_;  // empty: rank flat
+    size_t changes_since_build_ = 0;
+
+    uint32_t findClosestCentroid(const float* vector) const override;
+    // The n centroids nearest query among the nearest groups' clusters,
+    // optionally only placeable ones
+    std::vector<std::pair<uint32_t, float>> rankCoarse(const float* query, uint32_t n,
+                                                       bool members_only) const;
+    // Cluster the current centroids into groups_
+    void buildGroups();
+    void noteChange();
+};
+
+#endif // HIERARCHICAL_KMEANS_H
@@ -0,0 +1,223 @@
+#include "io_uring_engine.h"
+#include "logger.h"
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define VCS_HAVE_IO_URING 1
+#endif
+
+#ifdef VCS_HAVE_IO_URING
+
+namespace {
+
+int ioUringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                                    flags, nullptr, 0));
+}
+
+template <typename T>
+T* ringField(void* ring, uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+} // namespace
+
+#endif // VCS_HAVE_IO_URING
+
+IoUringEngine::IoUringEngine(Logger& logger)
+    : logger_(logger), ring_fd_(-1), sq_entries_(0), pending_(0),
+      sq_ring_(nullptr), sq_ring_size_(0), cq_ring_(nullptr), cq_ring_size_(0),
+      sqes_(nullptr), sqes_size_(0),
+      sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(nullptr), sq_array_(nullptr),
+      cq_head_(nullptr), cq_tail_(nullptr), cq_mask_(nullptr), cqes_(nullptr) {
+}
+
+IoUringEngine::~IoUringEngine() {
+    if (sqes_) {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_) {
+        munmap(sq_ring_, sq_ring_size_);
+    }
+    if (ring_fd_ >= 0) {
+        close(ring_fd_);
+    }
+}
+
+std::unique_ptr<IoUringEngine> IoUringEngine::create(uint32_t queue_depth, Logger& logger) {
+    std::unique_ptr<IoUringEngine> engine(new IoUringEngine(logger));
+    if (!engine->setup(queue_depth)) {
+        return nullptr;
+    }
+    return engine;
+}
+
+#ifdef VCS_HAVE_IO_URING
+
+bool IoUringEngine::setup(uint32_t queue_depth) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring_fd_ = ioUringSetup(queue_depth, &params);
+    if (ring_fd_ < 0) {
+        logger_.info("io_uring unavailable: " + std::string(strerror(errno)));
+        return false;
+    }
+    sq_entries_ = params.sq_entries;
+
+    // Map the submission and completion rings (one mapping on kernels
+    // that support it) and the SQE array
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        cq_ring_size_ = sq_ring_size_;
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        logger_.error("Failed to map io_uring submission ring: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    if (single_mmap) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            cq_ring_ = nullptr;
+            logger_.error("Failed to map io_uring completion ring: " + std::string(strerror(errno)));
+            return false;
+        }
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 ring_fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+        sqes_ = nullptr;
+        logger_.error("Failed to map io_uring submission entries: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    sq_head_ = ringField<unsigned>(sq_ring_, params.sq_off.head);
+    sq_tail_ = ringField<unsigned>(sq_ring_, params.sq_off.tail);
+    sq_mask_ = ringField<unsigned>(sq_ring_, params.sq_off.ring_mask);
+    sq_array_ = ringField<unsigned>(sq_ring_, params.sq_off.array);
+    cq_head_ = ringField<unsigned>(cq_ring_, params.cq_off.head);
+    cq_tail_ = ringField<unsigned>(cq_ring_, params.cq_off.tail);
+    cq_mask_ = ringField<unsigned>(cq_ring_, params.cq_off.ring_mask);
+    cqes_ = ringField<void>(cq_ring_, params.cq_off.cqes);
+
+    iovecs_.resize(sq_entries_);
+
+    logger_.info("io_uring engine ready, queue depth " + std::to_string(sq_entries_));
+    return true;
+}
+
+bool IoUringEngine::queueRead(int fd, void* buffer, size_t size, uint64_t offset, uint64_t tag) {
+    // We are the only producer, so our own tail needs no barrier; the
+    // kernel's head does
+    unsigned tail = *sq_tail_;
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (tail - head >= sq_entries_) {
+        return false;
+    }
+
+    unsigned index = tail & *sq_mask_;
+    iovecs_[index].iov_base = buffer;
+    iovecs_[index].iov_len = size;
+
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;  // READV rather than READ: works back to 5.1
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<uint64_t>(&iovecs_[index]);
+    sqe->len = 1;
+    sqe->user_data = tag;
+
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    pending_++;
+    return true;
+}
+
+bool IoUringEngine::submit() {
+    while (pending_ > 0) {
+        int submitted = ioUringEnter(ring_fd_, pending_, 0, 0);
+        if (submitted < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logger_.error("io_uring submit failed: " + std::string(strerror(errno)));
+            return false;
+        }
+        pending_ -= static_cast<uint32_t>(submitted);
+    }
+    return true;
+}
+
+bool IoUringEngine::waitCompletion(uint64_t& tag, int64_t& result) {
+    for (;;) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        if (head != tail) {
+            const io_uring_cqe* cqe = static_cast<const io_uring_cqe*>(cqes_) + (head & *cq_mask_);
+            tag = cqe->user_data;
+            result = cqe->res;
+            __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+
+        // Nothing completed yet: submit whatever is queued and wait
+        int submitted = ioUringEnter(ring_fd_, pending_, 1, IORING_ENTER_GETEVENTS);
+        if (submitted < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logger_.error("io_uring wait failed: " + std::string(strerror(errno)));
+            return false;
+        }
+        pending_ -= static_cast<uint32_t>(submitted);
+    }
+}
+
+#else // !VCS_HAVE_IO_URING
+
+bool IoUringEngine::setup(uint32_t) {
+    logger_.info("io_uring unavailable: not supported by this build");
+    return false;
+}
+
+bool IoUringEngine::queueRead(int, void*, size_t, uint64_t, uint64_t) {
+    return false;
+}
+
+bool IoUringEngine::submit() {
+    return false;
+}
+
+bool IoUringEngine::waitCompletion(uint64_t&, int64_t&) {
+    return false;
+}
+
+#endif // VCS_HAVE_IO_URING
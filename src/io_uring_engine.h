@@ -0,0 +1,72 @@
+#ifndef IO_URING_ENGINE_H
+#define IO_URING_ENGINE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <sys/uio.h>
+
+class Logger;
+
+// Minimal io_uring read engine, driven through the raw syscalls so there is
+// no liburing dependency. Reads are queued, submitted together and reaped
+// in completion order, which keeps many reads in flight on devices that
+// need queue depth to reach their IOPS.
+//
+// Not thread-safe: one caller drives the ring at a time.
+class IoUringEngine {
+public:
+    // Returns nullptr if the kernel (or a seccomp policy) doesn't allow
+    // io_uring; callers fall back to pread.
+    static std::unique_ptr<IoUringEngine> create(uint32_t queue_depth, Logger& logger);
+    ~IoUringEngine();
+
+    IoUringEngine(const IoUringEngine&) = delete;
+    IoUringEngine& operator=(const IoUringEngine&) = delete;
+
+    // Number of reads that can be queued before they are reaped
+    uint32_t queueDepth() const { return sq_entries_; }
+
+    // Queue a read of size bytes at offset into buffer. Nothing is issued
+    // until submit() or waitCompletion(). Returns false if the queue is full.
+    bool queueRead(int fd, void* buffer, size_t size, uint64_t offset, uint64_t tag);
+
+    // Hand every queued read to the kernel
+    bool submit();
+
+    // Block until a read completes. result is the byte count, or -errno.
+    bool waitCompletion(uint64_t& tag, int64_t& result);
+
+private:
+    IoUringEngine(Logger& logger);
+    bool setup(uint32_t queue_depth);
+
+    Logger& logger_;
+    int ring_fd_;
+    uint32_t sq_entries_;
+    uint32_t pending_;   // queued but not yet submitted
+
+    // Shared ring mappings
+    void* sq_ring_;
+    size_t sq_ring_size_;
+    void* cq_ring_;
+    size_t cq_ring_size_;
+    void* sqes_;
+    size_t sqes_size_;
+
+    // Pointers into the rings
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_mask_;
+    unsigned* sq_array_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned* cq_mask_;
+    void* cqes_;
+
+    // One iovec per submission slot; must live until the kernel consumes it
+    std::vector<iovec> iovecs_;
+};
+
+#endif // IO_URING_ENGINE_H
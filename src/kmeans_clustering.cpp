@@ -1,4 +1,7 @@
 #include "kmeans_clustering.h"
+#include "hierarchical_kmeans.h"
+#include "distance.h"
+#include "thread_pool.h"
 #include <cmath>
 #include <algorithm>
 #include <fstream>
@@ -29,7 +32,9 @@ bool KMeansClusteringStrategy::initialize(uint32_t vector_dim, uint32_t max_clus
     cluster_members_.clear();
     vector_to_cluster_.clear();
     vectors_.clear();
+    centroid_sums_.clear();
     cluster_info_.clear();
+    trained_centroids_.clear();
     seeded_centroids_ = 0;  // no real centroids yet — Forgy-seed on first adds
 
     // Will initialize centroids once we have some vectors
@@ -40,9 +45,9 @@ bool KMeansClusteringStrategy::initialize(uint32_t vector_dim, uint32_t max_clus
         ClusterInfo info;
         info.cluster_id = i;
         info.centroid.resize(vector_dim_, 0.0f);
-        info.start_offset = 0;  // Will be assigned by the storage layer
+        info.start_offset = 0;  // Extent is reserved by the storage layer
         info.vector_count = 0;
-        info.capacity = 1000;   // Default capacity, can be adjusted
+        info.capacity = 0;      // on the cluster's first vector
         
         cluster_info_[i] = info;
         cluster_members_[i] = std::set<uint32_t>();
@@ -59,12 +64,21 @@ uint32_t KMeansClusteringStrategy::assignToCluster(const Vector& vector) {
     }
     
     // Find closest centroid
-    return findClosestCentroid(vector);
+    return findClosestCentroid(vector.data());
 }
 
 bool KMeansClusteringStrategy::addVector(const Vector& vector, uint32_t vector_id) {
-    // Store vector
-    vectors_[vector_id] = vector;
+    if (vector.size() != vector_dim_) {
+        return false;  // never read past the end of a short vector
+    }
+    
+    // A vector added again replaces its earlier copy
+    if (vector_to_cluster_.find(vector_id) != vector_to_cluster_.end()) {
+        removeVector(vector_id);
+    }
+    if (!streaming_) {
+        vectors_[vector_id] = vector;
+    }
 
     uint32_t cluster_id;
     if (seeded_centroids_ < max_clusters_) {
@@ -81,7 +95,7 @@ bool KMeansClusteringStrategy::addVector(const Vector& vector, uint32_t vector_i
         seeded_centroids_++;
     } else {
         // All clusters seeded — assign to the nearest existing centroid.
-        cluster_id = findClosestCentroid(vector);
+        cluster_id = findClosestCentroid(vector.data());
     }
 
     // Update mappings
@@ -91,34 +105,52 @@ bool KMeansClusteringStrategy::addVector(const Vector& vector, uint32_t vector_i
     // Update cluster info
     cluster_info_[cluster_id].vector_count++;
 
-    // Update centroid (recompute mean of members)
+    // Fold the vector into the running mean
+    accumulate(centroid_sums_[cluster_id], vector.data(), 1.0);
     updateCentroid(cluster_id);
 
     return true;
 }
 
-bool KMeansClusteringStrategy::removeVector(uint32_t vector_id) {
-    if (vector_to_cluster_.find(vector_id) == vector_to_cluster_.end()) {
+bool KMeansClusteringStrategy::removeVector(uint32_t vector_id, const float* vector) {
+    auto it = vector_to_cluster_.find(vector_id);
+    if (it == vector_to_cluster_.end()) {
         return false;  // Vector not found
     }
     
-    uint32_t cluster_id = vector_to_cluster_[vector_id];
+    uint32_t cluster_id = it->second;
     
     // Remove from mappings
-    vector_to_cluster_.erase(vector_id);
+    vector_to_cluster_.erase(it);
     cluster_members_[cluster_id].erase(vector_id);
-    vectors_.erase(vector_id);
     
     // Update cluster info
     cluster_info_[cluster_id].vector_count--;
     
+    // Take the vector out of the running mean. Without its data (streaming
+    // mode, caller didn't pass it) the centroid keeps counting it until the
+    // next rebalance.
+    auto stored = vectors_.find(vector_id);
+    if (!vector && stored != vectors_.end()) {
+        vector = stored->second.data();
+    }
+    CentroidSum& sum = centroid_sums_[cluster_id];
+    if (cluster_members_[cluster_id].empty()) {
+        sum = CentroidSum();
+    } else if (vector && sum.count > 0) {
+        accumulate(sum, vector, -1.0);
+    }
+    if (stored != vectors_.end()) {
+        vectors_.erase(stored);
+    }
+    
     // Update centroid
     updateCentroid(cluster_id);
     
     return true;
 }
 
-std::vector<uint32_t> KMeansClusteringStrategy::findClosestClusters(const Vector& query, uint32_t n) {
+std::vector<uint32_t> KMeansClusteringStrategy::findClosestClusters(const Vector& query, uint32_t n) const {
     std::vector<std::pair<uint32_t, float>> distances;
     
     // Calculate distance to each centroid
@@ -127,68 +159,205 @@ std::vector<uint32_t> KMeansClusteringStrategy::findClosestClusters(const Vector
         distances.push_back({cluster_id, distance});
     }
     
-    // Sort by distance (closest first)
-    std::sort(distances.begin(), distances.end(), 
-              [](const auto& a, const auto& b) { return a.second < b.second; });
+    // Closest n first
+    keepClosest(distances, n);
     
-    // Take top n
     std::vector<uint32_t> result;
-    for (size_t i = 0; i < n && i < distances.size(); i++) {
-        result.push_back(distances[i].first);
+    result.reserve(distances.size());
+    for (const auto& [cluster_id, distance] : distances) {
+        result.push_back(cluster_id);
+    }
+    
+    return result;
+}
+
+std::vector<std::vector<uint32_t>> KMeansClusteringStrategy::findClosestClustersBatch(
+    const float* queries, size_t count, uint32_t n) const {
+    // Centroid-major: each centroid is loaded once and compared with every
+    // query. Squared distances rank the same as findClosestClusters' ones.
+    std::vector<std::vector<std::pair<uint32_t, float>>> distances(count);
+    for (auto& query_distances : distances) {
+        query_distances.reserve(centroids_.size());
+    }
+    for (const auto& [cluster_id, centroid] : centroids_) {
+        for (size_t q = 0; q < count; q++) {
+            float distance = l2DistanceSquared(queries + q * vector_dim_, centroid.data(), vector_dim_);
+            distances[q].push_back({cluster_id, distance});
+        }
+    }
+    
+    std::vector<std::vector<uint32_t>> result(count);
+    for (size_t q = 0; q < count; q++) {
+        keepClosest(distances[q], n);
+        result[q].reserve(distances[q].size());
+        for (const auto& [cluster_id, distance] : distances[q]) {
+            result[q].push_back(cluster_id);
+        }
     }
     
     return result;
 }
 
-Vector KMeansClusteringStrategy::getClusterCentroid(uint32_t cluster_id) {
+bool KMeansClusteringStrategy::moveVectors(const std::vector<uint32_t>& vector_ids,
+                                           uint32_t cluster_id, const float* vectors) {
     if (centroids_.find(cluster_id) == centroids_.end()) {
+        return false;
+    }
+    
+    bool all_moved = true;
+    std::set<uint32_t> changed = {cluster_id};
+    for (size_t i = 0; i < vector_ids.size(); i++) {
+        auto it = vector_to_cluster_.find(vector_ids[i]);
+        if (it == vector_to_cluster_.end()) {
+            all_moved = false;
+            continue;
+        }
+        const uint32_t from = it->second;
+        if (from == cluster_id) {
+            continue;
+        }
+        const float* data = vectors ? vectors + i * vector_dim_ : nullptr;
+        if (!data) {
+            auto stored = vectors_.find(vector_ids[i]);
+            if (stored != vectors_.end()) {
+                data = stored->second.data();
+            }
+        }
+        
+        cluster_members_[from].erase(vector_ids[i]);
+        cluster_info_[from].vector_count--;
+        CentroidSum& from_sum = centroid_sums_[from];
+        if (cluster_members_[from].empty()) {
+            // Merged away; its centroid stays until vectors move back in
+            from_sum = CentroidSum();
+            trained_centroids_.erase(from);
+        } else if (data && from_sum.count > 0) {
+            accumulate(from_sum, data, -1.0);
+        }
+        
+        it->second = cluster_id;
+        cluster_members_[cluster_id].insert(vector_ids[i]);
+        cluster_info_[cluster_id].vector_count++;
+        if (data) {
+            accumulate(centroid_sums_[cluster_id], data, 1.0);
+        }
+        changed.insert(from);
+    }
+    
+    for (uint32_t changed_id : changed) {
+        updateCentroid(changed_id);
+    }
+    return all_moved;
+}
+
+std::vector<uint32_t> KMeansClusteringStrategy::getEmptyClusters() const {
+    std::vector<uint32_t> empty;
+    if (seeded_centroids_ < max_clusters_) {
+        return empty;
+    }
+    for (const auto& [cluster_id, centroid] : centroids_) {
+        auto members = cluster_members_.find(cluster_id);
+        if (members == cluster_members_.end() || members->second.empty()) {
+            empty.push_back(cluster_id);
+        }
+    }
+    std::sort(empty.begin(), empty.end());
+    return empty;
+}
+
+Vector KMeansClusteringStrategy::getClusterCentroid(uint32_t cluster_id) const {
+    auto it = centroids_.find(cluster_id);
+    if (it == centroids_.end()) {
         return Vector(vector_dim_, 0.0f);  // Return zero vector if not found
     }
-    return centroids_[cluster_id];
+    return it->second;
 }
 
-uint32_t KMeansClusteringStrategy::getClusterSize(uint32_t cluster_id) {
-    if (cluster_members_.find(cluster_id) == cluster_members_.end()) {
+uint32_t KMeansClusteringStrategy::getClusterSize(uint32_t cluster_id) const {
+    auto it = cluster_members_.find(cluster_id);
+    if (it == cluster_members_.end()) {
         return 0;
     }
-    return static_cast<uint32_t>(cluster_members_[cluster_id].size());
+    return static_cast<uint32_t>(it->second.size());
+}
+
+uint32_t KMeansClusteringStrategy::getVectorCluster(uint32_t vector_id) const {
+    auto it = vector_to_cluster_.find(vector_id);
+    if (it == vector_to_cluster_.end()) {
+        return UINT32_MAX;
+    }
+    return it->second;
 }
 
-std::vector<ClusterInfo> KMeansClusteringStrategy::getAllClusters() {
+bool KMeansClusteringStrategy::setClusterExtent(uint32_t cluster_id, uint64_t start_offset,
+                                                uint32_t capacity) {
+    auto it = cluster_info_.find(cluster_id);
+    if (it == cluster_info_.end()) {
+        return false;
+    }
+    it->second.start_offset = start_offset;
+    it->second.capacity = capacity;
+    return true;
+}
+
+std::vector<ClusterInfo> KMeansClusteringStrategy::getAllClusters() const {
     std::vector<ClusterInfo> result;
     for (const auto& [cluster_id, info] : cluster_info_) {
         // Update centroid in info
         ClusterInfo updated_info = info;
-        updated_info.centroid = centroids_[cluster_id];
+        updated_info.centroid = getClusterCentroid(cluster_id);
         result.push_back(updated_info);
     }
     return result;
 }
 
 bool KMeansClusteringStrategy::rebalance() {
-    // Full K-means iteration
-    bool changed = false;
-    std::unordered_map<uint32_t, uint32_t> new_assignments;
-    
-    // Assign each vector to closest centroid
-    for (const auto& [vector_id, vector] : vectors_) {
-        uint32_t new_cluster = findClosestCentroid(vector);
-        new_assignments[vector_id] = new_cluster;
-        
-        if (vector_to_cluster_[vector_id] != new_cluster) {
-            changed = true;
+    // One full K-means iteration in a single pass over the vectors: assign
+    // each to its closest centroid and sum the clusters up again. The pass
+    // only reads the model, and each thread keeps its own assignments and
+    // sums, which are merged afterwards.
+    const size_t slots = thread_pool_ ? thread_pool_->threadCount() : 1;
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> assignments(slots);
+    std::vector<std::unordered_map<uint32_t, CentroidSum>> sums(slots);
+    auto assign = [&](uint32_t vector_id, const float* vector, size_t slot) {
+        if (vector_to_cluster_.find(vector_id) == vector_to_cluster_.end()) {
+            return;  // not part of the model
         }
+        uint32_t cluster_id = findClosestCentroid(vector);
+        assignments[slot].push_back({vector_id, cluster_id});
+        accumulate(sums[slot][cluster_id], vector, 1.0);
+    };
+    if (!streamVectors(assign)) {
+        logger_.error("Rebalance failed to read the stored vectors");
+        return false;
     }
     
-    if (!changed) {
-        return false;  // No changes, already balanced
+    std::unordered_map<uint32_t, CentroidSum> merged;
+    for (auto& slot_sums : sums) {
+        for (auto& [cluster_id, partial] : slot_sums) {
+            CentroidSum& total = merged[cluster_id];
+            if (total.count == 0) {
+                total = std::move(partial);
+                continue;
+            }
+            for (size_t i = 0; i < vector_dim_; i++) {
+                total.sum[i] += partial.sum[i];
+            }
+            total.count += partial.count;
+        }
     }
     
     // Apply new assignments
-    for (const auto& [vector_id, new_cluster] : new_assignments) {
-        uint32_t old_cluster = vector_to_cluster_[vector_id];
-        
-        if (old_cluster != new_cluster) {
+    bool changed = false;
+    for (const auto& slot_assignments : assignments) {
+        for (const auto& [vector_id, new_cluster] : slot_assignments) {
+            uint32_t& cluster = vector_to_cluster_[vector_id];
+            uint32_t old_cluster = cluster;
+            if (old_cluster == new_cluster) {
+                continue;
+            }
+            changed = true;
+            
             // Remove from old cluster
             cluster_members_[old_cluster].erase(vector_id);
             cluster_info_[old_cluster].vector_count--;
@@ -198,15 +367,214 @@ bool KMeansClusteringStrategy::rebalance() {
             cluster_info_[new_cluster].vector_count++;
             
             // Update mapping
-            vector_to_cluster_[vector_id] = new_cluster;
+            cluster = new_cluster;
         }
     }
     
-    // Update all centroids
+    // Update all centroids from the exact sums, which also drops anything
+    // removals left behind
     for (const auto& [cluster_id, _] : centroids_) {
+        auto it = merged.find(cluster_id);
+        centroid_sums_[cluster_id] = (it != merged.end()) ? std::move(it->second) : CentroidSum();
         updateCentroid(cluster_id);
     }
     
+    return changed;
+}
+
+bool KMeansClusteringStrategy::train(const float* sample, size_t count, const TrainingOptions& options) {
+    if (!sample || count == 0) {
+        logger_.error("K-means training needs a non-empty sample");
+        return false;
+    }
+    const auto started = std::chrono::steady_clock::now();
+    auto elapsed_ms = [&started]() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started).count();
+    };
+    const size_t k = std::min<size_t>(max_clusters_, count);
+    std::vector<float> centers;
+    seedPlusPlus(sample, count, k, centers);
+    logger_.info("K-means training: seeded " + std::to_string(k) + " centroids from " +
+                 std::to_string(count) + " vectors in " + std::to_string(elapsed_ms()) + " ms");
+    
+    // Shifts are measured against the sample's mean squared norm, so the
+    // tolerance doesn't depend on the data's scale
+    double scale = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        scale += dotProduct(sample + i * vector_dim_, sample + i * vector_dim_, vector_dim_);
+    }
+    scale = std::max(scale / count, 1e-12);
+    
+    // Mini-batch k-means: assign a random batch to the nearest centers in
+    // parallel, then move each center toward its batch members with a
+    // step of 1 / (vectors it has taken so far)
+    const size_t batch_size = std::max<size_t>(1, options.batch_size);
+    std::vector<uint32_t> taken(k, 0);
+    std::vector<size_t> batch(batch_size);
+    std::vector<uint32_t> nearest(batch_size);
+    std::vector<float> previous;
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+    uint32_t iteration = 0;
+    bool converged = false;
+    while (iteration < options.max_iterations && !converged) {
+        iteration++;
+        for (size_t& index : batch) {
+            index = pick(rng_);
+        }
+        forBlocks(batch_size, TRAINING_BATCH_BLOCK, [&](size_t begin, size_t end, size_t) {
+            for (size_t j = begin; j < end; j++) {
+                const float* vector = sample + batch[j] * vector_dim_;
+                float best = std::numeric_limits<float>::max();
+                for (size_t c = 0; c < k; c++) {
+                    float distance = l2DistanceSquared(vector, centers.data() + c * vector_dim_, vector_dim_);
+                    if (distance < best) {
+                        best = distance;
+                        nearest[j] = static_cast<uint32_t>(c);
+                    }
+                }
+            }
+        });
+        
+        previous = centers;
+        for (size_t j = 0; j < batch_size; j++) {
+            const uint32_t c = nearest[j];
+            const float step = 1.0f / ++taken[c];
+            float* center = centers.data() + static_cast<size_t>(c) * vector_dim_;
+            const float* vector = sample + batch[j] * vector_dim_;
+            for (size_t d = 0; d < vector_dim_; d++) {
+                center[d] += step * (vector[d] - center[d]);
+            }
+        }
+        double shift = 0.0;
+        for (size_t c = 0; c < k; c++) {
+            shift += l2DistanceSquared(centers.data() + c * vector_dim_, previous.data() + c * vector_dim_,
+                                       vector_dim_);
+        }
+        shift /= k * scale;
+        converged = iteration >= TRAINING_MIN_ITERATIONS && shift < options.tolerance;
+        if (iteration % TRAINING_PROGRESS_INTERVAL == 0) {
+            logger_.info("K-means training: iteration " + std::to_string(iteration) + ", centroid shift " +
+                         std::to_string(shift) + ", " + std::to_string(elapsed_ms()) + " ms");
+        }
+    }
+    
+    for (size_t c = 0; c < k; c++) {
+        const uint32_t cluster_id = static_cast<uint32_t>(c);
+        Vector centroid(centers.begin() + c * vector_dim_, centers.begin() + (c + 1) * vector_dim_);
+        cluster_info_[cluster_id].cluster_id = cluster_id;
+        cluster_info_[cluster_id].centroid = centroid;
+        centroids_[cluster_id] = std::move(centroid);
+        cluster_members_[cluster_id];
+        trained_centroids_.insert(cluster_id);
+    }
+    // Forgy seeding only fills clusters the sample was too small for
+    seeded_centroids_ = std::max(seeded_centroids_, static_cast<uint32_t>(k));
+    
+    logger_.info("K-means training " + std::string(converged ? "converged" : "stopped") + " after " +
+                 std::to_string(iteration) + " iterations in " + std::to_string(elapsed_ms()) + " ms");
+    return true;
+}
+
+void KMeansClusteringStrategy::seedPlusPlus(const float* sample, size_t count, size_t k,
+                                            std::vector<float>& centers) {
+    centers.assign(k * vector_dim_, 0.0f);
+    std::vector<float> closest(count, std::numeric_limits<float>::max());
+    size_t chosen = std::uniform_int_distribution<size_t>(0, count - 1)(rng_);
+    for (size_t c = 0; c < k; c++) {
+        float* center = centers.data() + c * vector_dim_;
+        std::copy(sample + chosen * vector_dim_, sample + (chosen + 1) * vector_dim_, center);
+        if (c + 1 == k) {
+            break;
+        }
+        forBlocks(count, REBALANCE_BLOCK_SIZE, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                closest[i] = std::min(closest[i], l2DistanceSquared(sample + i * vector_dim_, center, vector_dim_));
+            }
+        });
+        
+        double total = 0.0;
+        for (float distance : closest) {
+            total += distance;
+        }
+        if (total <= 0.0) {
+            // Every vector sits on a center already; any will do
+            chosen = std::uniform_int_distribution<size_t>(0, count - 1)(rng_);
+            continue;
+        }
+        double target = std::uniform_real_distribution<double>(0.0, total)(rng_);
+        chosen = count - 1;
+        for (size_t i = 0; i < count; i++) {
+            target -= closest[i];
+            if (target < 0.0) {
+                chosen = i;
+                break;
+            }
+        }
+    }
+}
+
+void KMeansClusteringStrategy::forBlocks(size_t count, size_t block_size,
+                                         const std::function<void(size_t, size_t, size_t)>& fn) const {
+    const size_t blocks = (count + block_size - 1) / block_size;
+    auto run_block = [&](size_t block, size_t slot) {
+        fn(block * block_size, std::min(count, (block + 1) * block_size), slot);
+    };
+    if (thread_pool_) {
+        thread_pool_->run(blocks, run_block);
+    } else {
+        for (size_t block = 0; block < blocks; block++) {
+            run_block(block, 0);
+        }
+    }
+}
+
+bool KMeansClusteringStrategy::isPlaceable(uint32_t cluster_id) const {
+    auto members = cluster_members_.find(cluster_id);
+    if (members != cluster_members_.end() && !members->second.empty()) {
+        return true;
+    }
+    return trained_centroids_.count(cluster_id) > 0;
+}
+
+void KMeansClusteringStrategy::setVectorSource(VectorSource source) {
+    vector_source_ = std::move(source);
+    streaming_ = static_cast<bool>(vector_source_);
+    if (streaming_) {
+        // The running sums already cover these; the source has the data
+        vectors_.clear();
+    }
+}
+
+bool KMeansClusteringStrategy::streamVectors(const VectorVisitor& visit) {
+    if (streaming_) {
+        if (!vector_source_) {
+            logger_.error("K-means model keeps no vectors and has no source to read them from");
+            return false;
+        }
+        return vector_source_(visit);
+    }
+    
+    // In-memory copy, split into blocks across the pool when there is one
+    std::vector<std::pair<uint32_t, const Vector*>> members;
+    members.reserve(vectors_.size());
+    for (const auto& [vector_id, vector] : vectors_) {
+        members.push_back({vector_id, &vector});
+    }
+    auto visit_block = [&](size_t block, size_t slot) {
+        size_t end = std::min(members.size(), (block + 1) * REBALANCE_BLOCK_SIZE);
+        for (size_t i = block * REBALANCE_BLOCK_SIZE; i < end; i++) {
+            visit(members[i].first, members[i].second->data(), slot);
+        }
+    };
+    size_t blocks = (members.size() + REBALANCE_BLOCK_SIZE - 1) / REBALANCE_BLOCK_SIZE;
+    if (thread_pool_) {
+        thread_pool_->run(blocks, visit_block);
+    } else {
+        for (size_t block = 0; block < blocks; block++) {
+            visit_block(block, 0);
+        }
+    }
     return true;
 }
 
@@ -219,31 +587,64 @@ std::vector<uint8_t> KMeansClusteringStrategy::serialize() {
     memcpy(result.data(), &vector_dim_, sizeof(uint32_t));
     memcpy(result.data() + sizeof(uint32_t), &max_clusters_, sizeof(uint32_t));
     
-    // Add number of vectors
-    uint32_t num_vectors = static_cast<uint32_t>(vectors_.size());
     size_t pos = 2 * sizeof(uint32_t);
-    result.resize(pos + sizeof(uint32_t));
-    memcpy(result.data() + pos, &num_vectors, sizeof(uint32_t));
-    pos += sizeof(uint32_t);
-    
-    // Add vectors and their assignments
-    for (const auto& [vector_id, vector] : vectors_) {
-        // Resize to fit vector_id, cluster_id, and vector data
-        size_t new_size = pos + 2 * sizeof(uint32_t) + vector.size() * sizeof(float);
-        result.resize(new_size);
-        
-        // Add vector_id
-        memcpy(result.data() + pos, &vector_id, sizeof(uint32_t));
-        pos += sizeof(uint32_t);
-        
-        // Add cluster_id
-        uint32_t cluster_id = vector_to_cluster_[vector_id];
-        memcpy(result.data() + pos, &cluster_id, sizeof(uint32_t));
+    if (streaming_) {
+        // Streaming models hold assignments and centroid sums, not vectors:
+        // STREAMING_FORMAT, then num_vectors (vector_id, cluster_id) pairs,
+        // then num_sums (cluster_id, count, sum[vector_dim] as doubles)
+        auto append = [&result, &pos](const void* data, size_t size) {
+            result.resize(pos + size);
+            memcpy(result.data() + pos, data, size);
+            pos += size;
+        };
+        uint32_t format = STREAMING_FORMAT;
+        append(&format, sizeof(uint32_t));
+        uint32_t num_vectors = static_cast<uint32_t>(vector_to_cluster_.size());
+        append(&num_vectors, sizeof(uint32_t));
+        result.reserve(pos + num_vectors * 2 * sizeof(uint32_t));
+        for (const auto& [vector_id, cluster_id] : vector_to_cluster_) {
+            append(&vector_id, sizeof(uint32_t));
+            append(&cluster_id, sizeof(uint32_t));
+        }
+        uint32_t num_sums = 0;
+        for (const auto& [cluster_id, sum] : centroid_sums_) {
+            num_sums += sum.count > 0 ? 1 : 0;
+        }
+        append(&num_sums, sizeof(uint32_t));
+        for (const auto& [cluster_id, sum] : centroid_sums_) {
+            if (sum.count == 0) {
+                continue;
+            }
+            append(&cluster_id, sizeof(uint32_t));
+            append(&sum.count, sizeof(uint32_t));
+            append(sum.sum.data(), vector_dim_ * sizeof(double));
+        }
+    } else {
+        // Add number of vectors
+        uint32_t num_vectors = static_cast<uint32_t>(vectors_.size());
+        result.resize(pos + sizeof(uint32_t));
+        memcpy(result.data() + pos, &num_vectors, sizeof(uint32_t));
         pos += sizeof(uint32_t);
         
-        // Add vector data
-        memcpy(result.data() + pos, vector.data(), vector.size() * sizeof(float));
-        pos += vector.size() * sizeof(float);
+        // Add vectors and their assignments
+        for (const auto& [vector_id, vector] : vectors_) {
+            // Resize to fit vector_id, cluster_id, and vector data
+            size_t new_size = pos + 2 * sizeof(uint32_t) + vector.size() * sizeof(float);
+            result.resize(new_size);
+            
+            // Add vector_id
+            memcpy(result.data() + pos, &vector_id, sizeof(uint32_t));
+            pos += sizeof(uint32_t);
+            
+            // Add cluster_id
+            uint32_t cluster_id = vector_to_cluster_[vector_id];
+            memcpy(result.data() + pos, &cluster_id, sizeof(uint32_t));
+            pos += sizeof(uint32_t);
+            
+            // Add vector data
+            memcpy(result.data() + pos, vector.data(), vector.size() * sizeof(float));
+            pos += vector.size() * sizeof(float);
+        }
     }
     
     // Add cluster info
@@ -273,7 +674,7 @@ std::vector<uint8_t> KMeansClusteringStrategy::serialize() {
 
 
 bool KMeansClusteringStrategy::deserialize(const std::vector<uint8_t>& data) {
-    if (data.size() < 2 * sizeof(uint32_t)) {
+    if (data.size() < 3 * sizeof(uint32_t)) {
         return false;  // Not enough data
     }
     
@@ -286,33 +687,88 @@ bool KMeansClusteringStrategy::deserialize(const std::vector<uint8_t>& data) {
     cluster_members_.clear();
     vector_to_cluster_.clear();
     vectors_.clear();
+    centroid_sums_.clear();
     cluster_info_.clear();
+    trained_centroids_.clear();
     
-    // Extract number of vectors
+    // Every read is checked against the end of the data, so a truncated
+    // or corrupt model fails the load instead of reading past it
     size_t pos = 2 * sizeof(uint32_t);
-    uint32_t num_vectors;
-    memcpy(&num_vectors, data.data() + pos, sizeof(uint32_t));
-    pos += sizeof(uint32_t);
+    auto fits = [&data, &pos](size_t size) { return size <= data.size() - pos; };
+    auto take = [&data, &pos, &fits](void* out, size_t size) {
+        if (!fits(size)) {
+            return false;
+        }
+        memcpy(out, data.data() + pos, size);
+        pos += size;
+        return true;
+    };
+    
+    // Extract number of vectors
+    uint32_t num_vectors = 0;
+    take(&num_vectors, sizeof(uint32_t));
+    
+    if (num_vectors == STREAMING_FORMAT) {
+        // Assignments and centroid sums (see serialize)
+        if (!take(&num_vectors, sizeof(uint32_t))) {
+            return false;
+        }
+        for (uint32_t i = 0; i < num_vectors; i++) {
+            uint32_t vector_id, cluster_id;
+            if (!take(&vector_id, sizeof(uint32_t)) || !take(&cluster_id, sizeof(uint32_t))) {
+                return false;
+            }
+            vector_to_cluster_[vector_id] = cluster_id;
+            if (cluster_members_.find(cluster_id) == cluster_members_.end()) {
+                centroids_[cluster_id] = Vector(vector_dim_, 0.0f);
+            }
+            cluster_members_[cluster_id].insert(vector_id);
+        }
+        uint32_t num_sums;
+        if (!take(&num_sums, sizeof(uint32_t))) {
+            return false;
+        }
+        for (uint32_t i = 0; i < num_sums; i++) {
+            uint32_t cluster_id;
+            CentroidSum sum;
+            if (!fits(2 * sizeof(uint32_t) + size_t(vector_dim_) * sizeof(double))) {
+                return false;
+            }
+            sum.sum.resize(vector_dim_);
+            take(&cluster_id, sizeof(uint32_t));
+            take(&sum.count, sizeof(uint32_t));
+            take(sum.sum.data(), vector_dim_ * sizeof(double));
+            centroid_sums_[cluster_id] = std::move(sum);
+        }
+        // A streaming model can't go back to keeping vectors
+        streaming_ = true;
+        num_vectors = 0;
+    }
     
     // Extract vectors and their assignments
     for (uint32_t i = 0; i < num_vectors; i++) {
+        if (!fits(2 * sizeof(uint32_t) + size_t(vector_dim_) * sizeof(float))) {
+            return false;
+        }
+        
         // Extract vector_id
         uint32_t vector_id;
-        memcpy(&vector_id, data.data() + pos, sizeof(uint32_t));
-        pos += sizeof(uint32_t);
+        take(&vector_id, sizeof(uint32_t));
         
         // Extract cluster_id
         uint32_t cluster_id;
-        memcpy(&cluster_id, data.data() + pos, sizeof(uint32_t));
-        pos += sizeof(uint32_t);
+        take(&cluster_id, sizeof(uint32_t));
         
         // Extract vector data
         Vector vector(vector_dim_);
-        memcpy(vector.data(), data.data() + pos, vector_dim_ * sizeof(float));
-        pos += vector_dim_ * sizeof(float);
+        take(vector.data(), vector_dim_ * sizeof(float));
         
-        // Store vector and assignment
-        vectors_[vector_id] = vector;
+        // Store assignment and sum the vector up; in streaming mode the
+        // vector itself isn't kept (an older model being converted)
+        accumulate(centroid_sums_[cluster_id], vector.data(), 1.0);
+        if (!streaming_) {
+            vectors_[vector_id] = vector;
+        }
         vector_to_cluster_[vector_id] = cluster_id;
         
         // Ensure cluster exists
@@ -327,20 +783,36 @@ bool KMeansClusteringStrategy::deserialize(const std::vector<uint8_t>& data) {
     
     // Extract number of clusters
     uint32_t num_clusters;
-    memcpy(&num_clusters, data.data() + pos, sizeof(uint32_t));
-    pos += sizeof(uint32_t);
+    if (!take(&num_clusters, sizeof(uint32_t))) {
+        return false;
+    }
     
     // Extract cluster info
     for (uint32_t i = 0; i < num_clusters; i++) {
         // Extract cluster_id
         uint32_t cluster_id;
-        memcpy(&cluster_id, data.data() + pos, sizeof(uint32_t));
-        pos += sizeof(uint32_t);
+        if (!take(&cluster_id, sizeof(uint32_t))) {
+            return false;
+        }
 
         // Extract ClusterInfo size
         uint32_t info_size;
-        memcpy(&info_size, data.data() + pos, sizeof(uint32_t));
-        pos += sizeof(uint32_t);
+        if (!take(&info_size, sizeof(uint32_t)) || !fits(info_size)) {
+            return false;
+        }
+
+        // ClusterInfo::deserialize trusts its input, so check the entry
+        // holds its fixed fields and the centroid they size
+        const size_t dim_pos = 3 * sizeof(uint32_t) + sizeof(uint64_t);
+        const size_t fixed_size = dim_pos + sizeof(uint32_t) + sizeof(float);
+        uint32_t centroid_dim = 0;
+        if (info_size >= fixed_size) {
+            memcpy(&centroid_dim, data.data() + pos + dim_pos, sizeof(uint32_t));
+        }
+        if (info_size < fixed_size ||
+            info_size - fixed_size < size_t(centroid_dim) * sizeof(int16_t)) {
+            return false;
+        }
 
         // Extract serialized ClusterInfo using exact size
         std::vector<uint8_t> serialized_info(data.begin() + pos, data.begin() + pos + info_size);
@@ -357,13 +829,27 @@ bool KMeansClusteringStrategy::deserialize(const std::vector<uint8_t>& data) {
     for (const auto& [cluster_id, _] : cluster_info_) {
         updateCentroid(cluster_id);
     }
+    
+    // A cluster with no members but a real centroid was trained (or
+    // emptied); keep placing vectors near it
+    for (const auto& [cluster_id, info] : cluster_info_) {
+        auto members = cluster_members_.find(cluster_id);
+        if ((members != cluster_members_.end() && !members->second.empty()) ||
+            info.centroid.size() != vector_dim_ ||
+            std::all_of(info.centroid.begin(), info.centroid.end(), [](float v) { return v == 0.0f; })) {
+            continue;
+        }
+        centroids_[cluster_id] = info.centroid;
+        cluster_members_[cluster_id];
+        trained_centroids_.insert(cluster_id);
+    }
 
     // Restore the seeded count = number of clusters that actually have
     // members. New vectors added after a load continue Forgy seeding from
     // here if the store isn't yet full, otherwise assign to nearest.
     seeded_centroids_ = 0;
     for (const auto& [cluster_id, members] : cluster_members_) {
-        if (!members.empty()) {
+        if (isPlaceable(cluster_id)) {
             seeded_centroids_++;
         }
     }
@@ -400,29 +886,23 @@ bool KMeansClusteringStrategy::loadFromFile(const std::string& filename) {
     return deserialize(serialized);
 }
 
-float KMeansClusteringStrategy::calculateDistance(const Vector& v1, const Vector& v2) {
-    float sum = 0.0f;
-    for (size_t i = 0; i < v1.size(); i++) {
-        float diff = v1[i] - v2[i];
-        sum += diff * diff;
-    }
-    return std::sqrt(sum);
+float KMeansClusteringStrategy::calculateDistance(const Vector& v1, const Vector& v2) const {
+    return std::sqrt(l2DistanceSquared(v1.data(), v2.data(), v1.size()));
 }
 
-uint32_t KMeansClusteringStrategy::findClosestCentroid(const Vector& vector) {
+uint32_t KMeansClusteringStrategy::findClosestCentroid(const float* vector) const {
     uint32_t closest_id = 0;
     float min_distance = std::numeric_limits<float>::max();
     bool found = false;
 
     for (const auto& [cluster_id, centroid] : centroids_) {
-        // Only consider seeded clusters — those with at least one member.
-        // An empty cluster's centroid is a zero/random vector and would
-        // otherwise corrupt nearest-centroid assignment.
-        auto mit = cluster_members_.find(cluster_id);
-        if (mit == cluster_members_.end() || mit->second.empty()) {
+        // Only consider seeded clusters — those with at least one member,
+        // or a trained centroid. An empty cluster's centroid is otherwise a
+        // zero/random vector and would corrupt nearest-centroid assignment.
+        if (!isPlaceable(cluster_id)) {
             continue;
         }
-        float distance = calculateDistance(vector, centroid);
+        float distance = l2DistanceSquared(vector, centroid.data(), vector_dim_);
         if (!found || distance < min_distance) {
             min_distance = distance;
             closest_id = cluster_id;
@@ -433,45 +913,42 @@ uint32_t KMeansClusteringStrategy::findClosestCentroid(const Vector& vector) {
     return closest_id;
 }
 
-void KMeansClusteringStrategy::updateCentroid(uint32_t cluster_id) {
-    const auto& members = cluster_members_[cluster_id];
-    
-    // If cluster is empty, leave centroid as is
-    if (members.empty()) {
-        return;
+void KMeansClusteringStrategy::keepClosest(std::vector<std::pair<uint32_t, float>>& distances,
+                                           uint32_t n) {
+    auto closer = [](const auto& a, const auto& b) { return a.second < b.second; };
+    if (n < distances.size()) {
+        std::nth_element(distances.begin(), distances.begin() + n, distances.end(), closer);
+        distances.resize(n);
     }
-    
-    // Calculate average of all vectors in cluster.
-    //
-    // MUST use find(), not vectors_[id]: operator[] default-constructs an
-    // EMPTY Vector for any member id missing from vectors_, and the inner
-    // loop then reads new_centroid[i] += vector[i] for i in [0,vector_dim_)
-    // out of a zero-length buffer — a 768-float out-of-bounds read. With a
-    // quiescent heap that OOB read hits mapped garbage and "works"; under
-    // heap churn (e.g. an await on the embed server between adds, which lets
-    // aiohttp/GC reuse the freed region) it lands on unmapped memory and
-    // segfaults (GPF in libstdc++). Skip missing/malformed members and
-    // average only over what we actually summed. (cbintel issue #147)
-    Vector new_centroid(vector_dim_, 0.0f);
+    std::sort(distances.begin(), distances.end(), closer);
+}
 
-    size_t counted = 0;
-    for (uint32_t vector_id : members) {
-        auto it = vectors_.find(vector_id);
-        if (it == vectors_.end() || it->second.size() != vector_dim_) {
-            continue;  // never read past the end of a short/absent vector
-        }
-        const Vector& vector = it->second;
-        for (size_t i = 0; i < vector_dim_; i++) {
-            new_centroid[i] += vector[i];
-        }
-        ++counted;
+void KMeansClusteringStrategy::accumulate(CentroidSum& sum, const float* vector, double sign) const {
+    if (sum.sum.empty()) {
+        sum.sum.assign(vector_dim_, 0.0);
+    }
+    for (size_t i = 0; i < vector_dim_; i++) {
+        sum.sum[i] += sign * vector[i];
     }
+    if (sign > 0) {
+        sum.count++;
+    } else {
+        sum.count--;
+    }
+}
 
-    if (counted == 0) {
-        return;  // nothing valid to average; leave centroid as-is
+void KMeansClusteringStrategy::updateCentroid(uint32_t cluster_id) {
+    // If cluster is empty, leave centroid as is
+    auto it = centroid_sums_.find(cluster_id);
+    if (it == centroid_sums_.end() || it->second.count == 0) {
+        return;
     }
+    
+    // Mean of the members, from the running sum
+    const CentroidSum& sum = it->second;
+    Vector new_centroid(vector_dim_);
     for (size_t i = 0; i < vector_dim_; i++) {
-        new_centroid[i] /= static_cast<float>(counted);
+        new_centroid[i] = static_cast<float>(sum.sum[i] / sum.count);
     }
     
     // Update centroid
@@ -707,6 +1184,9 @@ std::shared_ptr<ClusteringStrategy> createClusteringStrategy(
     if (strategy_name == "kmeans") {
         return std::make_shared<KMeansClusteringStrategy>(logger);
     }
+    if (strategy_name == "hierarchical_kmeans") {
+        return std::make_shared<HierarchicalKMeansStrategy>(logger);
+    }
     
     // Add more clustering strategies here
     
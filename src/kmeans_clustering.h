@@ -7,6 +7,7 @@
 #include <set>
 
 class Logger;
+class ThreadPool;
 
 class KMeansClusteringStrategy : public ClusteringStrategy {
 public:
@@ -16,19 +17,29 @@ public:
     bool initialize(uint32_t vector_dim, uint32_t max_clusters) override;
     uint32_t assignToCluster(const Vector& vector) override;
     bool addVector(const Vector& vector, uint32_t vector_id) override;
-    bool removeVector(uint32_t vector_id) override;
-    std::vector<uint32_t> findClosestClusters(const Vector& query, uint32_t n) override;
-    Vector getClusterCentroid(uint32_t cluster_id) override;
-    uint32_t getClusterSize(uint32_t cluster_id) override;
-    std::vector<ClusterInfo> getAllClusters() override;
+    bool removeVector(uint32_t vector_id, const float* vector = nullptr) override;
+    std::vector<uint32_t> findClosestClusters(const Vector& query, uint32_t n) const override;
+    std::vector<std::vector<uint32_t>> findClosestClustersBatch(const float* queries, size_t count,
+                                                                uint32_t n) const override;
+    bool moveVectors(const std::vector<uint32_t>& vector_ids, uint32_t cluster_id,
+                     const float* vectors) override;
+    std::vector<uint32_t> getEmptyClusters() const override;
+    Vector getClusterCentroid(uint32_t cluster_id) const override;
+    uint32_t getClusterSize(uint32_t cluster_id) const override;
+    uint32_t getVectorCluster(uint32_t vector_id) const override;
+    bool setClusterExtent(uint32_t cluster_id, uint64_t start_offset, uint32_t capacity) override;
+    std::vector<ClusterInfo> getAllClusters() const override;
     bool rebalance() override;
+    bool train(const float* sample, size_t count, const TrainingOptions& options) override;
+    void setThreadPool(ThreadPool* pool) override { thread_pool_ = pool; }
+    void setVectorSource(VectorSource source) override;
     std::vector<uint8_t> serialize() override;
     bool deserialize(const std::vector<uint8_t>& data) override;
     bool saveToFile(const std::string& filename) override;
     bool loadFromFile(const std::string& filename) override;
     std::string getName() const override { return "K-means"; }
 
-private:
+protected:
     Logger& logger_;
     uint32_t vector_dim_;
     uint32_t max_clusters_;
@@ -39,23 +50,72 @@ private:
     // search — otherwise every vector lands in whichever zero-centroid
     // the hash map happens to iterate first.
     uint32_t seeded_centroids_ = 0;
+    // Clusters whose centroid came from train(). They take vectors even
+    // while empty; a memberless trained cluster is restored from its
+    // ClusterInfo centroid on load.
+    std::set<uint32_t> trained_centroids_;
     
     // Cluster data
     std::unordered_map<uint32_t, Vector> centroids_;
     std::unordered_map<uint32_t, std::set<uint32_t>> cluster_members_;
     std::unordered_map<uint32_t, uint32_t> vector_to_cluster_;
+    // Copy of every vector, kept only without a vector source
     std::unordered_map<uint32_t, Vector> vectors_;
     
+    // Running sum of each cluster's vectors; the centroid is sum / count,
+    // so adding or removing a vector costs O(dim). count can trail the
+    // cluster size after a removal the strategy had no data for, until
+    // the next rebalance recomputes the sums.
+    struct CentroidSum {
+        std::vector<double> sum;
+        uint32_t count = 0;
+    };
+    std::unordered_map<uint32_t, CentroidSum> centroid_sums_;
+    
+    // Streaming mode: vectors come from vector_source_, not vectors_
+    bool streaming_ = false;
+    VectorSource vector_source_;
+    // Serialized in place of the vector count by streaming models, which
+    // store assignments and sums instead of vectors
+    static constexpr uint32_t STREAMING_FORMAT = UINT32_MAX;
+    
     // Cluster metadata
     std::unordered_map<uint32_t, ClusterInfo> cluster_info_;
     
     // Random number generator
     std::mt19937 rng_;
     
+    // Optional pool for the rebalance assignment pass, which it splits into
+    // blocks of REBALANCE_BLOCK_SIZE vectors
+    ThreadPool* thread_pool_ = nullptr;
+    static constexpr size_t REBALANCE_BLOCK_SIZE = 1024;
+    // Training runs at least this many mini-batch iterations and logs
+    // progress every TRAINING_PROGRESS_INTERVAL of them
+    static constexpr uint32_t TRAINING_MIN_ITERATIONS = 10;
+    static constexpr uint32_t TRAINING_PROGRESS_INTERVAL = 20;
+    // Batch vectors each training assignment task takes
+    static constexpr size_t TRAINING_BATCH_BLOCK = 64;
+    
     // Internal methods
-    float calculateDistance(const Vector& v1, const Vector& v2);
-    uint32_t findClosestCentroid(const Vector& vector);
+    float calculateDistance(const Vector& v1, const Vector& v2) const;
+    // Nearest centroid of a cluster with members; used to place and
+    // reassign vectors
+    virtual uint32_t findClosestCentroid(const float* vector) const;
+    // A cluster placement can pick: it has members or a trained centroid
+    bool isPlaceable(uint32_t cluster_id) const;
+    // k-means++: k rows of sample, each picked with probability
+    // proportional to its squared distance from those picked before
+    void seedPlusPlus(const float* sample, size_t count, size_t k, std::vector<float>& centers);
+    // Call fn(begin, end, slot) over [0, count) in blocks of block_size,
+    // on the pool if there is one
+    void forBlocks(size_t count, size_t block_size,
+                   const std::function<void(size_t, size_t, size_t)>& fn) const;
+    // Cut (cluster_id, distance) pairs down to the n smallest, sorted,
+    // without sorting the rest
+    static void keepClosest(std::vector<std::pair<uint32_t, float>>& distances, uint32_t n);
+    void accumulate(CentroidSum& sum, const float* vector, double sign) const;
     void updateCentroid(uint32_t cluster_id);
+    bool streamVectors(const VectorVisitor& visit);
     void initializeCentroids();
 };
 
@@ -0,0 +1,181 @@
+#include "logger.h"
+#include <cctype>
+#include <cstdlib>
+
+namespace {
+
+// How long the writer sleeps with nothing to write before looking again,
+// in case a wakeup raced with it
+constexpr auto WRITER_IDLE = std::chrono::milliseconds(100);
+
+const char* levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::DEBUG:   return "DEBUG";
+        case LogLevel::INFO:    return "INFO";
+        case LogLevel::WARNING: return "WARNING";
+        case LogLevel::ERROR:   return "ERROR";
+        default:                return "OFF";
+    }
+}
+
+}  // namespace
+
+Logger::Logger(const std::string& filename, LogLevel level, bool console)
+    : console_(console), level_(level), slots_(new Slot[RING_SIZE]) {
+    file_.open(filename, std::ios::out | std::ios::app);
+    for (size_t i = 0; i < RING_SIZE; i++) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    writer_ = std::thread(&Logger::writerLoop, this);
+}
+
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+    if (file_.is_open()) {
+        file_.close();
+    }
+}
+
+LogLevel Logger::defaultLevel() {
+    const char* forced = std::getenv("VCS_LOG_LEVEL");
+    if (forced == nullptr) {
+        return LogLevel::INFO;
+    }
+    std::string name(forced);
+    for (char& c : name) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    if (name == "debug") return LogLevel::DEBUG;
+    if (name == "warning") return LogLevel::WARNING;
+    if (name == "error") return LogLevel::ERROR;
+    if (name == "off") return LogLevel::OFF;
+    return LogLevel::INFO;
+}
+
+void Logger::push(LogLevel level, std::string message) {
+    const auto now = std::chrono::system_clock::now();
+    uint64_t position = tail_.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots_[position & (RING_SIZE - 1)];
+        const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+            if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < position) {
+            // Full: the writer hasn't freed this slot since the last lap
+            if (level < LogLevel::WARNING) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            wakeWriter();
+            std::this_thread::yield();
+            position = tail_.load(std::memory_order_relaxed);
+        } else {
+            position = tail_.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->time = now;
+    slot->message = std::move(message);
+    // seq_cst against the writer's check of sleeping_ then ready(), so
+    // one of the two sees the other
+    slot->sequence.store(position + 1);
+    if (sleeping_.load()) {
+        wakeWriter();
+    }
+}
+
+void Logger::wakeWriter() {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    wake_.notify_one();
+}
+
+void Logger::flush() {
+    const uint64_t target = tail_.load();
+    wakeWriter();
+    std::unique_lock<std::mutex> lock(flushed_mutex_);
+    flushed_cv_.wait(lock, [&] { return flushed_ >= target; });
+}
+
+bool Logger::ready() const {
+    return slots_[head_ & (RING_SIZE - 1)].sequence.load() == head_ + 1;
+}
+
+void Logger::writerLoop() {
+    for (;;) {
+        if (drain() > 0) {
+            file_.flush();
+            if (console_) {
+                std::cout.flush();
+            }
+            {
+                std::lock_guard<std::mutex> lock(flushed_mutex_);
+                flushed_ = head_;
+            }
+            flushed_cv_.notify_all();
+        }
+
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        sleeping_.store(true);
+        if (!ready()) {
+            if (stopping_ && tail_.load() == head_) {
+                break;
+            }
+            // A flush() with nothing left to write returns at once
+            {
+                std::lock_guard<std::mutex> flushed_lock(flushed_mutex_);
+                flushed_ = head_;
+            }
+            flushed_cv_.notify_all();
+            wake_.wait_for(lock, WRITER_IDLE);
+        }
+        sleeping_.store(false);
+    }
+    sleeping_.store(false);
+}
+
+size_t Logger::drain() {
+    size_t written = 0;
+    while (ready()) {
+        Slot& slot = slots_[head_ & (RING_SIZE - 1)];
+        writeLine(slot);
+        // Free the slot for the position a lap ahead
+        slot.sequence.store(head_ + RING_SIZE, std::memory_order_release);
+        head_++;
+        written++;
+    }
+    return written;
+}
+
+void Logger::writeLine(const Slot& slot) {
+    const std::time_t second = std::chrono::system_clock::to_time_t(slot.time);
+    if (second != stamp_second_) {
+        std::tm now_tm;
+        localtime_r(&second, &now_tm);  // std::localtime shares a static buffer
+        std::strftime(stamp_, sizeof(stamp_), "%Y-%m-%d %H:%M:%S", &now_tm);
+        stamp_second_ = second;
+    }
+
+    std::string line;
+    line.reserve(slot.message.size() + 40);
+    line += stamp_;
+    line += " [";
+    line += levelName(slot.level);
+    line += "] ";
+    line += slot.message;
+    line += '\n';
+    if (file_.is_open()) {
+        file_ << line;
+    }
+    if (console_) {
+        std::cout << line;
+    }
+}
@@ -3,63 +3,154 @@
 
 #include <string>
 #include <fstream>
-#include <iostream>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
 #include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+enum class LogLevel {
+    DEBUG,
+    INFO,
+    WARNING,
+    ERROR,
+    OFF
+};
 
+// Messages below this level (0 = DEBUG ... 4 = OFF) are compiled out:
+// build with -DVCS_LOG_MIN_LEVEL=1 and debug() calls cost nothing
+#ifndef VCS_LOG_MIN_LEVEL
+#define VCS_LOG_MIN_LEVEL 0
+#endif
+
+// Log to a file and stdout without holding up the caller. A message is
+// filtered by level, moved into a lock-free ring and written by a
+// background thread, which flushes whenever the ring runs dry. So lines
+// are written in the order their callers claimed ring slots, and a crash
+// can lose the last ones written; flush() waits for them.
+//
+// A message is a string, or a callable returning one that only runs if
+// the level is enabled:
+//
+//     logger_.debug([&] { return "Stored vector " + std::to_string(id); });
+//
+// When the ring is full, a DEBUG or INFO message is dropped (and
+// counted); a WARNING or ERROR waits for room.
+//
+// Thread-safe.
 class Logger {
 public:
-    Logger(const std::string& filename) : filename_(filename) {
-        file_.open(filename, std::ios::out | std::ios::app);
-    }
-    
-    ~Logger() {
-        if (file_.is_open()) {
-            file_.close();
-        }
+    // level defaults to the VCS_LOG_LEVEL environment variable (debug,
+    // info, warning, error or off), else INFO. console also echoes every
+    // line to stdout.
+    Logger(const std::string& filename, LogLevel level = defaultLevel(), bool console = true);
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    template <typename Message>
+    void debug(Message&& message) {
+        log<LogLevel::DEBUG>(std::forward<Message>(message));
     }
-    
-    void debug(const std::string& message) {
-        log("DEBUG", message);
+
+    template <typename Message>
+    void info(Message&& message) {
+        log<LogLevel::INFO>(std::forward<Message>(message));
     }
-    
-    void info(const std::string& message) {
-        log("INFO", message);
+
+    template <typename Message>
+    void warning(Message&& message) {
+        log<LogLevel::WARNING>(std::forward<Message>(message));
     }
-    
-    void warning(const std::string& message) {
-        log("WARNING", message);
+
+    template <typename Message>
+    void error(Message&& message) {
+        log<LogLevel::ERROR>(std::forward<Message>(message));
     }
-    
-    void error(const std::string& message) {
-        log("ERROR", message);
+
+    bool enabled(LogLevel level) const {
+        return static_cast<int>(level) >= VCS_LOG_MIN_LEVEL &&
+               level >= level_.load(std::memory_order_relaxed) && level != LogLevel::OFF;
     }
-    
+    void setLevel(LogLevel level) { level_.store(level, std::memory_order_relaxed); }
+    LogLevel getLevel() const { return level_.load(std::memory_order_relaxed); }
+
+    // Return once every message logged before the call is written out
+    void flush();
+    // Messages dropped because the ring was full
+    uint64_t getDroppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+    static LogLevel defaultLevel();
+
 private:
-    std::string filename_;
-    std::ofstream file_;
-    
-    void log(const std::string& level, const std::string& message) {
-        std::string timestamp = getCurrentTimestamp();
-        std::string log_entry = timestamp + " [" + level + "] " + message;
-        
-        if (file_.is_open()) {
-            file_ << log_entry << std::endl;
+    static constexpr size_t RING_SIZE = 4096;   // slots; a power of two
+
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        LogLevel level;
+        std::chrono::system_clock::time_point time;
+        std::string message;
+    };
+
+    template <LogLevel Level, typename Message>
+    void log(Message&& message) {
+        if constexpr (static_cast<int>(Level) >= VCS_LOG_MIN_LEVEL) {
+            if (!enabled(Level)) {
+                return;
+            }
+            if constexpr (std::is_invocable_v<Message&>) {
+                push(Level, std::string(message()));
+            } else {
+                push(Level, std::string(std::forward<Message>(message)));
+            }
         }
-        
-        std::cout << log_entry << std::endl;
-    }
-    
-    std::string getCurrentTimestamp() {
-        auto now = std::chrono::system_clock::now();
-        auto now_c = std::chrono::system_clock::to_time_t(now);
-        auto now_tm = std::localtime(&now_c);
-        
-        std::stringstream ss;
-        ss << std::put_time(now_tm, "%Y-%m-%d %H:%M:%S");
-        return ss.str();
     }
+
+    void push(LogLevel level, std::string message);
+    void wakeWriter();
+    void writerLoop();
+    // Whether the message at head_ is published
+    bool ready() const;
+    // Write out the published messages from head_
+    size_t drain();
+    void writeLine(const Slot& slot);
+
+    std::ofstream file_;
+    const bool console_;
+    std::atomic<LogLevel> level_;
+    std::atomic<uint64_t> dropped_{0};
+
+    // Vyukov's bounded queue: a slot is free for position p while its
+    // sequence is p, and holds p's message once it is p + 1
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<uint64_t> tail_{0};   // next position to claim
+    uint64_t head_ = 0;               // next position to write
+
+    // The writer sleeps on wake_ only while the ring is empty
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<bool> sleeping_{false};
+    bool stopping_ = false;
+
+    // Messages written and flushed so far, for flush()
+    std::mutex flushed_mutex_;
+    std::condition_variable flushed_cv_;
+    uint64_t flushed_ = 0;
+
+    // Writer's: the timestamp text of the last second formatted
+    std::time_t stamp_second_ = -1;
+    char stamp_[32];
+
+    std::thread writer_;
 };
 
 #endif // LOGGER_H
@@ -1,16 +1,274 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 #include "vector_cluster_store.h"
+#include "sharded_vector_store.h"
 #include "logger.h"
+#include "distance.h"
+#include <algorithm>
 #include <iostream>
+#include <limits>
 
 namespace py = pybind11;
 
+namespace {
+
+// A C-contiguous float32 array is read in place; anything else NumPy can
+// convert is copied into one first
+using FloatArray = py::array_t<float, py::array::c_style | py::array::forcecast>;
+using Results = std::vector<std::pair<uint32_t, float>>;
+
+// Results as (ids, similarities): an int64 and a float32 array, best first
+py::tuple resultArrays(const Results& results) {
+    py::array_t<int64_t> ids(results.size());
+    py::array_t<float> scores(results.size());
+    int64_t* id = ids.mutable_data();
+    float* score = scores.mutable_data();
+    for (size_t i = 0; i < results.size(); i++) {
+        id[i] = results[i].first;
+        score[i] = results[i].second;
+    }
+    return py::make_tuple(ids, scores);
+}
+
+// store_vector from a 1-D array of the store's dimension
+template <typename Store>
+bool storeVectorArray(Store& self, uint32_t id, const FloatArray& vector, const std::string& metadata) {
+    if (vector.ndim() != 1 || static_cast<uint32_t>(vector.shape(0)) != self.getVectorDim()) {
+        std::cerr << "Error: store_vector expects a 1-D array of " << self.getVectorDim()
+                  << " floats" << std::endl;
+        return false;
+    }
+    Vector data(vector.data(), vector.data() + vector.shape(0));
+    py::gil_scoped_release release;
+    try {
+        return self.storeVector(id, data, metadata);
+    } catch (const std::exception& e) {
+        std::cerr << "C++ exception in store_vector: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+// The vector read straight into a new array; empty if it isn't stored
+template <typename Store>
+py::array_t<float> retrieveVectorArray(Store& self, uint32_t id) {
+    py::array_t<float> vector(self.getVectorDim());
+    float* data = vector.mutable_data();
+    bool found;
+    {
+        py::gil_scoped_release release;
+        found = self.retrieveVector(id, data);
+    }
+    return found ? vector : py::array_t<float>(py::ssize_t(0));
+}
+
+// find_similar_vectors for a 1-D query array, as (ids, similarities)
+template <typename Store>
+py::tuple findSimilarArrays(Store& self, const FloatArray& query, uint32_t k, const SearchParams& params) {
+    if (query.ndim() != 1 || static_cast<uint32_t>(query.shape(0)) != self.getVectorDim()) {
+        std::cerr << "Error: find_similar_vectors expects a 1-D array of " << self.getVectorDim()
+                  << " floats" << std::endl;
+        return resultArrays(Results());
+    }
+    Vector data(query.data(), query.data() + query.shape(0));
+    Results results;
+    {
+        py::gil_scoped_release release;
+        try {
+            results = self.findSimilarVectors(data, k, params);
+        } catch (const std::exception& e) {
+            std::cerr << "C++ exception in find_similar_vectors: " << e.what() << std::endl;
+        }
+    }
+    return resultArrays(results);
+}
+
+// find_similar_vectors_batch for an (n, vector_dim) array, as (ids,
+// similarities) arrays of shape (n, k). A query with fewer than k results
+// is padded with id -1 and similarity -inf.
+template <typename Store>
+py::tuple findSimilarBatchArrays(Store& self, const FloatArray& queries, uint32_t k,
+                                 const SearchParams& params) {
+    if (queries.ndim() != 2 || static_cast<uint32_t>(queries.shape(1)) != self.getVectorDim()) {
+        std::cerr << "Error: find_similar_vectors_batch expects a 2-D array of shape (n, "
+                  << self.getVectorDim() << ")" << std::endl;
+        return py::make_tuple(py::array_t<int64_t>(std::vector<py::ssize_t>{0, k}),
+                              py::array_t<float>(std::vector<py::ssize_t>{0, k}));
+    }
+    const size_t count = static_cast<size_t>(queries.shape(0));
+    py::array_t<int64_t> ids(std::vector<py::ssize_t>{static_cast<py::ssize_t>(count), k});
+    py::array_t<float> scores(std::vector<py::ssize_t>{static_cast<py::ssize_t>(count), k});
+    int64_t* id = ids.mutable_data();
+    float* score = scores.mutable_data();
+    {
+        py::gil_scoped_release release;
+        std::fill(id, id + count * k, int64_t(-1));
+        std::fill(score, score + count * k, -std::numeric_limits<float>::infinity());
+        try {
+            auto results = self.findSimilarVectorsBatch(queries.data(), count, k, params);
+            for (size_t q = 0; q < results.size(); q++) {
+                for (size_t i = 0; i < results[q].size() && i < k; i++) {
+                    id[q * k + i] = results[q][i].first;
+                    score[q * k + i] = results[q][i].second;
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "C++ exception in find_similar_vectors_batch: " << e.what() << std::endl;
+        }
+    }
+    return py::make_tuple(ids, scores);
+}
+
+// Two 1-D arrays of the same length, as the distance functions take them
+template <typename A, typename B>
+bool sameLength(const char* name, const A& a, const B& b) {
+    if (a.ndim() != 1 || b.ndim() != 1 || a.shape(0) != b.shape(0)) {
+        std::cerr << "Error: " << name << " expects two 1-D arrays of the same length" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
 PYBIND11_MODULE(vector_cluster_store_py, m) {
     m.doc() = "Vector cluster storage for embeddings on raw devices";
     
+    py::enum_<LogLevel>(m, "LogLevel")
+        .value("DEBUG", LogLevel::DEBUG)
+        .value("INFO", LogLevel::INFO)
+        .value("WARNING", LogLevel::WARNING)
+        .value("ERROR", LogLevel::ERROR)
+        .value("OFF", LogLevel::OFF);
+    
     py::class_<Logger>(m, "Logger")
-        .def(py::init<const std::string&>());
+        // The level from VCS_LOG_LEVEL, else INFO
+        .def(py::init<const std::string&>())
+        .def(py::init<const std::string&, LogLevel, bool>(),
+             py::arg("filename"), py::arg("level"), py::arg("console") = true)
+        .def("set_level", &Logger::setLevel)
+        .def("get_level", &Logger::getLevel)
+        .def("flush", &Logger::flush, py::call_guard<py::gil_scoped_release>())
+        .def("get_dropped_count", &Logger::getDroppedCount);
+    
+    py::enum_<QuantizationType>(m, "QuantizationType")
+        .value("NONE", QuantizationType::NONE)
+        .value("SQ8", QuantizationType::SQ8)
+        .value("PQ", QuantizationType::PQ);
+    
+    py::enum_<Durability>(m, "Durability")
+        .value("NONE", Durability::NONE)
+        .value("GROUP", Durability::GROUP)
+        .value("PER_OP", Durability::PER_OP);
+    
+    py::enum_<AttributeType>(m, "AttributeType")
+        .value("INT", AttributeType::INT)
+        .value("STRING", AttributeType::STRING);
+    
+    py::class_<AttributeField>(m, "AttributeField")
+        .def(py::init([](const std::string& name, AttributeType type) {
+            return AttributeField{name, type};
+        }), py::arg("name"), py::arg("type") = AttributeType::STRING)
+        .def_readwrite("name", &AttributeField::name)
+        .def_readwrite("type", &AttributeField::type);
+    
+    // Conditions chain: AttributeFilter().equals("tenant", "a").range("year", 2020, 2024)
+    py::class_<AttributeFilter>(m, "AttributeFilter")
+        .def(py::init<>())
+        .def("equals", py::overload_cast<const std::string&, const std::string&>(&AttributeFilter::equals),
+             py::arg("field"), py::arg("value"), py::return_value_policy::reference_internal)
+        .def("equals", py::overload_cast<const std::string&, int64_t>(&AttributeFilter::equals),
+             py::arg("field"), py::arg("value"), py::return_value_policy::reference_internal)
+        .def("one_of", &AttributeFilter::in, py::arg("field"), py::arg("values"),
+             py::return_value_policy::reference_internal)
+        .def("range", &AttributeFilter::range, py::arg("field"), py::arg("min"), py::arg("max"),
+             py::return_value_policy::reference_internal)
+        .def("empty", &AttributeFilter::empty);
+    
+    py::class_<StoreOptions>(m, "StoreOptions")
+        .def(py::init<>())
+        .def_readwrite("normalize_vectors", &StoreOptions::normalize_vectors)
+        .def_readwrite("direct_io", &StoreOptions::direct_io)
+        .def_readwrite("use_mmap", &StoreOptions::use_mmap)
+        .def_readwrite("cache_bytes", &StoreOptions::cache_bytes)
+        .def_readwrite("use_io_uring", &StoreOptions::use_io_uring)
+        .def_readwrite("io_queue_depth", &StoreOptions::io_queue_depth)
+        .def_readwrite("worker_threads", &StoreOptions::worker_threads)
+        .def_readwrite("quantization", &StoreOptions::quantization)
+        .def_readwrite("pq_subvectors", &StoreOptions::pq_subvectors)
+        .def_readwrite("rerank_factor", &StoreOptions::rerank_factor)
+        .def_readwrite("background_compaction", &StoreOptions::background_compaction)
+        .def_readwrite("compaction_interval_ms", &StoreOptions::compaction_interval_ms)
+        .def_readwrite("compaction_batch", &StoreOptions::compaction_batch)
+        .def_readwrite("background_maintenance", &StoreOptions::background_maintenance)
+        .def_readwrite("maintenance_interval_ms", &StoreOptions::maintenance_interval_ms)
+        .def_readwrite("maintenance_clusters_per_step", &StoreOptions::maintenance_clusters_per_step)
+        .def_readwrite("maintenance_io_budget", &StoreOptions::maintenance_io_budget)
+        .def_readwrite("split_ratio", &StoreOptions::split_ratio)
+        .def_readwrite("merge_ratio", &StoreOptions::merge_ratio)
+        .def_readwrite("train_on_maintenance", &StoreOptions::train_on_maintenance)
+        .def_readwrite("read_only", &StoreOptions::read_only)
+        .def_readwrite("snapshot_retention", &StoreOptions::snapshot_retention)
+        .def_readwrite("durability", &StoreOptions::durability)
+        .def_readwrite("group_commit_ms", &StoreOptions::group_commit_ms)
+        .def_readwrite("group_commit_ops", &StoreOptions::group_commit_ops)
+        // A list, copied in and out: assign the whole list
+        .def_readwrite("attributes", &StoreOptions::attributes);
+    
+    py::class_<SearchParams>(m, "SearchParams")
+        .def(py::init<>())
+        .def_readwrite("nprobe", &SearchParams::nprobe)
+        .def_readwrite("max_candidates", &SearchParams::max_candidates)
+        .def_readwrite("prune_ratio", &SearchParams::prune_ratio)
+        .def_readwrite("deadline_us", &SearchParams::deadline_us)
+        .def_readwrite("filter", &SearchParams::filter);
+    
+    py::class_<SearchStats>(m, "SearchStats")
+        .def(py::init<>())
+        .def_readonly("clusters_scanned", &SearchStats::clusters_scanned)
+        .def_readonly("vectors_scanned", &SearchStats::vectors_scanned)
+        .def_readonly("codes_scored", &SearchStats::codes_scored)
+        .def_readonly("deadline_reached", &SearchStats::deadline_reached);
+    
+    py::class_<CacheStats>(m, "CacheStats")
+        .def(py::init<>())
+        .def_readonly("hits", &CacheStats::hits)
+        .def_readonly("misses", &CacheStats::misses)
+        .def_readonly("admissions", &CacheStats::admissions)
+        .def_readonly("evictions", &CacheStats::evictions)
+        .def_readonly("bytes", &CacheStats::bytes)
+        .def_readonly("entries", &CacheStats::entries);
+    
+    py::class_<OperationStats>(m, "OperationStats")
+        .def(py::init<>())
+        .def_readonly("count", &OperationStats::count)
+        .def_readonly("mean_us", &OperationStats::mean_us)
+        .def_readonly("p50_us", &OperationStats::p50_us)
+        .def_readonly("p90_us", &OperationStats::p90_us)
+        .def_readonly("p99_us", &OperationStats::p99_us)
+        .def_readonly("p999_us", &OperationStats::p999_us)
+        .def_readonly("max_us", &OperationStats::max_us)
+        .def_readonly("reads", &OperationStats::reads)
+        .def_readonly("writes", &OperationStats::writes)
+        .def_readonly("bytes_read", &OperationStats::bytes_read)
+        .def_readonly("bytes_written", &OperationStats::bytes_written);
+    
+    py::class_<StoreStats>(m, "StoreStats")
+        .def(py::init<>())
+        .def_readonly("store", &StoreStats::store)
+        .def_readonly("store_batch", &StoreStats::store_batch)
+        .def_readonly("retrieve", &StoreStats::retrieve)
+        .def_readonly("search", &StoreStats::search)
+        .def_readonly("search_batch", &StoreStats::search_batch)
+        .def_readonly("remove", &StoreStats::remove)
+        .def_readonly("maintenance", &StoreStats::maintenance)
+        .def_readonly("other", &StoreStats::other)
+        .def_readonly("queries", &StoreStats::queries)
+        .def_readonly("clusters_probed", &StoreStats::clusters_probed)
+        .def_readonly("vectors_scored", &StoreStats::vectors_scored)
+        .def_readonly("codes_scored", &StoreStats::codes_scored)
+        .def_readonly("syncs", &StoreStats::syncs)
+        .def_readonly("cache", &StoreStats::cache);
     
     py::class_<VectorClusterStore>(m, "VectorClusterStore")
         // keep_alive<1,2>: tie the Logger's lifetime to the store. The store
@@ -22,11 +280,26 @@ PYBIND11_MODULE(vector_cluster_store_py, m) {
         // churn reuses the freed block. Fixes it for ALL consumers at the
         // binding layer. (Nominate-AI/cbintel #147)
         .def(py::init<Logger&>(), py::keep_alive<1, 2>())
-        .def("initialize", &VectorClusterStore::initialize)
-        .def("store_vector", [](VectorClusterStore& self, uint32_t id, const std::vector<float>& vec, const std::string& metadata = "") {
-            std::cout << "Python binding: store_vector called with id=" << id 
-                      << ", vector size=" << vec.size() << std::endl;
-            
+        // Calls into the store release the GIL so Python threads can
+        // overlap; the store's reader-writer lock does the serializing.
+        // Arguments are converted before, and results after, the release.
+        .def("initialize", &VectorClusterStore::initialize,
+             py::arg("device_path"), py::arg("strategy_name"), py::arg("vector_dim"),
+             py::arg("max_clusters") = 100, py::arg("options") = StoreOptions(),
+             py::call_guard<py::gil_scoped_release>())
+        .def("get_options", &VectorClusterStore::getOptions)
+        .def("get_io_engine_name", &VectorClusterStore::getIoEngineName)
+        .def("get_cache_stats", &VectorClusterStore::getCacheStats)
+        .def("get_stats", &VectorClusterStore::getStats)
+        .def("get_stats_prometheus", &VectorClusterStore::getStatsPrometheus, py::arg("prefix") = "vcs")
+        .def("get_data_size", &VectorClusterStore::getDataSize)
+        .def("get_cluster_sizes", &VectorClusterStore::getClusterSizes)
+        .def("get_cluster_centroids", &VectorClusterStore::getClusterCentroids)
+        // A float32 array is used in place; lists take the overload below
+        .def("store_vector", &storeVectorArray<VectorClusterStore>,
+             py::arg("id"), py::arg("vector"), py::arg("metadata") = "")
+        .def("store_vector", [](VectorClusterStore& self, uint32_t id, const std::vector<float>& vec,
+                                const std::string& metadata) {
             // Verify the vector is not empty
             if (vec.empty()) {
                 std::cerr << "Error: Empty vector passed to store_vector" << std::endl;
@@ -40,10 +313,53 @@ PYBIND11_MODULE(vector_cluster_store_py, m) {
                 std::cerr << "C++ exception in store_vector: " << e.what() << std::endl;
                 return false;
             }
-        })
-        .def("retrieve_vector", [](VectorClusterStore& self, uint32_t id) {
-            std::cout << "Python binding: retrieve_vector called with id=" << id << std::endl;
+        }, py::arg("id"), py::arg("vector"), py::arg("metadata") = "",
+           py::call_guard<py::gil_scoped_release>())
+        .def("store_vectors", [](VectorClusterStore& self, const std::vector<uint32_t>& ids,
+                                 py::array_t<float, py::array::c_style | py::array::forcecast> vectors,
+                                 const std::vector<std::string>& metadata) {
+            // Expect a 2-D (n, vector_dim) array; forcecast/c_style give us a
+            // contiguous float32 block we can hand to the store as-is.
+            if (vectors.ndim() != 2) {
+                std::cerr << "Error: store_vectors expects a 2-D array, got "
+                          << vectors.ndim() << "-D" << std::endl;
+                return false;
+            }
+            if (static_cast<uint32_t>(vectors.shape(1)) != self.getVectorDim()) {
+                std::cerr << "Error: store_vectors got vectors of dimension " << vectors.shape(1)
+                          << ", store expects " << self.getVectorDim() << std::endl;
+                return false;
+            }
+            if (static_cast<size_t>(vectors.shape(0)) != ids.size()) {
+                std::cerr << "Error: store_vectors got " << ids.size() << " ids for "
+                          << vectors.shape(0) << " vectors" << std::endl;
+                return false;
+            }
             
+            try {
+                // Released in here rather than with call_guard: the array
+                // argument must be released (decref'd) with the GIL held
+                py::gil_scoped_release release;
+                return self.storeVectors(ids, vectors.data(), metadata);
+            } catch (const std::exception& e) {
+                std::cerr << "C++ exception in store_vectors: " << e.what() << std::endl;
+                return false;
+            }
+        }, py::arg("ids"), py::arg("vectors"), py::arg("metadata") = std::vector<std::string>())
+        .def("begin_batch", &VectorClusterStore::beginBatch, py::call_guard<py::gil_scoped_release>())
+        .def("commit_batch", &VectorClusterStore::commitBatch, py::call_guard<py::gil_scoped_release>())
+        .def("sync", &VectorClusterStore::sync, py::call_guard<py::gil_scoped_release>())
+        // (intact, report lines); call on a store that isn't open
+        .def("verify_checksums", [](VectorClusterStore& self, const std::string& path) {
+            std::vector<std::string> report;
+            bool intact;
+            {
+                py::gil_scoped_release release;
+                intact = self.verifyChecksums(path, report);
+            }
+            return py::make_tuple(intact, report);
+        }, py::arg("path"))
+        .def("retrieve_vector", [](VectorClusterStore& self, uint32_t id) {
             try {
                 Vector vec;
                 if (self.retrieveVector(id, vec)) {
@@ -55,7 +371,9 @@ PYBIND11_MODULE(vector_cluster_store_py, m) {
                 std::cerr << "C++ exception in retrieve_vector: " << e.what() << std::endl;
                 return Vector();
             }
-        })
+        }, py::call_guard<py::gil_scoped_release>())
+        // retrieve_vector as a float32 array, empty if the id isn't stored
+        .def("retrieve_vector_array", &retrieveVectorArray<VectorClusterStore>, py::arg("id"))
         .def("get_vector_metadata", [](VectorClusterStore& self, uint32_t id) {
             try {
                 return self.getVectorMetadata(id);
@@ -63,22 +381,197 @@ PYBIND11_MODULE(vector_cluster_store_py, m) {
                 std::cerr << "C++ exception in get_vector_metadata: " << e.what() << std::endl;
                 return std::string("");
             }
-        })
-        .def("find_similar_vectors", [](VectorClusterStore& self, const Vector& query, uint32_t k = 10) {
-            std::cout << "Python binding: find_similar_vectors called with query size=" 
-                      << query.size() << ", k=" << k << std::endl;
-            
+        }, py::call_guard<py::gil_scoped_release>())
+        .def("find_similar_vectors", [](VectorClusterStore& self, const Vector& query, uint32_t k,
+                                        const SearchParams& params) {
             try {
-                return self.findSimilarVectors(query, k);
+                return self.findSimilarVectors(query, k, params);
             } catch (const std::exception& e) {
                 std::cerr << "C++ exception in find_similar_vectors: " << e.what() << std::endl;
                 return std::vector<std::pair<uint32_t, float>>();
             }
-        })
-        .def("delete_vector", &VectorClusterStore::deleteVector)
-        .def("perform_maintenance", &VectorClusterStore::performMaintenance)
-        .def("save_index", &VectorClusterStore::saveIndex)
-        .def("load_index", &VectorClusterStore::loadIndex)
-        .def("print_store_info", &VectorClusterStore::printStoreInfo)
-        .def("print_cluster_info", &VectorClusterStore::printClusterInfo);
+        }, py::arg("query"), py::arg("k") = 10, py::arg("params") = SearchParams(),
+           py::call_guard<py::gil_scoped_release>())
+        // find_similar_vectors returning (results, SearchStats)
+        .def("find_similar_vectors_with_stats", [](VectorClusterStore& self, const Vector& query, uint32_t k,
+                                                   const SearchParams& params) {
+            SearchStats stats;
+            std::vector<std::pair<uint32_t, float>> results;
+            try {
+                results = self.findSimilarVectors(query, k, params, &stats);
+            } catch (const std::exception& e) {
+                std::cerr << "C++ exception in find_similar_vectors_with_stats: " << e.what() << std::endl;
+            }
+            return std::make_pair(results, stats);
+        }, py::arg("query"), py::arg("k") = 10, py::arg("params") = SearchParams(),
+           py::call_guard<py::gil_scoped_release>())
+        .def("find_similar_vectors_batch", [](VectorClusterStore& self,
+                                              py::array_t<float, py::array::c_style | py::array::forcecast> queries,
+                                              uint32_t k, const SearchParams& params) {
+            // One query per row of a 2-D (n, vector_dim) array; returns one
+            // list of (id, similarity) per query
+            if (queries.ndim() != 2) {
+                std::cerr << "Error: find_similar_vectors_batch expects a 2-D array, got "
+                          << queries.ndim() << "-D" << std::endl;
+                return std::vector<std::vector<std::pair<uint32_t, float>>>();
+            }
+            if (static_cast<uint32_t>(queries.shape(1)) != self.getVectorDim()) {
+                std::cerr << "Error: find_similar_vectors_batch got queries of dimension " << queries.shape(1)
+                          << ", store expects " << self.getVectorDim() << std::endl;
+                return std::vector<std::vector<std::pair<uint32_t, float>>>();
+            }
+            
+            try {
+                py::gil_scoped_release release;
+                return self.findSimilarVectorsBatch(queries.data(), static_cast<size_t>(queries.shape(0)), k,
+                                                    params);
+            } catch (const std::exception& e) {
+                std::cerr << "C++ exception in find_similar_vectors_batch: " << e.what() << std::endl;
+                return std::vector<std::vector<std::pair<uint32_t, float>>>();
+            }
+        }, py::arg("queries"), py::arg("k") = 10, py::arg("params") = SearchParams())
+        // The search calls again, taking float32 arrays and returning
+        // (ids, similarities) arrays instead of lists of pairs
+        .def("find_similar_vectors_array", &findSimilarArrays<VectorClusterStore>,
+             py::arg("query"), py::arg("k") = 10, py::arg("params") = SearchParams())
+        .def("find_similar_vectors_batch_array", &findSimilarBatchArrays<VectorClusterStore>,
+             py::arg("queries"), py::arg("k") = 10, py::arg("params") = SearchParams())
+        .def("delete_vector", &VectorClusterStore::deleteVector, py::call_guard<py::gil_scoped_release>())
+        .def("perform_maintenance", &VectorClusterStore::performMaintenance, py::call_guard<py::gil_scoped_release>())
+        .def("train", [](VectorClusterStore& self,
+                         py::array_t<float, py::array::c_style | py::array::forcecast> sample) {
+            // One training vector per row of a 2-D (n, vector_dim) array
+            if (sample.ndim() != 2 || static_cast<uint32_t>(sample.shape(1)) != self.getVectorDim()) {
+                std::cerr << "Error: train expects a 2-D array of shape (n, " << self.getVectorDim()
+                          << ")" << std::endl;
+                return false;
+            }
+            py::gil_scoped_release release;
+            return self.train(sample.data(), static_cast<size_t>(sample.shape(0)));
+        }, py::arg("sample"))
+        .def("maintenance_step", [](VectorClusterStore& self, size_t max_clusters) {
+            return self.maintenanceStep(max_clusters);
+        }, py::arg("max_clusters") = 4, py::call_guard<py::gil_scoped_release>())
+        .def("compact_storage", &VectorClusterStore::compactStorage,
+             py::arg("max_moves") = SIZE_MAX, py::call_guard<py::gil_scoped_release>())
+        .def("save_index", &VectorClusterStore::saveIndex,
+             py::arg("filename"), py::arg("base_filename") = "", py::call_guard<py::gil_scoped_release>())
+        .def("load_index", &VectorClusterStore::loadIndex, py::call_guard<py::gil_scoped_release>())
+        .def("apply_index_delta", &VectorClusterStore::applyIndexDelta, py::call_guard<py::gil_scoped_release>())
+        .def("print_store_info", &VectorClusterStore::printStoreInfo, py::call_guard<py::gil_scoped_release>())
+        .def("print_cluster_info", &VectorClusterStore::printClusterInfo, py::call_guard<py::gil_scoped_release>());
+
+    // One VectorClusterStore per device path, searched in parallel
+    py::class_<ShardedVectorStore>(m, "ShardedVectorStore")
+        // keep_alive<1,2>: the shards hold the Logger by reference, as above
+        .def(py::init<Logger&>(), py::keep_alive<1, 2>())
+        .def("initialize", &ShardedVectorStore::initialize,
+             py::arg("device_paths"), py::arg("strategy_name"), py::arg("vector_dim"),
+             py::arg("max_clusters") = 100, py::arg("options") = StoreOptions(),
+             py::call_guard<py::gil_scoped_release>())
+        .def("get_shard_count", &ShardedVectorStore::getShardCount)
+        .def("get_shard_sizes", &ShardedVectorStore::getShardSizes)
+        .def("store_vector", &storeVectorArray<ShardedVectorStore>,
+             py::arg("id"), py::arg("vector"), py::arg("metadata") = "")
+        .def("store_vector", [](ShardedVectorStore& self, uint32_t id, const std::vector<float>& vec,
+                                const std::string& metadata) {
+            try {
+                return self.storeVector(id, vec, metadata);
+            } catch (const std::exception& e) {
+                std::cerr << "C++ exception in store_vector: " << e.what() << std::endl;
+                return false;
+            }
+        }, py::arg("id"), py::arg("vector"), py::arg("metadata") = "",
+           py::call_guard<py::gil_scoped_release>())
+        .def("store_vectors", [](ShardedVectorStore& self, const std::vector<uint32_t>& ids,
+                                 py::array_t<float, py::array::c_style | py::array::forcecast> vectors,
+                                 const std::vector<std::string>& metadata) {
+            if (vectors.ndim() != 2 || static_cast<uint32_t>(vectors.shape(1)) != self.getVectorDim()) {
+                std::cerr << "Error: store_vectors expects a 2-D array of shape (n, " << self.getVectorDim()
+                          << ")" << std::endl;
+                return false;
+            }
+            if (static_cast<size_t>(vectors.shape(0)) != ids.size()) {
+                std::cerr << "Error: store_vectors got " << ids.size() << " ids for "
+                          << vectors.shape(0) << " vectors" << std::endl;
+                return false;
+            }
+
+            try {
+                py::gil_scoped_release release;
+                return self.storeVectors(ids, vectors.data(), metadata);
+            } catch (const std::exception& e) {
+                std::cerr << "C++ exception in store_vectors: " << e.what() << std::endl;
+                return false;
+            }
+        }, py::arg("ids"), py::arg("vectors"), py::arg("metadata") = std::vector<std::string>())
+        .def("retrieve_vector", [](ShardedVectorStore& self, uint32_t id) {
+            Vector vec;
+            if (!self.retrieveVector(id, vec)) {
+                return Vector();
+            }
+            return vec;
+        }, py::call_guard<py::gil_scoped_release>())
+        .def("retrieve_vector_array", &retrieveVectorArray<ShardedVectorStore>, py::arg("id"))
+        .def("get_vector_metadata", &ShardedVectorStore::getVectorMetadata,
+             py::call_guard<py::gil_scoped_release>())
+        .def("delete_vector", &ShardedVectorStore::deleteVector, py::call_guard<py::gil_scoped_release>())
+        .def("find_similar_vectors", [](ShardedVectorStore& self, const Vector& query, uint32_t k,
+                                        const SearchParams& params) {
+            return self.findSimilarVectors(query, k, params);
+        }, py::arg("query"), py::arg("k") = 10, py::arg("params") = SearchParams(),
+           py::call_guard<py::gil_scoped_release>())
+        .def("find_similar_vectors_with_stats", [](ShardedVectorStore& self, const Vector& query, uint32_t k,
+                                                   const SearchParams& params) {
+            SearchStats stats;
+            auto results = self.findSimilarVectors(query, k, params, &stats);
+            return std::make_pair(results, stats);
+        }, py::arg("query"), py::arg("k") = 10, py::arg("params") = SearchParams(),
+           py::call_guard<py::gil_scoped_release>())
+        .def("find_similar_vectors_batch", [](ShardedVectorStore& self,
+                                              py::array_t<float, py::array::c_style | py::array::forcecast> queries,
+                                              uint32_t k, const SearchParams& params) {
+            if (queries.ndim() != 2 || static_cast<uint32_t>(queries.shape(1)) != self.getVectorDim()) {
+                std::cerr << "Error: find_similar_vectors_batch expects a 2-D array of shape (n, "
+                          << self.getVectorDim() << ")" << std::endl;
+                return std::vector<std::vector<std::pair<uint32_t, float>>>();
+            }
+            py::gil_scoped_release release;
+            return self.findSimilarVectorsBatch(queries.data(), static_cast<size_t>(queries.shape(0)), k, params);
+        }, py::arg("queries"), py::arg("k") = 10, py::arg("params") = SearchParams())
+        .def("find_similar_vectors_array", &findSimilarArrays<ShardedVectorStore>,
+             py::arg("query"), py::arg("k") = 10, py::arg("params") = SearchParams())
+        .def("find_similar_vectors_batch_array", &findSimilarBatchArrays<ShardedVectorStore>,
+             py::arg("queries"), py::arg("k") = 10, py::arg("params") = SearchParams())
+        .def("perform_maintenance", &ShardedVectorStore::performMaintenance,
+             py::call_guard<py::gil_scoped_release>())
+        .def("sync", &ShardedVectorStore::sync, py::call_guard<py::gil_scoped_release>());
+    
+    // The distance kernels (distance.h), with the implementation
+    // VCS_DISTANCE_KERNEL selects when the process first uses one
+    m.def("distance_kernel_name", &distanceKernelName);
+    m.def("dot_product", [](const FloatArray& a, const FloatArray& b) {
+        return sameLength("dot_product", a, b) ? dotProduct(a.data(), b.data(), a.shape(0)) : 0.0f;
+    });
+    m.def("l2_distance_squared", [](const FloatArray& a, const FloatArray& b) {
+        return sameLength("l2_distance_squared", a, b) ? l2DistanceSquared(a.data(), b.data(), a.shape(0))
+                                                       : 0.0f;
+    });
+    // (dot, |a|^2, |b|^2)
+    m.def("dot_product_and_norms", [](const FloatArray& a, const FloatArray& b) {
+        float dot = 0.0f, norm_a_sq = 0.0f, norm_b_sq = 0.0f;
+        if (sameLength("dot_product_and_norms", a, b)) {
+            dotProductAndNorms(a.data(), b.data(), a.shape(0), dot, norm_a_sq, norm_b_sq);
+        }
+        return py::make_tuple(dot, norm_a_sq, norm_b_sq);
+    });
+    m.def("dot_product_u8", [](const FloatArray& a,
+                               const py::array_t<uint8_t, py::array::c_style | py::array::forcecast>& codes) {
+        return sameLength("dot_product_u8", a, codes) ? dotProductU8(a.data(), codes.data(), a.shape(0))
+                                                      : 0.0f;
+    });
+    m.def("cosine_similarity", [](const FloatArray& a, const FloatArray& b) {
+        return sameLength("cosine_similarity", a, b) ? cosineSimilarity(a.data(), b.data(), a.shape(0))
+                                                     : 0.0f;
+    });
 }
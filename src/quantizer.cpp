@@ -0,0 +1,309 @@
+#include "quantizer.h"
+#include "distance.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+
+namespace {
+
+void appendBytes(std::vector<uint8_t>& out, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+bool readBytes(const std::vector<uint8_t>& in, size_t& pos, void* data, size_t size) {
+    if (pos + size > in.size()) {
+        return false;
+    }
+    memcpy(data, in.data() + pos, size);
+    pos += size;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// SQ8: each dimension mapped linearly onto 0..255 over the range seen in
+// training. Decoded x[d] = min[d] + scale[d] * code[d], so
+// dot(q, x) = dot(q, min) + sum((q[d] * scale[d]) * code[d]).
+// ---------------------------------------------------------------------------
+
+class ScalarQuantizer : public Quantizer {
+public:
+    explicit ScalarQuantizer(uint32_t dim) : dim_(dim), min_(dim, 0.0f), scale_(dim, 0.0f) {}
+
+    QuantizationType type() const override { return QuantizationType::SQ8; }
+
+    bool train(const float* samples, size_t count, ThreadPool*) override {
+        if (count == 0) {
+            return false;
+        }
+        std::vector<float> max(dim_, std::numeric_limits<float>::lowest());
+        std::fill(min_.begin(), min_.end(), std::numeric_limits<float>::max());
+        for (size_t i = 0; i < count; i++) {
+            const float* v = samples + i * dim_;
+            for (uint32_t d = 0; d < dim_; d++) {
+                min_[d] = std::min(min_[d], v[d]);
+                max[d] = std::max(max[d], v[d]);
+            }
+        }
+        for (uint32_t d = 0; d < dim_; d++) {
+            scale_[d] = (max[d] - min_[d]) / 255.0f;
+        }
+        return true;
+    }
+
+    size_t codeSize() const override { return dim_; }
+
+    void encode(const float* vector, uint8_t* code) const override {
+        for (uint32_t d = 0; d < dim_; d++) {
+            // Values outside the trained range clamp to its ends
+            float level = scale_[d] > 0.0f ? (vector[d] - min_[d]) / scale_[d] : 0.0f;
+            code[d] = static_cast<uint8_t>(std::clamp(std::lround(level), 0l, 255l));
+        }
+    }
+
+    void prepareQuery(const float* query, std::vector<float>& table) const override {
+        // table[0] is dot(query, min); the rest is the query scaled per dimension
+        table.resize(dim_ + 1);
+        table[0] = dotProduct(query, min_.data(), dim_);
+        for (uint32_t d = 0; d < dim_; d++) {
+            table[d + 1] = query[d] * scale_[d];
+        }
+    }
+
+    void approximateDots(const std::vector<float>& table, const uint8_t* codes,
+                         size_t count, float* out) const override {
+        for (size_t i = 0; i < count; i++) {
+            out[i] = table[0] + dotProductU8(table.data() + 1, codes + i * dim_, dim_);
+        }
+    }
+
+    std::vector<uint8_t> serialize() const override {
+        std::vector<uint8_t> out;
+        appendBytes(out, &dim_, sizeof(dim_));
+        appendBytes(out, min_.data(), dim_ * sizeof(float));
+        appendBytes(out, scale_.data(), dim_ * sizeof(float));
+        return out;
+    }
+
+    bool deserialize(const std::vector<uint8_t>& data) override {
+        size_t pos = 0;
+        uint32_t dim;
+        if (!readBytes(data, pos, &dim, sizeof(dim)) || dim != dim_) {
+            return false;
+        }
+        return readBytes(data, pos, min_.data(), dim_ * sizeof(float)) &&
+               readBytes(data, pos, scale_.data(), dim_ * sizeof(float));
+    }
+
+    std::string getName() const override { return "SQ8"; }
+
+private:
+    uint32_t dim_;
+    std::vector<float> min_;
+    std::vector<float> scale_;
+};
+
+// ---------------------------------------------------------------------------
+// PQ: the vector is split into m subvectors of dsub dimensions and each is
+// replaced by the nearest of (up to) 256 codewords, learned per subspace
+// with k-means. dot(q, x) is the sum over subspaces of
+// dot(q_j, codeword_j[code_j]), read from a per-query table.
+// ---------------------------------------------------------------------------
+
+class ProductQuantizer : public Quantizer {
+public:
+    ProductQuantizer(uint32_t dim, uint32_t subvectors)
+        : dim_(dim), m_(subvectors), dsub_(dim / subvectors), ksub_(0) {}
+
+    QuantizationType type() const override { return QuantizationType::PQ; }
+
+    bool train(const float* samples, size_t count, ThreadPool* pool) override {
+        if (count == 0) {
+            return false;
+        }
+        ksub_ = static_cast<uint32_t>(std::min<size_t>(KSUB, count));
+        codebooks_.assign(static_cast<size_t>(m_) * ksub_ * dsub_, 0.0f);
+
+        // About TRAIN_POINTS_PER_CODEWORD points per codeword is plenty;
+        // more only slows training down
+        size_t stride = std::max<size_t>(1, count / (static_cast<size_t>(ksub_) * TRAIN_POINTS_PER_CODEWORD));
+        std::vector<size_t> rows;
+        for (size_t i = 0; i < count; i += stride) {
+            rows.push_back(i);
+        }
+
+        // Subspaces are independent, so they train in parallel
+        auto train_subspace = [&](size_t j, size_t) {
+            trainSubspace(static_cast<uint32_t>(j), samples, rows);
+        };
+        if (pool) {
+            pool->run(m_, train_subspace);
+        } else {
+            for (uint32_t j = 0; j < m_; j++) {
+                train_subspace(j, 0);
+            }
+        }
+        return true;
+    }
+
+    size_t codeSize() const override { return m_; }
+
+    void encode(const float* vector, uint8_t* code) const override {
+        for (uint32_t j = 0; j < m_; j++) {
+            code[j] = static_cast<uint8_t>(nearestCodeword(j, vector + j * dsub_));
+        }
+    }
+
+    void prepareQuery(const float* query, std::vector<float>& table) const override {
+        table.resize(static_cast<size_t>(m_) * KSUB);
+        for (uint32_t j = 0; j < m_; j++) {
+            for (uint32_t c = 0; c < ksub_; c++) {
+                table[j * KSUB + c] = dotProduct(query + j * dsub_, codeword(j, c), dsub_);
+            }
+        }
+    }
+
+    void approximateDots(const std::vector<float>& table, const uint8_t* codes,
+                         size_t count, float* out) const override {
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t* code = codes + i * m_;
+            float sum = 0.0f;
+            for (uint32_t j = 0; j < m_; j++) {
+                sum += table[j * KSUB + code[j]];
+            }
+            out[i] = sum;
+        }
+    }
+
+    std::vector<uint8_t> serialize() const override {
+        std::vector<uint8_t> out;
+        appendBytes(out, &dim_, sizeof(dim_));
+        appendBytes(out, &m_, sizeof(m_));
+        appendBytes(out, &ksub_, sizeof(ksub_));
+        appendBytes(out, codebooks_.data(), codebooks_.size() * sizeof(float));
+        return out;
+    }
+
+    bool deserialize(const std::vector<uint8_t>& data) override {
+        size_t pos = 0;
+        uint32_t dim, m, ksub;
+        if (!readBytes(data, pos, &dim, sizeof(dim)) || !readBytes(data, pos, &m, sizeof(m)) ||
+            !readBytes(data, pos, &ksub, sizeof(ksub)) ||
+            dim != dim_ || m != m_ || ksub == 0 || ksub > KSUB) {
+            return false;
+        }
+        ksub_ = ksub;
+        codebooks_.resize(static_cast<size_t>(m_) * ksub_ * dsub_);
+        return readBytes(data, pos, codebooks_.data(), codebooks_.size() * sizeof(float));
+    }
+
+    std::string getName() const override { return "PQ" + std::to_string(m_) + "x8"; }
+
+private:
+    static constexpr uint32_t KSUB = 256;
+    static constexpr size_t TRAIN_POINTS_PER_CODEWORD = 64;
+    static constexpr int TRAIN_ITERATIONS = 10;
+
+    uint32_t dim_;
+    uint32_t m_;
+    uint32_t dsub_;
+    uint32_t ksub_;
+    std::vector<float> codebooks_;  // [m][ksub][dsub]
+
+    const float* codeword(uint32_t j, uint32_t c) const {
+        return codebooks_.data() + (static_cast<size_t>(j) * ksub_ + c) * dsub_;
+    }
+
+    uint32_t nearestCodeword(uint32_t j, const float* sub) const {
+        uint32_t best = 0;
+        float best_distance = std::numeric_limits<float>::max();
+        for (uint32_t c = 0; c < ksub_; c++) {
+            float distance = l2DistanceSquared(sub, codeword(j, c), dsub_);
+            if (distance < best_distance) {
+                best_distance = distance;
+                best = c;
+            }
+        }
+        return best;
+    }
+
+    void trainSubspace(uint32_t j, const float* samples, const std::vector<size_t>& rows) {
+        float* codebook = codebooks_.data() + static_cast<size_t>(j) * ksub_ * dsub_;
+        auto sub = [&](size_t row) { return samples + rows[row] * dim_ + j * dsub_; };
+
+        // Seed from distinct sample points, then Lloyd iterations. Empty
+        // codewords are reseeded from a random point.
+        std::mt19937 rng(j + 1);
+        std::vector<size_t> order(rows.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::shuffle(order.begin(), order.end(), rng);
+        for (uint32_t c = 0; c < ksub_; c++) {
+            memcpy(codebook + c * dsub_, sub(order[c % order.size()]), dsub_ * sizeof(float));
+        }
+
+        std::vector<uint32_t> assignment(rows.size());
+        std::vector<float> sums(static_cast<size_t>(ksub_) * dsub_);
+        std::vector<uint32_t> counts(ksub_);
+        for (int iteration = 0; iteration < TRAIN_ITERATIONS; iteration++) {
+            for (size_t i = 0; i < rows.size(); i++) {
+                assignment[i] = nearestCodeword(j, sub(i));
+            }
+            std::fill(sums.begin(), sums.end(), 0.0f);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (size_t i = 0; i < rows.size(); i++) {
+                const float* v = sub(i);
+                float* sum = sums.data() + assignment[i] * dsub_;
+                for (uint32_t d = 0; d < dsub_; d++) {
+                    sum[d] += v[d];
+                }
+                counts[assignment[i]]++;
+            }
+            for (uint32_t c = 0; c < ksub_; c++) {
+                if (counts[c] == 0) {
+                    memcpy(codebook + c * dsub_, sub(rng() % rows.size()), dsub_ * sizeof(float));
+                    continue;
+                }
+                for (uint32_t d = 0; d < dsub_; d++) {
+                    codebook[c * dsub_ + d] = sums[c * dsub_ + d] / counts[c];
+                }
+            }
+        }
+    }
+};
+
+} // namespace
+
+std::unique_ptr<Quantizer> createQuantizer(QuantizationType type, uint32_t dim,
+                                           uint32_t pq_subvectors) {
+    switch (type) {
+    case QuantizationType::SQ8:
+        return std::unique_ptr<Quantizer>(new ScalarQuantizer(dim));
+    case QuantizationType::PQ: {
+        uint32_t m = pq_subvectors != 0 ? std::min(pq_subvectors, dim) : std::max(1u, dim / 8);
+        while (dim % m != 0) {
+            m--;
+        }
+        return std::unique_ptr<Quantizer>(new ProductQuantizer(dim, m));
+    }
+    case QuantizationType::NONE:
+        break;
+    }
+    return nullptr;
+}
+
+const char* quantizationTypeName(QuantizationType type) {
+    switch (type) {
+    case QuantizationType::SQ8:
+        return "sq8";
+    case QuantizationType::PQ:
+        return "pq";
+    case QuantizationType::NONE:
+        break;
+    }
+    return "none";
+}
@@ -0,0 +1,62 @@
+#ifndef QUANTIZER_H
+#define QUANTIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// Compact vector codes scanned ahead of the full-precision vectors
+enum class QuantizationType : uint32_t {
+    NONE = 0,
+    SQ8 = 1,   // one byte per dimension (4x smaller than float)
+    PQ = 2     // one byte per subvector (e.g. 32x smaller with dim/8 subvectors)
+};
+
+// Abstract base class for quantizers. A quantizer is trained on a sample
+// of vectors, then encodes each vector into codeSize() bytes. Searches
+// never decode: prepareQuery() turns the query into lookup data once, and
+// approximateDots() scores codes against it directly.
+//
+// The const methods are called from concurrent searches.
+class Quantizer {
+public:
+    virtual ~Quantizer() = default;
+
+    virtual QuantizationType type() const = 0;
+
+    // Fit the codec to count sample rows of dim floats. pool may be null.
+    virtual bool train(const float* samples, size_t count, ThreadPool* pool) = 0;
+
+    // Bytes per encoded vector
+    virtual size_t codeSize() const = 0;
+
+    virtual void encode(const float* vector, uint8_t* code) const = 0;
+
+    // Per-query lookup data for approximateDots
+    virtual void prepareQuery(const float* query, std::vector<float>& table) const = 0;
+
+    // out[i] = approximate dot(query, vector i) for count consecutive codes
+    virtual void approximateDots(const std::vector<float>& table, const uint8_t* codes,
+                                 size_t count, float* out) const = 0;
+
+    // Trained parameters
+    virtual std::vector<uint8_t> serialize() const = 0;
+    virtual bool deserialize(const std::vector<uint8_t>& data) = 0;
+
+    virtual std::string getName() const = 0;
+};
+
+// Untrained quantizer of the given type for dim-dimensional vectors, or
+// nullptr for NONE. pq_subvectors is the number of PQ subvectors (0 picks
+// dim / 8); it is lowered to the nearest divisor of dim.
+std::unique_ptr<Quantizer> createQuantizer(QuantizationType type, uint32_t dim,
+                                           uint32_t pq_subvectors = 0);
+
+// "none", "sq8" or "pq"
+const char* quantizationTypeName(QuantizationType type);
+
+#endif // QUANTIZER_H
@@ -0,0 +1,488 @@
+#include "sharded_vector_store.h"
+#include "distance.h"
+#include "logger.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <unordered_set>
+
+namespace {
+
+// Best k of results gathered from several shards, best first. A vector is
+// on one shard only, so there are no duplicates to drop.
+std::vector<std::pair<uint32_t, float>> mergeResults(
+    std::vector<std::vector<std::pair<uint32_t, float>>>& shard_results, uint32_t k) {
+    std::vector<std::pair<uint32_t, float>> merged;
+    for (auto& results : shard_results) {
+        merged.insert(merged.end(), results.begin(), results.end());
+    }
+    auto better = [](const std::pair<uint32_t, float>& a, const std::pair<uint32_t, float>& b) {
+        return a.second > b.second;
+    };
+    if (merged.size() > k) {
+        std::partial_sort(merged.begin(), merged.begin() + k, merged.end(), better);
+        merged.resize(k);
+    } else {
+        std::sort(merged.begin(), merged.end(), better);
+    }
+    return merged;
+}
+
+} // namespace
+
+ShardedVectorStore::ShardedVectorStore(Logger& logger)
+    : logger_(logger), vector_dim_(0), clusters_per_shard_(0), normalize_vectors_(false) {}
+
+ShardedVectorStore::~ShardedVectorStore() = default;
+
+bool ShardedVectorStore::initialize(const std::vector<std::string>& device_paths,
+                                    const std::string& strategy_name,
+                                    uint32_t vector_dim,
+                                    uint32_t max_clusters,
+                                    const StoreOptions& options) {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    if (device_paths.empty()) {
+        logger_.error("A sharded store needs at least one device path");
+        return false;
+    }
+    if (!shards_.empty()) {
+        logger_.error("Sharded store is already initialized");
+        return false;
+    }
+
+    const size_t count = device_paths.size();
+    clusters_per_shard_ = std::max<uint32_t>(1, static_cast<uint32_t>((max_clusters + count - 1) / count));
+    fanout_pool_ = std::make_unique<ThreadPool>(count);
+
+    // Shards open in parallel; each reads its own maps
+    std::vector<std::unique_ptr<VectorClusterStore>> shards(count);
+    std::vector<uint8_t> opened(count, 0);
+    fanout_pool_->run(count, [&](size_t shard, size_t) {
+        shards[shard] = std::make_unique<VectorClusterStore>(logger_);
+        opened[shard] = shards[shard]->initialize(device_paths[shard], strategy_name, vector_dim,
+                                                  clusters_per_shard_, options);
+    });
+    for (size_t shard = 0; shard < count; shard++) {
+        if (!opened[shard]) {
+            logger_.error("Failed to open shard " + std::to_string(shard) + " at " + device_paths[shard]);
+            return false;
+        }
+        if (shards[shard]->getVectorDim() != shards[0]->getVectorDim()) {
+            logger_.error("Shard " + std::to_string(shard) + " holds vectors of dimension " +
+                         std::to_string(shards[shard]->getVectorDim()) + ", shard 0 of " +
+                         std::to_string(shards[0]->getVectorDim()));
+            return false;
+        }
+    }
+    shards_ = std::move(shards);
+    vector_dim_ = shards_[0]->getVectorDim();
+    normalize_vectors_ = shards_[0]->getOptions().normalize_vectors;
+
+    // Which shard holds what, from the shards themselves
+    vector_shards_.clear();
+    shard_sizes_.assign(count, 0);
+    writes_since_refresh_.assign(count, 0);
+    for (uint32_t shard = 0; shard < count; shard++) {
+        for (uint32_t vector_id : shards_[shard]->getVectorIds()) {
+            if (!vector_shards_.emplace(vector_id, shard).second) {
+                logger_.warning("Vector " + std::to_string(vector_id) + " is on shards " +
+                              std::to_string(vector_shards_[vector_id]) + " and " +
+                              std::to_string(shard) + ", reading it from the first");
+            }
+        }
+        shard_sizes_[shard] = shards_[shard]->getVectorCount();
+        refreshCentroids(shard);
+    }
+
+    logger_.info("Sharded store initialized: " + std::to_string(count) + " shards, " +
+                std::to_string(vector_shards_.size()) + " vectors, " +
+                std::to_string(clusters_per_shard_) + " clusters per shard");
+    return true;
+}
+
+bool ShardedVectorStore::storeVector(uint32_t vector_id, const Vector& vector,
+                                     const std::string& metadata) {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    if (shards_.empty()) {
+        logger_.error("Sharded store not initialized");
+        return false;
+    }
+    if (vector.size() != vector_dim_) {
+        logger_.error("Vector dimension mismatch: expected " + std::to_string(vector_dim_) +
+                     ", got " + std::to_string(vector.size()));
+        return false;
+    }
+
+    auto it = vector_shards_.find(vector_id);
+    const bool existing = it != vector_shards_.end();
+    const uint32_t shard = existing ? it->second : routeVector(vector.data());
+    if (!shards_[shard]->storeVector(vector_id, vector, metadata)) {
+        return false;
+    }
+    if (!existing) {
+        vector_shards_[vector_id] = shard;
+        shard_sizes_[shard]++;
+    }
+    noteWrite(shard);
+    return true;
+}
+
+bool ShardedVectorStore::storeVectors(const std::vector<uint32_t>& vector_ids, const float* data,
+                                      const std::vector<std::string>& metadata) {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    if (shards_.empty()) {
+        logger_.error("Sharded store not initialized");
+        return false;
+    }
+    if (!metadata.empty() && metadata.size() != vector_ids.size()) {
+        logger_.error("Metadata count " + std::to_string(metadata.size()) + " doesn't match " +
+                     std::to_string(vector_ids.size()) + " vectors");
+        return false;
+    }
+
+    // Split the batch by shard. New ids are routed one after another, each
+    // counting towards its shard's size, so a batch spreads out like the
+    // same vectors stored one at a time.
+    struct ShardBatch {
+        std::vector<uint32_t> ids;
+        std::vector<float> rows;
+        std::vector<std::string> metadata;
+        std::vector<uint32_t> new_ids;
+    };
+    std::vector<ShardBatch> batches(shards_.size());
+    std::unordered_map<uint32_t, uint32_t> routed;
+    for (size_t i = 0; i < vector_ids.size(); i++) {
+        const float* row = data + i * vector_dim_;
+        uint32_t shard;
+        auto it = vector_shards_.find(vector_ids[i]);
+        auto batched = routed.find(vector_ids[i]);
+        if (it != vector_shards_.end()) {
+            shard = it->second;
+        } else if (batched != routed.end()) {
+            shard = batched->second;
+        } else {
+            shard = routeVector(row);
+            routed[vector_ids[i]] = shard;
+            batches[shard].new_ids.push_back(vector_ids[i]);
+            shard_sizes_[shard]++;
+        }
+        ShardBatch& batch = batches[shard];
+        batch.ids.push_back(vector_ids[i]);
+        batch.rows.insert(batch.rows.end(), row, row + vector_dim_);
+        if (!metadata.empty()) {
+            batch.metadata.push_back(metadata[i]);
+        }
+    }
+
+    std::vector<uint8_t> stored(shards_.size(), 1);
+    fanout_pool_->run(shards_.size(), [&](size_t shard, size_t) {
+        if (!batches[shard].ids.empty()) {
+            stored[shard] = shards_[shard]->storeVectors(batches[shard].ids, batches[shard].rows.data(),
+                                                         batches[shard].metadata);
+        }
+    });
+
+    bool all_stored = true;
+    for (uint32_t shard = 0; shard < shards_.size(); shard++) {
+        ShardBatch& batch = batches[shard];
+        if (batch.ids.empty()) {
+            continue;
+        }
+        if (stored[shard]) {
+            for (uint32_t vector_id : batch.new_ids) {
+                vector_shards_[vector_id] = shard;
+            }
+        } else {
+            // Keep whatever of the batch the shard did take
+            logger_.error("Shard " + std::to_string(shard) + " failed to store its part of the batch");
+            std::vector<uint32_t> held = shards_[shard]->getVectorIds();
+            std::unordered_set<uint32_t> present(held.begin(), held.end());
+            for (uint32_t vector_id : batch.new_ids) {
+                if (present.count(vector_id) > 0) {
+                    vector_shards_[vector_id] = shard;
+                }
+            }
+            all_stored = false;
+        }
+        shard_sizes_[shard] = shards_[shard]->getVectorCount();
+        refreshCentroids(shard);
+    }
+    return all_stored;
+}
+
+bool ShardedVectorStore::storeVectors(const std::vector<uint32_t>& vector_ids,
+                                      const std::vector<Vector>& vectors,
+                                      const std::vector<std::string>& metadata) {
+    if (vector_ids.size() != vectors.size()) {
+        logger_.error("Got " + std::to_string(vector_ids.size()) + " ids for " +
+                     std::to_string(vectors.size()) + " vectors");
+        return false;
+    }
+    std::vector<float> rows;
+    rows.reserve(vectors.size() * vector_dim_);
+    for (const Vector& vector : vectors) {
+        if (vector.size() != vector_dim_) {
+            logger_.error("Vector dimension mismatch: expected " + std::to_string(vector_dim_) +
+                         ", got " + std::to_string(vector.size()));
+            return false;
+        }
+        rows.insert(rows.end(), vector.begin(), vector.end());
+    }
+    return storeVectors(vector_ids, rows.data(), metadata);
+}
+
+bool ShardedVectorStore::retrieveVector(uint32_t vector_id, Vector& vector) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = vector_shards_.find(vector_id);
+    if (it == vector_shards_.end()) {
+        logger_.error("Vector " + std::to_string(vector_id) + " not found");
+        return false;
+    }
+    return shards_[it->second]->retrieveVector(vector_id, vector);
+}
+
+bool ShardedVectorStore::retrieveVector(uint32_t vector_id, float* vector) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = vector_shards_.find(vector_id);
+    if (it == vector_shards_.end()) {
+        logger_.error("Vector " + std::to_string(vector_id) + " not found");
+        return false;
+    }
+    return shards_[it->second]->retrieveVector(vector_id, vector);
+}
+
+std::string ShardedVectorStore::getVectorMetadata(uint32_t vector_id) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = vector_shards_.find(vector_id);
+    if (it == vector_shards_.end()) {
+        return "";
+    }
+    return shards_[it->second]->getVectorMetadata(vector_id);
+}
+
+bool ShardedVectorStore::deleteVector(uint32_t vector_id) {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    auto it = vector_shards_.find(vector_id);
+    if (it == vector_shards_.end()) {
+        logger_.error("Vector " + std::to_string(vector_id) + " not found");
+        return false;
+    }
+    const uint32_t shard = it->second;
+    if (!shards_[shard]->deleteVector(vector_id)) {
+        return false;
+    }
+    vector_shards_.erase(it);
+    shard_sizes_[shard]--;
+    noteWrite(shard);
+    return true;
+}
+
+std::vector<std::pair<uint32_t, float>> ShardedVectorStore::findSimilarVectors(const Vector& query,
+                                                                               uint32_t k) {
+    return findSimilarVectors(query, k, SearchParams());
+}
+
+std::vector<std::pair<uint32_t, float>> ShardedVectorStore::findSimilarVectors(
+    const Vector& query, uint32_t k, const SearchParams& params, SearchStats* stats) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (stats) {
+        *stats = SearchStats();
+    }
+    if (shards_.empty() || query.size() != vector_dim_) {
+        logger_.error("Query dimension mismatch: expected " + std::to_string(vector_dim_) +
+                     ", got " + std::to_string(query.size()));
+        return {};
+    }
+
+    // With nprobe, only the shards owning the nprobe nearest centroids
+    std::vector<uint32_t> asked;
+    if (params.nprobe > 0 && !centroids_.empty()) {
+        Vector routed = query;
+        if (normalize_vectors_) {
+            float norm = std::sqrt(dotProduct(routed.data(), routed.data(), vector_dim_));
+            if (norm > 0.0f) {
+                for (float& value : routed) {
+                    value /= norm;
+                }
+            }
+        }
+        std::vector<uint8_t> wanted(shards_.size(), 0);
+        for (uint32_t row : nearestCentroids(routed.data(), params.nprobe)) {
+            wanted[centroid_shards_[row]] = 1;
+        }
+        for (uint32_t shard = 0; shard < shards_.size(); shard++) {
+            if (wanted[shard]) {
+                asked.push_back(shard);
+            }
+        }
+    } else {
+        for (uint32_t shard = 0; shard < shards_.size(); shard++) {
+            asked.push_back(shard);
+        }
+    }
+
+    std::vector<std::vector<std::pair<uint32_t, float>>> results(asked.size());
+    std::vector<SearchStats> shard_stats(asked.size());
+    fanout_pool_->run(asked.size(), [&](size_t task, size_t) {
+        results[task] = shards_[asked[task]]->findSimilarVectors(query, k, params, &shard_stats[task]);
+    });
+
+    if (stats) {
+        for (const SearchStats& shard : shard_stats) {
+            stats->clusters_scanned += shard.clusters_scanned;
+            stats->vectors_scanned += shard.vectors_scanned;
+            stats->codes_scored += shard.codes_scored;
+            stats->deadline_reached = stats->deadline_reached || shard.deadline_reached;
+        }
+    }
+    return mergeResults(results, k);
+}
+
+std::vector<std::vector<std::pair<uint32_t, float>>> ShardedVectorStore::findSimilarVectorsBatch(
+    const float* queries, size_t count, uint32_t k, const SearchParams& params) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<std::vector<std::vector<std::pair<uint32_t, float>>>> shard_results(shards_.size());
+    fanout_pool_->run(shards_.size(), [&](size_t shard, size_t) {
+        shard_results[shard] = shards_[shard]->findSimilarVectorsBatch(queries, count, k, params);
+    });
+
+    std::vector<std::vector<std::pair<uint32_t, float>>> results(count);
+    for (size_t q = 0; q < count; q++) {
+        std::vector<std::vector<std::pair<uint32_t, float>>> per_shard;
+        for (auto& shard : shard_results) {
+            if (q < shard.size()) {
+                per_shard.push_back(std::move(shard[q]));
+            }
+        }
+        results[q] = mergeResults(per_shard, k);
+    }
+    return results;
+}
+
+bool ShardedVectorStore::performMaintenance() {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    std::vector<uint8_t> maintained(shards_.size(), 0);
+    fanout_pool_->run(shards_.size(), [&](size_t shard, size_t) {
+        maintained[shard] = shards_[shard]->performMaintenance();
+    });
+    bool all_maintained = true;
+    for (uint32_t shard = 0; shard < shards_.size(); shard++) {
+        if (!maintained[shard]) {
+            logger_.error("Maintenance failed on shard " + std::to_string(shard));
+            all_maintained = false;
+        }
+        refreshCentroids(shard);
+    }
+    return all_maintained;
+}
+
+bool ShardedVectorStore::sync() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<uint8_t> synced(shards_.size(), 0);
+    fanout_pool_->run(shards_.size(), [&](size_t shard, size_t) {
+        synced[shard] = shards_[shard]->sync();
+    });
+    bool all_synced = true;
+    for (uint32_t shard = 0; shard < shards_.size(); shard++) {
+        if (!synced[shard]) {
+            logger_.error("Sync failed on shard " + std::to_string(shard));
+            all_synced = false;
+        }
+    }
+    return all_synced;
+}
+
+std::vector<size_t> ShardedVectorStore::getShardSizes() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return shard_sizes_;
+}
+
+uint32_t ShardedVectorStore::routeVector(const float* vector) const {
+    uint32_t least_loaded = 0;
+    size_t total = 0;
+    bool seeding = false;
+    for (uint32_t shard = 0; shard < shards_.size(); shard++) {
+        if (shard_sizes_[shard] < shard_sizes_[least_loaded]) {
+            least_loaded = shard;
+        }
+        total += shard_sizes_[shard];
+        seeding = seeding || shard_sizes_[shard] < clusters_per_shard_;
+    }
+    // A shard's first vectors seed its clusters; spread them evenly so
+    // every shard starts from a sample of the data
+    if (seeding || centroids_.empty()) {
+        return least_loaded;
+    }
+
+    Vector normalized;
+    if (normalize_vectors_) {
+        normalized.assign(vector, vector + vector_dim_);
+        float norm = std::sqrt(dotProduct(vector, vector, vector_dim_));
+        if (norm > 0.0f) {
+            for (float& value : normalized) {
+                value /= norm;
+            }
+        }
+        vector = normalized.data();
+    }
+
+    const double limit = SHARD_IMBALANCE * static_cast<double>(total) / shards_.size() + clusters_per_shard_;
+    for (uint32_t row : nearestCentroids(vector, ROUTING_CANDIDATES)) {
+        const uint32_t shard = centroid_shards_[row];
+        if (shard_sizes_[shard] <= limit) {
+            return shard;
+        }
+    }
+    return least_loaded;
+}
+
+std::vector<uint32_t> ShardedVectorStore::nearestCentroids(const float* vector, uint32_t n) const {
+    const size_t rows = centroid_shards_.size();
+    std::vector<std::pair<float, uint32_t>> distances(rows);
+    for (size_t row = 0; row < rows; row++) {
+        distances[row] = {l2DistanceSquared(vector, centroids_.data() + row * vector_dim_, vector_dim_),
+                          static_cast<uint32_t>(row)};
+    }
+    const size_t keep = std::min<size_t>(n, rows);
+    std::partial_sort(distances.begin(), distances.begin() + keep, distances.end());
+    std::vector<uint32_t> nearest;
+    nearest.reserve(keep);
+    for (size_t i = 0; i < keep; i++) {
+        nearest.push_back(distances[i].second);
+    }
+    return nearest;
+}
+
+void ShardedVectorStore::refreshCentroids(uint32_t shard) {
+    // Drop the shard's old rows, then append its current centroids
+    size_t kept = 0;
+    for (size_t row = 0; row < centroid_shards_.size(); row++) {
+        if (centroid_shards_[row] == shard) {
+            continue;
+        }
+        if (kept != row) {
+            std::copy(centroids_.begin() + row * vector_dim_, centroids_.begin() + (row + 1) * vector_dim_,
+                      centroids_.begin() + kept * vector_dim_);
+            centroid_shards_[kept] = centroid_shards_[row];
+        }
+        kept++;
+    }
+    centroid_shards_.resize(kept);
+    centroids_.resize(kept * vector_dim_);
+
+    for (const auto& [cluster_id, centroid] : shards_[shard]->getClusterCentroids()) {
+        centroids_.insert(centroids_.end(), centroid.begin(), centroid.end());
+        centroid_shards_.push_back(shard);
+    }
+    writes_since_refresh_[shard] = 0;
+}
+
+void ShardedVectorStore::noteWrite(uint32_t shard) {
+    // While a shard is still seeding its clusters every write adds one
+    if (++writes_since_refresh_[shard] >= ROUTING_REFRESH_WRITES ||
+        shard_sizes_[shard] <= clusters_per_shard_) {
+        refreshCentroids(shard);
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef SHARDED_VECTOR_STORE_H
+#define SHARDED_VECTOR_STORE_H
+
+#include "vector_cluster_store.h"
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Logger;
+class ThreadPool;
+
+// A store spread over several devices or files, with one VectorClusterStore
+// (a shard) on each, so capacity and I/O bandwidth grow with the number of
+// drives. Every shard is a complete store of its own; nothing is written
+// outside them, and reopening the same paths (in any order) restores the
+// sharded store.
+//
+// Clusters are placed across the shards: each shard clusters the vectors
+// it holds, and the sharded store routes by a shared table of every
+// shard's centroids. A new vector goes to the shard owning the centroid
+// nearest to it, unless that shard already holds far more than its share;
+// until every shard has seeded its clusters, vectors go to the shard with
+// the fewest. A stored id stays on its shard when it is overwritten.
+//
+// Searches fan out to the shards in parallel, one thread per shard, and
+// merge their top-k. With SearchParams::nprobe set only the shards owning
+// the nprobe nearest centroids are asked; otherwise every shard is.
+//
+// Thread-safe: searches and reads run concurrently, writes are serialized.
+class ShardedVectorStore {
+public:
+    ShardedVectorStore(Logger& logger);
+    ~ShardedVectorStore();
+
+    // Open or create one shard per path. max_clusters is split evenly over
+    // the shards; options apply to each of them.
+    bool initialize(const std::vector<std::string>& device_paths,
+                    const std::string& strategy_name,
+                    uint32_t vector_dim,
+                    uint32_t max_clusters = 100,
+                    const StoreOptions& options = StoreOptions());
+
+    bool storeVector(uint32_t vector_id, const Vector& vector, const std::string& metadata = "");
+    // Rows of vector_dim floats, stored with one storeVectors per shard,
+    // the shards in parallel
+    bool storeVectors(const std::vector<uint32_t>& vector_ids, const float* data,
+                      const std::vector<std::string>& metadata = {});
+    bool storeVectors(const std::vector<uint32_t>& vector_ids, const std::vector<Vector>& vectors,
+                      const std::vector<std::string>& metadata = {});
+
+    bool retrieveVector(uint32_t vector_id, Vector& vector);
+    bool retrieveVector(uint32_t vector_id, float* vector);
+    std::string getVectorMetadata(uint32_t vector_id);
+    bool deleteVector(uint32_t vector_id);
+
+    std::vector<std::pair<uint32_t, float>> findSimilarVectors(const Vector& query, uint32_t k = 10);
+    // stats, if given, sums what the shards asked did
+    std::vector<std::pair<uint32_t, float>> findSimilarVectors(
+        const Vector& query, uint32_t k, const SearchParams& params, SearchStats* stats = nullptr);
+    // Every shard runs the whole batch, sharing its I/O between the queries
+    std::vector<std::vector<std::pair<uint32_t, float>>> findSimilarVectorsBatch(
+        const float* queries, size_t count, uint32_t k = 10,
+        const SearchParams& params = SearchParams());
+
+    // performMaintenance on every shard, in parallel
+    bool performMaintenance();
+    // sync on every shard, in parallel
+    bool sync();
+
+    size_t getShardCount() const { return shards_.size(); }
+    uint32_t getVectorDim() const { return vector_dim_; }
+    // Vectors held by each shard, in path order
+    std::vector<size_t> getShardSizes() const;
+
+private:
+    // The routing table is refreshed from a shard after this many single
+    // writes to it, and after every batch
+    static constexpr size_t ROUTING_REFRESH_WRITES = 1024;
+    // Nearest centroids tried when a vector's nearest shard is too full
+    static constexpr uint32_t ROUTING_CANDIDATES = 4;
+    // A shard holding more than this times the mean shard size (plus its
+    // cluster count) takes no new vectors by centroid
+    static constexpr double SHARD_IMBALANCE = 1.5;
+
+    Logger& logger_;
+    std::vector<std::unique_ptr<VectorClusterStore>> shards_;
+    uint32_t vector_dim_;
+    uint32_t clusters_per_shard_;
+    bool normalize_vectors_;
+    // One thread per shard for fan-out
+    std::unique_ptr<ThreadPool> fanout_pool_;
+
+    // Shared centroid table: every shard's centroids, rows of vector_dim
+    // floats, with the shard owning each row
+    std::vector<float> centroids_;
+    std::vector<uint32_t> centroid_shards_;
+    std::vector<size_t> writes_since_refresh_;
+
+    // Which shard holds each vector, and how many each holds
+    std::unordered_map<uint32_t, uint32_t> vector_shards_;
+    std::vector<size_t> shard_sizes_;
+
+    // Shared by searches and reads, exclusive for writes
+    mutable std::shared_mutex mutex_;
+
+    // Shard for a new vector; mutex_ held exclusively
+    uint32_t routeVector(const float* vector) const;
+    // Rows of the centroid table nearest to vector, nearest first
+    std::vector<uint32_t> nearestCentroids(const float* vector, uint32_t n) const;
+    // Reload the shard's rows of the centroid table
+    void refreshCentroids(uint32_t shard);
+    // Note a single write to a shard, refreshing its centroids when due
+    void noteWrite(uint32_t shard);
+};
+
+#endif // SHARDED_VECTOR_STORE_H
@@ -0,0 +1,242 @@
+#include "store_metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+// Upper bounds of the Prometheus histogram buckets, in seconds
+constexpr double EXPORT_BOUNDS[] = {1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3, 1e-2,
+                                    2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+
+std::string number(double value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.9g", value);
+    return text;
+}
+
+void header(std::string& out, const std::string& name, const char* type, const char* help) {
+    out += "# HELP " + name + " " + help + "\n";
+    out += "# TYPE " + name + " " + type + "\n";
+}
+
+void sample(std::string& out, const std::string& name, const std::string& labels, const std::string& value) {
+    out += name;
+    if (!labels.empty()) {
+        out += "{" + labels + "}";
+    }
+    out += " " + value + "\n";
+}
+
+void sample(std::string& out, const std::string& name, const std::string& labels, uint64_t value) {
+    sample(out, name, labels, std::to_string(value));
+}
+
+}  // namespace
+
+IoCounters*& IoCounters::current() {
+    static thread_local IoCounters* counters = nullptr;
+    return counters;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    buckets_[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t max = max_ns_.load(std::memory_order_relaxed);
+    while (ns > max && !max_ns_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t ns) {
+    if (ns < (uint64_t(2) << SUB_BITS)) {
+        return static_cast<size_t>(ns);
+    }
+    const int msb = 63 - __builtin_clzll(ns);
+    if (msb >= MAX_BITS) {
+        return BUCKETS - 1;
+    }
+    // The top SUB_BITS bits below the leading one pick the sub-bucket
+    const int shift = msb - SUB_BITS;
+    return (static_cast<size_t>(msb - SUB_BITS + 1) << SUB_BITS) +
+           static_cast<size_t>((ns >> shift) - (uint64_t(1) << SUB_BITS));
+}
+
+uint64_t LatencyHistogram::bucketTop(size_t bucket) {
+    if (bucket < (size_t(2) << SUB_BITS)) {
+        return bucket;
+    }
+    const int shift = static_cast<int>(bucket >> SUB_BITS) - 1;
+    const uint64_t sub = bucket & ((size_t(1) << SUB_BITS) - 1);
+    return (((uint64_t(1) << SUB_BITS) + sub) << shift) + (uint64_t(1) << shift) - 1;
+}
+
+uint64_t LatencyHistogram::percentileNs(double q) const {
+    // Counted from the buckets, which a concurrent record() may be ahead
+    // of count_ in
+    uint64_t total = 0;
+    for (const auto& bucket : buckets_) {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * total)));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < BUCKETS; b++) {
+        seen += buckets_[b].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(bucketTop(b), maxNs());
+        }
+    }
+    return maxNs();
+}
+
+uint64_t LatencyHistogram::countAtOrBelow(uint64_t ns) const {
+    uint64_t total = 0;
+    for (size_t b = 0; b < BUCKETS && bucketTop(b) <= ns; b++) {
+        total += buckets_[b].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+StoreMetrics::Scope::Scope(StoreMetrics& metrics, Operation operation)
+    : metrics_(metrics.owns(IoCounters::current()) ? nullptr : &metrics),
+      operation_(operation),
+      start_(metrics_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point()),
+      io_(metrics_ ? &metrics.operations_[operation].io : IoCounters::current()) {}
+
+StoreMetrics::Scope::~Scope() {
+    if (metrics_) {
+        const auto elapsed = std::chrono::steady_clock::now() - start_;
+        metrics_->operations_[operation_].latency.record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+}
+
+const char* StoreMetrics::operationName(Operation operation) {
+    switch (operation) {
+        case STORE:        return "store";
+        case STORE_BATCH:  return "store_batch";
+        case RETRIEVE:     return "retrieve";
+        case SEARCH:       return "search";
+        case SEARCH_BATCH: return "search_batch";
+        case REMOVE:       return "remove";
+        case MAINTENANCE:  return "maintenance";
+        default:           return "other";
+    }
+}
+
+OperationStats StoreMetrics::operationStats(Operation operation) const {
+    const OperationMetrics& metrics = operations_[operation];
+    const LatencyHistogram& latency = metrics.latency;
+    OperationStats stats;
+    stats.count = latency.count();
+    if (stats.count > 0) {
+        stats.mean_us = latency.sumNs() / 1e3 / stats.count;
+        stats.p50_us = latency.percentileNs(0.5) / 1e3;
+        stats.p90_us = latency.percentileNs(0.9) / 1e3;
+        stats.p99_us = latency.percentileNs(0.99) / 1e3;
+        stats.p999_us = latency.percentileNs(0.999) / 1e3;
+        stats.max_us = latency.maxNs() / 1e3;
+    }
+    stats.reads = metrics.io.reads.load(std::memory_order_relaxed);
+    stats.writes = metrics.io.writes.load(std::memory_order_relaxed);
+    stats.bytes_read = metrics.io.bytes_read.load(std::memory_order_relaxed);
+    stats.bytes_written = metrics.io.bytes_written.load(std::memory_order_relaxed);
+    return stats;
+}
+
+StoreStats StoreMetrics::snapshot(const CacheStats& cache) const {
+    StoreStats stats;
+    stats.store = operationStats(STORE);
+    stats.store_batch = operationStats(STORE_BATCH);
+    stats.retrieve = operationStats(RETRIEVE);
+    stats.search = operationStats(SEARCH);
+    stats.search_batch = operationStats(SEARCH_BATCH);
+    stats.remove = operationStats(REMOVE);
+    stats.maintenance = operationStats(MAINTENANCE);
+    stats.other.reads = other_.reads.load(std::memory_order_relaxed);
+    stats.other.writes = other_.writes.load(std::memory_order_relaxed);
+    stats.other.bytes_read = other_.bytes_read.load(std::memory_order_relaxed);
+    stats.other.bytes_written = other_.bytes_written.load(std::memory_order_relaxed);
+    stats.queries = queries_.load(std::memory_order_relaxed);
+    stats.clusters_probed = clusters_probed_.load(std::memory_order_relaxed);
+    stats.vectors_scored = vectors_scored_.load(std::memory_order_relaxed);
+    stats.codes_scored = codes_scored_.load(std::memory_order_relaxed);
+    stats.syncs = syncs_.load(std::memory_order_relaxed);
+    stats.cache = cache;
+    return stats;
+}
+
+std::string StoreMetrics::prometheus(const CacheStats& cache, uint64_t vectors, const std::string& prefix) const {
+    std::string out;
+
+    const std::string duration = prefix + "_operation_duration_seconds";
+    header(out, duration, "histogram", "Latency of store operations, lock waits included.");
+    for (int op = 0; op < OPERATION_COUNT; op++) {
+        const LatencyHistogram& latency = operations_[op].latency;
+        const std::string label = std::string("operation=\"") + operationName(static_cast<Operation>(op)) + "\"";
+        for (double bound : EXPORT_BOUNDS) {
+            sample(out, duration + "_bucket", label + ",le=\"" + number(bound) + "\"",
+                   latency.countAtOrBelow(static_cast<uint64_t>(bound * 1e9)));
+        }
+        // From the buckets too, so the series stays cumulative while
+        // operations record concurrently
+        const uint64_t count = latency.countAtOrBelow(UINT64_MAX);
+        sample(out, duration + "_bucket", label + ",le=\"+Inf\"", count);
+        sample(out, duration + "_sum", label, number(latency.sumNs() / 1e9));
+        sample(out, duration + "_count", label, count);
+    }
+
+    struct IoMetric {
+        const char* name;
+        const char* help;
+        const std::atomic<uint64_t> IoCounters::*counter;
+    };
+    const IoMetric io_metrics[] = {
+        {"_io_reads_total", "Device reads (pread and io_uring).", &IoCounters::reads},
+        {"_io_writes_total", "Device writes (pwrite).", &IoCounters::writes},
+        {"_io_read_bytes_total", "Bytes read from the device.", &IoCounters::bytes_read},
+        {"_io_written_bytes_total", "Bytes written to the device.", &IoCounters::bytes_written},
+    };
+    for (const IoMetric& metric : io_metrics) {
+        const std::string name = prefix + metric.name;
+        header(out, name, "counter", metric.help);
+        for (int op = 0; op <= OPERATION_COUNT; op++) {
+            const IoCounters& io = op < OPERATION_COUNT ? operations_[op].io : other_;
+            sample(out, name,
+                   std::string("operation=\"") + operationName(static_cast<Operation>(op)) + "\"",
+                   (io.*metric.counter).load(std::memory_order_relaxed));
+        }
+    }
+
+    const struct {
+        const char* name;
+        const char* type;
+        const char* help;
+        uint64_t value;
+    } totals[] = {
+        {"_search_queries_total", "counter", "Queries searched, each query of a batch included.",
+         queries_.load(std::memory_order_relaxed)},
+        {"_search_clusters_probed_total", "counter", "Clusters scanned by searches.",
+         clusters_probed_.load(std::memory_order_relaxed)},
+        {"_search_vectors_scored_total", "counter", "Vectors read and scored at full precision.",
+         vectors_scored_.load(std::memory_order_relaxed)},
+        {"_search_codes_scored_total", "counter", "Quantized codes scored.",
+         codes_scored_.load(std::memory_order_relaxed)},
+        {"_io_syncs_total", "counter", "fdatasync calls, checkpoints included.",
+         syncs_.load(std::memory_order_relaxed)},
+        {"_cache_hits_total", "counter", "Cluster cache lookups served from memory.", cache.hits},
+        {"_cache_misses_total", "counter", "Cluster cache lookups that went to the device.", cache.misses},
+        {"_cache_evictions_total", "counter", "Extents evicted from the cluster cache.", cache.evictions},
+        {"_cache_bytes", "gauge", "Bytes held by the cluster cache.", cache.bytes},
+        {"_vectors", "gauge", "Vectors in the store.", vectors},
+    };
+    for (const auto& total : totals) {
+        const std::string name = prefix + total.name;
+        header(out, name, total.type, total.help);
+        sample(out, name, "", total.value);
+    }
+    return out;
+}
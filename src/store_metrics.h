@@ -0,0 +1,202 @@
+#ifndef STORE_METRICS_H
+#define STORE_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "cluster_cache.h"
+
+// Device I/O done for one kind of operation: system calls and io_uring
+// reads. Reads served from the mapping or the cluster cache aren't I/O.
+struct IoCounters {
+    std::atomic<uint64_t> reads{0};
+    std::atomic<uint64_t> writes{0};
+    std::atomic<uint64_t> bytes_read{0};
+    std::atomic<uint64_t> bytes_written{0};
+
+    // The counters I/O on this thread is charged to, or null outside an
+    // operation. ThreadPool tasks take their caller's.
+    static IoCounters*& current();
+
+    // Charge I/O on this thread to counters while in scope
+    class Scope {
+    public:
+        explicit Scope(IoCounters* counters) : previous_(current()) { current() = counters; }
+        ~Scope() { current() = previous_; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        IoCounters* previous_;
+    };
+};
+
+// Latencies in the style of an HDR histogram: buckets are exact below 32
+// ns, then 16 to each power of two, so any percentile is within 1/16 of
+// the true value. Recording is a couple of relaxed atomic adds.
+class LatencyHistogram {
+public:
+    // 16 sub-buckets times the powers of two up to 2^40 ns (about 18 min);
+    // longer latencies land in the last bucket
+    static constexpr int SUB_BITS = 4;
+    static constexpr int MAX_BITS = 40;
+    static constexpr size_t BUCKETS = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+    void record(uint64_t ns);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sumNs() const { return sum_ns_.load(std::memory_order_relaxed); }
+    uint64_t maxNs() const { return max_ns_.load(std::memory_order_relaxed); }
+    // The latency at or below which fraction q of the recorded ones fall
+    // (the top of its bucket, capped at the maximum); 0 if none
+    uint64_t percentileNs(double q) const;
+    // Recorded latencies up to ns (taken at bucket granularity)
+    uint64_t countAtOrBelow(uint64_t ns) const;
+
+    static size_t bucketOf(uint64_t ns);
+    // Largest latency that falls in bucket
+    static uint64_t bucketTop(size_t bucket);
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_ns_{0};
+    std::atomic<uint64_t> max_ns_{0};
+};
+
+// One kind of operation since the store was opened
+struct OperationStats {
+    uint64_t count = 0;
+    // Latency in microseconds, as the caller saw it (lock waits included)
+    double mean_us = 0;
+    double p50_us = 0;
+    double p90_us = 0;
+    double p99_us = 0;
+    double p999_us = 0;
+    double max_us = 0;
+    // Device I/O done for these operations
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+};
+
+// VectorClusterStore::getStats()
+struct StoreStats {
+    OperationStats store;         // storeVector
+    OperationStats store_batch;   // storeVectors
+    OperationStats retrieve;      // retrieveVector
+    OperationStats search;        // findSimilarVectors
+    OperationStats search_batch;  // findSimilarVectorsBatch, one per batch
+    OperationStats remove;        // deleteVector
+    // performMaintenance, train, maintenanceStep and compactStorage,
+    // background steps included
+    OperationStats maintenance;
+    // I/O outside any of these: opening, checkpoints, index loads; only
+    // the I/O counters are set
+    OperationStats other;
+
+    uint64_t queries = 0;            // a batch counts each of its queries
+    uint64_t clusters_probed = 0;
+    uint64_t vectors_scored = 0;     // read and scored at full precision
+    uint64_t codes_scored = 0;       // quantized codes scored
+    uint64_t syncs = 0;              // fdatasync calls (StoreOptions::durability)
+    CacheStats cache;
+};
+
+// What a VectorClusterStore counts. Thread-safe and lock-free: operations
+// on any thread record into shared atomics.
+class StoreMetrics {
+public:
+    enum Operation {
+        STORE,
+        STORE_BATCH,
+        RETRIEVE,
+        SEARCH,
+        SEARCH_BATCH,
+        REMOVE,
+        MAINTENANCE,
+        OPERATION_COUNT
+    };
+
+    // Times one operation and charges the I/O done for it, on this thread
+    // and by the ThreadPool tasks it runs, to its kind. Nested in another
+    // operation on the same store, it does nothing, so each call counts
+    // once.
+    class Scope {
+    public:
+        Scope(StoreMetrics& metrics, Operation operation);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        StoreMetrics* metrics_;   // null when nested
+        Operation operation_;
+        std::chrono::steady_clock::time_point start_;
+        IoCounters::Scope io_;
+    };
+
+    // Device I/O, charged to the current operation's kind (or to other)
+    void countRead(uint64_t bytes) {
+        IoCounters& io = currentIo();
+        io.reads.fetch_add(1, std::memory_order_relaxed);
+        io.bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    void countWrite(uint64_t bytes) {
+        IoCounters& io = currentIo();
+        io.writes.fetch_add(1, std::memory_order_relaxed);
+        io.bytes_written.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void countSync() { syncs_.fetch_add(1, std::memory_order_relaxed); }
+
+    void countSearch(uint64_t queries, uint64_t clusters, uint64_t vectors, uint64_t codes) {
+        queries_.fetch_add(queries, std::memory_order_relaxed);
+        clusters_probed_.fetch_add(clusters, std::memory_order_relaxed);
+        vectors_scored_.fetch_add(vectors, std::memory_order_relaxed);
+        codes_scored_.fetch_add(codes, std::memory_order_relaxed);
+    }
+
+    StoreStats snapshot(const CacheStats& cache) const;
+    // The metrics in the Prometheus text exposition format, every name
+    // starting with prefix
+    std::string prometheus(const CacheStats& cache, uint64_t vectors, const std::string& prefix) const;
+
+    static const char* operationName(Operation operation);
+
+private:
+    struct OperationMetrics {
+        LatencyHistogram latency;
+        IoCounters io;
+    };
+
+    IoCounters& currentIo() {
+        IoCounters* io = IoCounters::current();
+        return owns(io) ? *io : other_;
+    }
+    // Whether io is one of this store's operation counters
+    bool owns(const IoCounters* io) const {
+        for (const OperationMetrics& operation : operations_) {
+            if (io == &operation.io) {
+                return true;
+            }
+        }
+        return false;
+    }
+    OperationStats operationStats(Operation operation) const;
+
+    std::array<OperationMetrics, OPERATION_COUNT> operations_;
+    IoCounters other_;
+    std::atomic<uint64_t> queries_{0};
+    std::atomic<uint64_t> clusters_probed_{0};
+    std::atomic<uint64_t> vectors_scored_{0};
+    std::atomic<uint64_t> codes_scored_{0};
+    std::atomic<uint64_t> syncs_{0};
+};
+
+#endif // STORE_METRICS_H
@@ -0,0 +1,105 @@
+#include "thread_pool.h"
+#include "store_metrics.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads) : stopping_(false) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 1; i < threads; i++) {
+        workers_.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_available_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(size_t tasks, const std::function<void(size_t task, size_t slot)>& fn) {
+    if (workers_.empty() || tasks <= 1) {
+        for (size_t task = 0; task < tasks; task++) {
+            fn(task, 0);
+        }
+        return;
+    }
+
+    Job job;
+    job.fn = &fn;
+    job.io = IoCounters::current();
+    job.tasks = tasks;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobs_.push_back(&job);
+    size_t slot = job.slots++;
+    job.active++;
+    lock.unlock();
+    work_available_.notify_all();
+
+    // The caller works on its own job too, so a job always finishes even
+    // when every worker is busy with someone else's
+    size_t ran = work(job, slot);
+
+    lock.lock();
+    job.done += ran;
+    job.active--;
+    // All tasks are claimed by now; make sure no worker picks the job up
+    auto it = std::find(jobs_.begin(), jobs_.end(), &job);
+    if (it != jobs_.end()) {
+        jobs_.erase(it);
+    }
+    // Workers still touching the job keep it alive until they let go
+    job.finished.wait(lock, [&job] { return job.done == job.tasks && job.active == 0; });
+}
+
+void ThreadPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        work_available_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+            return;  // stopping
+        }
+
+        Job* job = jobs_.front();
+        if (job->next >= job->tasks) {
+            jobs_.pop_front();
+            continue;
+        }
+        size_t slot = job->slots++;
+        job->active++;
+        lock.unlock();
+
+        size_t ran = work(*job, slot);
+
+        lock.lock();
+        job->done += ran;
+        job->active--;
+        if (job->done == job->tasks && job->active == 0) {
+            job->finished.notify_all();
+        }
+    }
+}
+
+size_t ThreadPool::work(Job& job, size_t slot) {
+    IoCounters::Scope io(job.io);
+    size_t ran = 0;
+    for (;;) {
+        size_t task;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (job.next >= job.tasks) {
+                break;
+            }
+            task = job.next++;
+        }
+        (*job.fn)(task, slot);
+        ran++;
+    }
+    return ran;
+}
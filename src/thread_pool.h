@@ -0,0 +1,63 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <cstddef>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct IoCounters;
+
+// Fixed-size worker pool for splitting one operation (a search, a
+// rebalance pass) across cores. run() hands out task indices to the pool's
+// workers and to the calling thread, and returns once every task is done.
+// Several threads may call run() at once; their jobs share the workers.
+//
+// A pool of one thread has no workers and runs everything inline.
+class ThreadPool {
+public:
+    // threads counts the calling thread, so threads - 1 workers are
+    // started. 0 means one per hardware thread.
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Threads that can work on one run() call, including the caller
+    size_t threadCount() const { return workers_.size() + 1; }
+
+    // Call fn(task, slot) for every task in [0, tasks). slot identifies the
+    // thread within this call (always < threadCount()), so callers can keep
+    // per-thread state such as a scratch buffer or a partial result.
+    // Workers charge device I/O to the caller's IoCounters. fn must not
+    // throw.
+    void run(size_t tasks, const std::function<void(size_t task, size_t slot)>& fn);
+
+private:
+    struct Job {
+        const std::function<void(size_t, size_t)>* fn;
+        IoCounters* io;       // the caller's, for the workers to charge
+        size_t tasks;
+        size_t next = 0;      // next unclaimed task
+        size_t done = 0;      // tasks finished
+        size_t slots = 0;     // threads that joined
+        size_t active = 0;    // threads still working on it
+        std::condition_variable finished;
+    };
+
+    void workerLoop();
+    // Claim and run tasks of job until none are left; returns how many ran
+    size_t work(Job& job, size_t slot);
+
+    std::vector<std::thread> workers_;
+    std::deque<Job*> jobs_;   // jobs with unclaimed tasks, oldest first
+    std::mutex mutex_;
+    std::condition_variable work_available_;
+    bool stopping_;
+};
+
+#endif // THREAD_POOL_H
@@ -1,8 +1,12 @@
 #include "vector_cluster_store.h"
+#include "distance.h"
+#include "io_uring_engine.h"
+#include "thread_pool.h"
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <linux/fs.h>
 #include <cstring>
 #include <iostream>
@@ -10,30 +14,200 @@
 #include <cmath>
 #include <fstream>
 #include <unordered_set>
+#include <shared_mutex>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <numeric>
+#include <random>
+
+namespace {
+
+// CRC-32 (IEEE 802.3 polynomial), used to validate write-ahead log records
+uint32_t crc32(const void* data, size_t size, uint32_t crc = 0) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// L2 norm of a dim-length vector
+float vectorNorm(const float* v, size_t dim) {
+    return std::sqrt(dotProduct(v, v, dim));
+}
+
+// Scale v to unit length in place and return its original norm. An
+// all-zero vector is left as is.
+float normalizeVector(float* v, size_t dim) {
+    float norm = vectorNorm(v, dim);
+    if (norm > 0.0f) {
+        float inv = 1.0f / norm;
+        for (size_t i = 0; i < dim; i++) {
+            v[i] *= inv;
+        }
+    }
+    return norm;
+}
+
+// Bounded top-k by similarity: a min-heap of at most k (id, similarity)
+// pairs whose root is the weakest result kept so far
+bool weakerResult(const std::pair<uint32_t, float>& a, const std::pair<uint32_t, float>& b) {
+    return a.second > b.second;
+}
+
+void offerResult(std::vector<std::pair<uint32_t, float>>& top, uint32_t k,
+                 uint32_t vector_id, float similarity) {
+    if (top.size() < k) {
+        top.push_back({vector_id, similarity});
+        std::push_heap(top.begin(), top.end(), weakerResult);
+    } else if (k > 0 && similarity > top.front().second) {
+        std::pop_heap(top.begin(), top.end(), weakerResult);
+        top.back() = {vector_id, similarity};
+        std::push_heap(top.begin(), top.end(), weakerResult);
+    }
+}
+
+// Heap order to best-first
+void finishResults(std::vector<std::pair<uint32_t, float>>& top) {
+    std::sort_heap(top.begin(), top.end(), weakerResult);
+}
+
+// Two-way k-means over count rows of dim floats: side[i] says which of the
+// two centres row i ended up nearer. Seeded with the row furthest from the
+// mean and the row furthest from that one; all rows stay on side 0 if
+// they are identical.
+std::vector<uint8_t> splitTwoWays(const float* rows, size_t count, size_t dim, uint32_t iterations,
+                                  std::array<Vector, 2>& centres) {
+    std::vector<uint8_t> side(count, 0);
+    std::vector<double> mean(dim, 0.0);
+    for (size_t i = 0; i < count; i++) {
+        for (size_t d = 0; d < dim; d++) {
+            mean[d] += rows[i * dim + d];
+        }
+    }
+    centres = {Vector(dim), Vector(dim)};
+    for (size_t d = 0; d < dim; d++) {
+        centres[0][d] = static_cast<float>(mean[d] / std::max<size_t>(count, 1));
+    }
+    auto furthest = [&](const float* from) {
+        size_t best = 0;
+        float best_distance = -1.0f;
+        for (size_t i = 0; i < count; i++) {
+            float distance = l2DistanceSquared(rows + i * dim, from, dim);
+            if (distance > best_distance) {
+                best_distance = distance;
+                best = i;
+            }
+        }
+        return best;
+    };
+    const size_t first = furthest(centres[0].data());
+    const size_t second = furthest(rows + first * dim);
+    if (l2DistanceSquared(rows + first * dim, rows + second * dim, dim) == 0.0f) {
+        return side;
+    }
+    centres[0].assign(rows + first * dim, rows + (first + 1) * dim);
+    centres[1].assign(rows + second * dim, rows + (second + 1) * dim);
+    
+    for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+        bool changed = false;
+        for (size_t i = 0; i < count; i++) {
+            uint8_t nearer = l2DistanceSquared(rows + i * dim, centres[1].data(), dim) <
+                             l2DistanceSquared(rows + i * dim, centres[0].data(), dim);
+            changed = changed || nearer != side[i];
+            side[i] = nearer;
+        }
+        if (!changed && iteration > 0) {
+            break;
+        }
+        std::vector<double> sums[2] = {std::vector<double>(dim, 0.0), std::vector<double>(dim, 0.0)};
+        size_t sizes[2] = {0, 0};
+        for (size_t i = 0; i < count; i++) {
+            for (size_t d = 0; d < dim; d++) {
+                sums[side[i]][d] += rows[i * dim + d];
+            }
+            sizes[side[i]]++;
+        }
+        if (sizes[0] == 0 || sizes[1] == 0) {
+            break;
+        }
+        for (int c = 0; c < 2; c++) {
+            for (size_t d = 0; d < dim; d++) {
+                centres[c][d] = static_cast<float>(sums[c][d] / sizes[c]);
+            }
+        }
+    }
+    return side;
+}
+
+} // namespace
 
 // Assuming Logger class is defined in a separate header
 // extern class Logger;
 
 VectorClusterStore::VectorClusterStore(Logger& logger)
-    : fd_(-1), device_size_(0), block_size_(0), is_direct_io_(false),
-      vector_dim_(0), next_vector_id_(0), next_alloc_offset_(0),
-      header_offset_(0), cluster_map_offset_(0), vector_map_offset_(0),
-      data_offset_(0), logger_(logger) {
+    : fd_(-1), device_size_(0), block_size_(0), is_direct_io_(false), vector_dim_(0),
+      next_vector_id_(0), data_map_(nullptr), data_map_offset_(0), data_map_size_(0), file_end_(0),
+      entry_norms_(false), next_alloc_offset_(0), snapshot_crc_(0), quant_offset_(0),
+      quant_size_(0), batch_active_(false), metadata_dirty_(false), store_version_(0),
+      header_offset_(0), cluster_map_offset_(0), vector_map_offset_(0), cluster_map_capacity_(0),
+      vector_map_capacity_(0), data_offset_(0), wal_offset_(0), wal_size_(0), metadata_slot_(0),
+      checkpoint_sequence_(0), cluster_map_offsets_{0, 0}, vector_map_offsets_{0, 0},
+      cluster_map_size_(0), cluster_map_crc_(0), vector_map_size_(0), vector_map_crc_(0),
+      wal_generation_(0), wal_sequence_(0), wal_tail_(0), wal_records_(0), background_stop_(false),
+      writes_logged_(0), writes_synced_(0), sync_stop_(false), sync_failed_(false),
+      checkpoint_count_(0), logger_(logger) {
 }
 
 VectorClusterStore::~VectorClusterStore() {
+    stopBackgroundThreads();
+
+    // An uncommitted batch still owes a metadata flush; don't drop it.
+    if (batch_active_ && metadata_dirty_ && fd_ >= 0) {
+        logger_.warning("Store closed with an open batch, committing it");
+        commitBatch();
+    }
     closeDevice();
 }
 
 bool VectorClusterStore::initialize(const std::string& device_path, 
                                    const std::string& strategy_name,
                                    uint32_t vector_dim,
-                                   uint32_t max_clusters) {
-    std::lock_guard<std::mutex> lock(store_mutex_);
+                                   uint32_t max_clusters,
+                                   const StoreOptions& options) {
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
     
     // Set device path and parameters
     device_path_ = device_path;
     vector_dim_ = vector_dim;
+    options_ = options;
+    
+    // Attributes are extracted again on every open, for the fields this
+    // open names
+    for (size_t i = 0; i < options_.attributes.size(); i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (options_.attributes[j].name == options_.attributes[i].name) {
+                logger_.error("Attribute field '" + options_.attributes[i].name + "' named twice");
+                return false;
+            }
+        }
+    }
+    vector_map_.setAttributeFields(options_.attributes);
     
     // Create clustering strategy
     clustering_ = createClusteringStrategy(strategy_name, logger_);
@@ -41,6 +215,11 @@ bool VectorClusterStore::initialize(const std::string& device_path,
         logger_.error("Failed to create clustering strategy: " + strategy_name);
         return false;
     }
+    thread_pool_.reset(new ThreadPool(options_.worker_threads));
+    clustering_->setThreadPool(thread_pool_.get());
+    // The model reads vectors back from the data region instead of keeping
+    // its own copy of each
+    clustering_->setVectorSource([this](const VectorVisitor& visit) { return streamVectors(visit); });
     
     // Initialize clustering strategy
     if (!clustering_->initialize(vector_dim, max_clusters)) {
@@ -49,61 +228,153 @@ bool VectorClusterStore::initialize(const std::string& device_path,
     }
     
     // Open device
-    if (!openDevice()) {
+    if (!openConfiguredDevice()) {
         return false;
     }
+    cache_.reset();
+    if (options_.cache_bytes > 0) {
+        if (options_.use_mmap) {
+            logger_.warning("use_mmap reads through the page cache; ignoring cache_bytes");
+        } else {
+            cache_.reset(new ClusterCache(options_.cache_bytes));
+        }
+    }
 
-    // Define layout
+    // Define layout (a new store's; readHeader takes an existing one's
+    // from its header)
+    store_version_ = 0;
     header_offset_ = 0;  // Store header at the beginning
-    cluster_map_offset_ = 512;  // After header
-    // Increase to 50MB for cluster map (5x more space than before)
-    vector_map_offset_ = cluster_map_offset_ + (50 * 1024 * 1024);
-    data_offset_ = vector_map_offset_ + (10 * 1024 * 1024);  // Still 10MB for vector map
+    cluster_map_capacity_ = CLUSTER_MAP_CAPACITY;
+    vector_map_capacity_ = VECTOR_MAP_CAPACITY;
+    cluster_map_offsets_[0] = 2 * HEADER_COPY_SPACING;
+    cluster_map_offsets_[1] = cluster_map_offsets_[0] + cluster_map_capacity_;
+    vector_map_offsets_[0] = cluster_map_offsets_[1] + cluster_map_capacity_;
+    vector_map_offsets_[1] = vector_map_offsets_[0] + vector_map_capacity_;
+    cluster_map_offset_ = cluster_map_offsets_[0];
+    vector_map_offset_ = vector_map_offsets_[0];
+    wal_offset_ = vector_map_offsets_[1] + vector_map_capacity_;
+    wal_size_ = WAL_REGION_SIZE;
+    data_offset_ = wal_offset_ + wal_size_;
 
     // Allocation high-water mark starts at the data region; bumped past
     // existing vectors below if this is an existing store.
     next_alloc_offset_ = data_offset_;
+    free_space_.clear();
+    pending_free_.clear();
+    quant_pinned_.clear();
+    snapshot_held_.clear();
+    if (options_.snapshot_retention > 0) {
+        snapshot_held_.emplace_back();
+    }
 
     // Check if the device has a valid header
     if (readHeader()) {
         logger_.info("Found existing vector store, loading data");
 
-        // Read cluster map and vector map
+        // Read cluster map and vector map, then roll the WAL forward
+        // over them
         if (!readClusterMap() || !readVectorMap()) {
             logger_.error("Failed to read store metadata");
             closeDevice();
             return false;
         }
+        if (!replayWal()) {
+            logger_.error("Failed to replay write-ahead log");
+            closeDevice();
+            return false;
+        }
 
-        // Bump the allocation high-water mark past every vector already on
-        // disk so new stores append rather than overwrite.
-        size_t vector_size = vector_dim_ * sizeof(float);
-        for (const auto& [vid, entry] : vector_map_) {
-            uint64_t end = entry.offset + vector_size;
-            if (end > next_alloc_offset_) {
-                next_alloc_offset_ = end;
-            }
+        // Pick up each cluster's extent and bump the allocation high-water
+        // mark past everything already on disk so new stores append rather
+        // than overwrite.
+        rebuildClusterExtents();
+        
+        // A quantized index that can't be used only costs search speed
+        if (quant_offset_ != 0 && !readQuantizedIndex()) {
+            logger_.warning("Quantized index unreadable, searching full-precision vectors "
+                            "until the next maintenance");
+            dropQuantizedIndex();
         }
+    } else if (store_version_ != 0) {
+        // Something is there; don't initialize a new store over it
+        logger_.error("Vector store at " + device_path + " can't be opened");
+        closeDevice();
+        return false;
+    } else if (options_.read_only) {
+        logger_.error("No vector store to open read-only at " + device_path);
+        closeDevice();
+        return false;
     } else {
         logger_.info("Initializing new vector store");
         
         // Initialize new store
+        store_version_ = STORE_VERSION;
+        metadata_slot_ = 0;
+        checkpoint_sequence_ = 1;
         next_vector_id_ = 0;
         vector_map_.clear();
+        cluster_extents_.clear();
+        dropQuantizedIndex();
+        pending_free_.clear();
+        wal_generation_ = 1;
+        wal_sequence_ = 0;
+        wal_tail_ = wal_offset_ + sizeof(WalHeader);
+        wal_records_ = 0;
+        entry_norms_ = true;
+        
+        // The log is read whole on open, so a file must reach the data
+        // region
+        struct stat st;
+        if (fstat(fd_, &st) == 0 && S_ISREG(st.st_mode) &&
+            static_cast<uint64_t>(st.st_size) < data_offset_) {
+            if (ftruncate(fd_, data_offset_) < 0) {
+                logger_.error("Failed to extend file: " + std::string(strerror(errno)));
+                closeDevice();
+                return false;
+            }
+            device_size_ = data_offset_;
+        }
         
-        // Write header
-        if (!writeHeader()) {
+        // Empty maps and log, then the header that names them. Whatever
+        // was in the other header copy's place must not pass for one.
+        std::vector<char> blank(HEADER_COPY_SPACING, 0);
+        if (!writeAligned(blank.data(), blank.size(), HEADER_COPY_SPACING) ||
+            !writeClusterMap() || !writeVectorMap() || !writeWalHeader()) {
+            logger_.error("Failed to write store metadata");
+            closeDevice();
+            return false;
+        }
+        if (!writeHeader() || (options_.durability != Durability::NONE && !syncDevice())) {
             logger_.error("Failed to write store header");
             closeDevice();
             return false;
         }
-        
-        // Write empty maps
-        if (!writeClusterMap() || !writeVectorMap()) {
-            logger_.error("Failed to write store metadata");
+    }
+    
+    if (options_.use_mmap) {
+        mapDataRegion();
+    }
+    
+    if (options_.read_only && (options_.background_compaction || options_.background_maintenance)) {
+        logger_.warning("Store opened read-only; not starting background compaction or maintenance");
+    } else if (options_.background_compaction && !compaction_thread_.joinable()) {
+        compaction_thread_ = std::thread(&VectorClusterStore::compactionLoop, this,
+                                         std::max(1u, options_.compaction_interval_ms),
+                                         static_cast<size_t>(std::max(1u, options_.compaction_batch)));
+    }
+    if (!options_.read_only && options_.background_maintenance && !maintenance_thread_.joinable()) {
+        maintenance_thread_ = std::thread(&VectorClusterStore::maintenanceLoop, this);
+    }
+    // The sync thread has its own descriptor, so it can sync without the
+    // store lock while writes go on
+    if (!options_.read_only && options_.durability == Durability::GROUP && !sync_thread_.joinable()) {
+        int sync_fd = dup(fd_);
+        if (sync_fd < 0) {
+            logger_.error("Failed to start group commit: " + std::string(strerror(errno)));
             closeDevice();
             return false;
         }
+        sync_thread_ = std::thread(&VectorClusterStore::groupCommitLoop, this, sync_fd);
     }
     
     logger_.info("Vector store initialized successfully");
@@ -205,8 +476,13 @@ bool VectorClusterStore::openDeviceWithDirectIO(bool readOnly) {
     int flags = readOnly ? O_RDONLY : O_RDWR;
     flags |= O_DIRECT;
     
+    // Allow creating new files, as openDevice does
+    if (!readOnly && device_path_.find("/dev/") != 0) {
+        flags |= O_CREAT;
+    }
+    
     logger_.debug("Opening device/file with O_DIRECT: " + device_path_);
-    fd_ = open(device_path_.c_str(), flags);
+    fd_ = open(device_path_.c_str(), flags, 0644);
     
     if (fd_ < 0) {
         logger_.error("Failed to open with O_DIRECT: " + device_path_ + 
@@ -262,14 +538,194 @@ bool VectorClusterStore::openDeviceWithDirectIO(bool readOnly) {
     
     is_direct_io_ = true;
     
+    // Search reads go through io_uring when asked for and the kernel
+    // allows it; otherwise they stay on pread
+    if (options_.use_io_uring) {
+        io_engine_ = IoUringEngine::create(options_.io_queue_depth, logger_);
+    }
+    
     logger_.info("Device/file opened successfully with O_DIRECT");
     logger_.info("Size: " + std::to_string(device_size_) + " bytes");
     logger_.info("Block size: " + std::to_string(block_size_) + " bytes");
+    logger_.info(std::string("I/O engine: ") + getIoEngineName());
+    
+    return true;
+}
+
+bool VectorClusterStore::openDeviceWithMmap(bool readOnly) {
+    if (!openDevice(readOnly)) {
+        return false;
+    }
+    // A store being initialized doesn't know its layout yet; initialize
+    // maps the data region once it does
+    if (data_offset_ != 0) {
+        mapDataRegion();
+    }
+    return true;
+}
+
+bool VectorClusterStore::openConfiguredDevice() {
+    if (options_.use_mmap) {
+        if (options_.direct_io) {
+            logger_.warning("use_mmap reads through the page cache; ignoring direct_io");
+        }
+        return openDeviceWithMmap(options_.read_only);
+    }
+    return options_.direct_io ? openDeviceWithDirectIO(options_.read_only) : openDevice(options_.read_only);
+}
+
+bool VectorClusterStore::mapDataRegion() {
+    unmapDataRegion();
+    if (fd_ < 0 || is_direct_io_) {
+        return false;
+    }
     
+    struct stat st;
+    if (fstat(fd_, &st) < 0) {
+        logger_.error("Failed to stat file: " + std::string(strerror(errno)));
+        return false;
+    }
+    file_end_ = S_ISBLK(st.st_mode) ? device_size_ : static_cast<uint64_t>(st.st_size);
+    
+    // Map twice what is in use so a growing store remaps only now and then.
+    // Pages past the end of a file are never touched (see mappedSpan).
+    const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    const uint64_t used_end = std::max({file_end_, next_alloc_offset_, data_offset_ + page_size});
+    data_map_offset_ = (data_offset_ / page_size) * page_size;
+    uint64_t size = 2 * (used_end - data_map_offset_);
+    if (S_ISBLK(st.st_mode)) {
+        size = std::min(size, device_size_ - data_map_offset_);
+    }
+    size = ((size + page_size - 1) / page_size) * page_size;
+    
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, data_map_offset_);
+    if (map == MAP_FAILED) {
+        logger_.warning("Failed to map data region, reading with pread: " + std::string(strerror(errno)));
+        return false;
+    }
+    // Searches read whole cluster extents and ask for them ahead
+    // (adviseClusterExtents); readahead across unrelated clusters just
+    // evicts useful pages
+    madvise(map, size, MADV_RANDOM);
+    
+    data_map_ = static_cast<char*>(map);
+    data_map_size_ = size;
+    logger_.info("Mapped " + std::to_string(size) + " bytes of the data region");
     return true;
 }
 
+void VectorClusterStore::unmapDataRegion() {
+    if (data_map_) {
+        munmap(data_map_, data_map_size_);
+        data_map_ = nullptr;
+        data_map_size_ = 0;
+    }
+}
+
+void VectorClusterStore::extendDataMap() {
+    if (data_map_ && next_alloc_offset_ > data_map_offset_ + data_map_size_) {
+        mapDataRegion();
+    }
+}
+
+const char* VectorClusterStore::mappedSpan(uint64_t offset, size_t size) const {
+    if (!data_map_ || offset < data_map_offset_ || offset + size > file_end_ ||
+        offset + size > data_map_offset_ + data_map_size_) {
+        return nullptr;
+    }
+    return data_map_ + (offset - data_map_offset_);
+}
+
+void VectorClusterStore::adviseClusterExtents(const std::vector<uint32_t>& clusters) const {
+    if (!data_map_) {
+        return;
+    }
+    const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    for (uint32_t cluster_id : clusters) {
+        auto it = cluster_extents_.find(cluster_id);
+        if (it == cluster_extents_.end() || it->second.used == 0) {
+            continue;
+        }
+        uint64_t start = std::max(it->second.start_offset, data_map_offset_);
+        uint64_t end = std::min({it->second.start_offset + it->second.used * vectorSlotSize(), file_end_,
+                                 data_map_offset_ + data_map_size_});
+        if (start >= end) {
+            continue;
+        }
+        uint64_t page_start = ((start - data_map_offset_) / page_size) * page_size;
+        madvise(data_map_ + page_start, end - data_map_offset_ - page_start, MADV_WILLNEED);
+    }
+}
+
+uint64_t VectorClusterStore::getDataSize() const {
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    return next_alloc_offset_ > data_offset_ ? next_alloc_offset_ - data_offset_ : 0;
+}
+
+std::unordered_map<uint32_t, uint32_t> VectorClusterStore::getClusterSizes() const {
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    std::unordered_map<uint32_t, uint32_t> sizes;
+    for (const auto& [cluster_id, members] : vector_map_.clusterMembers()) {
+        sizes[cluster_id] = static_cast<uint32_t>(members.size());
+    }
+    return sizes;
+}
+
+std::unordered_map<uint32_t, Vector> VectorClusterStore::getClusterCentroids() const {
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    std::unordered_map<uint32_t, Vector> centroids;
+    for (const auto& [cluster_id, members] : vector_map_.clusterMembers()) {
+        if (members.empty()) {
+            continue;
+        }
+        Vector centroid = clustering_->getClusterCentroid(cluster_id);
+        if (centroid.size() == vector_dim_) {
+            centroids[cluster_id] = std::move(centroid);
+        }
+    }
+    return centroids;
+}
+
+size_t VectorClusterStore::getVectorCount() const {
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    return vector_map_.size();
+}
+
+std::vector<uint32_t> VectorClusterStore::getVectorIds() const {
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    std::vector<uint32_t> ids;
+    ids.reserve(vector_map_.size());
+    for (uint32_t slot = 0; slot < vector_map_.size(); slot++) {
+        ids.push_back(vector_map_.id(slot));
+    }
+    return ids;
+}
+
+CacheStats VectorClusterStore::getCacheStats() const {
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    return cache_ ? cache_->stats() : CacheStats();
+}
+
+StoreStats VectorClusterStore::getStats() const {
+    return metrics_.snapshot(getCacheStats());
+}
+
+std::string VectorClusterStore::getStatsPrometheus(const std::string& prefix) const {
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    return metrics_.prometheus(cache_ ? cache_->stats() : CacheStats(), vector_map_.size(), prefix);
+}
+
+const char* VectorClusterStore::getIoEngineName() const {
+    if (data_map_) {
+        return "mmap";
+    }
+    std::lock_guard<std::mutex> lock(io_engine_mutex_);
+    return io_engine_ ? "io_uring" : "pread";
+}
+
 void VectorClusterStore::closeDevice() {
+    io_engine_.reset();
+    unmapDataRegion();
     if (fd_ >= 0) {
         close(fd_);
         fd_ = -1;
@@ -278,12 +734,16 @@ void VectorClusterStore::closeDevice() {
 }
 
 bool VectorClusterStore::storeVector(uint32_t vector_id, const Vector& vector, const std::string& metadata) {
-    std::lock_guard<std::mutex> lock(store_mutex_);
+    StoreMetrics::Scope metrics(metrics_, StoreMetrics::STORE);
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
     
     if (fd_ < 0) {
         logger_.error("Device not open");
         return false;
     }
+    if (!checkWritable("storeVector")) {
+        return false;
+    }
     
     if (vector.size() != vector_dim_) {
         logger_.error("Vector dimension mismatch: got " + std::to_string(vector.size()) + 
@@ -291,861 +751,4307 @@ bool VectorClusterStore::storeVector(uint32_t vector_id, const Vector& vector, c
         return false;
     }
     
-    // Assign to a cluster
-    uint32_t cluster_id = clustering_->assignToCluster(vector);
+    // In normalized mode the unit vector is what gets clustered and stored
+    Vector normalized;
+    float norm;
+    if (options_.normalize_vectors) {
+        normalized = vector;
+        norm = normalizeVector(normalized.data(), vector_dim_) > 0.0f ? 1.0f : 0.0f;
+    } else {
+        norm = vectorNorm(vector.data(), vector_dim_);
+    }
+    const Vector& stored = options_.normalize_vectors ? normalized : vector;
+    
+    // An overwrite takes the old vector out of the model first, and puts
+    // it back if the new one can't be stored
+    uint32_t existing = vector_map_.find(vector_id);
+    Vector replaced;
+    if (existing != VectorIndex::NO_SLOT) {
+        removeFromModel(existing, &replaced);
+    }
+    
+    // Add to the clustering model first: the cluster the model puts the
+    // vector in decides which extent it is written to
+    clustering_->addVector(stored, vector_id);
+    uint32_t cluster_id = clustering_->getVectorCluster(vector_id);
     
     // Allocate space for the vector
     uint64_t offset = allocateVectorSpace(cluster_id);
     if (offset == 0) {
         logger_.error("Failed to allocate space for vector");
+        clustering_->removeVector(vector_id, stored.data());
+        if (existing != VectorIndex::NO_SLOT) {
+            restoreToModel(existing, replaced);
+        }
         return false;
     }
     
     // Write vector to storage
-    if (!writeVector(offset, vector)) {
+    if (!writeVector(offset, stored)) {
         logger_.error("Failed to write vector data");
+        clustering_->removeVector(vector_id, stored.data());
+        if (existing != VectorIndex::NO_SLOT) {
+            restoreToModel(existing, replaced);
+        }
+        freeSpace(cluster_id, offset, vectorSlotSize());
         return false;
     }
     
-    // Add to vector map
-    VectorEntry entry;
-    entry.vector_id = vector_id;
-    entry.cluster_id = cluster_id;
-    entry.offset = offset;
-    entry.metadata = metadata;
-    
-    vector_map_[vector_id] = entry;
-    
-    // Update clustering model
-    clustering_->addVector(vector, vector_id);
+    // Add to vector map, freeing the slot an overwritten vector had
+    if (existing != VectorIndex::NO_SLOT) {
+        freeVectorSlot(existing);
+    }
+    uint32_t slot = vector_map_.insert(vector_id, cluster_id, offset, norm);
+    vector_map_.setMetadata(slot, metadata);
     
     // Update next vector ID if needed
     if (vector_id >= next_vector_id_) {
         next_vector_id_ = vector_id + 1;
     }
     
-    // Update metadata and persist clustering model
-    if (!writeHeader() || !writeVectorMap() || !writeClusterMap()) {
+    // Log the insert (the WAL replays it into the clustering model)
+    VectorEntry entry;
+    entry.vector_id = vector_id;
+    entry.cluster_id = cluster_id;
+    entry.offset = offset;
+    entry.norm = norm;
+    entry.data_crc = walDataCrc(stored.data());
+    entry.metadata = metadata;
+    if (!persistOperations(WAL_INSERT, {entry})) {
         logger_.error("Failed to update metadata");
         return false;
     }
 
-    logger_.debug("Stored vector " + std::to_string(vector_id) +
-                 " in cluster " + std::to_string(cluster_id));
+    logger_.debug([&] {
+        return "Stored vector " + std::to_string(vector_id) + " in cluster " + std::to_string(cluster_id);
+    });
 
     return true;
 }
 
-bool VectorClusterStore::retrieveVector(uint32_t vector_id, Vector& vector) {
-    std::lock_guard<std::mutex> lock(store_mutex_);
-    
-    if (fd_ < 0) {
-        logger_.error("Device not open");
-        return false;
-    }
-    
-    // Check if vector exists
-    auto it = vector_map_.find(vector_id);
-    if (it == vector_map_.end()) {
-        logger_.error("Vector " + std::to_string(vector_id) + " not found");
+bool VectorClusterStore::storeVectors(const std::vector<uint32_t>& vector_ids,
+                                      const std::vector<Vector>& vectors,
+                                      const std::vector<std::string>& metadata) {
+    if (vectors.size() != vector_ids.size()) {
+        logger_.error("storeVectors: " + std::to_string(vector_ids.size()) + " ids but " +
+                     std::to_string(vectors.size()) + " vectors");
         return false;
     }
     
-    // Get vector offset
-    uint64_t offset = it->second.offset;
-    
-    // Read vector from storage
-    vector.resize(vector_dim_);
-    if (!readVector(offset, vector)) {
-        logger_.error("Failed to read vector data");
-        return false;
+    // Flatten into one row-major block for the contiguous write path
+    std::vector<float> data;
+    data.reserve(vectors.size() * vector_dim_);
+    for (size_t i = 0; i < vectors.size(); i++) {
+        if (vectors[i].size() != vector_dim_) {
+            logger_.error("Vector dimension mismatch at batch index " + std::to_string(i) +
+                        ": got " + std::to_string(vectors[i].size()) +
+                        ", expected " + std::to_string(vector_dim_));
+            return false;
+        }
+        data.insert(data.end(), vectors[i].begin(), vectors[i].end());
     }
     
-    logger_.debug("Retrieved vector " + std::to_string(vector_id));
-    
-    return true;
+    return storeVectors(vector_ids, data.data(), metadata);
 }
 
-std::string VectorClusterStore::getVectorMetadata(uint32_t vector_id) {
-    std::lock_guard<std::mutex> lock(store_mutex_);
+bool VectorClusterStore::storeVectors(const std::vector<uint32_t>& vector_ids, const float* data,
+                                      const std::vector<std::string>& metadata) {
+    // Each id is stored once, from its last row; a repeat would be added to
+    // the model twice and take a slot that is freed straight away
+    std::unordered_set<uint32_t> seen;
+    seen.reserve(vector_ids.size());
+    std::vector<size_t> last_rows;
+    for (size_t i = vector_ids.size(); i-- > 0;) {
+        if (seen.insert(vector_ids[i]).second) {
+            last_rows.push_back(i);
+        }
+    }
+    if (last_rows.size() < vector_ids.size()) {
+        const bool with_metadata = !metadata.empty();
+        if (with_metadata && metadata.size() != vector_ids.size()) {
+            logger_.error("storeVectors: " + std::to_string(vector_ids.size()) + " ids but " +
+                         std::to_string(metadata.size()) + " metadata entries");
+            return false;
+        }
+        std::vector<uint32_t> unique_ids;
+        std::vector<float> unique_rows;
+        std::vector<std::string> unique_metadata;
+        unique_ids.reserve(last_rows.size());
+        unique_rows.reserve(last_rows.size() * vector_dim_);
+        for (auto it = last_rows.rbegin(); it != last_rows.rend(); ++it) {
+            unique_ids.push_back(vector_ids[*it]);
+            unique_rows.insert(unique_rows.end(), data + *it * vector_dim_, data + (*it + 1) * vector_dim_);
+            if (with_metadata) {
+                unique_metadata.push_back(metadata[*it]);
+            }
+        }
+        logger_.debug([&] {
+            return "storeVectors: batch of " + std::to_string(vector_ids.size()) + " holds " +
+                   std::to_string(unique_ids.size()) + " distinct ids";
+        });
+        return storeVectors(unique_ids, unique_rows.data(), unique_metadata);
+    }
+    
+    StoreMetrics::Scope metrics(metrics_, StoreMetrics::STORE_BATCH);
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
     
     if (fd_ < 0) {
         logger_.error("Device not open");
-        return "";
+        return false;
+    }
+    if (!checkWritable("storeVectors")) {
+        return false;
     }
     
-    // Check if vector exists
-    auto it = vector_map_.find(vector_id);
-    if (it == vector_map_.end()) {
-        logger_.debug("Vector " + std::to_string(vector_id) + " not found");
-        return "";
+    if (!metadata.empty() && metadata.size() != vector_ids.size()) {
+        logger_.error("storeVectors: " + std::to_string(vector_ids.size()) + " ids but " +
+                     std::to_string(metadata.size()) + " metadata entries");
+        return false;
     }
     
-    return it->second.metadata;
-}
-
-std::vector<std::pair<uint32_t, float>> VectorClusterStore::findSimilarVectors(
-    const Vector& query, uint32_t k) {
-
-    std::lock_guard<std::mutex> lock(store_mutex_);
-
-    // A loaded store must stay searchable. Under a long-lived host (the
-    // cbintel uvicorn service) the device fd can end up closed between the
-    // initial load and a later query — the in-memory maps are intact but
-    // findSimilarVectors reads vector data back from the device. Reopen on
-    // demand instead of failing. (A fresh short-lived process never tripped
-    // this; the service did 100% — see #147.)
-    if (fd_ < 0 && !openDevice()) {
-        logger_.error("Device not open and reopen failed");
-        return {};
+    if (vector_ids.empty()) {
+        return true;
     }
-
-    if (query.size() != vector_dim_) {
-        logger_.error("Query vector dimension mismatch: got " + std::to_string(query.size()) + 
-                    ", expected " + std::to_string(vector_dim_));
-        return {};
+    
+    const size_t count = vector_ids.size();
+    const size_t vector_size = vector_dim_ * sizeof(float);
+    
+    // In normalized mode, normalize a copy of the batch up front; everything
+    // below then works on unit vectors.
+    std::vector<float> normalized;
+    if (options_.normalize_vectors) {
+        normalized.assign(data, data + count * vector_dim_);
+        data = normalized.data();
     }
     
-    // Walk clusters nearest-centroid-first and accumulate a scan set
-    // until we've covered a generous budget of candidate vectors. The
-    // old code hardcoded the 3 nearest clusters, which gave terrible
-    // recall once Forgy seeding spread vectors across many small clusters
-    // (e.g. ~1 vector/cluster on a 140-doc / 100-cluster store → only ~3
-    // of 140 vectors ever examined).
-    //
-    // Budget: at least k*20 vectors (min 200). On small/medium stores
-    // this examines essentially everything (correct, and still fast at
-    // these sizes); on huge stores it prunes the long tail of distant
-    // clusters.
-    const size_t scan_budget = std::max<size_t>(static_cast<size_t>(k) * 20, 200);
-
-    std::vector<uint32_t> ordered_clusters =
-        clustering_->findClosestClusters(query, UINT32_MAX);
-
-    std::unordered_set<uint32_t> scan_set;
-    size_t estimated = 0;
-    for (uint32_t cluster_id : ordered_clusters) {
-        scan_set.insert(cluster_id);
-        estimated += clustering_->getClusterSize(cluster_id);
-        if (estimated >= scan_budget) {
-            break;
+    // Update the model and allocate space. This happens vector by vector
+    // exactly as N storeVector calls would do it, so a batch produces the
+    // same clustering as the equivalent single inserts. On failure, slots
+    // already handed out are freed again and the vectors the batch would
+    // have overwritten go back into the model.
+    std::vector<VectorEntry> entries(count);
+    std::vector<std::pair<uint32_t, Vector>> replaced;
+    auto restoreModel = [&](size_t added) {
+        for (size_t j = 0; j < added; j++) {
+            clustering_->removeVector(vector_ids[j], data + j * vector_dim_);
         }
-    }
-
-    // Single pass over the vector map — scan vectors whose cluster is in
-    // the candidate set. O(N) rather than O(clusters × N).
-    std::vector<std::pair<uint32_t, float>> candidates;
-    size_t processed = 0;
-    for (const auto& [vector_id, entry] : vector_map_) {
-        if (scan_set.find(entry.cluster_id) == scan_set.end()) {
-            continue;
+        for (const auto& [slot, vector] : replaced) {
+            restoreToModel(slot, vector);
+        }
+    };
+    for (size_t i = 0; i < count; i++) {
+        VectorEntry& entry = entries[i];
+        entry.vector_id = vector_ids[i];
+        if (options_.normalize_vectors) {
+            entry.norm = normalizeVector(normalized.data() + i * vector_dim_, vector_dim_) > 0.0f ? 1.0f : 0.0f;
+        } else {
+            entry.norm = vectorNorm(data + i * vector_dim_, vector_dim_);
+        }
+        entry.data_crc = walDataCrc(data + i * vector_dim_);
+        uint32_t existing = vector_map_.find(vector_ids[i]);
+        if (existing != VectorIndex::NO_SLOT) {
+            replaced.emplace_back(existing, Vector());
+            removeFromModel(existing, &replaced.back().second);
+        }
+        clustering_->addVector(Vector(data + i * vector_dim_, data + (i + 1) * vector_dim_),
+                               vector_ids[i]);
+        entry.cluster_id = clustering_->getVectorCluster(vector_ids[i]);
+        entry.offset = allocateVectorSpace(entry.cluster_id);
+        if (entry.offset == 0) {
+            logger_.error("Failed to allocate space for vector " + std::to_string(vector_ids[i]));
+            restoreModel(i + 1);
+            for (size_t j = 0; j < i; j++) {
+                freeSpace(entries[j].cluster_id, entries[j].offset, vectorSlotSize());
+            }
+            return false;
         }
-        Vector vector(vector_dim_);
-        if (readVector(entry.offset, vector)) {
-            float similarity = calculateCosineSimilarity(query, vector);
-            candidates.push_back({vector_id, similarity});
-            processed++;
+        if (!metadata.empty()) {
+            entry.metadata = metadata[i];
         }
     }
-
-    logger_.info("Processed " + std::to_string(processed) +
-                " vectors from " + std::to_string(scan_set.size()) + " clusters");
-    
-    // Sort by similarity (highest first)
-    std::sort(candidates.begin(), candidates.end(), 
-              [](const auto& a, const auto& b) { return a.second > b.second; });
     
-    // Return top k
-    if (candidates.size() > k) {
-        candidates.resize(k);
+    // Slots come out of per-cluster extents, so in device order the batch
+    // is a handful of contiguous runs, one per cluster it touched. Stage
+    // each run (slot padding stays zeroed) and write it sequentially,
+    // bounded so a huge batch doesn't need a buffer the size of the batch.
+    const uint64_t slot_size = vectorSlotSize();
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = i;
     }
+    std::sort(order.begin(), order.end(),
+              [&entries](size_t a, size_t b) { return entries[a].offset < entries[b].offset; });
     
-    return candidates;
+    std::vector<char> span;
+    size_t runs = 0;
+    for (size_t first = 0; first < count;) {
+        uint64_t span_start = entries[order[first]].offset;
+        size_t last = first;
+        while (last + 1 < count &&
+               entries[order[last + 1]].offset == entries[order[last]].offset + slot_size &&
+               entries[order[last + 1]].offset + vector_size - span_start <= MAX_WRITE_SPAN) {
+            last++;
+        }
+        uint64_t span_end = entries[order[last]].offset + vector_size;
+        
+        span.assign(span_end - span_start, 0);
+        for (size_t k = first; k <= last; k++) {
+            size_t i = order[k];
+            memcpy(span.data() + (entries[i].offset - span_start), data + i * vector_dim_, vector_size);
+        }
+        
+        if (!writeAligned(span.data(), span.size(), span_start)) {
+            logger_.error("Failed to write vector data for batch of " + std::to_string(count));
+            restoreModel(count);
+            for (size_t i = 0; i < count; i++) {
+                freeSpace(entries[i].cluster_id, entries[i].offset, slot_size);
+            }
+            return false;
+        }
+        first = last + 1;
+        runs++;
+    }
+    
+    // Data is on the device; publish the entries
+    vector_map_.reserve(vector_map_.size() + count);
+    for (const auto& entry : entries) {
+        if (entry.vector_id >= next_vector_id_) {
+            next_vector_id_ = entry.vector_id + 1;
+        }
+        uint32_t existing = vector_map_.find(entry.vector_id);
+        if (existing != VectorIndex::NO_SLOT) {
+            freeVectorSlot(existing);
+        }
+        uint32_t slot = vector_map_.insert(entry.vector_id, entry.cluster_id, entry.offset, entry.norm);
+        vector_map_.setMetadata(slot, entry.metadata);
+    }
+    
+    if (!persistOperations(WAL_INSERT, entries)) {
+        logger_.error("Failed to update metadata");
+        return false;
+    }
+    
+    logger_.debug([&] {
+        return "Stored batch of " + std::to_string(count) + " vectors in " + std::to_string(runs) + " writes";
+    });
+    
+    return true;
+}
+
+bool VectorClusterStore::beginBatch() {
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
+    
+    if (!checkWritable("beginBatch")) {
+        return false;
+    }
+    if (batch_active_) {
+        logger_.error("beginBatch: a batch is already open");
+        return false;
+    }
+    
+    batch_active_ = true;
+    return true;
+}
+
+bool VectorClusterStore::commitBatch() {
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
+    
+    if (!batch_active_) {
+        logger_.error("commitBatch: no batch is open");
+        return false;
+    }
+    
+    batch_active_ = false;
+    if (!metadata_dirty_) {
+        return true;
+    }
+    
+    if (!flushMetadata()) {
+        logger_.error("Failed to persist metadata at batch commit");
+        return false;
+    }
+    
+    logger_.debug("Committed batch: " + std::to_string(vector_map_.size()) + " vectors in store");
+    return true;
+}
+
+bool VectorClusterStore::retrieveVector(uint32_t vector_id, Vector& vector) {
+    Vector data(vector_dim_);
+    if (!retrieveVector(vector_id, data.data())) {
+        return false;
+    }
+    vector.swap(data);
+    return true;
+}
+
+bool VectorClusterStore::retrieveVector(uint32_t vector_id, float* vector) {
+    StoreMetrics::Scope metrics(metrics_, StoreMetrics::RETRIEVE);
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    
+    if (fd_ < 0) {
+        logger_.error("Device not open");
+        return false;
+    }
+    
+    // Check if vector exists
+    uint32_t slot = vector_map_.find(vector_id);
+    if (slot == VectorIndex::NO_SLOT) {
+        logger_.error("Vector " + std::to_string(vector_id) + " not found");
+        return false;
+    }
+    
+    // Get vector offset
+    uint64_t offset = vector_map_.offset(slot);
+    
+    // Read vector from the cache or from storage
+    auto extent = cache_ ? cluster_extents_.find(vector_map_.cluster(slot)) : cluster_extents_.end();
+    if (extent != cluster_extents_.end()) {
+        if (auto cached = cache_->find(extent->second.start_offset)) {
+            if (const char* data = cached->span(offset, vector_dim_ * sizeof(float))) {
+                memcpy(vector, data, vector_dim_ * sizeof(float));
+                return true;
+            }
+        }
+    }
+    if (!readAligned(vector, vector_dim_ * sizeof(float), offset)) {
+        logger_.error("Failed to read vector data");
+        return false;
+    }
+    
+    logger_.debug([&] { return "Retrieved vector " + std::to_string(vector_id); });
+    
+    return true;
+}
+
+std::string VectorClusterStore::getVectorMetadata(uint32_t vector_id) {
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    
+    if (fd_ < 0) {
+        logger_.error("Device not open");
+        return "";
+    }
+    
+    // Check if vector exists
+    uint32_t slot = vector_map_.find(vector_id);
+    if (slot == VectorIndex::NO_SLOT) {
+        logger_.debug([&] { return "Vector " + std::to_string(vector_id) + " not found"; });
+        return "";
+    }
+    
+    // Loaded on first use, then kept in the arena
+    std::string metadata = entryMetadata(slot);
+    std::lock_guard<std::mutex> metadata_lock(metadata_mutex_);
+    if (vector_map_.metadataDeviceOffset(slot) != 0) {
+        vector_map_.loadMetadata(slot, metadata);
+    }
+    return metadata;
+}
+
+std::vector<std::pair<uint32_t, float>> VectorClusterStore::findSimilarVectors(
+    const Vector& query, uint32_t k) {
+    return findSimilarVectors(query, k, SearchParams());
+}
+
+std::vector<std::pair<uint32_t, float>> VectorClusterStore::findSimilarVectors(
+    const Vector& query, uint32_t k, const SearchParams& params, SearchStats* stats) {
+    StoreMetrics::Scope metrics(metrics_, StoreMetrics::SEARCH);
+    const SearchClock::time_point deadline = searchDeadline(params);
+    SearchStats search_stats;
+
+    // Searches share the store with each other and with retrievals; only
+    // mutations take it exclusively
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    if (!ensureDeviceOpen(lock)) {
+        return {};
+    }
+
+    if (query.size() != vector_dim_) {
+        logger_.error("Query vector dimension mismatch: got " + std::to_string(query.size()) + 
+                    ", expected " + std::to_string(vector_dim_));
+        return {};
+    }
+    
+    SearchFilter filter;
+    if (!compileFilter(params, filter)) {
+        return {};
+    }
+    SearchFilter* active_filter = params.filter.empty() ? nullptr : &filter;
+    
+    const uint32_t ranked = initialRankCount(params);
+    std::vector<uint32_t> scan_clusters = chooseScanClusters(
+        query.data(), clustering_->findClosestClusters(query, ranked), ranked, k, params, active_filter);
+    adviseClusterExtents(scan_clusters);
+
+    // Gather the scan clusters' members from their member lists, so the
+    // cost follows the clusters scanned rather than the store size. They
+    // are then read in device order, which walks each cluster's extents
+    // front to back instead of seeking around the data region.
+    //
+    // With a quantized index, the codes pick which coded vectors are read
+    // at all; vectors stored since the index was built are always read.
+    // Members the filter rejects are dropped here, before any read.
+    std::vector<ScanEntry> scan;
+    if (quantizer_) {
+        collectQuantizedCandidates(query.data(), scan_clusters, k, deadline, active_filter, scan,
+                                   search_stats);
+    }
+    for (uint32_t cluster_id : scan_clusters) {
+        for (uint32_t slot : vector_map_.members(cluster_id)) {
+            if (!vector_map_.quantized(slot) && meetsFilter(active_filter, slot)) {
+                scan.push_back(scanEntry(slot));
+            }
+        }
+    }
+    if (deadline == SearchClock::time_point::max()) {
+        std::sort(scan.begin(), scan.end(),
+                  [](const ScanEntry& a, const ScanEntry& b) { return a.offset < b.offset; });
+    } else {
+        // A search that may be cut short reads cluster by cluster, nearest
+        // first, and each cluster in device order
+        std::unordered_map<uint32_t, uint32_t> rank;
+        for (uint32_t i = 0; i < scan_clusters.size(); i++) {
+            rank[scan_clusters[i]] = i;
+        }
+        std::vector<std::pair<uint32_t, ScanEntry>> ranked;
+        ranked.reserve(scan.size());
+        for (const ScanEntry& entry : scan) {
+            ranked.emplace_back(rank[vector_map_.cluster(vector_map_.find(entry.vector_id))], entry);
+        }
+        std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+            return a.first != b.first ? a.first < b.first : a.second.offset < b.second.offset;
+        });
+        for (size_t i = 0; i < ranked.size(); i++) {
+            scan[i] = ranked[i].second;
+        }
+    }
+    
+    // The query norm is computed once here; each candidate then costs a
+    // single dot product, scored in place in the read buffer
+    const float query_norm = vectorNorm(query.data(), vector_dim_);
+    std::vector<std::pair<uint32_t, float>> results;
+    AlignedBuffer buffer;
+    const size_t candidates = scan.size();
+    size_t processed = 0;
+    
+    // Candidates in cached extents are scored first, and only the rest read
+    if (cache_) {
+        auto extents = cachedExtents(scan_clusters, deadline, buffer);
+        size_t uncached = 0;
+        for (const ScanEntry& entry : scan) {
+            if (const float* vector = cachedVector(extents, entry.offset)) {
+                offerResult(results, k, entry.vector_id, scoreCandidate(query.data(), query_norm, vector, entry.norm));
+                processed++;
+            } else {
+                scan[uncached++] = entry;
+            }
+        }
+        scan.resize(uncached);
+    }
+    processed += scanCandidates(query.data(), query_norm, scan, k, deadline, results, buffer);
+
+    search_stats.clusters_scanned = static_cast<uint32_t>(scan_clusters.size());
+    search_stats.vectors_scanned = processed;
+    if (processed < candidates && SearchClock::now() >= deadline) {
+        search_stats.deadline_reached = true;
+    }
+    metrics_.countSearch(1, search_stats.clusters_scanned, search_stats.vectors_scanned,
+                         search_stats.codes_scored);
+    logger_.debug([&] {
+        if (quantizer_) {
+            return "Scored " + std::to_string(search_stats.codes_scored) + " codes, re-ranked " +
+                   std::to_string(processed) + " vectors from " + std::to_string(scan_clusters.size()) +
+                   " clusters";
+        }
+        return "Processed " + std::to_string(processed) + " vectors from " +
+               std::to_string(scan_clusters.size()) + " clusters";
+    });
+    if (search_stats.deadline_reached) {
+        logger_.info("Search deadline of " + std::to_string(params.deadline_us) + " us reached");
+    }
+    if (stats) {
+        *stats = search_stats;
+    }
+    
+    // Highest similarity first
+    finishResults(results);
+    return results;
+}
+
+std::vector<std::vector<std::pair<uint32_t, float>>> VectorClusterStore::findSimilarVectorsBatch(
+    const float* queries, size_t count, uint32_t k, const SearchParams& params) {
+    StoreMetrics::Scope metrics(metrics_, StoreMetrics::SEARCH_BATCH);
+    const SearchClock::time_point deadline = searchDeadline(params);
+
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    if (!ensureDeviceOpen(lock)) {
+        return {};
+    }
+    
+    SearchFilter filter;
+    if (!compileFilter(params, filter)) {
+        return {};
+    }
+    SearchFilter* active_filter = params.filter.empty() ? nullptr : &filter;
+    
+    std::vector<std::vector<std::pair<uint32_t, float>>> results(count);
+    if (count == 0) {
+        return results;
+    }
+    
+    // Rank the centroids for every query in one pass, then pick each
+    // query's clusters exactly as findSimilarVectors would
+    const uint32_t ranked = initialRankCount(params);
+    std::vector<std::vector<uint32_t>> rankings =
+        clustering_->findClosestClustersBatch(queries, count, ranked);
+    
+    // Invert to cluster -> interested queries, so each cluster is read once
+    std::unordered_map<uint32_t, std::vector<uint32_t>> interested;
+    for (size_t q = 0; q < count; q++) {
+        for (uint32_t cluster_id : chooseScanClusters(queries + q * vector_dim_, std::move(rankings[q]),
+                                                      ranked, k, params, active_filter)) {
+            interested[cluster_id].push_back(static_cast<uint32_t>(q));
+        }
+    }
+    
+    std::unordered_map<uint32_t, std::vector<ScanEntry>> members;
+    for (const auto& [cluster_id, queries_of_cluster] : interested) {
+        std::vector<ScanEntry>& cluster_members = members[cluster_id];
+        for (uint32_t slot : vector_map_.members(cluster_id)) {
+            if (meetsFilter(active_filter, slot)) {
+                cluster_members.push_back(scanEntry(slot));
+            }
+        }
+    }
+    
+    std::vector<float> query_norms(count);
+    for (size_t q = 0; q < count; q++) {
+        query_norms[q] = vectorNorm(queries + q * vector_dim_, vector_dim_);
+    }
+    
+    // One task per cluster: read it in device order and score every
+    // interested query against each vector while it is in cache. Each
+    // thread keeps its own top-k per query; they are merged at the end.
+    std::vector<uint32_t> clusters;
+    for (auto& [cluster_id, cluster_members] : members) {
+        std::sort(cluster_members.begin(), cluster_members.end(),
+                  [](const ScanEntry& a, const ScanEntry& b) { return a.offset < b.offset; });
+        clusters.push_back(cluster_id);
+    }
+    const size_t threads = thread_pool_ ? thread_pool_->threadCount() : 1;
+    std::vector<AlignedBuffer> buffers(threads);
+    std::vector<std::vector<std::vector<std::pair<uint32_t, float>>>> partial(
+        threads, std::vector<std::vector<std::pair<uint32_t, float>>>(count));
+    std::vector<size_t> processed(threads, 0);
+    std::atomic<bool> deadline_reached(false);
+    
+    auto scan_cluster = [&](size_t index, size_t slot) {
+        std::vector<ScanEntry>& scan = members.at(clusters[index]);
+        const std::vector<uint32_t>& scan_queries = interested.at(clusters[index]);
+        if (cache_) {
+            auto extents = cachedExtents({clusters[index]}, deadline, buffers[slot]);
+            size_t uncached = 0;
+            for (const ScanEntry& entry : scan) {
+                if (const float* vector = cachedVector(extents, entry.offset)) {
+                    for (uint32_t q : scan_queries) {
+                        offerResult(partial[slot][q], k, entry.vector_id,
+                                    scoreCandidate(queries + q * vector_dim_, query_norms[q], vector, entry.norm));
+                    }
+                    processed[slot]++;
+                } else {
+                    scan[uncached++] = entry;
+                }
+            }
+            scan.resize(uncached);
+        }
+        for (const ScanRun& run : buildScanRuns(scan, SCAN_READ_SPAN)) {
+            if (SearchClock::now() >= deadline) {
+                deadline_reached = true;
+                return;
+            }
+            const char* data = readSpan(run.start, run.end - run.start, buffers[slot]);
+            if (!data) {
+                logger_.error("Failed to read candidate vectors at offset " + std::to_string(run.start));
+                continue;
+            }
+            for (size_t i = run.first; i <= run.last; i++) {
+                const float* vector = reinterpret_cast<const float*>(data + (scan[i].offset - run.start));
+                for (uint32_t q : scan_queries) {
+                    offerResult(partial[slot][q], k, scan[i].vector_id,
+                                scoreCandidate(queries + q * vector_dim_, query_norms[q],
+                                               vector, scan[i].norm));
+                }
+            }
+            processed[slot] += run.last - run.first + 1;
+        }
+    };
+    if (thread_pool_) {
+        thread_pool_->run(clusters.size(), scan_cluster);
+    } else {
+        for (size_t index = 0; index < clusters.size(); index++) {
+            scan_cluster(index, 0);
+        }
+    }
+    
+    size_t total = 0;
+    for (size_t slot = 0; slot < threads; slot++) {
+        for (size_t q = 0; q < count; q++) {
+            for (const auto& result : partial[slot][q]) {
+                offerResult(results[q], k, result.first, result.second);
+            }
+        }
+        total += processed[slot];
+    }
+    for (auto& query_results : results) {
+        finishResults(query_results);
+    }
+    
+    metrics_.countSearch(count, clusters.size(), total, 0);
+    logger_.debug([&] {
+        return "Processed " + std::to_string(total) + " vectors from " + std::to_string(clusters.size()) +
+               " clusters for " + std::to_string(count) + " queries";
+    });
+    if (deadline_reached) {
+        logger_.info("Search deadline of " + std::to_string(params.deadline_us) + " us reached");
+    }
+    return results;
+}
+
+std::vector<std::vector<std::pair<uint32_t, float>>> VectorClusterStore::findSimilarVectorsBatch(
+    const std::vector<Vector>& queries, uint32_t k, const SearchParams& params) {
+    std::vector<float> data;
+    data.reserve(queries.size() * vector_dim_);
+    for (const Vector& query : queries) {
+        if (query.size() != vector_dim_) {
+            logger_.error("Query vector dimension mismatch: got " + std::to_string(query.size()) +
+                        ", expected " + std::to_string(vector_dim_));
+            return {};
+        }
+        data.insert(data.end(), query.begin(), query.end());
+    }
+    return findSimilarVectorsBatch(data.data(), queries.size(), k, params);
+}
+
+bool VectorClusterStore::ensureDeviceOpen(std::shared_lock<std::shared_mutex>& lock) {
+    // A loaded store must stay searchable. Under a long-lived host (the
+    // cbintel uvicorn service) the device fd can end up closed between the
+    // initial load and a later query — the in-memory maps are intact but
+    // findSimilarVectors reads vector data back from the device. Reopen on
+    // demand instead of failing. (A fresh short-lived process never tripped
+    // this; the service did 100% — see #147.) Reopening changes device
+    // state, so it is done under the exclusive lock.
+    while (fd_ < 0) {
+        lock.unlock();
+        {
+            std::lock_guard<std::shared_mutex> exclusive(store_mutex_);
+            if (fd_ < 0 && !openConfiguredDevice()) {
+                logger_.error("Device not open and reopen failed");
+                return false;
+            }
+        }
+        lock.lock();
+    }
+    return true;
+}
+
+std::vector<uint32_t> VectorClusterStore::chooseScanClusters(
+    const float* query, std::vector<uint32_t> ranked, uint32_t requested, uint32_t k,
+    const SearchParams& params, SearchFilter* filter) const {
+    for (;;) {
+        bool exhausted = false;
+        std::vector<uint32_t> scan_clusters = selectScanClusters(query, ranked, k, params, filter, exhausted);
+        // Fewer than requested means every cluster was ranked
+        if (!exhausted || ranked.size() < requested || requested == UINT32_MAX) {
+            return scan_clusters;
+        }
+        requested = requested > UINT32_MAX / 4 ? UINT32_MAX : requested * 4;
+        ranked = clustering_->findClosestClusters(Vector(query, query + vector_dim_), requested);
+    }
+}
+
+std::vector<uint32_t> VectorClusterStore::selectScanClusters(
+    const float* query, const std::vector<uint32_t>& ordered_clusters, uint32_t k,
+    const SearchParams& params, SearchFilter* filter, bool& exhausted) const {
+    // Walk clusters nearest-centroid-first and accumulate a scan set
+    // until we've covered a generous budget of candidate vectors. The
+    // old code hardcoded the 3 nearest clusters, which gave terrible
+    // recall once Forgy seeding spread vectors across many small clusters
+    // (e.g. ~1 vector/cluster on a 140-doc / 100-cluster store → only ~3
+    // of 140 vectors ever examined).
+    //
+    // Budget: at least k*20 vectors (min 200). On small/medium stores
+    // this examines essentially everything (correct, and still fast at
+    // these sizes); on huge stores it prunes the long tail of distant
+    // clusters. params can cap the clusters, set the budget, or prune by
+    // centroid distance instead.
+    size_t scan_budget = std::max<size_t>(static_cast<size_t>(k) * 20, 200);
+    if (params.max_candidates > 0) {
+        scan_budget = params.max_candidates;
+    } else if (params.nprobe > 0) {
+        scan_budget = SIZE_MAX;
+    }
+    const size_t max_clusters = params.nprobe > 0 ? params.nprobe : SIZE_MAX;
+
+    // Clusters come nearest first, so the first one past the distance
+    // bound ends the walk
+    float distance_bound = -1.0f;
+    auto centroid_distance = [&](uint32_t cluster_id) {
+        Vector centroid = clustering_->getClusterCentroid(cluster_id);
+        if (centroid.size() != vector_dim_) {
+            return 0.0f;
+        }
+        return std::sqrt(l2DistanceSquared(query, centroid.data(), vector_dim_));
+    };
+
+    std::vector<uint32_t> scan_clusters;
+    size_t estimated = 0;
+    size_t walked = 0;
+    for (uint32_t cluster_id : ordered_clusters) {
+        if (scan_clusters.size() >= max_clusters) {
+            break;
+        }
+        if (params.prune_ratio > 0.0f) {
+            float distance = centroid_distance(cluster_id);
+            if (distance_bound < 0.0f) {
+                distance_bound = distance * (1.0f + params.prune_ratio);
+            } else if (distance > distance_bound) {
+                break;
+            }
+        }
+        walked++;
+        const size_t size = filter ? matchingMembers(cluster_id, *filter)
+                                   : clustering_->getClusterSize(cluster_id);
+        if (filter && size == 0) {
+            continue;
+        }
+        scan_clusters.push_back(cluster_id);
+        estimated += size;
+        if (estimated >= scan_budget) {
+            break;
+        }
+    }
+    exhausted = walked == ordered_clusters.size() &&
+                scan_clusters.size() < max_clusters && estimated < scan_budget;
+    return scan_clusters;
+}
+
+bool VectorClusterStore::compileFilter(const SearchParams& params, SearchFilter& filter) const {
+    if (params.filter.empty()) {
+        return true;
+    }
+    std::string error;
+    if (!vector_map_.attributes().compile(params.filter, filter.compiled, error)) {
+        logger_.error("Search filter: " + error);
+        return false;
+    }
+    return true;
+}
+
+size_t VectorClusterStore::matchingMembers(uint32_t cluster_id, SearchFilter& filter) const {
+    auto counted = filter.matching.find(cluster_id);
+    if (counted != filter.matching.end()) {
+        return counted->second;
+    }
+    size_t matching = 0;
+    for (uint32_t slot : vector_map_.members(cluster_id)) {
+        matching += vector_map_.matches(filter.compiled, slot);
+    }
+    filter.matching[cluster_id] = matching;
+    return matching;
+}
+
+VectorClusterStore::SearchClock::time_point VectorClusterStore::searchDeadline(
+    const SearchParams& params) {
+    // Anything past a century is no deadline (and would overflow the clock)
+    constexpr uint64_t CENTURY_US = 100ULL * 365 * 24 * 3600 * 1000000;
+    if (params.deadline_us == 0 || params.deadline_us > CENTURY_US) {
+        return SearchClock::time_point::max();
+    }
+    return SearchClock::now() + std::chrono::microseconds(params.deadline_us);
+}
+
+std::vector<VectorClusterStore::ScanRun> VectorClusterStore::buildScanRuns(
+    const std::vector<ScanEntry>& scan, size_t span_limit) const {
+    const size_t vector_size = vector_dim_ * sizeof(float);
+    
+    // Extend a run while the next vector is close enough to read through
+    // to and the run still fits one read
+    std::vector<ScanRun> runs;
+    for (size_t first = 0; first < scan.size();) {
+        ScanRun run{first, first, scan[first].offset, scan[first].offset + vector_size};
+        while (run.last + 1 < scan.size()) {
+            uint64_t next = scan[run.last + 1].offset;
+            if (next > run.end + SCAN_MAX_GAP || next + vector_size - run.start > span_limit) {
+                break;
+            }
+            run.end = std::max(run.end, next + vector_size);
+            run.last++;
+        }
+        runs.push_back(run);
+        first = run.last + 1;
+    }
+    return runs;
+}
+
+size_t VectorClusterStore::scanCandidates(const float* query, float query_norm,
+                                          const std::vector<ScanEntry>& scan, uint32_t k,
+                                          SearchClock::time_point deadline,
+                                          std::vector<std::pair<uint32_t, float>>& top,
+                                          AlignedBuffer& buffer) {
+    const size_t vector_size = vector_dim_ * sizeof(float);
+    const size_t threads = thread_pool_ ? thread_pool_->threadCount() : 1;
+    
+    // With several threads, cap runs so each thread gets a few
+    size_t span_limit = SCAN_READ_SPAN;
+    if (threads > 1) {
+        span_limit = std::clamp(scan.size() * vector_size / (threads * PARALLEL_SCAN_RUNS_PER_THREAD),
+                                PARALLEL_SCAN_MIN_SPAN, SCAN_READ_SPAN);
+    }
+    std::vector<ScanRun> runs = buildScanRuns(scan, span_limit);
+    
+    if (threads > 1 && runs.size() > 1) {
+        return scanRunsParallel(query, query_norm, scan, runs, k, deadline, top);
+    }
+    
+    // The ring has a single submitter. A search that finds it busy reads
+    // with pread instead, which concurrent searches can share.
+    {
+        std::unique_lock<std::mutex> engine_lock(io_engine_mutex_, std::try_to_lock);
+        if (engine_lock.owns_lock() && io_engine_) {
+            return scanRunsAsync(query, query_norm, scan, runs, k, deadline, top);
+        }
+    }
+    
+    size_t processed = 0;
+    for (const ScanRun& run : runs) {
+        if (SearchClock::now() >= deadline) {
+            break;
+        }
+        const char* data = readSpan(run.start, run.end - run.start, buffer);
+        if (!data) {
+            logger_.error("Failed to read candidate vectors at offset " + std::to_string(run.start));
+            continue;
+        }
+        scoreRun(query, query_norm, scan, run, data, k, top);
+        processed += run.last - run.first + 1;
+    }
+    
+    return processed;
+}
+
+size_t VectorClusterStore::scanRunsAsync(const float* query, float query_norm,
+                                         const std::vector<ScanEntry>& scan,
+                                         const std::vector<ScanRun>& runs, uint32_t k,
+                                         SearchClock::time_point deadline,
+                                         std::vector<std::pair<uint32_t, float>>& top) {
+    // One buffer per queue slot; a slot's buffer is reused once its run
+    // has been scored
+    struct Slot {
+        AlignedBuffer buffer;
+        size_t run = 0;
+        size_t adjustment = 0;
+        size_t bytes = 0;
+        bool in_flight = false;
+    };
+    const size_t slot_count = std::min<size_t>(io_engine_->queueDepth(), runs.size());
+    std::vector<Slot> slots(slot_count);
+    std::vector<size_t> free_slots;
+    for (size_t i = slot_count; i > 0; i--) {
+        free_slots.push_back(i - 1);
+    }
+    
+    size_t processed = 0;
+    size_t next = 0;
+    size_t in_flight = 0;
+    size_t in_flight_bytes = 0;
+    
+    while (next < runs.size() || in_flight > 0) {
+        // Past the deadline, queue nothing more and finish what's in flight
+        if (next < runs.size() && SearchClock::now() >= deadline) {
+            next = runs.size();
+        }
+        
+        // Queue as many runs as slots and the byte budget allow
+        while (next < runs.size() && !free_slots.empty()) {
+            const ScanRun& run = runs[next];
+            size_t size = run.end - run.start;
+            if (in_flight > 0 && in_flight_bytes + size > ASYNC_SCAN_INFLIGHT_BYTES) {
+                break;
+            }
+            
+            Slot& slot = slots[free_slots.back()];
+            uint64_t read_offset;
+            size_t read_size;
+            if (!prepareSpan(run.start, size, slot.buffer, read_offset, read_size) ||
+                !io_engine_->queueRead(fd_, slot.buffer.data, read_size, read_offset, free_slots.back())) {
+                // Read this one synchronously instead
+                const char* data = readSpan(run.start, size, slot.buffer);
+                if (data) {
+                    scoreRun(query, query_norm, scan, run, data, k, top);
+                    processed += run.last - run.first + 1;
+                } else {
+                    logger_.error("Failed to read candidate vectors at offset " + std::to_string(run.start));
+                }
+                next++;
+                continue;
+            }
+            
+            metrics_.countRead(read_size);
+            slot.run = next;
+            slot.adjustment = run.start - read_offset;
+            slot.bytes = size;
+            slot.in_flight = true;
+            free_slots.pop_back();
+            in_flight++;
+            in_flight_bytes += size;
+            next++;
+        }
+        
+        if (in_flight == 0) {
+            continue;
+        }
+        
+        uint64_t tag;
+        int64_t result;
+        if (!io_engine_->submit() || !io_engine_->waitCompletion(tag, result)) {
+            // The ring is unusable and reads may still be in flight into
+            // the slot buffers, so those buffers are leaked rather than
+            // freed under the kernel. Drop the engine (later scans use
+            // pread) and read the runs this scan hasn't scored with pread:
+            // those in flight, then the unqueued ones while time remains.
+            logger_.error("io_uring failed, falling back to pread");
+            std::vector<size_t> remaining;
+            for (Slot& leaked : slots) {
+                if (leaked.in_flight) {
+                    remaining.push_back(leaked.run);
+                }
+                leaked.buffer.data = nullptr;
+            }
+            io_engine_.reset();
+            
+            AlignedBuffer buffer;
+            const size_t queued = remaining.size();
+            for (; next < runs.size(); next++) {
+                remaining.push_back(next);
+            }
+            for (size_t i = 0; i < remaining.size(); i++) {
+                if (i >= queued && SearchClock::now() >= deadline) {
+                    break;
+                }
+                const ScanRun& run = runs[remaining[i]];
+                const char* data = readSpan(run.start, run.end - run.start, buffer);
+                if (!data) {
+                    logger_.error("Failed to read candidate vectors at offset " + std::to_string(run.start));
+                    continue;
+                }
+                scoreRun(query, query_norm, scan, run, data, k, top);
+                processed += run.last - run.first + 1;
+            }
+            return processed;
+        }
+        
+        Slot& slot = slots[tag];
+        slot.in_flight = false;
+        const ScanRun& run = runs[slot.run];
+        const char* data = static_cast<const char*>(slot.buffer.data) + slot.adjustment;
+        if (result < static_cast<int64_t>(slot.adjustment + slot.bytes)) {
+            // Failed or short: retry synchronously
+            data = readSpan(run.start, slot.bytes, slot.buffer);
+        }
+        if (data) {
+            scoreRun(query, query_norm, scan, run, data, k, top);
+            processed += run.last - run.first + 1;
+        } else {
+            logger_.error("Failed to read candidate vectors at offset " + std::to_string(run.start));
+        }
+        
+        free_slots.push_back(tag);
+        in_flight--;
+        in_flight_bytes -= slot.bytes;
+    }
+    
+    return processed;
+}
+
+size_t VectorClusterStore::scanRunsParallel(const float* query, float query_norm,
+                                            const std::vector<ScanEntry>& scan,
+                                            const std::vector<ScanRun>& runs, uint32_t k,
+                                            SearchClock::time_point deadline,
+                                            std::vector<std::pair<uint32_t, float>>& top) {
+    const size_t threads = thread_pool_->threadCount();
+    std::vector<AlignedBuffer> buffers(threads);
+    std::vector<std::vector<std::pair<uint32_t, float>>> partial(threads);
+    std::vector<size_t> processed(threads, 0);
+    
+    thread_pool_->run(runs.size(), [&](size_t index, size_t slot) {
+        if (SearchClock::now() >= deadline) {
+            return;
+        }
+        const ScanRun& run = runs[index];
+        const char* data = readSpan(run.start, run.end - run.start, buffers[slot]);
+        if (!data) {
+            logger_.error("Failed to read candidate vectors at offset " + std::to_string(run.start));
+            return;
+        }
+        scoreRun(query, query_norm, scan, run, data, k, partial[slot]);
+        processed[slot] += run.last - run.first + 1;
+    });
+    
+    size_t total = 0;
+    for (size_t slot = 0; slot < threads; slot++) {
+        for (const auto& result : partial[slot]) {
+            offerResult(top, k, result.first, result.second);
+        }
+        total += processed[slot];
+    }
+    return total;
+}
+
+void VectorClusterStore::scoreRun(const float* query, float query_norm,
+                                  const std::vector<ScanEntry>& scan, const ScanRun& run,
+                                  const char* data, uint32_t k,
+                                  std::vector<std::pair<uint32_t, float>>& top) {
+    for (size_t i = run.first; i <= run.last; i++) {
+        const float* vector = reinterpret_cast<const float*>(data + (scan[i].offset - run.start));
+        offerResult(top, k, scan[i].vector_id,
+                    scoreCandidate(query, query_norm, vector, scan[i].norm));
+    }
+}
+
+std::vector<std::shared_ptr<const ClusterCache::Extent>> VectorClusterStore::cachedExtents(
+    const std::vector<uint32_t>& clusters, SearchClock::time_point deadline, AlignedBuffer& buffer) {
+    std::vector<std::shared_ptr<const ClusterCache::Extent>> extents;
+    const uint64_t slot_size = vectorSlotSize();
+    for (uint32_t cluster_id : clusters) {
+        auto it = cluster_extents_.find(cluster_id);
+        if (it == cluster_extents_.end() || it->second.used == 0) {
+            continue;
+        }
+        const uint64_t start = it->second.start_offset;
+        const uint64_t size = it->second.used * slot_size;
+        std::shared_ptr<const ClusterCache::Extent> extent = cache_->find(start);
+        if (!extent && cache_->admit(start, size) && SearchClock::now() < deadline) {
+            // The whole extent in one read, holes and all
+            if (const char* data = readSpan(start, size, buffer)) {
+                extent = cache_->insert(start, std::vector<char>(data, data + size));
+            }
+        }
+        if (extent) {
+            extents.push_back(std::move(extent));
+        }
+    }
+    std::sort(extents.begin(), extents.end(), [](const auto& a, const auto& b) { return a->start < b->start; });
+    return extents;
+}
+
+const float* VectorClusterStore::cachedVector(
+    const std::vector<std::shared_ptr<const ClusterCache::Extent>>& extents, uint64_t offset) const {
+    auto it = std::upper_bound(extents.begin(), extents.end(), offset,
+                               [](uint64_t value, const auto& extent) { return value < extent->start; });
+    if (it == extents.begin()) {
+        return nullptr;
+    }
+    return reinterpret_cast<const float*>((*std::prev(it))->span(offset, vector_dim_ * sizeof(float)));
+}
+
+bool VectorClusterStore::streamVectors(const VectorVisitor& visit) {
+    // Every stored vector in device order, read in coalesced runs spread
+    // over the pool. The runs are scored straight out of the read buffers.
+    std::vector<ScanEntry> scan;
+    scan.reserve(vector_map_.size());
+    for (uint32_t slot = 0; slot < vector_map_.size(); slot++) {
+        scan.push_back(scanEntry(slot));
+    }
+    std::sort(scan.begin(), scan.end(),
+              [](const ScanEntry& a, const ScanEntry& b) { return a.offset < b.offset; });
+    std::vector<ScanRun> runs = buildScanRuns(scan, SCAN_READ_SPAN);
+    
+    std::vector<AlignedBuffer> buffers(thread_pool_->threadCount());
+    std::atomic<bool> read_failed(false);
+    thread_pool_->run(runs.size(), [&](size_t index, size_t slot) {
+        const ScanRun& run = runs[index];
+        const char* data = readSpan(run.start, run.end - run.start, buffers[slot]);
+        if (!data) {
+            logger_.error("Failed to read vectors at offset " + std::to_string(run.start));
+            read_failed = true;
+            return;
+        }
+        for (size_t i = run.first; i <= run.last; i++) {
+            visit(scan[i].vector_id, reinterpret_cast<const float*>(data + (scan[i].offset - run.start)),
+                  slot);
+        }
+    });
+    return !read_failed;
+}
+
+void VectorClusterStore::removeFromModel(uint32_t slot, Vector* removed) {
+    // The model keeps no copy of the vector, so hand it the data to take
+    // out of the centroid. If the read fails the centroid is corrected at
+    // the next rebalance.
+    Vector vector;
+    if (readVector(vector_map_.offset(slot), vector)) {
+        clustering_->removeVector(vector_map_.id(slot), vector.data());
+    } else {
+        clustering_->removeVector(vector_map_.id(slot));
+        vector.clear();
+    }
+    if (removed) {
+        *removed = std::move(vector);
+    }
+}
+
+void VectorClusterStore::restoreToModel(uint32_t slot, const Vector& vector) {
+    if (vector.empty()) {
+        return;  // never read, so left to the next rebalance
+    }
+    const uint32_t vector_id = vector_map_.id(slot);
+    const uint32_t cluster_id = vector_map_.cluster(slot);
+    clustering_->addVector(vector, vector_id);
+    if (clustering_->getVectorCluster(vector_id) != cluster_id) {
+        clustering_->moveVectors({vector_id}, cluster_id, vector.data());
+    }
+}
+
+void VectorClusterStore::collectQuantizedCandidates(
+    const float* query, const std::vector<uint32_t>& scan_clusters, uint32_t k,
+    SearchClock::time_point deadline, const SearchFilter* filter, std::vector<ScanEntry>& scan,
+    SearchStats& stats) {
+    const size_t code_size = quantizer_->codeSize();
+    const uint32_t rerank = static_cast<uint32_t>(
+        std::min<uint64_t>(static_cast<uint64_t>(k) * std::max(1u, options_.rerank_factor), UINT32_MAX));
+    
+    // Codes are scored in chunks of up to SCAN_READ_SPAN bytes, spread
+    // over the pool
+    struct CodeChunk {
+        const QuantizedCluster* cluster;
+        size_t first;
+        size_t count;
+    };
+    const size_t codes_per_chunk = std::max<size_t>(1, SCAN_READ_SPAN / code_size);
+    std::vector<CodeChunk> chunks;
+    for (uint32_t cluster_id : scan_clusters) {
+        auto it = quantized_clusters_.find(cluster_id);
+        if (it == quantized_clusters_.end()) {
+            continue;
+        }
+        const size_t count = it->second.ids.size();
+        for (size_t first = 0; first < count; first += codes_per_chunk) {
+            chunks.push_back({&it->second, first, std::min(codes_per_chunk, count - first)});
+        }
+    }
+    if (chunks.empty()) {
+        return;
+    }
+    
+    std::vector<float> table;
+    quantizer_->prepareQuery(query, table);
+    
+    const size_t threads = thread_pool_->threadCount();
+    std::vector<AlignedBuffer> buffers(threads);
+    std::vector<std::vector<float>> scores(threads);
+    std::vector<std::vector<std::pair<uint32_t, float>>> partial(threads);
+    std::vector<size_t> scored(threads, 0);
+    std::atomic<bool> deadline_reached(false);
+    
+    thread_pool_->run(chunks.size(), [&](size_t index, size_t slot) {
+        if (SearchClock::now() >= deadline) {
+            deadline_reached = true;
+            return;
+        }
+        const CodeChunk& chunk = chunks[index];
+        const QuantizedCluster& cluster = *chunk.cluster;
+        const char* codes = readSpan(cluster.codes_offset + chunk.first * code_size,
+                                     chunk.count * code_size, buffers[slot]);
+        if (!codes) {
+            logger_.error("Failed to read quantized codes at offset " +
+                         std::to_string(cluster.codes_offset));
+            return;
+        }
+        // Codes hold the residual from the cluster centroid
+        const float base = dotProduct(query, cluster.centroid.data(), vector_dim_);
+        std::vector<float>& dots = scores[slot];
+        dots.resize(chunk.count);
+        quantizer_->approximateDots(table, reinterpret_cast<const uint8_t*>(codes), chunk.count,
+                                    dots.data());
+        for (size_t i = 0; i < chunk.count; i++) {
+            // Codes come in whole chunks, so the filter applies to the
+            // candidates they offer
+            if (filter) {
+                uint32_t member = vector_map_.find(cluster.ids[chunk.first + i]);
+                if (member == VectorIndex::NO_SLOT || !vector_map_.matches(filter->compiled, member)) {
+                    continue;
+                }
+            }
+            float norm = cluster.norms[chunk.first + i];
+            float score = base + dots[i];
+            offerResult(partial[slot], rerank, cluster.ids[chunk.first + i],
+                        norm > 0.0f ? score / norm : score);
+        }
+        scored[slot] += chunk.count;
+    });
+    
+    std::vector<std::pair<uint32_t, float>> candidates;
+    size_t total = 0;
+    for (size_t slot = 0; slot < threads; slot++) {
+        for (const auto& result : partial[slot]) {
+            offerResult(candidates, rerank, result.first, result.second);
+        }
+        total += scored[slot];
+    }
+    stats.codes_scored = total;
+    stats.deadline_reached = deadline_reached;
+    
+    // A code whose vector was deleted or overwritten since the index was
+    // built is stale; an overwritten vector is read as uncoded instead
+    for (const auto& candidate : candidates) {
+        uint32_t slot = vector_map_.find(candidate.first);
+        if (slot != VectorIndex::NO_SLOT && vector_map_.quantized(slot)) {
+            scan.push_back(scanEntry(slot));
+        }
+    }
+}
+
+bool VectorClusterStore::deleteVector(uint32_t vector_id) {
+    StoreMetrics::Scope metrics(metrics_, StoreMetrics::REMOVE);
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
+    
+    if (fd_ < 0) {
+        logger_.error("Device not open");
+        return false;
+    }
+    if (!checkWritable("deleteVector")) {
+        return false;
+    }
+    
+    // Check if vector exists
+    uint32_t slot = vector_map_.find(vector_id);
+    if (slot == VectorIndex::NO_SLOT) {
+        logger_.error("Vector " + std::to_string(vector_id) + " not found");
+        return false;
+    }
+    
+    // Get vector data to remove from clustering model
+    Vector vector(vector_dim_);
+    if (!readVector(vector_map_.offset(slot), vector)) {
+        logger_.error("Failed to read vector data for deletion");
+        return false;
+    }
+    
+    // Remove from clustering model
+    clustering_->removeVector(vector_id, vector.data());
+    
+    // Remove from vector map. The slot is free for reuse after the next
+    // checkpoint.
+    VectorEntry removed = vector_map_.entry(slot);
+    freeVectorSlot(slot);
+    vector_map_.erase(slot);
+
+    // Log the delete
+    if (!persistOperations(WAL_DELETE, {removed})) {
+        logger_.error("Failed to update metadata after deletion");
+        return false;
+    }
+
+    logger_.debug([&] { return "Deleted vector " + std::to_string(vector_id); });
+    return true;
+}
+
+bool VectorClusterStore::performMaintenance() {
+    StoreMetrics::Scope metrics(metrics_, StoreMetrics::MAINTENANCE);
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
+    
+    if (!checkWritable("performMaintenance")) {
+        return false;
+    }
+    if (options_.train_on_maintenance && !vector_map_.empty()) {
+        const size_t clusters = clustering_->getAllClusters().size();
+        std::vector<float> sample;
+        if (!sampleVectors(std::max(TRAINING_SAMPLE_MIN, clusters * TRAINING_SAMPLE_PER_CLUSTER), sample) ||
+            !trainModel(sample.data(), sample.size() / vector_dim_)) {
+            logger_.error("Failed to retrain clusters, refining the current ones");
+        }
+    }
+    return maintain();
+}
+
+bool VectorClusterStore::train(const float* sample, size_t count) {
+    StoreMetrics::Scope metrics(metrics_, StoreMetrics::MAINTENANCE);
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
+    
+    if (fd_ < 0) {
+        logger_.error("Device not open");
+        return false;
+    }
+    if (!checkWritable("train")) {
+        return false;
+    }
+    if (!trainModel(sample, count)) {
+        return false;
+    }
+    // An empty store only needs the model checkpointed
+    return vector_map_.empty() ? flushMetadata() : maintain();
+}
+
+bool VectorClusterStore::train(const std::vector<Vector>& sample) {
+    std::vector<float> data;
+    data.reserve(sample.size() * vector_dim_);
+    for (const Vector& vector : sample) {
+        if (vector.size() != vector_dim_) {
+            logger_.error("Training vector dimension mismatch: got " + std::to_string(vector.size()) +
+                        ", expected " + std::to_string(vector_dim_));
+            return false;
+        }
+        data.insert(data.end(), vector.begin(), vector.end());
+    }
+    return train(data.data(), sample.size());
+}
+
+bool VectorClusterStore::trainModel(const float* sample, size_t count) {
+    if (count == 0) {
+        logger_.error("Cannot train on an empty sample");
+        return false;
+    }
+    if (!clustering_->train(sample, count, TrainingOptions())) {
+        logger_.error("Failed to train clustering model");
+        return false;
+    }
+    return true;
+}
+
+bool VectorClusterStore::sampleVectors(size_t count, std::vector<float>& sample) {
+    // Pick the slots, then read them in device order
+    std::vector<uint32_t> slots(vector_map_.size());
+    std::iota(slots.begin(), slots.end(), 0);
+    if (count < slots.size()) {
+        std::mt19937 rng(static_cast<uint32_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+        for (size_t i = 0; i < count; i++) {
+            std::swap(slots[i], slots[std::uniform_int_distribution<size_t>(i, slots.size() - 1)(rng)]);
+        }
+        slots.resize(count);
+    }
+    std::vector<ScanEntry> scan;
+    scan.reserve(slots.size());
+    for (uint32_t slot : slots) {
+        scan.push_back(scanEntry(slot));
+    }
+    std::sort(scan.begin(), scan.end(),
+              [](const ScanEntry& a, const ScanEntry& b) { return a.offset < b.offset; });
+    std::vector<ScanRun> runs = buildScanRuns(scan, SCAN_READ_SPAN);
+    
+    const size_t vector_size = vector_dim_ * sizeof(float);
+    sample.resize(scan.size() * vector_dim_);
+    std::vector<AlignedBuffer> buffers(thread_pool_->threadCount());
+    std::atomic<bool> read_failed(false);
+    thread_pool_->run(runs.size(), [&](size_t index, size_t slot) {
+        const ScanRun& run = runs[index];
+        const char* data = readSpan(run.start, run.end - run.start, buffers[slot]);
+        if (!data) {
+            logger_.error("Failed to read vectors at offset " + std::to_string(run.start));
+            read_failed = true;
+            return;
+        }
+        for (size_t i = run.first; i <= run.last; i++) {
+            memcpy(sample.data() + i * vector_dim_, data + (scan[i].offset - run.start), vector_size);
+        }
+    });
+    return !read_failed;
+}
+
+bool VectorClusterStore::maintain() {
+    logger_.info("Performing maintenance");
+    
+    // Rebalance clusters
+    if (clustering_->rebalance()) {
+        logger_.info("Clusters rebalanced");
+        
+        // Take over the model's new assignments
+        for (uint32_t slot = 0; slot < vector_map_.size(); slot++) {
+            uint32_t new_cluster = clustering_->getVectorCluster(vector_map_.id(slot));
+            if (new_cluster != UINT32_MAX && new_cluster != vector_map_.cluster(slot)) {
+                logger_.debug([&] {
+                    return "Moving vector " + std::to_string(vector_map_.id(slot)) + " from cluster " +
+                           std::to_string(vector_map_.cluster(slot)) + " to " + std::to_string(new_cluster);
+                });
+                vector_map_.setCluster(slot, new_cluster);
+            }
+        }
+    }
+    
+    // Compact every cluster whose members don't exactly fill the front of
+    // its extent: vectors the rebalance moved in, members left behind in
+    // earlier extents as the cluster grew, holes from deletes, or a store
+    // written before extents existed. The old copies stay intact until the
+    // checkpoint below, so a crash part way leaves the store as it was.
+    std::unordered_map<uint32_t, std::vector<uint32_t>> members = vector_map_.clusterMembers();
+    size_t compacted = 0;
+    for (auto& [cluster_id, cluster_members] : members) {
+        if (isClusterCompact(cluster_id, cluster_members)) {
+            continue;
+        }
+        if (!compactCluster(cluster_id, cluster_members)) {
+            logger_.error("Failed to compact cluster " + std::to_string(cluster_id));
+            continue;
+        }
+        compacted++;
+    }
+    if (compacted > 0) {
+        logger_.info("Compacted " + std::to_string(compacted) + " clusters");
+    }
+    
+    // Re-encode every cluster against the current centroids, which also
+    // folds vectors stored since the last build into the codes
+    if (options_.quantization != QuantizationType::NONE &&
+        !buildQuantizedIndex(members)) {
+        logger_.error("Failed to build quantized index, searching full-precision vectors");
+        dropQuantizedIndex();
+    }
+    
+    // Checkpoint the model and vector map. This must be a full checkpoint,
+    // not a bare cluster map rewrite: a model newer than the vector map
+    // would have WAL inserts replayed into it a second time on reopen.
+    if (!flushMetadata()) {
+        logger_.error("Failed to update metadata after maintenance");
+        return false;
+    }
+    
+    logger_.info("Maintenance completed");
+    return true;
+}
+
+size_t VectorClusterStore::compactStorage(size_t max_moves) {
+    StoreMetrics::Scope metrics(metrics_, StoreMetrics::MAINTENANCE);
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
+    
+    // An open batch owns the log until it commits
+    if (fd_ < 0 || batch_active_ || options_.read_only) {
+        return 0;
+    }
+    
+    const uint64_t slot_size = vectorSlotSize();
+    const size_t vector_size = vector_dim_ * sizeof(float);
+    std::vector<char> buffer(vector_size);
+    std::vector<VectorEntry> moves;
+    
+    // Copy one member to the slot allocateVectorSpace hands out. The old
+    // copy stays intact until the checkpoint after its move is logged.
+    auto relocate = [&](uint32_t cluster_id, uint32_t slot) {
+        const uint64_t from = vector_map_.offset(slot);
+        if (!readAligned(buffer.data(), vector_size, from)) {
+            logger_.error("Failed to read vector " + std::to_string(vector_map_.id(slot)) +
+                         " for compaction");
+            return false;
+        }
+        const uint64_t to = allocateVectorSpace(cluster_id);
+        if (!writeAligned(buffer.data(), vector_size, to)) {
+            logger_.error("Failed to relocate vector " + std::to_string(vector_map_.id(slot)));
+            freeSpace(cluster_id, to, slot_size);
+            return false;
+        }
+        freeSpace(cluster_id, from, slot_size);
+        vector_map_.setOffset(slot, to);
+        
+        VectorEntry entry;
+        entry.vector_id = vector_map_.id(slot);
+        entry.cluster_id = cluster_id;
+        entry.offset = to;
+        entry.data_crc = walDataCrc(reinterpret_cast<const float*>(buffer.data()));
+        moves.push_back(entry);
+        return true;
+    };
+    
+    bool failed = false;
+    for (auto& [cluster_id, extent] : cluster_extents_) {
+        if (moves.size() >= max_moves || failed) {
+            break;
+        }
+        if (!extent.scattered && extent.free_slots.empty()) {
+            continue;
+        }
+        
+        // Members outside the extent first, as long as it has room for
+        // them; then the members furthest back, into the holes in front
+        // of them. Coded members are left for maintenance.
+        const uint64_t extent_end = extent.start_offset + static_cast<uint64_t>(extent.capacity) * slot_size;
+        std::vector<uint32_t> outside;
+        std::vector<std::pair<uint32_t, uint32_t>> inside;  // extent slot, index slot
+        for (uint32_t slot : vector_map_.members(cluster_id)) {
+            const uint64_t offset = vector_map_.offset(slot);
+            if (offset < extent.start_offset || offset >= extent_end) {
+                if (!vector_map_.quantized(slot)) {
+                    outside.push_back(slot);
+                }
+            } else if (!vector_map_.quantized(slot)) {
+                inside.push_back({static_cast<uint32_t>((offset - extent.start_offset) / slot_size), slot});
+            }
+        }
+        if (outside.empty()) {
+            extent.scattered = false;
+        }
+        
+        for (uint32_t slot : outside) {
+            if (moves.size() >= max_moves ||
+                (extent.free_slots.empty() && extent.used == extent.capacity)) {
+                break;
+            }
+            if (!relocate(cluster_id, slot)) {
+                failed = true;
+                break;
+            }
+        }
+        
+        std::sort(inside.begin(), inside.end(), std::greater<std::pair<uint32_t, uint32_t>>());
+        for (const auto& [extent_slot, slot] : inside) {
+            if (failed || moves.size() >= max_moves || extent.free_slots.empty() ||
+                *extent.free_slots.begin() >= extent_slot) {
+                break;
+            }
+            if (!relocate(cluster_id, slot)) {
+                failed = true;
+            }
+        }
+    }
+    
+    if (!moves.empty()) {
+        if (!persistOperations(WAL_MOVE, moves)) {
+            logger_.error("Failed to log compaction moves");
+        }
+        logger_.debug("Compaction relocated " + std::to_string(moves.size()) + " vectors");
+    } else if (!pending_free_.empty() && !failed) {
+        // Pass complete: checkpoint so the space it vacated can be reused
+        if (!flushMetadata()) {
+            logger_.error("Failed to checkpoint after compaction");
+        }
+    }
+    return moves.size();
+}
+
+size_t VectorClusterStore::maintenanceStep(size_t max_clusters, uint64_t* io_bytes) {
+    StoreMetrics::Scope metrics(metrics_, StoreMetrics::MAINTENANCE);
+    if (io_bytes) {
+        *io_bytes = 0;
+    }
+    if (options_.read_only) {
+        return 0;
+    }
+    const size_t vector_size = vector_dim_ * sizeof(float);
+    
+    // One cluster being split or merged away: its members as read, and
+    // the cluster each one goes to (from, for those that stay)
+    struct ClusterMove {
+        uint32_t from;
+        uint32_t split_into;  // UINT32_MAX for a merge
+        std::vector<uint32_t> ids;
+        std::vector<uint64_t> offsets;
+        std::vector<float> data;  // a row of vector_dim floats per id
+        std::vector<uint32_t> targets;
+    };
+    std::vector<ClusterMove> plan;
+    uint64_t checkpoint = 0;
+    uint64_t bytes_read = 0;
+    
+    {
+        std::shared_lock<std::shared_mutex> lock(store_mutex_);
+        // An open batch owns the log until it commits
+        if (fd_ < 0 || batch_active_ || vector_map_.empty()) {
+            return 0;
+        }
+        checkpoint = checkpoint_count_;
+        
+        const auto& clusters = vector_map_.clusterMembers();
+        std::vector<uint32_t> empty = clustering_->getEmptyClusters();
+        size_t occupied = 0;
+        for (const auto& [cluster_id, members] : clusters) {
+            occupied += members.empty() ? 0 : 1;
+        }
+        const double mean = static_cast<double>(vector_map_.size()) / (occupied + empty.size());
+        
+        std::vector<std::pair<size_t, uint32_t>> oversized;   // size, cluster
+        std::vector<std::pair<size_t, uint32_t>> undersized;
+        for (const auto& [cluster_id, members] : clusters) {
+            const size_t size = members.size();
+            if (size >= 2 && size > options_.split_ratio * mean) {
+                oversized.push_back({size, cluster_id});
+            } else if (size > 0 && size < options_.merge_ratio * mean) {
+                undersized.push_back({size, cluster_id});
+            }
+        }
+        std::sort(oversized.begin(), oversized.end(), std::greater<std::pair<size_t, uint32_t>>());
+        std::sort(undersized.begin(), undersized.end());
+        
+        // The largest clusters first, as many as there are empty clusters
+        // to split them into; then the smallest, whose merges leave empty
+        // clusters for later splits
+        size_t next_empty = 0;
+        for (const auto& [size, cluster_id] : oversized) {
+            if (plan.size() >= max_clusters || next_empty >= empty.size()) {
+                break;
+            }
+            plan.push_back({cluster_id, empty[next_empty++], {}, {}, {}, {}});
+        }
+        std::unordered_set<uint32_t> merging;
+        for (const auto& [size, cluster_id] : undersized) {
+            // Keep at least two clusters
+            if (plan.size() >= max_clusters || merging.size() + 2 >= occupied) {
+                break;
+            }
+            plan.push_back({cluster_id, UINT32_MAX, {}, {}, {}, {}});
+            merging.insert(cluster_id);
+        }
+        if (plan.empty()) {
+            return 0;
+        }
+        
+        // The nearest cluster other than from that keeps its members, and
+        // the squared distance to its centroid
+        auto nearestOther = [&](const float* vector, uint32_t from, float& distance) {
+            Vector query(vector, vector + vector_dim_);
+            for (uint32_t candidate : clustering_->findClosestClusters(query, REASSIGN_CANDIDATES)) {
+                auto it = clusters.find(candidate);
+                if (candidate == from || merging.count(candidate) > 0 ||
+                    it == clusters.end() || it->second.empty()) {
+                    continue;
+                }
+                Vector centroid = clustering_->getClusterCentroid(candidate);
+                if (centroid.size() != vector_dim_) {
+                    continue;
+                }
+                distance = l2DistanceSquared(vector, centroid.data(), vector_dim_);
+                return candidate;
+            }
+            return UINT32_MAX;
+        };
+        
+        for (ClusterMove& move : plan) {
+            // Copy out the members
+            const std::vector<uint32_t>& members = vector_map_.members(move.from);
+            const size_t count = members.size();
+            move.ids.resize(count);
+            move.offsets.resize(count);
+            move.data.resize(count * vector_dim_);
+            for (size_t k = 0; k < count; k++) {
+                move.ids[k] = vector_map_.id(members[k]);
+                move.offsets[k] = vector_map_.offset(members[k]);
+            }
+            std::atomic<bool> read_failed(false);
+            thread_pool_->run((count + MAINTENANCE_READ_GRAIN - 1) / MAINTENANCE_READ_GRAIN,
+                              [&](size_t task, size_t) {
+                size_t end = std::min(count, (task + 1) * MAINTENANCE_READ_GRAIN);
+                for (size_t k = task * MAINTENANCE_READ_GRAIN; k < end && !read_failed; k++) {
+                    if (!readAligned(move.data.data() + k * vector_dim_, vector_size, move.offsets[k])) {
+                        logger_.error("Failed to read vector " + std::to_string(move.ids[k]) +
+                                     " for maintenance");
+                        read_failed = true;
+                    }
+                }
+            });
+            if (read_failed) {
+                return 0;
+            }
+            bytes_read += count * vector_size;
+            
+            // A merged cluster's members each go to their nearest other
+            // cluster. A split keeps the larger half of a two-way k-means
+            // and hands the other to the empty cluster, except for members
+            // a neighbouring centroid is nearer to than their half's.
+            move.targets.assign(count, move.from);
+            std::array<Vector, 2> centres;
+            std::vector<uint8_t> side;
+            uint8_t leaving = 0;
+            if (move.split_into != UINT32_MAX) {
+                side = splitTwoWays(move.data.data(), count, vector_dim_, SPLIT_ITERATIONS, centres);
+                const size_t second = std::count(side.begin(), side.end(), 1);
+                if (second == 0 || second == count) {
+                    continue;  // identical vectors don't split
+                }
+                leaving = (second <= count / 2) ? 1 : 0;
+            }
+            for (size_t k = 0; k < count; k++) {
+                const float* vector = move.data.data() + k * vector_dim_;
+                float neighbour_distance = 0.0f;
+                uint32_t neighbour = nearestOther(vector, move.from, neighbour_distance);
+                if (move.split_into == UINT32_MAX) {
+                    if (neighbour != UINT32_MAX) {
+                        move.targets[k] = neighbour;
+                    }
+                    continue;
+                }
+                const uint32_t half = (side[k] == leaving) ? move.split_into : move.from;
+                if (neighbour != UINT32_MAX &&
+                    neighbour_distance < l2DistanceSquared(vector, centres[side[k]].data(), vector_dim_)) {
+                    move.targets[k] = neighbour;
+                } else {
+                    move.targets[k] = half;
+                }
+            }
+        }
+    }
+    if (io_bytes) {
+        *io_bytes = bytes_read;
+    }
+    
+    // Write the moved copies and switch the entries over in one go
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
+    if (fd_ < 0 || batch_active_) {
+        return 0;
+    }
+    // A checkpoint since the reads may have let a slot be freed and
+    // refilled by another copy of the same vector; read again next step
+    if (checkpoint_count_ != checkpoint) {
+        logger_.debug("Store checkpointed during a maintenance step, retrying it later");
+        return 0;
+    }
+    
+    const uint64_t slot_size = vectorSlotSize();
+    std::vector<VectorEntry> moves;
+    size_t splits = 0;
+    size_t merges = 0;
+    bool failed = false;
+    for (ClusterMove& move : plan) {
+        if (failed) {
+            break;
+        }
+        if (move.split_into != UINT32_MAX && vector_map_.members(move.split_into).empty()) {
+            reserveEmptyExtent(move.split_into, static_cast<uint32_t>(
+                std::count(move.targets.begin(), move.targets.end(), move.split_into)));
+        }
+        // Moved vectors by cluster, for the model
+        std::map<uint32_t, std::pair<std::vector<uint32_t>, std::vector<float>>> moved;
+        for (size_t k = 0; k < move.ids.size(); k++) {
+            const uint32_t target = move.targets[k];
+            if (target == move.from) {
+                continue;
+            }
+            // Skip vectors deleted, overwritten or moved since they were read
+            uint32_t slot = vector_map_.find(move.ids[k]);
+            if (slot == VectorIndex::NO_SLOT || vector_map_.cluster(slot) != move.from ||
+                vector_map_.offset(slot) != move.offsets[k]) {
+                continue;
+            }
+            const float* row = move.data.data() + k * vector_dim_;
+            const uint64_t to = allocateVectorSpace(target);
+            if (!writeAligned(row, vector_size, to)) {
+                logger_.error("Failed to move vector " + std::to_string(move.ids[k]) +
+                             " to cluster " + std::to_string(target));
+                freeSpace(target, to, slot_size);
+                failed = true;
+                break;
+            }
+            // The old copy (pinned if coded) is freed after the checkpoint;
+            // the code scored it against the old cluster's centroid
+            freeVectorSlot(slot);
+            vector_map_.setQuantized(slot, false);
+            vector_map_.setCluster(slot, target);
+            vector_map_.setOffset(slot, to);
+            auto& [moved_ids, moved_data] = moved[target];
+            moved_ids.push_back(move.ids[k]);
+            moved_data.insert(moved_data.end(), row, row + vector_dim_);
+            
+            VectorEntry entry;
+            entry.vector_id = move.ids[k];
+            entry.cluster_id = target;
+            entry.offset = to;
+            entry.data_crc = walDataCrc(row);
+            moves.push_back(entry);
+        }
+        if (moved.empty()) {
+            continue;
+        }
+        size_t count = 0;
+        for (const auto& [target, vectors] : moved) {
+            clustering_->moveVectors(vectors.first, target, vectors.second.data());
+            count += vectors.first.size();
+        }
+        (move.split_into != UINT32_MAX ? splits : merges)++;
+        logger_.debug(std::string(move.split_into != UINT32_MAX ? "Split " : "Merged ") + "cluster " +
+                     std::to_string(move.from) + ", moving " + std::to_string(count) + " vectors to " +
+                     std::to_string(moved.size()) + " clusters");
+    }
+    
+    if (!moves.empty()) {
+        if (!persistOperations(WAL_MOVE, moves)) {
+            logger_.error("Failed to log maintenance moves");
+        }
+        logger_.info("Maintenance step split " + std::to_string(splits) + " and merged " +
+                    std::to_string(merges) + " clusters, moving " + std::to_string(moves.size()) +
+                    " vectors");
+    }
+    if (io_bytes) {
+        *io_bytes += moves.size() * vector_size;
+    }
+    return moves.size();
+}
+
+void VectorClusterStore::compactionLoop(uint32_t interval_ms, size_t batch) {
+    std::unique_lock<std::mutex> lock(background_mutex_);
+    while (!background_cv_.wait_for(lock, std::chrono::milliseconds(interval_ms),
+                                    [this] { return background_stop_; })) {
+        lock.unlock();
+        compactStorage(batch);
+        lock.lock();
+    }
+}
+
+void VectorClusterStore::maintenanceLoop() {
+    const uint64_t interval_ms = std::max(1u, options_.maintenance_interval_ms);
+    const size_t clusters = std::max(1u, options_.maintenance_clusters_per_step);
+    uint64_t wait_ms = interval_ms;
+    std::unique_lock<std::mutex> lock(background_mutex_);
+    while (!background_cv_.wait_for(lock, std::chrono::milliseconds(wait_ms),
+                                    [this] { return background_stop_; })) {
+        lock.unlock();
+        uint64_t io_bytes = 0;
+        maintenanceStep(clusters, &io_bytes);
+        // Spread the I/O out: a step that moved more than the budget's
+        // share of an interval waits until the average is back under it
+        wait_ms = interval_ms;
+        if (options_.maintenance_io_budget > 0) {
+            wait_ms = std::max(wait_ms, io_bytes * 1000 / options_.maintenance_io_budget);
+        }
+        lock.lock();
+    }
+}
+
+void VectorClusterStore::stopBackgroundThreads() {
+    {
+        std::lock_guard<std::mutex> lock(background_mutex_);
+        background_stop_ = true;
+    }
+    background_cv_.notify_all();
+    if (compaction_thread_.joinable()) {
+        compaction_thread_.join();
+    }
+    if (maintenance_thread_.joinable()) {
+        maintenance_thread_.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        sync_stop_ = true;
+    }
+    sync_cv_.notify_all();
+    if (sync_thread_.joinable()) {
+        sync_thread_.join();
+    }
+}
+
+void VectorClusterStore::groupCommitLoop(int fd) {
+    const auto interval = std::chrono::milliseconds(std::max(1u, options_.group_commit_ms));
+    const uint64_t group = std::max(1u, options_.group_commit_ops);
+    std::unique_lock<std::mutex> lock(sync_mutex_);
+    for (;;) {
+        // Nothing to commit, or nothing that can be committed any more
+        if (writes_logged_ == writes_synced_ || sync_failed_) {
+            if (sync_stop_) {
+                break;
+            }
+            sync_cv_.wait(lock);
+            continue;
+        }
+        // Wait for the group to fill or its first write to get old; on
+        // the way out, commit what is left
+        const auto deadline = oldest_unsynced_ + interval;
+        if (!sync_stop_ && writes_logged_ - writes_synced_ < group &&
+            std::chrono::steady_clock::now() < deadline) {
+            sync_cv_.wait_until(lock, deadline);
+            continue;
+        }
+        
+        // Writes logged while the sync runs join the next group
+        const uint64_t covered = writes_logged_;
+        const auto started = std::chrono::steady_clock::now();
+        lock.unlock();
+        const bool synced = fdatasync(fd) == 0;
+        if (synced) {
+            metrics_.countSync();
+        } else {
+            logger_.error("Group commit fdatasync failed: " + std::string(strerror(errno)));
+        }
+        lock.lock();
+        if (!synced) {
+            // The writes stay unsynced; sync() and later writes report it
+            sync_failed_ = true;
+            continue;
+        }
+        writes_synced_ = std::max(writes_synced_, covered);
+        oldest_unsynced_ = started;
+    }
+    lock.unlock();
+    close(fd);
+}
+
+bool VectorClusterStore::saveIndex(const std::string& filename, const std::string& base_filename) {
+    // Exclusive: saveToFile isn't part of the strategy's const read interface
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
+    
+    // What the base snapshot held, to write the delta against. Read before
+    // anything is written, in case filename is the base.
+    std::unordered_map<uint32_t, VectorEntry> base_entries;
+    uint32_t base_crc = 0;
+    if (!base_filename.empty()) {
+        std::ifstream base(base_filename + ".vmap", std::ios::binary);
+        if (!base.is_open()) {
+            logger_.error("Failed to open base snapshot " + base_filename + ".vmap");
+            return false;
+        }
+        uint32_t num_vectors = 0;
+        base.read(reinterpret_cast<char*>(&num_vectors), sizeof(uint32_t));
+        base_crc = crc32(&num_vectors, sizeof(uint32_t));
+        for (uint32_t i = 0; i < num_vectors && base; i++) {
+            VectorEntry entry;
+            if (!readSnapshotEntry(base, base_crc, entry)) {
+                return false;
+            }
+            base_entries[entry.vector_id] = std::move(entry);
+        }
+        if (!base) {
+            logger_.error("Base snapshot " + base_filename + ".vmap is truncated");
+            return false;
+        }
+    }
+    
+    // Save clustering model
+    std::vector<uint8_t> model = clustering_->serialize();
+    {
+        std::ofstream model_file(filename, std::ios::binary);
+        if (model_file.is_open()) {
+            model_file.write(reinterpret_cast<const char*>(model.data()), model.size());
+        }
+        if (!model_file.is_open() || model_file.bad()) {
+            logger_.error("Failed to save clustering model");
+            return false;
+        }
+    }
+    
+    // Save vector map to a separate file
+    std::string vector_map_file = filename + ".vmap";
+    std::ofstream file(vector_map_file, std::ios::binary);
+    if (!file.is_open()) {
+        logger_.error("Failed to open vector map file for writing");
+        return false;
+    }
+    
+    // Write number of vectors
+    uint32_t num_vectors = static_cast<uint32_t>(vector_map_.size());
+    file.write(reinterpret_cast<const char*>(&num_vectors), sizeof(uint32_t));
+    uint32_t crc = crc32(&num_vectors, sizeof(uint32_t));
+    
+    // Write vector entries, noting those the base doesn't hold as they are
+    std::vector<uint32_t> upserts;
+    for (uint32_t slot = 0; slot < vector_map_.size(); slot++) {
+        std::string metadata = entryMetadata(slot);
+        writeSnapshotEntry(file, crc, vector_map_.id(slot), vector_map_.cluster(slot),
+                           vector_map_.offset(slot), metadata);
+        if (base_filename.empty()) {
+            continue;
+        }
+        auto it = base_entries.find(vector_map_.id(slot));
+        if (it == base_entries.end() || it->second.cluster_id != vector_map_.cluster(slot) ||
+            it->second.offset != vector_map_.offset(slot) || it->second.metadata != metadata) {
+            upserts.push_back(slot);
+        }
+    }
+    
+    bool success = !file.bad();
+    file.close();
+    
+    if (success && !base_filename.empty()) {
+        std::ofstream delta(filename + ".delta", std::ios::binary);
+        DeltaHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.signature, DELTA_SIGNATURE, sizeof(DELTA_SIGNATURE));
+        header.base_crc = base_crc;
+        header.crc = crc;
+        header.model_size = model.size();
+        header.upserts = static_cast<uint32_t>(upserts.size());
+        std::vector<uint32_t> deletes;
+        for (const auto& [vector_id, entry] : base_entries) {
+            if (vector_map_.find(vector_id) == VectorIndex::NO_SLOT) {
+                deletes.push_back(vector_id);
+            }
+        }
+        header.deletes = static_cast<uint32_t>(deletes.size());
+        
+        delta.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        delta.write(reinterpret_cast<const char*>(model.data()), model.size());
+        uint32_t unused_crc = 0;
+        for (uint32_t slot : upserts) {
+            writeSnapshotEntry(delta, unused_crc, vector_map_.id(slot), vector_map_.cluster(slot),
+                               vector_map_.offset(slot), entryMetadata(slot));
+        }
+        delta.write(reinterpret_cast<const char*>(deletes.data()), deletes.size() * sizeof(uint32_t));
+        success = delta.is_open() && !delta.bad();
+        if (success) {
+            logger_.info("Snapshot delta saved to " + filename + ".delta: " + std::to_string(upserts.size()) +
+                        " changed and " + std::to_string(deletes.size()) + " deleted vectors");
+        }
+    }
+    
+    if (success) {
+        logger_.info("Index saved to " + filename);
+        
+        // A new snapshot: the oldest one still held falls out of retention,
+        // and space freed before the one after it is named by none kept
+        if (!snapshot_held_.empty()) {
+            snapshot_held_.emplace_back();
+            while (snapshot_held_.size() > options_.snapshot_retention) {
+                for (const FreedSpace& space : snapshot_held_.front()) {
+                    releaseSpace(space);
+                }
+                snapshot_held_.pop_front();
+            }
+        }
+    } else {
+        logger_.error("Failed to save vector map");
+    }
+    
+    return success;
+}
+
+void VectorClusterStore::writeSnapshotEntry(std::ostream& out, uint32_t& crc, uint32_t vector_id,
+                                            uint32_t cluster_id, uint64_t offset,
+                                            const std::string& metadata) const {
+    uint32_t metadata_size = static_cast<uint32_t>(metadata.size());
+    out.write(reinterpret_cast<const char*>(&vector_id), sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(&cluster_id), sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(&offset), sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(&metadata_size), sizeof(uint32_t));
+    out.write(metadata.data(), metadata_size);
+    crc = crc32(&vector_id, sizeof(uint32_t), crc);
+    crc = crc32(&cluster_id, sizeof(uint32_t), crc);
+    crc = crc32(&offset, sizeof(uint64_t), crc);
+    crc = crc32(&metadata_size, sizeof(uint32_t), crc);
+    crc = crc32(metadata.data(), metadata_size, crc);
+}
+
+bool VectorClusterStore::readSnapshotEntry(std::istream& in, uint32_t& crc, VectorEntry& entry) const {
+    // The on-disk layout (written by writeSnapshotEntry) is three fields
+    // per entry — vector_id, cluster_id, offset — followed by a
+    // length-prefixed metadata blob. A prior version of loadIndex
+    // incorrectly read FOUR fields (an extra entry.vector_id that saveIndex
+    // never writes), desyncing the stream by 4 bytes after each entry and
+    // causing the "Loaded 2 vectors" / huge metadata_size corruption
+    // observed on reload.
+    const uint32_t MAX_METADATA_SIZE = 10240; // 10KB — matches writeVectorMap
+    uint32_t metadata_size = 0;
+    in.read(reinterpret_cast<char*>(&entry.vector_id), sizeof(uint32_t));
+    in.read(reinterpret_cast<char*>(&entry.cluster_id), sizeof(uint32_t));
+    in.read(reinterpret_cast<char*>(&entry.offset), sizeof(uint64_t));
+    in.read(reinterpret_cast<char*>(&metadata_size), sizeof(uint32_t));
+    
+    // Bound metadata_size before allocating to keep a corrupt file from
+    // triggering a multi-GB allocation. If we see something out of
+    // bounds, the stream is desynced — fail the load loudly rather than
+    // silently storing junk.
+    if (!in || metadata_size > MAX_METADATA_SIZE) {
+        logger_.error("Snapshot entry for vector " + std::to_string(entry.vector_id) +
+                     " is truncated or its metadata_size " + std::to_string(metadata_size) +
+                     " exceeds MAX_METADATA_SIZE — snapshot is corrupt or format version mismatch");
+        return false;
+    }
+    entry.metadata.assign(metadata_size, '\0');
+    in.read(&entry.metadata[0], metadata_size);
+    
+    crc = crc32(&entry.vector_id, sizeof(uint32_t), crc);
+    crc = crc32(&entry.cluster_id, sizeof(uint32_t), crc);
+    crc = crc32(&entry.offset, sizeof(uint64_t), crc);
+    crc = crc32(&metadata_size, sizeof(uint32_t), crc);
+    crc = crc32(entry.metadata.data(), metadata_size, crc);
+    return true;
+}
+
+bool VectorClusterStore::loadIndex(const std::string& filename) {
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
+    
+    // Read and check the whole snapshot before changing anything, so a bad
+    // one leaves the index (and the snapshot deltas chain onto) as it was
+    std::ifstream model_file(filename, std::ios::binary | std::ios::ate);
+    if (!model_file.is_open()) {
+        logger_.error("Failed to open clustering model " + filename);
+        return false;
+    }
+    std::vector<uint8_t> model(static_cast<size_t>(model_file.tellg()));
+    model_file.seekg(0, std::ios::beg);
+    if (!model_file.read(reinterpret_cast<char*>(model.data()), model.size())) {
+        logger_.error("Failed to read clustering model " + filename);
+        return false;
+    }
+    
+    // Vector map from a separate file
+    std::string vector_map_file = filename + ".vmap";
+    std::ifstream file(vector_map_file, std::ios::binary);
+    if (!file.is_open()) {
+        logger_.error("Failed to open vector map file for reading");
+        return false;
+    }
+    uint32_t num_vectors = 0;
+    file.read(reinterpret_cast<char*>(&num_vectors), sizeof(uint32_t));
+    uint32_t crc = crc32(&num_vectors, sizeof(uint32_t));
+    std::vector<VectorEntry> entries;
+    for (uint32_t i = 0; i < num_vectors && file; i++) {
+        VectorEntry entry;
+        if (!readSnapshotEntry(file, crc, entry)) {
+            logger_.error("loadIndex: aborting load of " + vector_map_file);
+            return false;
+        }
+        entries.push_back(std::move(entry));
+    }
+    if (!file) {
+        logger_.error("Failed to load vector map: " + vector_map_file + " is truncated");
+        return false;
+    }
+    file.close();
+    
+    if (!clustering_->deserialize(model)) {
+        // The model may be partly replaced; no delta may build on it
+        logger_.error("Failed to load clustering model");
+        snapshot_crc_ = 0;
+        return false;
+    }
+    vector_map_.clear();
+    vector_map_.reserve(entries.size());
+    for (const VectorEntry& entry : entries) {
+        uint32_t slot = vector_map_.insert(entry.vector_id, entry.cluster_id, entry.offset, entry.norm);
+        vector_map_.setMetadata(slot, entry.metadata);
+        
+        // Update next_vector_id if needed
+        if (entry.vector_id >= next_vector_id_) {
+            next_vector_id_ = entry.vector_id + 1;
+        }
+    }
+    
+    logger_.info("Index loaded from " + filename);
+    logger_.info("Loaded " + std::to_string(vector_map_.size()) + " vectors");
+    snapshot_crc_ = crc;
+    // A replica's writer may have written anywhere the new index names
+    if (cache_) {
+        cache_->clear();
+    }
+    
+    // Bump the allocation high-water mark past loaded vectors so any
+    // subsequent stores append rather than overwrite existing data.
+    // The current high-water mark is kept as a floor: space reserved
+    // before the load may still hold extents the index doesn't know of.
+    // The codes describe the vectors that were replaced, and freed
+    // space is worked out again from the loaded map
+    dropQuantizedIndex();
+    pending_free_.clear();
+    uint64_t floor = next_alloc_offset_;
+    rebuildClusterExtents();
+    next_alloc_offset_ = std::max(next_alloc_offset_, floor);
+    
+    // A replica leaves the device to its writer; the data the loaded
+    // index names may lie past what was mapped at open
+    if (options_.read_only) {
+        if (data_map_) {
+            mapDataRegion();
+        }
+        return true;
+    }
+    
+    // Update device metadata
+    if (!flushMetadata()) {
+        logger_.error("Failed to update device metadata after loading index");
+        return false;
+    }
+    return true;
+}
+
+bool VectorClusterStore::applyIndexDelta(const std::string& filename) {
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
+    
+    std::string delta_file = filename + ".delta";
+    std::ifstream file(delta_file, std::ios::binary);
+    if (!file.is_open()) {
+        logger_.error("Failed to open snapshot delta " + delta_file);
+        return false;
+    }
+    
+    DeltaHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || memcmp(header.signature, DELTA_SIGNATURE, sizeof(DELTA_SIGNATURE)) != 0) {
+        logger_.error(delta_file + " is not a snapshot delta");
+        return false;
+    }
+    if (snapshot_crc_ == 0 || header.base_crc != snapshot_crc_) {
+        logger_.error(delta_file + " applies to a different snapshot than the one loaded; "
+                     "load a full snapshot first");
+        return false;
+    }
+    
+    // Read everything before changing anything, so a bad delta leaves the
+    // loaded snapshot as it was
+    std::vector<uint8_t> model(header.model_size);
+    file.read(reinterpret_cast<char*>(model.data()), model.size());
+    std::vector<VectorEntry> upserts(header.upserts);
+    uint32_t unused_crc = 0;
+    for (VectorEntry& entry : upserts) {
+        if (!file || !readSnapshotEntry(file, unused_crc, entry)) {
+            logger_.error("Snapshot delta " + delta_file + " is truncated");
+            return false;
+        }
+    }
+    std::vector<uint32_t> deletes(header.deletes);
+    file.read(reinterpret_cast<char*>(deletes.data()), deletes.size() * sizeof(uint32_t));
+    if (!file) {
+        logger_.error("Snapshot delta " + delta_file + " is truncated");
+        return false;
+    }
+    if (!clustering_->deserialize(model)) {
+        // As in loadIndex: nothing may chain onto a partly replaced model
+        logger_.error("Failed to load clustering model from " + delta_file);
+        snapshot_crc_ = 0;
+        return false;
+    }
+    
+    for (uint32_t vector_id : deletes) {
+        uint32_t slot = vector_map_.find(vector_id);
+        if (slot != VectorIndex::NO_SLOT) {
+            vector_map_.erase(slot);
+        }
+    }
+    for (const VectorEntry& entry : upserts) {
+        uint32_t slot = vector_map_.find(entry.vector_id);
+        if (slot != VectorIndex::NO_SLOT) {
+            vector_map_.erase(slot);
+        }
+        slot = vector_map_.insert(entry.vector_id, entry.cluster_id, entry.offset, entry.norm);
+        vector_map_.setMetadata(slot, entry.metadata);
+        next_vector_id_ = std::max(next_vector_id_, entry.vector_id + 1);
+    }
+    snapshot_crc_ = header.crc;
+    if (cache_) {
+        cache_->clear();
+    }
+    
+    // As after loadIndex
+    dropQuantizedIndex();
+    pending_free_.clear();
+    uint64_t floor = next_alloc_offset_;
+    rebuildClusterExtents();
+    next_alloc_offset_ = std::max(next_alloc_offset_, floor);
+    logger_.info("Applied snapshot delta " + delta_file + ": " + std::to_string(upserts.size()) +
+                " changed and " + std::to_string(deletes.size()) + " deleted vectors, " +
+                std::to_string(vector_map_.size()) + " in store");
+    
+    if (options_.read_only) {
+        if (data_map_) {
+            mapDataRegion();
+        }
+        return true;
+    }
+    if (!flushMetadata()) {
+        logger_.error("Failed to update device metadata after applying snapshot delta");
+        return false;
+    }
+    return true;
+}
+
+bool VectorClusterStore::checkWritable(const char* operation) const {
+    if (options_.read_only) {
+        logger_.error(std::string(operation) + ": store is open read-only");
+        return false;
+    }
+    return true;
+}
+
+void VectorClusterStore::printStoreInfo() const {
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    
+    if (fd_ < 0) {
+        std::cout << "Device not open" << std::endl;
+        return;
+    }
+    
+    std::cout << "=== Vector Cluster Store Information ===" << std::endl;
+    std::cout << "Device path: " << device_path_ << std::endl;
+    std::cout << "Device size: " << device_size_ << " bytes (" 
+              << (device_size_ / (1024*1024)) << " MB)" << std::endl;
+    std::cout << "Block size: " << block_size_ << " bytes" << std::endl;
+    std::cout << "Direct I/O: " << (is_direct_io_ ? "Yes" : "No") << std::endl;
+    std::cout << "I/O engine: " << getIoEngineName() << std::endl;
+    std::cout << "Vector dimension: " << vector_dim_ << std::endl;
+    std::cout << "Vector count: " << vector_map_.size() << std::endl;
+    std::cout << "Next vector ID: " << next_vector_id_ << std::endl;
+    std::cout << "Data region: " << (next_alloc_offset_ - data_offset_) << " bytes, "
+              << freeBytes() << " free, " << pendingFreeBytes() << " awaiting a checkpoint" << std::endl;
+    std::cout << "Clustering strategy: " << clustering_->getName() << std::endl;
+    std::cout << "Distance kernel: " << distanceKernelName() << std::endl;
+    std::cout << "Normalized vectors: " << (options_.normalize_vectors ? "Yes" : "No") << std::endl;
+    std::cout << "Format version: " << store_version_;
+    if (store_version_ >= 3) {
+        std::cout << " (checkpoint " << checkpoint_sequence_ << " in copy " << char('A' + metadata_slot_) << ")";
+    }
+    std::cout << std::endl;
+    const char* durability = options_.durability == Durability::PER_OP ? "per operation"
+                           : options_.durability == Durability::GROUP  ? "group commit"
+                                                                       : "none";
+    std::cout << "Durability: " << durability << " (" << metrics_.snapshot(CacheStats()).syncs << " syncs)"
+              << std::endl;
+    if (quantizer_) {
+        size_t coded = 0;
+        for (uint32_t slot = 0; slot < vector_map_.size(); slot++) {
+            coded += vector_map_.quantized(slot) ? 1 : 0;
+        }
+        std::cout << "Quantization: " << quantizer_->getName() << " (" << coded << " vectors coded, "
+                  << quantizer_->codeSize() << " bytes each)" << std::endl;
+    } else {
+        std::cout << "Quantization: None" << std::endl;
+    }
+    
+    // Operations since the store was opened
+    const StoreStats stats = metrics_.snapshot(cache_ ? cache_->stats() : CacheStats());
+    const std::pair<const char*, const OperationStats*> operations[] = {
+        {"store", &stats.store}, {"store_batch", &stats.store_batch}, {"retrieve", &stats.retrieve},
+        {"search", &stats.search}, {"search_batch", &stats.search_batch}, {"remove", &stats.remove},
+        {"maintenance", &stats.maintenance}};
+    std::cout << "Operations:" << std::endl;
+    for (const auto& [name, operation] : operations) {
+        if (operation->count == 0) {
+            continue;
+        }
+        std::cout << "  " << name << ": " << operation->count << " calls, p50 " << operation->p50_us
+                  << " us, p99 " << operation->p99_us << " us, max " << operation->max_us << " us; "
+                  << operation->reads << " reads (" << operation->bytes_read << " bytes), "
+                  << operation->writes << " writes (" << operation->bytes_written << " bytes)" << std::endl;
+    }
+    if (stats.queries > 0) {
+        std::cout << "Searches: " << stats.queries << " queries, " << stats.clusters_probed
+                  << " clusters probed, " << stats.vectors_scored << " vectors and " << stats.codes_scored
+                  << " codes scored" << std::endl;
+    }
+    if (cache_) {
+        std::cout << "Cluster cache: " << stats.cache.hits << " hits, " << stats.cache.misses << " misses, "
+                  << stats.cache.bytes << " of " << cache_->budget() << " bytes" << std::endl;
+    }
+    
+    // Get cluster counts
+    std::cout << "Cluster distribution:" << std::endl;
+    for (const auto& [cluster_id, members] : vector_map_.clusterMembers()) {
+        std::cout << "  Cluster " << cluster_id << ": " << members.size() << " vectors" << std::endl;
+    }
+    
+    std::cout << "=================================" << std::endl;
+}
+
+void VectorClusterStore::printClusterInfo(uint32_t cluster_id) const {
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    
+    if (fd_ < 0) {
+        std::cout << "Device not open" << std::endl;
+        return;
+    }
+    
+    std::cout << "=== Cluster " << cluster_id << " Information ===" << std::endl;
+    
+    Vector centroid = clustering_->getClusterCentroid(cluster_id);
+    uint32_t size = clustering_->getClusterSize(cluster_id);
+    
+    std::cout << "Size: " << size << " vectors" << std::endl;
+    auto extent = cluster_extents_.find(cluster_id);
+    if (extent != cluster_extents_.end()) {
+        std::cout << "Extent: offset " << extent->second.start_offset << ", "
+                  << extent->second.used << "/" << extent->second.capacity << " slots used, "
+                  << extent->second.free_slots.size() << " free again" << std::endl;
+    }
+    std::cout << "Centroid: [";
+    for (size_t i = 0; i < std::min(5ul, centroid.size()); i++) {
+        std::cout << centroid[i];
+        if (i < std::min(4ul, centroid.size() - 1)) {
+            std::cout << ", ";
+        }
+    }
+    if (centroid.size() > 5) {
+        std::cout << ", ...";
+    }
+    std::cout << "]" << std::endl;
+    
+    // List vectors in this cluster
+    std::cout << "Vectors:" << std::endl;
+    int count = 0;
+    for (uint32_t slot : vector_map_.members(cluster_id)) {
+        std::cout << "  ID " << vector_map_.id(slot) << " at offset " << vector_map_.offset(slot);
+        // Metadata not loaded yet is left on the device
+        std::lock_guard<std::mutex> metadata_lock(metadata_mutex_);
+        std::string metadata = vector_map_.metadata(slot);
+        if (!metadata.empty()) {
+            std::cout << " (" << metadata << ")";
+        }
+        std::cout << std::endl;
+        count++;
+        if (count >= 10) {
+            std::cout << "  ... and " << (size - 10) << " more" << std::endl;
+            break;
+        }
+    }
+    
+    std::cout << "=================================" << std::endl;
+}
+
+bool VectorClusterStore::flushMetadata() {
+    if (!checkWritable("flushMetadata")) {
+        return false;
+    }
+    // Inside a batch the flush is owed, not done
+    if (batch_active_) {
+        metadata_dirty_ = true;
+        return true;
+    }
+    
+    if (store_version_ >= 3) {
+        if (!writeCheckpoint()) {
+            return false;
+        }
+    } else {
+        // Older stores rewrite their one copy in place
+        if (!writeHeader() || !writeVectorMap() || !writeClusterMap()) {
+            return false;
+        }
+        
+        // The maps now contain everything logged so far. Start a new log
+        // generation; records of the old one stop being replayed.
+        if (wal_offset_ != 0) {
+            wal_generation_++;
+            wal_tail_ = wal_offset_ + sizeof(WalHeader);
+            wal_records_ = 0;
+            if (!writeWalHeader()) {
+                logger_.error("Failed to reset write-ahead log");
+                return false;
+            }
+        }
+        if (options_.durability != Durability::NONE) {
+            if (!syncDevice()) {
+                return false;
+            }
+            markSynced();
+        }
+    }
+    
+    // Nothing on the device refers to space freed before this point now
+    releasePendingSpace();
+    checkpoint_count_++;
+    metadata_dirty_ = false;
+    return true;
+}
+
+bool VectorClusterStore::writeCheckpoint() {
+    const bool sync = options_.durability != Durability::NONE;
+    const uint32_t slot = 1 - metadata_slot_;
+    const uint64_t cluster_map_offset = cluster_map_offset_;
+    const uint64_t vector_map_offset = vector_map_offset_;
+    
+    // The maps go to the copy not in use; until its header is written the
+    // current copy and the log over it stay what a reopen finds
+    cluster_map_offset_ = cluster_map_offsets_[slot];
+    vector_map_offset_ = vector_map_offsets_[slot];
+    if (!writeVectorMap() || !writeClusterMap() || (sync && !syncDevice())) {
+        cluster_map_offset_ = cluster_map_offset;
+        vector_map_offset_ = vector_map_offset;
+        return false;
+    }
+    
+    // The header switches over: from it on, only records of the new log
+    // generation are replayed
+    metadata_slot_ = slot;
+    checkpoint_sequence_++;
+    wal_generation_++;
+    if (!writeHeader() || (sync && !syncDevice())) {
+        logger_.error("Failed to write checkpoint " + std::to_string(checkpoint_sequence_));
+        metadata_slot_ = 1 - slot;
+        checkpoint_sequence_--;
+        wal_generation_--;
+        cluster_map_offset_ = cluster_map_offset;
+        vector_map_offset_ = vector_map_offset;
+        return false;
+    }
+    if (sync) {
+        markSynced();
+    }
+    
+    wal_tail_ = wal_offset_ + sizeof(WalHeader);
+    wal_records_ = 0;
+    if (!writeWalHeader()) {
+        logger_.error("Failed to reset write-ahead log");
+        return false;
+    }
+    return true;
+}
+
+bool VectorClusterStore::syncDevice() {
+    std::unique_lock<std::mutex> lock(sync_mutex_);
+    if (sync_failed_) {
+        logger_.error("An earlier fdatasync failed; writes since may not be durable");
+        return false;
+    }
+    lock.unlock();
+    if (fdatasync(fd_) != 0) {
+        logger_.error("fdatasync failed: " + std::string(strerror(errno)));
+        lock.lock();
+        sync_failed_ = true;
+        return false;
+    }
+    metrics_.countSync();
+    return true;
+}
+
+bool VectorClusterStore::commitWrites(size_t count) {
+    switch (options_.durability) {
+        case Durability::PER_OP:
+            return syncDevice();
+        case Durability::GROUP: {
+            std::lock_guard<std::mutex> lock(sync_mutex_);
+            if (sync_failed_) {
+                logger_.error("Write not durable: an earlier group commit failed");
+                return false;
+            }
+            const bool first = writes_logged_ == writes_synced_;
+            if (first) {
+                oldest_unsynced_ = std::chrono::steady_clock::now();
+            }
+            writes_logged_ += count;
+            if (first || writes_logged_ - writes_synced_ >= std::max(1u, options_.group_commit_ops)) {
+                sync_cv_.notify_one();
+            }
+            return true;
+        }
+        default:
+            return true;
+    }
+}
+
+void VectorClusterStore::markSynced() {
+    std::lock_guard<std::mutex> lock(sync_mutex_);
+    writes_synced_ = writes_logged_;
+}
+
+bool VectorClusterStore::sync() {
+    std::shared_lock<std::shared_mutex> lock(store_mutex_);
+    if (fd_ < 0) {
+        logger_.error("Device not open");
+        return false;
+    }
+    if (options_.read_only) {
+        return true;
+    }
+    // Writers are locked out, so everything logged is covered
+    if (!syncDevice()) {
+        return false;
+    }
+    markSynced();
+    return true;
 }
 
-bool VectorClusterStore::deleteVector(uint32_t vector_id) {
-    std::lock_guard<std::mutex> lock(store_mutex_);
+bool VectorClusterStore::verifyChecksums(const std::string& device_path, std::vector<std::string>& report) {
+    std::lock_guard<std::shared_mutex> lock(store_mutex_);
+    if (fd_ >= 0) {
+        logger_.error("verifyChecksums: the store is open");
+        return false;
+    }
+    device_path_ = device_path;
+    if (!openDevice(true)) {
+        report.push_back("cannot open " + device_path);
+        return false;
+    }
+    
+    StoreHeader copies[2];
+    if (!readAligned(&copies[0], sizeof(copies[0]), 0)) {
+        memset(&copies[0], 0, sizeof(copies[0]));
+    }
+    bool intact = false;
+    if (memcmp(copies[0].signature, STORE_SIGNATURE, sizeof(STORE_SIGNATURE)) == 0 &&
+        (copies[0].version == 1 || copies[0].version == 2)) {
+        // One header, no checksums but the vector map's
+        applyHeader(copies[0]);
+        report.push_back("version " + std::to_string(store_version_) + " store: one header, no checksum");
+        VectorMapHeader map;
+        if (!readAligned(&map, sizeof(map), vector_map_offset_)) {
+            report.push_back("vector map: unreadable");
+        } else if (memcmp(map.signature, VECTOR_MAP_SIGNATURE, sizeof(VECTOR_MAP_SIGNATURE)) != 0) {
+            report.push_back("vector map: older format, no checksum");
+            intact = true;
+        } else if (map.record_size != sizeof(VectorMapRecord) ||
+                   sizeof(VectorMapHeader) + uint64_t(map.entry_count) * sizeof(VectorMapRecord) >
+                       vector_map_capacity_) {
+            report.push_back("vector map: header invalid");
+        } else {
+            std::vector<char> records(size_t(map.entry_count) * sizeof(VectorMapRecord));
+            intact = readAligned(records.data(), records.size(), vector_map_offset_ + sizeof(map)) &&
+                     crc32(records.data(), records.size()) == map.crc;
+            report.push_back("vector map: " + std::to_string(map.entry_count) + " entries, checksum " +
+                             (intact ? "ok" : "mismatch"));
+        }
+        WalHeader wal;
+        if (wal_offset_ == 0 || !readAligned(&wal, sizeof(wal), wal_offset_) ||
+            memcmp(wal.signature, WAL_SIGNATURE, sizeof(WAL_SIGNATURE)) != 0) {
+            wal_offset_ = 0;
+        } else {
+            wal_generation_ = wal.generation;
+            wal_sequence_ = wal.checkpoint_sequence;
+        }
+    } else {
+        if (!readAligned(&copies[1], sizeof(copies[1]), HEADER_COPY_SPACING)) {
+            memset(&copies[1], 0, sizeof(copies[1]));
+        }
+        // The copy a reopen takes: the latest one whose maps check out
+        int current = -1;
+        int latest = -1;
+        for (uint32_t slot = 0; slot < 2; slot++) {
+            const std::string name = std::string("header copy ") + char('A' + slot);
+            if (!headerCopyValid(copies[slot], slot)) {
+                report.push_back(name + ": no valid header");
+                continue;
+            }
+            std::string problem;
+            const bool maps = mapsIntact(copies[slot], problem);
+            report.push_back(name + ": checkpoint " + std::to_string(copies[slot].checkpoint_sequence) +
+                             ", maps " + (maps ? "ok" : problem));
+            if (latest < 0 || copies[slot].checkpoint_sequence > copies[latest].checkpoint_sequence) {
+                latest = slot;
+            }
+            if (maps && (current < 0 || copies[slot].checkpoint_sequence > copies[current].checkpoint_sequence)) {
+                current = slot;
+            }
+        }
+        if (current < 0) {
+            report.push_back("no intact checkpoint");
+            closeDevice();
+            return false;
+        }
+        applyHeader(copies[current]);
+        intact = current == latest;
+    }
+    
+    // The records a reopen would replay, up to the end of the log
+    if (wal_offset_ != 0) {
+        std::vector<char> log(wal_size_ - sizeof(WalHeader));
+        if (!readAligned(log.data(), log.size(), wal_offset_ + sizeof(WalHeader))) {
+            report.push_back("write-ahead log: unreadable");
+            intact = false;
+        } else {
+            size_t pos = 0;
+            uint32_t records = 0;
+            WalRecord record;
+            Vector vector;
+            while (size_t length = walRecordAt(log, pos, record, vector)) {
+                pos += length;
+                wal_sequence_++;
+                records++;
+            }
+            report.push_back("write-ahead log: " + std::to_string(records) + " records in generation " +
+                             std::to_string(wal_generation_));
+        }
+    }
+    closeDevice();
+    return intact;
+}
+
+bool VectorClusterStore::persistOperations(WalRecordType type,
+                                           const std::vector<VectorEntry>& entries) {
+    // Version 1 stores have no log, and an open batch checkpoints at commit
+    if (wal_offset_ == 0 || batch_active_) {
+        return flushMetadata();
+    }
+    
+    size_t needed = 0;
+    for (const VectorEntry& entry : entries) {
+        needed += sizeof(WalRecord) + (type == WAL_INSERT ? entry.metadata.size() : 0);
+    }
+    
+    // Log full (or long enough that replay would get slow): checkpoint
+    // instead. The checkpoint covers these operations too.
+    if (wal_records_ + entries.size() > WAL_CHECKPOINT_RECORDS ||
+        wal_tail_ + needed > wal_offset_ + wal_size_) {
+        logger_.debug("Write-ahead log full after " + std::to_string(wal_records_) +
+                     " records, checkpointing");
+        return flushMetadata();
+    }
+    
+    return appendWalRecords(type, entries) && commitWrites(entries.size());
+}
+
+uint32_t VectorClusterStore::walDataCrc(const float* data) const {
+    // Nothing is logged inside a batch; its commit checkpoints
+    if (store_version_ < 3 || wal_offset_ == 0 || batch_active_) {
+        return 0;
+    }
+    return crc32(data, vector_dim_ * sizeof(float));
+}
+
+uint32_t VectorClusterStore::walRecordCrc(WalRecord record, const char* metadata,
+                                          uint32_t data_crc) const {
+    record.crc = 0;
+    uint32_t crc = crc32(&record, sizeof(record));
+    crc = crc32(metadata, record.metadata_size, crc);
+    if (walCoversData(record.type)) {
+        crc = crc32(&data_crc, sizeof(data_crc), crc);
+    }
+    return crc;
+}
+
+bool VectorClusterStore::appendWalRecords(WalRecordType type,
+                                          const std::vector<VectorEntry>& entries) {
+    const uint32_t MAX_METADATA_SIZE = 10240; // 10KB — matches writeVectorMap
+    
+    // Serialize every record into one buffer so the append is one write
+    std::vector<char> buffer;
+    uint64_t sequence = wal_sequence_;
+    for (const VectorEntry& entry : entries) {
+        const std::string empty;
+        const std::string& metadata = (type == WAL_INSERT) ? entry.metadata : empty;
+        if (metadata.size() > MAX_METADATA_SIZE) {
+            logger_.error("Metadata size too large: " + std::to_string(metadata.size()) +
+                         " bytes for vector " + std::to_string(entry.vector_id));
+            return false;
+        }
+        
+        WalRecord record;
+        memset(&record, 0, sizeof(record));
+        record.magic = WAL_RECORD_MAGIC;
+        record.generation = wal_generation_;
+        record.sequence = sequence++;
+        record.type = type;
+        record.vector_id = entry.vector_id;
+        record.cluster_id = entry.cluster_id;
+        record.metadata_size = static_cast<uint32_t>(metadata.size());
+        record.offset = entry.offset;
+        record.crc = walRecordCrc(record, metadata.data(), entry.data_crc);
+        
+        size_t pos = buffer.size();
+        buffer.resize(pos + sizeof(record) + metadata.size());
+        memcpy(buffer.data() + pos, &record, sizeof(record));
+        memcpy(buffer.data() + pos + sizeof(record), metadata.data(), metadata.size());
+    }
+    
+    if (!writeAligned(buffer.data(), buffer.size(), wal_tail_)) {
+        logger_.error("Failed to append to write-ahead log at offset " + std::to_string(wal_tail_));
+        return false;
+    }
+    
+    wal_tail_ += buffer.size();
+    wal_sequence_ = sequence;
+    wal_records_ += static_cast<uint32_t>(entries.size());
+    return true;
+}
+
+bool VectorClusterStore::writeWalHeader() {
+    WalHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.signature, WAL_SIGNATURE, sizeof(WAL_SIGNATURE));
+    header.generation = wal_generation_;
+    header.checkpoint_sequence = wal_sequence_;
+    
+    return writeAligned(&header, sizeof(header), wal_offset_);
+}
+
+bool VectorClusterStore::replayWal() {
+    if (wal_offset_ == 0) {
+        return true;  // version 1 store, nothing to replay
+    }
+    
+    wal_tail_ = wal_offset_ + sizeof(WalHeader);
+    wal_records_ = 0;
+    
+    // Version 3 headers name the generation themselves (applyHeader)
+    if (store_version_ < 3) {
+        WalHeader header;
+        if (!readAligned(&header, sizeof(header), wal_offset_)) {
+            logger_.error("Failed to read write-ahead log header");
+            return false;
+        }
+        
+        if (memcmp(header.signature, WAL_SIGNATURE, sizeof(WAL_SIGNATURE)) != 0) {
+            // Never written (or wiped): the maps are all there is. Start a log.
+            logger_.warning("No write-ahead log header found, starting a new log");
+            wal_generation_ = 1;
+            wal_sequence_ = 0;
+            return options_.read_only || writeWalHeader();
+        }
+        
+        wal_generation_ = header.generation;
+        wal_sequence_ = header.checkpoint_sequence;
+    }
+    
+    // The record area is bounded (WAL_REGION_SIZE), so read it in one go
+    // and walk it
+    std::vector<char> log(wal_size_ - sizeof(WalHeader));
+    if (!readAligned(log.data(), log.size(), wal_tail_)) {
+        logger_.error("Failed to read write-ahead log records");
+        return false;
+    }
+    
+    size_t pos = 0;
+    uint32_t applied = 0;
+    WalRecord record;
+    Vector vector;
+    while (size_t length = walRecordAt(log, pos, record, vector)) {
+        const char* metadata = log.data() + pos + sizeof(record);
+        
+        // Replaying this generation again after another crash reads every
+        // offset it names, so none of them may be reused before the next
+        // checkpoint; rebuildClusterExtents drops those still in use
+        uint32_t slot = vector_map_.find(record.vector_id);
+        if (slot != VectorIndex::NO_SLOT) {
+            freeSpace(vector_map_.cluster(slot), vector_map_.offset(slot), vectorSlotSize());
+        }
+        freeSpace(record.cluster_id, record.offset, vectorSlotSize());
+        switch (record.type) {
+            case WAL_INSERT: {
+                // Replay is idempotent: a crash between writing the maps and
+                // resetting the log leaves records the maps already contain.
+                if (slot != VectorIndex::NO_SLOT && vector_map_.offset(slot) == record.offset) {
+                    break;
+                }
+                if (vector.empty() && !readVector(record.offset, vector)) {
+                    logger_.error("Failed to read vector " + std::to_string(record.vector_id) +
+                                 " during log replay");
+                    break;
+                }
+                if (slot != VectorIndex::NO_SLOT) {
+                    removeFromModel(slot);
+                }
+                slot = vector_map_.insert(record.vector_id, record.cluster_id, record.offset,
+                                          vectorNorm(vector.data(), vector_dim_));
+                vector_map_.setMetadata(slot, std::string(metadata, record.metadata_size));
+                clustering_->addVector(vector, record.vector_id);
+                if (record.vector_id >= next_vector_id_) {
+                    next_vector_id_ = record.vector_id + 1;
+                }
+                break;
+            }
+            case WAL_DELETE:
+                if (slot != VectorIndex::NO_SLOT) {
+                    removeFromModel(slot);
+                    vector_map_.erase(slot);
+                }
+                break;
+            case WAL_MOVE:
+                if (slot != VectorIndex::NO_SLOT) {
+                    // A split or merge moved it to another cluster; so does
+                    // the model
+                    if (clustering_->getVectorCluster(record.vector_id) != record.cluster_id) {
+                        if (vector.empty() && !readVector(record.offset, vector)) {
+                            logger_.error("Failed to read vector " + std::to_string(record.vector_id) +
+                                         " during log replay");
+                            break;
+                        }
+                        clustering_->moveVectors({record.vector_id}, record.cluster_id, vector.data());
+                    }
+                    vector_map_.setCluster(slot, record.cluster_id);
+                    vector_map_.setOffset(slot, record.offset);
+                }
+                break;
+            default:
+                logger_.warning("Unknown write-ahead log record type " +
+                              std::to_string(record.type));
+                break;
+        }
+        
+        pos += length;
+        wal_sequence_++;
+        applied++;
+    }
+    
+    wal_tail_ += pos;
+    wal_records_ = applied;
+    
+    if (applied > 0) {
+        logger_.info("Replayed " + std::to_string(applied) + " write-ahead log records");
+    }
+    return true;
+}
+
+size_t VectorClusterStore::walRecordAt(const std::vector<char>& log, size_t pos, WalRecord& record,
+                                       Vector& vector) {
+    const uint32_t MAX_METADATA_SIZE = 10240; // 10KB — matches writeVectorMap
+    if (pos + sizeof(WalRecord) > log.size()) {
+        return 0;
+    }
+    memcpy(&record, log.data() + pos, sizeof(record));
+    if (record.magic != WAL_RECORD_MAGIC || record.generation != wal_generation_ ||
+        record.sequence != wal_sequence_ || record.metadata_size > MAX_METADATA_SIZE ||
+        pos + sizeof(record) + record.metadata_size > log.size()) {
+        return 0;
+    }
+    
+    // A vector the record covers that can't be read back never made it to
+    // the device either
+    vector.clear();
+    uint32_t data_crc = 0;
+    if (walCoversData(record.type)) {
+        if (!readVector(record.offset, vector)) {
+            logger_.warning("Vector of write-ahead log record " + std::to_string(record.sequence) +
+                          " unreadable, treating it as the end of the log");
+            return 0;
+        }
+        data_crc = crc32(vector.data(), vector_dim_ * sizeof(float));
+    }
+    if (walRecordCrc(record, log.data() + pos + sizeof(record), data_crc) != record.crc) {
+        logger_.warning("Write-ahead log record " + std::to_string(record.sequence) +
+                      " failed its checksum, treating it as the end of the log");
+        return 0;
+    }
+    return sizeof(record) + record.metadata_size;
+}
+
+bool VectorClusterStore::readHeader() {
+    if (fd_ < 0) {
+        return false;
+    }
+    
+    StoreHeader header;
+    if (!readAligned(&header, sizeof(header), header_offset_)) {
+        return false;
+    }
+    
+    // Check version. Version 2 adds the write-ahead log region; version 1
+    // stores keep working without one (every mutation rewrites the maps).
+    // Both have the one header.
+    const bool signed_header = memcmp(header.signature, STORE_SIGNATURE, sizeof(STORE_SIGNATURE)) == 0;
+    if (signed_header && (header.version == 1 || header.version == 2)) {
+        applyHeader(header);
+        return true;
+    }
+
+    // Version 3: the copy with the later checkpoint, unless it is torn or
+    // its maps don't match it (the checkpoint never finished reaching the
+    // device); then the one before
+    StoreHeader copies[2];
+    copies[0] = header;
+    if (!readAligned(&copies[1], sizeof(copies[1]), header_offset_ + HEADER_COPY_SPACING)) {
+        memset(&copies[1], 0, sizeof(copies[1]));
+    }
+    const bool valid[2] = {headerCopyValid(copies[0], 0), headerCopyValid(copies[1], 1)};
+    if (!valid[0] && !valid[1]) {
+        const bool signed_copy = memcmp(copies[1].signature, STORE_SIGNATURE, sizeof(STORE_SIGNATURE)) == 0;
+        if (!signed_header && !signed_copy) {
+            logger_.debug("Invalid store signature");
+            return false;
+        }
+        if (signed_header && header.version != STORE_VERSION) {
+            logger_.error("Unsupported store version: " + std::to_string(header.version));
+        } else {
+            logger_.error("Both store header copies failed their checksums");
+        }
+        // Keep initialize from writing a new store over it
+        store_version_ = STORE_VERSION;
+        return false;
+    }
+    uint32_t order[2] = {0, 1};
+    if (!valid[0] || (valid[1] && copies[1].checkpoint_sequence > copies[0].checkpoint_sequence)) {
+        std::swap(order[0], order[1]);
+    }
+    for (uint32_t slot : order) {
+        if (!valid[slot]) {
+            continue;
+        }
+        std::string problem;
+        if (!mapsIntact(copies[slot], problem)) {
+            logger_.warning("Checkpoint " + std::to_string(copies[slot].checkpoint_sequence) + " unusable (" +
+                            problem + "), trying the one before");
+            continue;
+        }
+        if (slot != order[0] && valid[order[0]]) {
+            logger_.warning("Opened checkpoint " + std::to_string(copies[slot].checkpoint_sequence) +
+                            "; writes logged after it are lost");
+        }
+        applyHeader(copies[slot]);
+        return true;
+    }
+    logger_.error("No intact checkpoint in the store");
+    store_version_ = STORE_VERSION;
+    return false;
+}
+
+bool VectorClusterStore::headerCopyValid(const StoreHeader& header, uint32_t slot) const {
+    if (memcmp(header.signature, STORE_SIGNATURE, sizeof(STORE_SIGNATURE)) != 0 ||
+        header.version != STORE_VERSION || header.slot != slot) {
+        return false;
+    }
+    StoreHeader copy = header;
+    copy.header_crc = 0;
+    return crc32(&copy, sizeof(copy)) == header.header_crc;
+}
+
+bool VectorClusterStore::mapsIntact(const StoreHeader& header, std::string& problem) {
+    const struct {
+        const char* name;
+        uint64_t offset;
+        uint64_t size;
+        uint64_t capacity;
+        uint32_t crc;
+    } maps[] = {
+        {"cluster map", header.cluster_map_offset, header.cluster_map_size, header.cluster_map_capacity,
+         header.cluster_map_crc},
+        {"vector map", header.vector_map_offset, header.vector_map_size, header.vector_map_capacity,
+         header.vector_map_crc},
+    };
+    std::vector<char> image;
+    for (const auto& map : maps) {
+        if (map.size > map.capacity) {
+            problem = std::string(map.name) + " larger than its region";
+            return false;
+        }
+        image.resize(map.size);
+        if (!readAligned(image.data(), image.size(), map.offset)) {
+            problem = std::string(map.name) + " unreadable";
+            return false;
+        }
+        if (crc32(image.data(), image.size()) != map.crc) {
+            problem = std::string(map.name) + " checksum mismatch";
+            return false;
+        }
+    }
+    return true;
+}
+
+void VectorClusterStore::applyHeader(const StoreHeader& header) {
+    // Update store parameters
+    store_version_ = header.version;
+    vector_dim_ = header.vector_dim;
+    next_vector_id_ = header.next_id;
+    cluster_map_offset_ = header.cluster_map_offset;
+    vector_map_offset_ = header.vector_map_offset;
+    data_offset_ = header.data_offset;
+    if (header.version >= 2) {
+        wal_offset_ = header.wal_offset;
+        wal_size_ = header.wal_size;
+        // The store's own options override what the caller asked for
+        options_.normalize_vectors = (header.flags & STORE_FLAG_NORMALIZED) != 0;
+        entry_norms_ = (header.flags & STORE_FLAG_ENTRY_NORMS) != 0;
+        quant_offset_ = header.quant_offset;
+        quant_size_ = header.quant_size;
+    } else {
+        // Version 1 headers were not zero-filled, so their reserved bytes
+        // (where flags now live) can't be trusted
+        wal_offset_ = 0;
+        wal_size_ = 0;
+        options_.normalize_vectors = false;
+        entry_norms_ = false;
+        quant_offset_ = 0;
+        quant_size_ = 0;
+    }
+    if (header.version >= 3) {
+        metadata_slot_ = header.slot;
+        checkpoint_sequence_ = header.checkpoint_sequence;
+        for (int slot = 0; slot < 2; slot++) {
+            cluster_map_offsets_[slot] = header.cluster_map_offsets[slot];
+            vector_map_offsets_[slot] = header.vector_map_offsets[slot];
+        }
+        cluster_map_capacity_ = header.cluster_map_capacity;
+        vector_map_capacity_ = header.vector_map_capacity;
+        cluster_map_size_ = header.cluster_map_size;
+        cluster_map_crc_ = header.cluster_map_crc;
+        vector_map_size_ = header.vector_map_size;
+        vector_map_crc_ = header.vector_map_crc;
+        wal_generation_ = header.wal_generation;
+        wal_sequence_ = header.wal_sequence;
+    } else {
+        // Each map runs up to the next region
+        cluster_map_capacity_ = vector_map_offset_ - cluster_map_offset_;
+        vector_map_capacity_ = ((wal_offset_ != 0) ? wal_offset_ : data_offset_) - vector_map_offset_;
+    }
+    
+    logger_.info("Read store header: version=" + std::to_string(header.version) +
+                ", vector_dim=" + std::to_string(vector_dim_) +
+                ", vector_count=" + std::to_string(header.vector_count));
+}
+
+bool VectorClusterStore::writeHeader() {
+    if (fd_ < 0) {
+        return false;
+    }
+    
+    StoreHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.signature, STORE_SIGNATURE, sizeof(STORE_SIGNATURE));
+    header.version = store_version_;
+    header.vector_dim = vector_dim_;
+    header.max_clusters = 100;  // Fixed for now
+    header.vector_count = static_cast<uint32_t>(vector_map_.size());
+    header.next_id = next_vector_id_;
+    header.cluster_map_offset = cluster_map_offset_;
+    header.vector_map_offset = vector_map_offset_;
+    header.data_offset = data_offset_;
+    header.wal_offset = wal_offset_;
+    header.wal_size = wal_size_;
+    header.quant_offset = quant_offset_;
+    header.quant_size = quant_size_;
+    if (header.version >= 2) {
+        header.flags = (options_.normalize_vectors ? STORE_FLAG_NORMALIZED : 0) |
+                       (entry_norms_ ? STORE_FLAG_ENTRY_NORMS : 0);
+    }
+    
+    std::string strategy_name = clustering_->getName();
+    strncpy(header.strategy_name, strategy_name.c_str(), sizeof(header.strategy_name) - 1);
+    header.strategy_name[sizeof(header.strategy_name) - 1] = '\0';
+    
+    if (header.version < 3) {
+        return writeAligned(&header, sizeof(header), header_offset_);
+    }
     
+    header.checkpoint_sequence = checkpoint_sequence_;
+    for (int slot = 0; slot < 2; slot++) {
+        header.cluster_map_offsets[slot] = cluster_map_offsets_[slot];
+        header.vector_map_offsets[slot] = vector_map_offsets_[slot];
+    }
+    header.cluster_map_capacity = cluster_map_capacity_;
+    header.vector_map_capacity = vector_map_capacity_;
+    header.cluster_map_size = cluster_map_size_;
+    header.vector_map_size = vector_map_size_;
+    header.cluster_map_crc = cluster_map_crc_;
+    header.vector_map_crc = vector_map_crc_;
+    header.wal_generation = wal_generation_;
+    header.wal_sequence = wal_sequence_;
+    header.slot = metadata_slot_;
+    header.header_crc = crc32(&header, sizeof(header));
+    return writeAligned(&header, sizeof(header), header_offset_ + metadata_slot_ * HEADER_COPY_SPACING);
+}
+
+bool VectorClusterStore::writeClusterMap() {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    // Serialize the full clustering model state
+    std::vector<uint8_t> serialized = clustering_->serialize();
+
+    // Calculate size needed (4 bytes for size + serialized data)
+    size_t size_needed = sizeof(uint32_t) + serialized.size();
+
+    // Ensure we have enough space
+    if (size_needed > cluster_map_capacity_) {
+        logger_.error("Cluster map too large: need " + std::to_string(size_needed) +
+                     " bytes, have " + std::to_string(cluster_map_capacity_));
+        return false;
+    }
+
+    // Size of serialized data, then the serialized clustering model, in
+    // one write
+    uint32_t data_size = static_cast<uint32_t>(serialized.size());
+    serialized.insert(serialized.begin(), reinterpret_cast<const uint8_t*>(&data_size),
+                      reinterpret_cast<const uint8_t*>(&data_size) + sizeof(data_size));
+    if (!writeAligned(serialized.data(), serialized.size(), cluster_map_offset_)) {
+        logger_.error("Failed to write cluster map");
+        return false;
+    }
+    cluster_map_size_ = serialized.size();
+    cluster_map_crc_ = crc32(serialized.data(), serialized.size());
+
+    logger_.debug("Wrote cluster map: " + std::to_string(data_size) + " bytes");
+    return true;
+}
+
+bool VectorClusterStore::readClusterMap() {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    // Read size of serialized data
+    uint32_t data_size;
+    if (!readAligned(&data_size, sizeof(data_size), cluster_map_offset_)) {
+        logger_.error("Failed to read cluster map size");
+        return false;
+    }
+
+    // If no data, nothing to restore (new store)
+    if (data_size == 0) {
+        logger_.debug("Read cluster map: empty (new store)");
+        return true;
+    }
+
+    // Sanity check size
+    if (data_size > cluster_map_capacity_ - sizeof(uint32_t)) {
+        logger_.error("Cluster map size invalid: " + std::to_string(data_size));
+        return false;
+    }
+
+    // Read serialized clustering model
+    std::vector<uint8_t> serialized(data_size);
+    if (!readAligned(serialized.data(), data_size, cluster_map_offset_ + sizeof(uint32_t))) {
+        logger_.error("Failed to read cluster map data");
+        return false;
+    }
+
+    // Deserialize and restore the clustering model state
+    if (!clustering_->deserialize(serialized)) {
+        logger_.error("Failed to deserialize clustering model");
+        return false;
+    }
+
+    logger_.debug("Read cluster map: " + std::to_string(data_size) + " bytes restored");
+    return true;
+}
+bool VectorClusterStore::writeVectorMap() {
     if (fd_ < 0) {
-        logger_.error("Device not open");
         return false;
     }
     
-    // Check if vector exists
-    auto it = vector_map_.find(vector_id);
-    if (it == vector_map_.end()) {
-        logger_.error("Vector " + std::to_string(vector_id) + " not found");
+    // Sanity check the number of vectors
+    const uint32_t MAX_VECTORS = 1000000; // 1 million vectors max
+    if (vector_map_.size() > MAX_VECTORS) {
+        logger_.error("Vector count too large: " + std::to_string(vector_map_.size()) + 
+                     ", maximum allowed: " + std::to_string(MAX_VECTORS));
         return false;
     }
     
-    // Get vector data to remove from clustering model
-    Vector vector(vector_dim_);
-    if (!readVector(it->second.offset, vector)) {
-        logger_.error("Failed to read vector data for deletion");
-        return false;
+    // Metadata that was never loaded is copied over from the current heap,
+    // which is read in one go before it gets overwritten
+    uint64_t old_heap_start = UINT64_MAX;
+    uint64_t old_heap_end = 0;
+    size_t heap_size = 0;
+    const uint32_t MAX_METADATA_SIZE = 10240; // 10KB max per vector
+    for (uint32_t slot = 0; slot < vector_map_.size(); slot++) {
+        uint32_t metadata_size = vector_map_.metadataSize(slot);
+        // Sanity check metadata size
+        if (metadata_size > MAX_METADATA_SIZE) {
+            logger_.error("Metadata size too large: " + std::to_string(metadata_size) + 
+                         " bytes for vector " + std::to_string(vector_map_.id(slot)));
+            return false;
+        }
+        uint64_t device_offset = vector_map_.metadataDeviceOffset(slot);
+        if (device_offset != 0) {
+            old_heap_start = std::min(old_heap_start, device_offset);
+            old_heap_end = std::max(old_heap_end, device_offset + metadata_size);
+        }
+        heap_size += metadata_size;
     }
     
-    // Remove from clustering model
-    clustering_->removeVector(vector_id);
-    
-    // Remove from vector map
-    vector_map_.erase(it);
-
-    // Update metadata and persist clustering model
-    if (!writeHeader() || !writeVectorMap() || !writeClusterMap()) {
-        logger_.error("Failed to update metadata after deletion");
+    // Ensure we have enough space
+    const size_t table_size = sizeof(VectorMapHeader) + vector_map_.size() * sizeof(VectorMapRecord);
+    const size_t size_needed = table_size + heap_size;
+    if (size_needed > vector_map_capacity_) {
+        logger_.error("Vector map too large: " + std::to_string(size_needed) + 
+                     " bytes needed, but only " + 
+                     std::to_string(vector_map_capacity_) + " bytes available");
         return false;
     }
-
-    logger_.debug("Deleted vector " + std::to_string(vector_id));
     
-    // Note: We don't reclaim space on the device yet - this would be a future enhancement
-    
-    return true;
-}
-
-bool VectorClusterStore::performMaintenance() {
-    std::lock_guard<std::mutex> lock(store_mutex_);
+    std::vector<char> old_heap;
+    if (old_heap_end > old_heap_start) {
+        old_heap.resize(old_heap_end - old_heap_start);
+        if (!readAligned(old_heap.data(), old_heap.size(), old_heap_start)) {
+            logger_.error("Failed to read vector map metadata heap");
+            return false;
+        }
+    }
     
-    logger_.info("Performing maintenance");
+    // Build the whole map and write it with one write. Records follow
+    // the index's slot order.
+    std::vector<char> image(size_needed);
+    VectorMapHeader* header = reinterpret_cast<VectorMapHeader*>(image.data());
+    memcpy(header->signature, VECTOR_MAP_SIGNATURE, sizeof(VECTOR_MAP_SIGNATURE));
+    header->entry_count = static_cast<uint32_t>(vector_map_.size());
+    header->record_size = sizeof(VectorMapRecord);
+    header->heap_size = heap_size;
     
-    // Rebalance clusters
-    if (clustering_->rebalance()) {
-        logger_.info("Clusters rebalanced");
-        
-        // Update cluster assignments
-        for (auto& [vector_id, entry] : vector_map_) {
-            // Get vector data
-            Vector vector(vector_dim_);
-            if (readVector(entry.offset, vector)) {
-                // Get new cluster assignment
-                uint32_t new_cluster = clustering_->assignToCluster(vector);
-                
-                if (new_cluster != entry.cluster_id) {
-                    logger_.debug("Moving vector " + std::to_string(vector_id) + 
-                                 " from cluster " + std::to_string(entry.cluster_id) + 
-                                 " to " + std::to_string(new_cluster));
-                    
-                    // Allocate space in new cluster
-                    uint64_t new_offset = allocateVectorSpace(new_cluster);
-                    if (new_offset == 0) {
-                        logger_.error("Failed to allocate space for vector during rebalancing");
-                        continue;
-                    }
-                    
-                    // Write vector to new location
-                    if (writeVector(new_offset, vector)) {
-                        // Update entry
-                        entry.cluster_id = new_cluster;
-                        entry.offset = new_offset;
-                    }
-                }
-            }
-        }
-        
-        // Update metadata
-        if (!writeVectorMap() || !writeClusterMap()) {
-            logger_.error("Failed to update metadata after rebalancing");
-            return false;
+    VectorMapRecord* records = reinterpret_cast<VectorMapRecord*>(image.data() + sizeof(VectorMapHeader));
+    size_t heap_pos = table_size;
+    for (uint32_t slot = 0; slot < vector_map_.size(); slot++) {
+        VectorMapRecord& record = records[slot];
+        record.vector_id = vector_map_.id(slot);
+        record.cluster_id = vector_map_.cluster(slot);
+        record.offset = vector_map_.offset(slot);
+        record.norm = entry_norms_ ? vector_map_.norm(slot) : 0.0f;
+        record.metadata_size = vector_map_.metadataSize(slot);
+        uint64_t device_offset = vector_map_.metadataDeviceOffset(slot);
+        const char* metadata = device_offset != 0 ? old_heap.data() + (device_offset - old_heap_start)
+                                                  : vector_map_.metadataData(slot);
+        if (record.metadata_size > 0) {
+            memcpy(image.data() + heap_pos, metadata, record.metadata_size);
         }
+        heap_pos += record.metadata_size;
     }
+    header->crc = crc32(records, vector_map_.size() * sizeof(VectorMapRecord));
     
-    // Update cluster map to reflect current state
-    if (!writeClusterMap()) {
-        logger_.error("Failed to update cluster map");
+    if (!writeAligned(image.data(), image.size(), vector_map_offset_)) {
+        logger_.error("Failed to write vector map");
         return false;
     }
+    vector_map_size_ = image.size();
+    vector_map_crc_ = crc32(image.data(), image.size());
     
-    logger_.info("Maintenance completed");
+    // Metadata still on the device now lives in the new heap
+    uint64_t metadata_offset = vector_map_offset_ + table_size;
+    for (uint32_t slot = 0; slot < vector_map_.size(); slot++) {
+        uint32_t metadata_size = vector_map_.metadataSize(slot);
+        if (vector_map_.metadataDeviceOffset(slot) != 0) {
+            vector_map_.setDeviceMetadata(slot, metadata_offset, metadata_size);
+        }
+        metadata_offset += metadata_size;
+    }
+    
+    logger_.debug("Wrote vector map: " + std::to_string(vector_map_.size()) + " vectors, " +
+                  std::to_string(heap_size) + " bytes of metadata");
     return true;
 }
 
-bool VectorClusterStore::saveIndex(const std::string& filename) {
-    std::lock_guard<std::mutex> lock(store_mutex_);
+bool VectorClusterStore::readVectorMap() {
+    if (fd_ < 0) {
+        return false;
+    }
     
-    // Save clustering model
-    if (!clustering_->saveToFile(filename)) {
-        logger_.error("Failed to save clustering model");
+    // Clear existing map
+    vector_map_.clear();
+    
+    VectorMapHeader header;
+    if (!readAligned(&header, sizeof(header), vector_map_offset_)) {
         return false;
     }
+    if (memcmp(header.signature, VECTOR_MAP_SIGNATURE, sizeof(VECTOR_MAP_SIGNATURE)) != 0) {
+        uint32_t num_vectors;
+        memcpy(&num_vectors, &header, sizeof(num_vectors));
+        return readLegacyVectorMap(num_vectors);
+    }
     
-    // Save vector map to a separate file
-    std::string vector_map_file = filename + ".vmap";
-    std::ofstream file(vector_map_file, std::ios::binary);
-    if (!file.is_open()) {
-        logger_.error("Failed to open vector map file for writing");
+    // Sanity check - limit maximum vectors to prevent excessive memory usage
+    const uint32_t MAX_VECTORS = 1000000; // 1 million vectors max
+    const uint64_t table_size = sizeof(VectorMapHeader) +
+                                static_cast<uint64_t>(header.entry_count) * sizeof(VectorMapRecord);
+    if (header.entry_count > MAX_VECTORS || header.record_size != sizeof(VectorMapRecord) ||
+        table_size + header.heap_size > vector_map_capacity_) {
+        logger_.error("Vector map header invalid: " + std::to_string(header.entry_count) +
+                      " entries of " + std::to_string(header.record_size) + " bytes");
         return false;
     }
     
-    // Write number of vectors
-    uint32_t num_vectors = static_cast<uint32_t>(vector_map_.size());
-    file.write(reinterpret_cast<const char*>(&num_vectors), sizeof(uint32_t));
+    // The whole table in one read
+    std::vector<VectorMapRecord> records(header.entry_count);
+    if (header.entry_count > 0 &&
+        !readAligned(records.data(), records.size() * sizeof(VectorMapRecord),
+                     vector_map_offset_ + sizeof(VectorMapHeader))) {
+        logger_.error("Failed to read vector map entries");
+        return false;
+    }
+    if (crc32(records.data(), records.size() * sizeof(VectorMapRecord)) != header.crc) {
+        logger_.error("Vector map checksum mismatch");
+        return false;
+    }
     
-    // Write vector entries
-    for (const auto& [vector_id, entry] : vector_map_) {
-        file.write(reinterpret_cast<const char*>(&vector_id), sizeof(uint32_t));
-        file.write(reinterpret_cast<const char*>(&entry.cluster_id), sizeof(uint32_t));
-        file.write(reinterpret_cast<const char*>(&entry.offset), sizeof(uint64_t));
+    // Metadata stays in the heap until getVectorMetadata asks for it
+    vector_map_.reserve(header.entry_count);
+    uint64_t metadata_offset = vector_map_offset_ + table_size;
+    uint64_t heap_end = metadata_offset + header.heap_size;
+    for (const VectorMapRecord& record : records) {
+        if (metadata_offset + record.metadata_size > heap_end) {
+            logger_.error("Metadata of vector " + std::to_string(record.vector_id) +
+                          " runs past the vector map heap");
+            vector_map_.clear();
+            return false;
+        }
+        uint32_t slot = vector_map_.insert(record.vector_id, record.cluster_id, record.offset,
+                                           entry_norms_ ? record.norm : 0.0f);
+        vector_map_.setDeviceMetadata(slot, metadata_offset, record.metadata_size);
+        metadata_offset += record.metadata_size;
         
-        // Write metadata string
-        uint32_t metadata_size = static_cast<uint32_t>(entry.metadata.size());
-        file.write(reinterpret_cast<const char*>(&metadata_size), sizeof(uint32_t));
-        file.write(entry.metadata.c_str(), metadata_size);
+        // Update next_vector_id if needed
+        if (record.vector_id >= next_vector_id_) {
+            next_vector_id_ = record.vector_id + 1;
+        }
     }
     
-    bool success = !file.bad();
-    file.close();
-    
-    if (success) {
-        logger_.info("Index saved to " + filename);
-    } else {
-        logger_.error("Failed to save vector map");
+    // The metadata stays on the device, but its attributes are indexed
+    // now; the heap is read once for them
+    if (!vector_map_.attributes().empty() && header.heap_size > 0) {
+        std::vector<char> heap(header.heap_size);
+        if (!readAligned(heap.data(), heap.size(), vector_map_offset_ + table_size)) {
+            logger_.error("Failed to read vector map heap for attributes");
+            vector_map_.clear();
+            return false;
+        }
+        const uint64_t heap_start = vector_map_offset_ + table_size;
+        for (uint32_t slot = 0; slot < vector_map_.size(); slot++) {
+            if (uint64_t offset = vector_map_.metadataDeviceOffset(slot)) {
+                vector_map_.indexAttributes(slot, heap.data() + (offset - heap_start),
+                                            vector_map_.metadataSize(slot));
+            }
+        }
     }
     
-    return success;
+    logger_.debug("Read vector map: " + std::to_string(header.entry_count) + " vectors");
+    return true;
 }
 
-bool VectorClusterStore::loadIndex(const std::string& filename) {
-    std::lock_guard<std::mutex> lock(store_mutex_);
-    
-    // Load clustering model
-    if (!clustering_->loadFromFile(filename)) {
-        logger_.error("Failed to load clustering model");
+bool VectorClusterStore::readLegacyVectorMap(uint32_t num_vectors) {
+    // Sanity check - limit maximum vectors to prevent excessive memory usage
+    const uint32_t MAX_VECTORS = 1000000; // 1 million vectors max
+    if (num_vectors > MAX_VECTORS) {
+        logger_.error("Vector count too large: " + std::to_string(num_vectors) + 
+                     ", maximum allowed: " + std::to_string(MAX_VECTORS));
         return false;
     }
+    if (num_vectors == 0) {
+        logger_.debug("Read vector map: 0 vectors");
+        return true;
+    }
     
-    // Load vector map from a separate file
-    std::string vector_map_file = filename + ".vmap";
-    std::ifstream file(vector_map_file, std::ios::binary);
-    if (!file.is_open()) {
-        logger_.error("Failed to open vector map file for reading");
+    // Entries are variable-length (metadata inline), so read the whole
+    // region once and parse it in memory. The next checkpoint rewrites the
+    // map in the current format.
+    std::vector<char> region(vector_map_capacity_);
+    if (!readAligned(region.data(), region.size(), vector_map_offset_)) {
+        logger_.error("Failed to read vector map");
         return false;
     }
     
-    // Clear existing vector map
-    vector_map_.clear();
-    
-    // Read number of vectors
-    uint32_t num_vectors;
-    file.read(reinterpret_cast<char*>(&num_vectors), sizeof(uint32_t));
+    size_t pos = sizeof(uint32_t);
+    auto take = [&](void* out, size_t size) {
+        if (pos + size > region.size()) {
+            return false;
+        }
+        memcpy(out, region.data() + pos, size);
+        pos += size;
+        return true;
+    };
     
-    // Read vector entries. The on-disk layout (written by saveIndex)
-    // is three fields per entry — vector_id, cluster_id, offset —
-    // followed by a length-prefixed metadata blob. A prior version of
-    // this loop incorrectly read FOUR fields (an extra entry.vector_id
-    // that saveIndex never writes), desyncing the stream by 4 bytes
-    // after each entry and causing the "Loaded 2 vectors" / huge
-    // metadata_size corruption observed on reload.
-    const uint32_t MAX_METADATA_SIZE = 10240; // 10KB — matches writeVectorMap
+    vector_map_.reserve(num_vectors);
     for (uint32_t i = 0; i < num_vectors; i++) {
         uint32_t vector_id;
         VectorEntry entry;
-
-        file.read(reinterpret_cast<char*>(&vector_id), sizeof(uint32_t));
-        file.read(reinterpret_cast<char*>(&entry.cluster_id), sizeof(uint32_t));
-        file.read(reinterpret_cast<char*>(&entry.offset), sizeof(uint64_t));
-
-        // Read metadata string
         uint32_t metadata_size;
-        file.read(reinterpret_cast<char*>(&metadata_size), sizeof(uint32_t));
-
-        // Bound metadata_size before allocating to keep a corrupt file
-        // from triggering a multi-GB allocation. If we see something
-        // out of bounds, the stream is desynced — fail the load loudly
-        // rather than silently storing junk.
-        if (metadata_size > MAX_METADATA_SIZE) {
-            logger_.error("loadIndex: metadata_size " + std::to_string(metadata_size) +
-                         " for vector " + std::to_string(vector_id) +
-                         " exceeds MAX_METADATA_SIZE — checkpoint is corrupt or "
-                         "format version mismatch; aborting load");
+        // Older maps don't have a norm; 0 means unknown
+        if (!take(&vector_id, sizeof(vector_id)) ||
+            !take(&entry.cluster_id, sizeof(entry.cluster_id)) ||
+            !take(&entry.offset, sizeof(entry.offset)) ||
+            (entry_norms_ && !take(&entry.norm, sizeof(entry.norm))) ||
+            !take(&metadata_size, sizeof(metadata_size))) {
+            logger_.error("Vector map truncated at entry " + std::to_string(i));
+            vector_map_.clear();
             return false;
         }
-
-        entry.vector_id = vector_id;
-        if (metadata_size > 0) {
-            std::vector<char> metadata_buffer(metadata_size);
-            file.read(metadata_buffer.data(), metadata_size);
-            entry.metadata.assign(metadata_buffer.data(), metadata_size);
+        
+        // Sanity check metadata size
+        const uint32_t MAX_METADATA_SIZE = 10240; // 10KB max per vector
+        if (metadata_size > MAX_METADATA_SIZE || pos + metadata_size > region.size()) {
+            logger_.error("Metadata size too large: " + std::to_string(metadata_size) + 
+                         " bytes for vector " + std::to_string(vector_id));
+            vector_map_.clear();
+            return false;
         }
-
-        vector_map_[vector_id] = entry;
-
+        uint32_t slot = vector_map_.insert(vector_id, entry.cluster_id, entry.offset, entry.norm);
+        vector_map_.setMetadata(slot, std::string(region.data() + pos, metadata_size));
+        pos += metadata_size;
+        
         // Update next_vector_id if needed
         if (vector_id >= next_vector_id_) {
             next_vector_id_ = vector_id + 1;
         }
     }
     
-    bool success = !file.bad() && !file.fail();
-    file.close();
-    
-    if (success) {
-        logger_.info("Index loaded from " + filename);
-        logger_.info("Loaded " + std::to_string(vector_map_.size()) + " vectors");
-
-        // Bump the allocation high-water mark past loaded vectors so any
-        // subsequent stores append rather than overwrite existing data.
-        size_t vector_size = vector_dim_ * sizeof(float);
-        for (const auto& [vid, entry] : vector_map_) {
-            uint64_t end = entry.offset + vector_size;
-            if (end > next_alloc_offset_) {
-                next_alloc_offset_ = end;
-            }
-        }
+    logger_.debug("Read legacy vector map: " + std::to_string(num_vectors) + " vectors");
+    return true;
+}
 
-        // Update device metadata
-        if (!writeHeader() || !writeVectorMap() || !writeClusterMap()) {
-            logger_.error("Failed to update device metadata after loading index");
-            return false;
+std::string VectorClusterStore::entryMetadata(uint32_t slot) {
+    uint64_t offset;
+    uint32_t size;
+    {
+        std::lock_guard<std::mutex> lock(metadata_mutex_);
+        offset = vector_map_.metadataDeviceOffset(slot);
+        if (offset == 0) {
+            return vector_map_.metadata(slot);
         }
-    } else {
-        logger_.error("Failed to load vector map");
+        size = vector_map_.metadataSize(slot);
     }
     
-    return success;
+    std::string metadata(size, '\0');
+    if (!readAligned(&metadata[0], size, offset)) {
+        logger_.error("Failed to read metadata for vector " + std::to_string(vector_map_.id(slot)));
+        return "";
+    }
+    return metadata;
 }
 
-void VectorClusterStore::printStoreInfo() const {
-    if (fd_ < 0) {
-        std::cout << "Device not open" << std::endl;
-        return;
+uint64_t VectorClusterStore::allocateVectorSpace(uint32_t cluster_id) {
+    // Hand out the lowest free slot of the cluster's extent, or the next
+    // one past those handed out so far. New extents are
+    // reserved at next_alloc_offset_, a per-instance high-water mark (NOT a
+    // function-static — that old bug shared the offset across stores and
+    // reset it on reopen, clobbering existing vectors).
+    const uint64_t slot_size = vectorSlotSize();
+
+    // Lazily initialize from data_offset_ on first use of a fresh store.
+    if (next_alloc_offset_ < data_offset_) {
+        next_alloc_offset_ = data_offset_;
     }
-    
-    std::cout << "=== Vector Cluster Store Information ===" << std::endl;
-    std::cout << "Device path: " << device_path_ << std::endl;
-    std::cout << "Device size: " << device_size_ << " bytes (" 
-              << (device_size_ / (1024*1024)) << " MB)" << std::endl;
-    std::cout << "Block size: " << block_size_ << " bytes" << std::endl;
-    std::cout << "Direct I/O: " << (is_direct_io_ ? "Yes" : "No") << std::endl;
-    std::cout << "Vector dimension: " << vector_dim_ << std::endl;
-    std::cout << "Vector count: " << vector_map_.size() << std::endl;
-    std::cout << "Next vector ID: " << next_vector_id_ << std::endl;
-    std::cout << "Clustering strategy: " << clustering_->getName() << std::endl;
-    
-    // Get cluster counts
-    std::unordered_map<uint32_t, uint32_t> cluster_counts;
-    for (const auto& [_, entry] : vector_map_) {
-        cluster_counts[entry.cluster_id]++;
+
+    ClusterExtent& extent = cluster_extents_[cluster_id];
+    if (!extent.free_slots.empty()) {
+        uint32_t slot = *extent.free_slots.begin();
+        extent.free_slots.erase(extent.free_slots.begin());
+        return extent.start_offset + static_cast<uint64_t>(slot) * slot_size;
     }
     
-    std::cout << "Cluster distribution:" << std::endl;
-    for (const auto& [cluster_id, count] : cluster_counts) {
-        std::cout << "  Cluster " << cluster_id << ": " << count << " vectors" << std::endl;
+    if (extent.used == extent.capacity) {
+        uint32_t growth = std::min(extent.capacity, CLUSTER_EXTENT_MAX_GROWTH);
+        uint64_t extent_end = extent.start_offset + static_cast<uint64_t>(extent.capacity) * slot_size;
+        uint64_t growth_end = extent_end + static_cast<uint64_t>(growth) * slot_size;
+        
+        if (extent.capacity > 0 && extent_end == next_alloc_offset_) {
+            // Nothing was reserved after this extent: grow it in place
+            next_alloc_offset_ = growth_end;
+            extent.capacity += growth;
+            extendDataMap();
+        } else if (extent.capacity > 0 && carveFreeRange(extent_end, growth_end)) {
+            // The space after this extent is free: grow into it
+            extent.capacity += growth;
+        } else {
+            // Move on to a new, larger extent. Members in the old one stay
+            // where they are until maintenance or compactStorage moves them.
+            uint32_t capacity = (extent.capacity > 0) ? extent.capacity + growth
+                                                      : CLUSTER_EXTENT_INITIAL_CAPACITY;
+            if (extent.used > 0) {
+                extent.scattered = true;
+            }
+            uint64_t start = reserveExtent(capacity);
+            // None of the old extent's tail has been handed out since the
+            // last checkpoint, so it is free right away
+            if (extent.capacity > 0) {
+                addFreeRange(extent.start_offset + static_cast<uint64_t>(extent.used) * slot_size,
+                             extent_end);
+            }
+            extent.start_offset = start;
+            extent.capacity = capacity;
+            extent.used = 0;
+        }
+        
+        clustering_->setClusterExtent(cluster_id, extent.start_offset, extent.capacity);
+        logger_.debug([&] {
+            return "Cluster " + std::to_string(cluster_id) + " extent at " +
+                   std::to_string(extent.start_offset) + ", " + std::to_string(extent.capacity) + " slots";
+        });
     }
-    
-    std::cout << "=================================" << std::endl;
+
+    return extent.start_offset + static_cast<uint64_t>(extent.used++) * slot_size;
 }
 
-void VectorClusterStore::printClusterInfo(uint32_t cluster_id) const {
-    if (fd_ < 0) {
-        std::cout << "Device not open" << std::endl;
+void VectorClusterStore::reserveEmptyExtent(uint32_t cluster_id, uint32_t count) {
+    const uint64_t slot_size = vectorSlotSize();
+    if (next_alloc_offset_ < data_offset_) {
+        next_alloc_offset_ = data_offset_;
+    }
+    ClusterExtent& extent = cluster_extents_[cluster_id];
+    if (extent.capacity - extent.used + extent.free_slots.size() >= count) {
         return;
     }
     
-    std::cout << "=== Cluster " << cluster_id << " Information ===" << std::endl;
-    
-    Vector centroid = clustering_->getClusterCentroid(cluster_id);
-    uint32_t size = clustering_->getClusterSize(cluster_id);
-    
-    std::cout << "Size: " << size << " vectors" << std::endl;
-    std::cout << "Centroid: [";
-    for (size_t i = 0; i < std::min(5ul, centroid.size()); i++) {
-        std::cout << centroid[i];
-        if (i < std::min(4ul, centroid.size() - 1)) {
-            std::cout << ", ";
+    // The cluster has no members, so whatever of the old extent isn't
+    // pending a checkpoint is free now; the pending slots are released as
+    // plain ranges once no extent holds them
+    if (extent.capacity > 0) {
+        for (uint32_t slot : extent.free_slots) {
+            uint64_t offset = extent.start_offset + static_cast<uint64_t>(slot) * slot_size;
+            addFreeRange(offset, offset + slot_size);
         }
+        addFreeRange(extent.start_offset + static_cast<uint64_t>(extent.used) * slot_size,
+                     extent.start_offset + static_cast<uint64_t>(extent.capacity) * slot_size);
     }
-    if (centroid.size() > 5) {
-        std::cout << ", ...";
+    uint32_t capacity = std::max(CLUSTER_EXTENT_INITIAL_CAPACITY, count + count / 2);
+    extent.start_offset = reserveExtent(capacity);
+    extent.capacity = capacity;
+    extent.used = 0;
+    extent.free_slots.clear();
+    extent.scattered = false;
+    clustering_->setClusterExtent(cluster_id, extent.start_offset, extent.capacity);
+}
+
+uint64_t VectorClusterStore::reserveExtent(uint32_t capacity) {
+    return reserveSpace(static_cast<uint64_t>(capacity) * vectorSlotSize());
+}
+
+uint64_t VectorClusterStore::reserveSpace(uint64_t bytes) {
+    uint64_t reused = takeFreeRange(bytes);
+    if (reused != 0) {
+        return reused;
     }
-    std::cout << "]" << std::endl;
     
-    // List vectors in this cluster
-    std::cout << "Vectors:" << std::endl;
-    int count = 0;
-    for (const auto& [vector_id, entry] : vector_map_) {
-        if (entry.cluster_id == cluster_id) {
-            std::cout << "  ID " << vector_id << " at offset " << entry.offset;
-            if (!entry.metadata.empty()) {
-                std::cout << " (" << entry.metadata << ")";
-            }
-            std::cout << std::endl;
-            count++;
-            if (count >= 10) {
-                std::cout << "  ... and " << (size - 10) << " more" << std::endl;
-                break;
-            }
-        }
+    // Ensure block alignment
+    uint64_t start = ((next_alloc_offset_ + block_size_ - 1) / block_size_) * block_size_;
+    next_alloc_offset_ = start + bytes;
+    extendDataMap();
+    return start;
+}
+
+void VectorClusterStore::freeVectorSlot(uint32_t slot) {
+    const uint32_t cluster_id = vector_map_.cluster(slot);
+    const uint64_t offset = vector_map_.offset(slot);
+    if (quantizer_ && vector_map_.quantized(slot)) {
+        quant_pinned_.push_back({cluster_id, offset, vectorSlotSize()});
+    } else {
+        freeSpace(cluster_id, offset, vectorSlotSize());
     }
-    
-    std::cout << "=================================" << std::endl;
 }
 
-bool VectorClusterStore::readHeader() {
-    if (fd_ < 0) {
-        return false;
+void VectorClusterStore::freeSpace(uint32_t cluster_id, uint64_t offset, uint64_t size) {
+    if (size > 0) {
+        pending_free_.push_back({cluster_id, offset, size});
     }
-    
-    StoreHeader header;
-    if (!readAligned(&header, sizeof(header), header_offset_)) {
-        return false;
+}
+
+void VectorClusterStore::releasePendingSpace() {
+    // Replicas may still be reading space the held snapshots name; it
+    // joins the newest snapshot's hold instead of being freed
+    if (!snapshot_held_.empty()) {
+        snapshot_held_.back().insert(snapshot_held_.back().end(), pending_free_.begin(), pending_free_.end());
+        pending_free_.clear();
+        return;
     }
-    
-    // Check signature
-    if (memcmp(header.signature, STORE_SIGNATURE, sizeof(STORE_SIGNATURE)) != 0) {
-        logger_.debug("Invalid store signature");
-        return false;
+    for (const FreedSpace& space : pending_free_) {
+        releaseSpace(space);
     }
+    pending_free_.clear();
+}
+
+VectorClusterStore::ClusterExtent* VectorClusterStore::extentContaining(uint32_t cluster_id,
+                                                                        uint64_t offset) {
+    const uint64_t slot_size = vectorSlotSize();
+    auto contains = [&](const ClusterExtent& extent) {
+        return offset >= extent.start_offset &&
+               offset < extent.start_offset + static_cast<uint64_t>(extent.capacity) * slot_size;
+    };
     
-    // Check version
-    if (header.version != 1) {
-        logger_.error("Unsupported store version: " + std::to_string(header.version));
-        return false;
+    // Almost always the cluster's own extent, if any
+    auto it = cluster_extents_.find(cluster_id);
+    if (it != cluster_extents_.end() && contains(it->second)) {
+        return &it->second;
     }
-    
-    // Update store parameters
-    vector_dim_ = header.vector_dim;
-    next_vector_id_ = header.next_id;
-    cluster_map_offset_ = header.cluster_map_offset;
-    vector_map_offset_ = header.vector_map_offset;
-    data_offset_ = header.data_offset;
-    
-    logger_.info("Read store header: vector_dim=" + std::to_string(vector_dim_) + 
-                ", vector_count=" + std::to_string(header.vector_count));
-    
-    return true;
+    for (auto& [other_id, extent] : cluster_extents_) {
+        if (contains(extent)) {
+            return &extent;
+        }
+    }
+    return nullptr;
 }
 
-bool VectorClusterStore::writeHeader() {
-    if (fd_ < 0) {
-        return false;
-    }
-    
-    StoreHeader header;
-    memcpy(header.signature, STORE_SIGNATURE, sizeof(STORE_SIGNATURE));
-    header.version = 1;
-    header.vector_dim = vector_dim_;
-    header.max_clusters = 100;  // Fixed for now
-    header.vector_count = static_cast<uint32_t>(vector_map_.size());
-    header.next_id = next_vector_id_;
-    header.cluster_map_offset = cluster_map_offset_;
-    header.vector_map_offset = vector_map_offset_;
-    header.data_offset = data_offset_;
+void VectorClusterStore::releaseSpace(const FreedSpace& space) {
+    const uint64_t slot_size = vectorSlotSize();
     
-    std::string strategy_name = clustering_->getName();
-    strncpy(header.strategy_name, strategy_name.c_str(), sizeof(header.strategy_name) - 1);
-    header.strategy_name[sizeof(header.strategy_name) - 1] = '\0';
+    // A slot of a current extent goes back on that extent's free list
+    ClusterExtent* extent = (space.size == slot_size) ? extentContaining(space.cluster_id, space.offset)
+                                                      : nullptr;
+    if (!extent) {
+        addFreeRange(space.offset, space.offset + space.size);
+        return;
+    }
+    uint32_t slot = static_cast<uint32_t>((space.offset - extent->start_offset) / slot_size);
+    if (slot < extent->used) {
+        extent->free_slots.insert(slot);
+    }
+    // Free slots at the end shrink the used part instead
+    while (!extent->free_slots.empty() && *extent->free_slots.rbegin() == extent->used - 1) {
+        extent->free_slots.erase(std::prev(extent->free_slots.end()));
+        extent->used--;
+    }
+}
+
+void VectorClusterStore::addFreeRange(uint64_t start, uint64_t end) {
+    if (start >= end) {
+        return;
+    }
     
-    memset(header.reserved, 0, sizeof(header.reserved));
+    // Merge with every range it overlaps or touches. Freeing space twice
+    // (a slot inside an extent that is freed whole) is harmless.
+    auto it = free_space_.upper_bound(start);
+    if (it != free_space_.begin() && std::prev(it)->second >= start) {
+        --it;
+    }
+    while (it != free_space_.end() && it->first <= end) {
+        start = std::min(start, it->first);
+        end = std::max(end, it->second);
+        it = free_space_.erase(it);
+    }
     
-    return writeAligned(&header, sizeof(header), header_offset_);
+    // Free space at the end of the data region lowers the high-water mark
+    if (end >= next_alloc_offset_) {
+        next_alloc_offset_ = std::max(start, data_offset_);
+        return;
+    }
+    free_space_[start] = end;
 }
 
-bool VectorClusterStore::writeClusterMap() {
-    if (fd_ < 0) {
-        return false;
+uint64_t VectorClusterStore::takeFreeRange(uint64_t bytes) {
+    for (const auto& [start, end] : free_space_) {
+        uint64_t aligned = ((start + block_size_ - 1) / block_size_) * block_size_;
+        if (aligned + bytes <= end) {
+            carveFreeRange(aligned, aligned + bytes);
+            return aligned;
+        }
     }
+    return 0;
+}
 
-    // Serialize the full clustering model state
-    std::vector<uint8_t> serialized = clustering_->serialize();
-
-    // Calculate size needed (4 bytes for size + serialized data)
-    size_t size_needed = sizeof(uint32_t) + serialized.size();
-
-    // Ensure we have enough space
-    if (size_needed > (vector_map_offset_ - cluster_map_offset_)) {
-        logger_.error("Cluster map too large: need " + std::to_string(size_needed) +
-                     " bytes, have " + std::to_string(vector_map_offset_ - cluster_map_offset_));
+bool VectorClusterStore::carveFreeRange(uint64_t start, uint64_t end) {
+    auto it = free_space_.upper_bound(start);
+    if (it == free_space_.begin()) {
         return false;
     }
-
-    // Write size of serialized data
-    uint32_t data_size = static_cast<uint32_t>(serialized.size());
-    if (!writeAligned(&data_size, sizeof(data_size), cluster_map_offset_)) {
-        logger_.error("Failed to write cluster map size");
+    --it;
+    const uint64_t range_start = it->first;
+    const uint64_t range_end = it->second;
+    if (range_end < end) {
         return false;
     }
-
-    // Write serialized clustering model
-    if (data_size > 0) {
-        if (!writeAligned(serialized.data(), serialized.size(), cluster_map_offset_ + sizeof(uint32_t))) {
-            logger_.error("Failed to write cluster map data");
-            return false;
-        }
+    
+    free_space_.erase(it);
+    if (range_start < start) {
+        free_space_[range_start] = start;
+    }
+    if (end < range_end) {
+        free_space_[end] = range_end;
     }
-
-    logger_.debug("Wrote cluster map: " + std::to_string(data_size) + " bytes");
     return true;
 }
 
-bool VectorClusterStore::readClusterMap() {
-    if (fd_ < 0) {
-        return false;
+bool VectorClusterStore::carveFreeSlot(uint32_t cluster_id, uint64_t offset) {
+    const uint64_t slot_size = vectorSlotSize();
+    ClusterExtent* extent = extentContaining(cluster_id, offset);
+    if (extent) {
+        uint32_t slot = static_cast<uint32_t>((offset - extent->start_offset) / slot_size);
+        return extent->free_slots.erase(slot) > 0;
     }
+    return carveFreeRange(offset, offset + slot_size);
+}
 
-    // Read size of serialized data
-    uint32_t data_size;
-    if (!readAligned(&data_size, sizeof(data_size), cluster_map_offset_)) {
-        logger_.error("Failed to read cluster map size");
-        return false;
+uint64_t VectorClusterStore::freeBytes() const {
+    uint64_t bytes = 0;
+    for (const auto& [start, end] : free_space_) {
+        bytes += end - start;
     }
-
-    // If no data, nothing to restore (new store)
-    if (data_size == 0) {
-        logger_.debug("Read cluster map: empty (new store)");
-        return true;
+    for (const auto& [cluster_id, extent] : cluster_extents_) {
+        bytes += extent.free_slots.size() * vectorSlotSize();
     }
+    return bytes;
+}
 
-    // Sanity check size
-    if (data_size > (vector_map_offset_ - cluster_map_offset_ - sizeof(uint32_t))) {
-        logger_.error("Cluster map size invalid: " + std::to_string(data_size));
-        return false;
+uint64_t VectorClusterStore::pendingFreeBytes() const {
+    uint64_t bytes = 0;
+    for (const FreedSpace& space : pending_free_) {
+        bytes += space.size;
     }
+    for (const FreedSpace& space : quant_pinned_) {
+        bytes += space.size;
+    }
+    return bytes;
+}
 
-    // Read serialized clustering model
-    std::vector<uint8_t> serialized(data_size);
-    if (!readAligned(serialized.data(), data_size, cluster_map_offset_ + sizeof(uint32_t))) {
-        logger_.error("Failed to read cluster map data");
-        return false;
+uint64_t VectorClusterStore::vectorSlotSize() const {
+    uint64_t vector_size = vector_dim_ * sizeof(float);
+    return ((vector_size + block_size_ - 1) / block_size_) * block_size_;
+}
+
+void VectorClusterStore::rebuildClusterExtents() {
+    const uint64_t slot_size = vectorSlotSize();
+    const uint64_t vector_size = vector_dim_ * sizeof(float);
+    
+    cluster_extents_.clear();
+    free_space_.clear();
+    next_alloc_offset_ = data_offset_;
+    
+    // Current extents in device order, for finding which one holds an offset
+    std::vector<std::pair<uint64_t, uint32_t>> extent_starts;
+    for (const auto& info : clustering_->getAllClusters()) {
+        // Stores written before extents existed have none recorded
+        if (info.capacity == 0 || info.start_offset < data_offset_) {
+            continue;
+        }
+        ClusterExtent& extent = cluster_extents_[info.cluster_id];
+        extent.start_offset = info.start_offset;
+        extent.capacity = info.capacity;
+        next_alloc_offset_ = std::max(next_alloc_offset_,
+                                      info.start_offset + static_cast<uint64_t>(info.capacity) * slot_size);
+        extent_starts.push_back({info.start_offset, info.cluster_id});
+    }
+    std::sort(extent_starts.begin(), extent_starts.end());
+    auto extent_at = [&](uint64_t offset) -> ClusterExtent* {
+        auto it = std::upper_bound(extent_starts.begin(), extent_starts.end(),
+                                   std::make_pair(offset, UINT32_MAX));
+        if (it == extent_starts.begin()) {
+            return nullptr;
+        }
+        ClusterExtent& extent = cluster_extents_[std::prev(it)->second];
+        if (offset >= extent.start_offset + static_cast<uint64_t>(extent.capacity) * slot_size) {
+            return nullptr;
+        }
+        return &extent;
+    };
+    
+    // Which slots of each extent are occupied. This goes by offset, not by
+    // cluster: after a crash a vector logged into space another cluster's
+    // extent on the device still covers must not be handed out again.
+    // Vectors outside every extent (earlier extents, or extents reserved
+    // after the last checkpoint and replayed from the log) are kept as
+    // single slots, and push the high-water mark so nothing is ever
+    // allocated over them.
+    std::unordered_map<const ClusterExtent*, std::vector<bool>> occupied;
+    std::vector<std::pair<uint64_t, uint64_t>> in_use;
+    for (uint32_t i = 0; i < vector_map_.size(); i++) {
+        const uint64_t offset = vector_map_.offset(i);
+        next_alloc_offset_ = std::max(next_alloc_offset_, offset + vector_size);
+        
+        ClusterExtent* extent = extent_at(offset);
+        auto own = cluster_extents_.find(vector_map_.cluster(i));
+        if (own != cluster_extents_.end() && extent != &own->second) {
+            own->second.scattered = true;
+        }
+        if (!extent) {
+            in_use.push_back({offset, offset + slot_size});
+            continue;
+        }
+        uint32_t slot = static_cast<uint32_t>((offset - extent->start_offset) / slot_size);
+        std::vector<bool>& slots = occupied[extent];
+        slots.resize(extent->capacity, false);
+        slots[slot] = true;
+        extent->used = std::max<uint32_t>(extent->used, slot + 1);
+    }
+    
+    if (quant_offset_ != 0) {
+        next_alloc_offset_ = std::max(next_alloc_offset_, quant_offset_ + quant_size_);
+        in_use.push_back({quant_offset_, quant_offset_ + quant_size_});
+    }
+    
+    // Everything else below the high-water mark is free: unoccupied slots
+    // below each extent's fill level, and the gaps between extents
+    for (auto& [cluster_id, extent] : cluster_extents_) {
+        in_use.push_back({extent.start_offset,
+                          extent.start_offset + static_cast<uint64_t>(extent.capacity) * slot_size});
+        auto it = occupied.find(&extent);
+        for (uint32_t slot = 0; slot < extent.used; slot++) {
+            if (!it->second[slot]) {
+                extent.free_slots.insert(slot);
+            }
+        }
+    }
+    std::sort(in_use.begin(), in_use.end());
+    uint64_t position = data_offset_;
+    for (const auto& [start, end] : in_use) {
+        if (start > position) {
+            free_space_[position] = start;
+        }
+        position = std::max(position, end);
+    }
+    
+    // Space the log (or this instance, before the rebuild) freed stays
+    // pending until the next checkpoint (pending_free_), and space freed
+    // while replicas may read it stays held for their snapshots
+    // (snapshot_held_). Whatever of either is in use again is simply
+    // dropped from it rather than freed.
+    auto carve = [&](std::vector<FreedSpace>& spaces) {
+        std::vector<FreedSpace> pending;
+        pending.swap(spaces);
+        for (const FreedSpace& space : pending) {
+            bool free = (space.size == slot_size) ? carveFreeSlot(space.cluster_id, space.offset)
+                                                  : carveFreeRange(space.offset, space.offset + space.size);
+            if (free) {
+                spaces.push_back(space);
+            }
+        }
+    };
+    carve(pending_free_);
+    for (std::vector<FreedSpace>& held : snapshot_held_) {
+        carve(held);
     }
+}
 
-    // Deserialize and restore the clustering model state
-    if (!clustering_->deserialize(serialized)) {
-        logger_.error("Failed to deserialize clustering model");
+bool VectorClusterStore::isClusterCompact(uint32_t cluster_id,
+                                          const std::vector<uint32_t>& members) const {
+    auto it = cluster_extents_.find(cluster_id);
+    if (it == cluster_extents_.end() || it->second.used != members.size()) {
         return false;
     }
-
-    logger_.debug("Read cluster map: " + std::to_string(data_size) + " bytes restored");
+    
+    // used slots and as many members, each in its own slot: all inside
+    // means the front of the extent is exactly filled
+    const uint64_t extent_end = it->second.start_offset +
+                                static_cast<uint64_t>(it->second.used) * vectorSlotSize();
+    for (uint32_t slot : members) {
+        const uint64_t offset = vector_map_.offset(slot);
+        if (offset < it->second.start_offset || offset >= extent_end) {
+            return false;
+        }
+    }
     return true;
 }
-bool VectorClusterStore::writeVectorMap() {
-    if (fd_ < 0) {
-        return false;
-    }
+
+bool VectorClusterStore::compactCluster(uint32_t cluster_id, std::vector<uint32_t>& members) {
+    const uint64_t slot_size = vectorSlotSize();
+    const size_t vector_size = vector_dim_ * sizeof(float);
+    const uint32_t count = static_cast<uint32_t>(members.size());
     
-    // Calculate size needed
-    size_t fixed_entry_size = sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t);
-    size_t size_needed = sizeof(uint32_t);  // Number of vectors
+    // Leave room for the cluster to grow by half before the extent fills
+    uint32_t capacity = std::max(CLUSTER_EXTENT_INITIAL_CAPACITY, count + count / 2);
+    uint64_t start = reserveExtent(capacity);
+    const uint64_t reserved = static_cast<uint64_t>(capacity) * slot_size;
     
-    // Sanity check the number of vectors
-    const uint32_t MAX_VECTORS = 1000000; // 1 million vectors max
-    if (vector_map_.size() > MAX_VECTORS) {
-        logger_.error("Vector count too large: " + std::to_string(vector_map_.size()) + 
-                     ", maximum allowed: " + std::to_string(MAX_VECTORS));
-        return false;
-    }
+    // Copy in device order, staging up to MAX_WRITE_SPAN at a time. If a
+    // copy fails the new extent is freed again; nothing refers to it yet.
+    std::sort(members.begin(), members.end(), [this](uint32_t a, uint32_t b) {
+        return vector_map_.offset(a) < vector_map_.offset(b);
+    });
     
-    for (const auto& pair : vector_map_) {
-        const auto& entry = pair.second;
-        // Sanity check metadata size
-        const uint32_t MAX_METADATA_SIZE = 10240; // 10KB max per vector
-        if (entry.metadata.size() > MAX_METADATA_SIZE) {
-            logger_.error("Metadata size too large: " + std::to_string(entry.metadata.size()) + 
-                         " bytes for vector " + std::to_string(entry.vector_id));
+    const size_t slots_per_write = std::max<size_t>(1, MAX_WRITE_SPAN / slot_size);
+    std::vector<char> span;
+    for (size_t first = 0; first < count; first += slots_per_write) {
+        size_t n = std::min<size_t>(slots_per_write, count - first);
+        span.assign((n - 1) * slot_size + vector_size, 0);
+        // Members may be scattered, so the reads are spread over the pool
+        std::atomic<bool> read_failed(false);
+        thread_pool_->run((n + MAINTENANCE_READ_GRAIN - 1) / MAINTENANCE_READ_GRAIN,
+                          [&](size_t task, size_t) {
+            size_t end = std::min(n, (task + 1) * MAINTENANCE_READ_GRAIN);
+            for (size_t k = task * MAINTENANCE_READ_GRAIN; k < end && !read_failed; k++) {
+                uint32_t slot = members[first + k];
+                if (!readAligned(span.data() + k * slot_size, vector_size, vector_map_.offset(slot))) {
+                    logger_.error("Failed to read vector " + std::to_string(vector_map_.id(slot)) +
+                                 " for compaction");
+                    read_failed = true;
+                }
+            }
+        });
+        if (read_failed) {
+            freeSpace(UINT32_MAX, start, reserved);
+            return false;
+        }
+        if (!writeAligned(span.data(), span.size(), start + first * slot_size)) {
+            logger_.error("Failed to write compacted extent for cluster " + std::to_string(cluster_id));
+            freeSpace(UINT32_MAX, start, reserved);
             return false;
         }
-        
-        size_needed += fixed_entry_size + entry.metadata.size();
     }
     
-    // Ensure we have enough space
-    if (size_needed > (data_offset_ - vector_map_offset_)) {
-        logger_.error("Vector map too large: " + std::to_string(size_needed) + 
-                     " bytes needed, but only " + 
-                     std::to_string(data_offset_ - vector_map_offset_) + " bytes available");
-        return false;
+    // Every copy is written; switch the entries over. The old extent, and
+    // members' slots outside it, are freed for reuse after the checkpoint
+    // that ends maintenance.
+    ClusterExtent& extent = cluster_extents_[cluster_id];
+    const uint64_t old_start = extent.start_offset;
+    const uint64_t old_end = old_start + static_cast<uint64_t>(extent.capacity) * slot_size;
+    freeSpace(UINT32_MAX, old_start, old_end - old_start);
+    for (uint32_t k = 0; k < count; k++) {
+        uint64_t offset = vector_map_.offset(members[k]);
+        if (offset < old_start || offset >= old_end) {
+            freeSpace(UINT32_MAX, offset, slot_size);
+        }
+        vector_map_.setOffset(members[k], start + k * slot_size);
     }
     
-    // Write number of vectors
-    uint32_t num_vectors = static_cast<uint32_t>(vector_map_.size());
-    if (!writeAligned(&num_vectors, sizeof(num_vectors), vector_map_offset_)) {
+    extent.start_offset = start;
+    extent.capacity = capacity;
+    extent.used = count;
+    extent.free_slots.clear();
+    extent.scattered = false;
+    clustering_->setClusterExtent(cluster_id, start, capacity);
+    
+    logger_.debug([&] {
+        return "Compacted cluster " + std::to_string(cluster_id) + ": " + std::to_string(count) +
+               " vectors at " + std::to_string(start);
+    });
+    return true;
+}
+
+bool VectorClusterStore::buildQuantizedIndex(
+    std::unordered_map<uint32_t, std::vector<uint32_t>>& members) {
+    const size_t vector_size = vector_dim_ * sizeof(float);
+    
+    // The old index is replaced, not updated; until the checkpoint the
+    // header still points at it
+    dropQuantizedIndex();
+    
+    std::unique_ptr<Quantizer> quantizer =
+        createQuantizer(options_.quantization, vector_dim_, options_.pq_subvectors);
+    if (!quantizer) {
+        logger_.error("Unknown quantization type " +
+                     std::to_string(static_cast<uint32_t>(options_.quantization)));
         return false;
     }
     
-    // Write each vector entry in chunks
-    uint64_t offset = vector_map_offset_ + sizeof(uint32_t);
+    // Clusters in id order, each member list in device order, so the codes
+    // follow the layout of the vectors they describe
+    std::vector<uint32_t> cluster_ids;
+    size_t total = 0;
+    for (auto& [cluster_id, cluster_members] : members) {
+        cluster_ids.push_back(cluster_id);
+        std::sort(cluster_members.begin(), cluster_members.end(), [this](uint32_t a, uint32_t b) {
+            return vector_map_.offset(a) < vector_map_.offset(b);
+        });
+        total += cluster_members.size();
+    }
+    if (total == 0) {
+        return true;
+    }
+    std::sort(cluster_ids.begin(), cluster_ids.end());
     
-    // Define a reasonable chunk size (100 vectors per chunk)
-    const uint32_t CHUNK_SIZE = 100;
-    uint32_t i = 0;
+    std::unordered_map<uint32_t, Vector> centroids;
+    for (uint32_t cluster_id : cluster_ids) {
+        Vector centroid = clustering_->getClusterCentroid(cluster_id);
+        centroid.resize(vector_dim_, 0.0f);
+        centroids[cluster_id] = std::move(centroid);
+    }
     
-    for (const auto& pair : vector_map_) {
-        uint32_t vector_id = pair.first;
-        const auto& entry = pair.second;
-        
-        // Write vector ID
-        if (!writeAligned(&vector_id, sizeof(vector_id), offset)) {
-            logger_.error("Failed to write vector ID at offset " + std::to_string(offset));
-            return false;
+    // Train on the residuals of an evenly strided sample
+    std::vector<std::pair<uint32_t, const float*>> sample;
+    const size_t stride = std::max<size_t>(1, total / QUANT_TRAIN_SAMPLES);
+    size_t position = 0;
+    for (uint32_t cluster_id : cluster_ids) {
+        for (uint32_t slot : members[cluster_id]) {
+            if (position++ % stride == 0) {
+                sample.push_back({slot, centroids[cluster_id].data()});
+            }
         }
-        offset += sizeof(vector_id);
-        
-        // Write cluster ID
-        if (!writeAligned(&entry.cluster_id, sizeof(entry.cluster_id), offset)) {
-            logger_.error("Failed to write cluster ID for vector " + std::to_string(vector_id));
-            return false;
+    }
+    std::vector<float> samples(sample.size() * vector_dim_);
+    std::atomic<bool> read_failed(false);
+    thread_pool_->run((sample.size() + MAINTENANCE_READ_GRAIN - 1) / MAINTENANCE_READ_GRAIN,
+                      [&](size_t task, size_t) {
+        size_t end = std::min(sample.size(), (task + 1) * MAINTENANCE_READ_GRAIN);
+        for (size_t i = task * MAINTENANCE_READ_GRAIN; i < end && !read_failed; i++) {
+            float* row = samples.data() + i * vector_dim_;
+            if (!readAligned(row, vector_size, vector_map_.offset(sample[i].first))) {
+                logger_.error("Failed to read vector " + std::to_string(vector_map_.id(sample[i].first)) +
+                             " for quantizer training");
+                read_failed = true;
+                return;
+            }
+            for (uint32_t d = 0; d < vector_dim_; d++) {
+                row[d] -= sample[i].second[d];
+            }
         }
-        offset += sizeof(entry.cluster_id);
+    });
+    if (read_failed || !quantizer->train(samples.data(), sample.size(), thread_pool_.get())) {
+        return false;
+    }
+    samples = std::vector<float>();
+    
+    // Lay the index out: header, parameters, directory, then the codes
+    const size_t code_size = quantizer->codeSize();
+    std::vector<uint8_t> params = quantizer->serialize();
+    uint64_t directory_size = 0;
+    for (uint32_t cluster_id : cluster_ids) {
+        directory_size += 2 * sizeof(uint32_t) + sizeof(uint64_t) + vector_size +
+                          members[cluster_id].size() * (sizeof(uint32_t) + sizeof(uint64_t) + sizeof(float));
+    }
+    const uint64_t codes_start = sizeof(QuantHeader) + params.size() + directory_size;
+    const uint64_t index_size = codes_start + total * code_size;
+    const uint64_t index_offset = reserveSpace(index_size);
+    
+    // Encode cluster by cluster, reading members in coalesced runs on the pool
+    std::vector<uint8_t> directory;
+    directory.reserve(directory_size);
+    auto append = [&directory](const void* field, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(field);
+        directory.insert(directory.end(), bytes, bytes + size);
+    };
+    std::unordered_map<uint32_t, QuantizedCluster> clusters;
+    uint64_t codes_offset = index_offset + codes_start;
+    const size_t threads = thread_pool_->threadCount();
+    std::vector<AlignedBuffer> buffers(threads);
+    std::vector<Vector> residuals(threads, Vector(vector_dim_));
+    std::vector<uint8_t> codes;
+    
+    for (uint32_t cluster_id : cluster_ids) {
+        const std::vector<uint32_t>& cluster_members = members[cluster_id];
+        const size_t count = cluster_members.size();
+        QuantizedCluster& cluster = clusters[cluster_id];
+        cluster.centroid = centroids[cluster_id];
+        cluster.codes_offset = codes_offset;
+        cluster.ids.resize(count);
+        cluster.norms.resize(count);
+        codes.assign(count * code_size, 0);
         
-        // Write vector offset
-        if (!writeAligned(&entry.offset, sizeof(entry.offset), offset)) {
-            logger_.error("Failed to write vector offset for vector " + std::to_string(vector_id));
+        std::vector<ScanEntry> scan;
+        scan.reserve(count);
+        for (uint32_t slot : cluster_members) {
+            scan.push_back(scanEntry(slot));
+        }
+        std::vector<ScanRun> runs = buildScanRuns(scan, SCAN_READ_SPAN);
+        thread_pool_->run(runs.size(), [&](size_t index, size_t slot) {
+            const ScanRun& run = runs[index];
+            const char* data = readSpan(run.start, run.end - run.start, buffers[slot]);
+            if (!data) {
+                logger_.error("Failed to read vectors at offset " + std::to_string(run.start) +
+                             " for encoding");
+                read_failed = true;
+                return;
+            }
+            float* residual = residuals[slot].data();
+            for (size_t i = run.first; i <= run.last; i++) {
+                const float* vector = reinterpret_cast<const float*>(data + (scan[i].offset - run.start));
+                for (uint32_t d = 0; d < vector_dim_; d++) {
+                    residual[d] = vector[d] - cluster.centroid[d];
+                }
+                quantizer->encode(residual, codes.data() + i * code_size);
+                cluster.ids[i] = scan[i].vector_id;
+                cluster.norms[i] = vectorNorm(vector, vector_dim_);
+            }
+        });
+        if (read_failed) {
             return false;
         }
-        offset += sizeof(entry.offset);
-        
-        // Write metadata size and data
-        uint32_t metadata_size = static_cast<uint32_t>(entry.metadata.size());
-        if (!writeAligned(&metadata_size, sizeof(metadata_size), offset)) {
-            logger_.error("Failed to write metadata size for vector " + std::to_string(vector_id));
+        if (!codes.empty() && !writeAligned(codes.data(), codes.size(), codes_offset)) {
+            logger_.error("Failed to write quantized codes for cluster " + std::to_string(cluster_id));
             return false;
         }
-        offset += sizeof(metadata_size);
+        codes_offset += codes.size();
         
-        if (metadata_size > 0) {
-            if (!writeAligned(entry.metadata.c_str(), metadata_size, offset)) {
-                logger_.error("Failed to write metadata for vector " + std::to_string(vector_id));
-                return false;
-            }
-            offset += metadata_size;
+        uint32_t count32 = static_cast<uint32_t>(count);
+        append(&cluster_id, sizeof(cluster_id));
+        append(&count32, sizeof(count32));
+        append(&cluster.codes_offset, sizeof(cluster.codes_offset));
+        append(cluster.centroid.data(), vector_size);
+        append(cluster.ids.data(), count * sizeof(uint32_t));
+        for (const ScanEntry& entry : scan) {
+            append(&entry.offset, sizeof(entry.offset));
         }
-        
-        i++;
-        
-        // Log progress for large vector maps
-        if (num_vectors > CHUNK_SIZE && i % 1000 == 0) {
-            logger_.debug("Wrote " + std::to_string(i) + "/" + std::to_string(num_vectors) + " vectors");
+        append(cluster.norms.data(), count * sizeof(float));
+    }
+    
+    std::vector<uint8_t> head(sizeof(QuantHeader));
+    QuantHeader* header = reinterpret_cast<QuantHeader*>(head.data());
+    memcpy(header->signature, QUANT_SIGNATURE, sizeof(QUANT_SIGNATURE));
+    header->type = static_cast<uint32_t>(quantizer->type());
+    header->vector_dim = vector_dim_;
+    header->code_size = static_cast<uint32_t>(code_size);
+    header->cluster_count = static_cast<uint32_t>(cluster_ids.size());
+    header->params_size = params.size();
+    header->directory_size = directory.size();
+    header->crc = crc32(directory.data(), directory.size(), crc32(params.data(), params.size()));
+    head.insert(head.end(), params.begin(), params.end());
+    head.insert(head.end(), directory.begin(), directory.end());
+    if (!writeAligned(head.data(), head.size(), index_offset)) {
+        logger_.error("Failed to write quantized index directory");
+        return false;
+    }
+    
+    retireQuantizedIndex();
+    for (uint32_t cluster_id : cluster_ids) {
+        for (uint32_t slot : members[cluster_id]) {
+            vector_map_.setQuantized(slot, true);
         }
     }
+    quantizer_ = std::move(quantizer);
+    quantized_clusters_ = std::move(clusters);
+    quant_offset_ = index_offset;
+    quant_size_ = index_size;
     
-    logger_.debug("Wrote vector map: " + std::to_string(num_vectors) + " vectors");
+    logger_.info("Built " + quantizer_->getName() + " index: " + std::to_string(total) +
+                " vectors, " + std::to_string(code_size) + " bytes each");
     return true;
 }
 
-bool VectorClusterStore::readVectorMap() {
-    if (fd_ < 0) {
+bool VectorClusterStore::readQuantizedIndex() {
+    const size_t vector_size = vector_dim_ * sizeof(float);
+    
+    QuantHeader header;
+    if (quant_size_ < sizeof(header) || !readAligned(&header, sizeof(header), quant_offset_)) {
         return false;
     }
-    
-    // Clear existing map
-    vector_map_.clear();
-    
-    // Read number of vectors
-    uint32_t num_vectors;
-    if (!readAligned(&num_vectors, sizeof(num_vectors), vector_map_offset_)) {
+    if (memcmp(header.signature, QUANT_SIGNATURE, sizeof(QUANT_SIGNATURE)) != 0 ||
+        header.vector_dim != vector_dim_ ||
+        sizeof(header) + header.params_size + header.directory_size > quant_size_) {
+        logger_.error("Invalid quantized index header");
         return false;
     }
     
-    // Sanity check - limit maximum vectors to prevent excessive memory usage
-    const uint32_t MAX_VECTORS = 1000000; // 1 million vectors max
-    if (num_vectors > MAX_VECTORS) {
-        logger_.error("Vector count too large: " + std::to_string(num_vectors) + 
-                     ", maximum allowed: " + std::to_string(MAX_VECTORS));
+    QuantizationType type = static_cast<QuantizationType>(header.type);
+    std::unique_ptr<Quantizer> quantizer = createQuantizer(type, vector_dim_, header.code_size);
+    if (!quantizer || quantizer->codeSize() != header.code_size) {
+        logger_.error("Unsupported quantized index type " + std::to_string(header.type));
         return false;
     }
     
-    // Read each vector entry in chunks
-    uint64_t offset = vector_map_offset_ + sizeof(uint32_t);
-    
-    // Define a reasonable chunk size (100 vectors per chunk)
-    const uint32_t CHUNK_SIZE = 100;
+    std::vector<uint8_t> data(header.params_size + header.directory_size);
+    if (!data.empty() && !readAligned(data.data(), data.size(), quant_offset_ + sizeof(header))) {
+        return false;
+    }
+    if (crc32(data.data() + header.params_size, header.directory_size,
+              crc32(data.data(), header.params_size)) != header.crc) {
+        logger_.error("Quantized index checksum mismatch");
+        return false;
+    }
+    if (!quantizer->deserialize(std::vector<uint8_t>(data.begin(), data.begin() + header.params_size))) {
+        logger_.error("Invalid quantizer parameters");
+        return false;
+    }
     
-    for (uint32_t i = 0; i < num_vectors;) {
-        // Calculate how many vectors to read in this chunk
-        uint32_t chunk_vectors = std::min(CHUNK_SIZE, num_vectors - i);
-        
-        for (uint32_t j = 0; j < chunk_vectors; j++, i++) {
-            uint32_t vector_id;
-            VectorEntry entry;
-            
-            // Read vector ID
-            if (!readAligned(&vector_id, sizeof(vector_id), offset)) {
-                logger_.error("Failed to read vector ID at offset " + std::to_string(offset));
-                return false;
-            }
-            offset += sizeof(vector_id);
-            
-            entry.vector_id = vector_id;
-            
-            // Read cluster ID
-            if (!readAligned(&entry.cluster_id, sizeof(entry.cluster_id), offset)) {
-                logger_.error("Failed to read cluster ID for vector " + std::to_string(vector_id));
-                return false;
-            }
-            offset += sizeof(entry.cluster_id);
-            
-            // Read vector offset
-            if (!readAligned(&entry.offset, sizeof(entry.offset), offset)) {
-                logger_.error("Failed to read vector offset for vector " + std::to_string(vector_id));
-                return false;
-            }
-            offset += sizeof(entry.offset);
-            
-            // Read metadata size and data
-            uint32_t metadata_size;
-            if (!readAligned(&metadata_size, sizeof(metadata_size), offset)) {
-                logger_.error("Failed to read metadata size for vector " + std::to_string(vector_id));
-                return false;
-            }
-            offset += sizeof(metadata_size);
-            
-            // Sanity check metadata size
-            const uint32_t MAX_METADATA_SIZE = 10240; // 10KB max per vector
-            if (metadata_size > MAX_METADATA_SIZE) {
-                logger_.error("Metadata size too large: " + std::to_string(metadata_size) + 
-                             " bytes for vector " + std::to_string(vector_id));
-                return false;
-            }
-            
-            if (metadata_size > 0) {
-                std::vector<char> metadata_buffer(metadata_size);
-                if (!readAligned(metadata_buffer.data(), metadata_size, offset)) {
-                    logger_.error("Failed to read metadata for vector " + std::to_string(vector_id));
-                    return false;
-                }
-                entry.metadata.assign(metadata_buffer.data(), metadata_size);
-                offset += metadata_size;
-            }
-            
-            // Add to map
-            vector_map_[vector_id] = entry;
-            
-            // Update next_vector_id if needed
-            if (vector_id >= next_vector_id_) {
-                next_vector_id_ = vector_id + 1;
+    // Walk the directory. Codes are only trusted for vectors still at the
+    // offset they were encoded from; the rest are searched uncoded.
+    size_t pos = header.params_size;
+    auto take = [&](void* out, size_t size) {
+        if (pos + size > data.size()) {
+            return false;
+        }
+        memcpy(out, data.data() + pos, size);
+        pos += size;
+        return true;
+    };
+    std::unordered_map<uint32_t, QuantizedCluster> clusters;
+    std::vector<uint32_t> coded;
+    std::vector<FreedSpace> stale;
+    for (uint32_t c = 0; c < header.cluster_count; c++) {
+        uint32_t cluster_id, count;
+        uint64_t codes_offset;
+        if (!take(&cluster_id, sizeof(cluster_id)) || !take(&count, sizeof(count)) ||
+            !take(&codes_offset, sizeof(codes_offset)) ||
+            vector_size + static_cast<uint64_t>(count) * (sizeof(uint32_t) + sizeof(uint64_t) + sizeof(float)) >
+                data.size() - pos) {
+            logger_.error("Corrupt quantized index directory");
+            return false;
+        }
+        QuantizedCluster& cluster = clusters[cluster_id];
+        cluster.centroid.resize(vector_dim_);
+        cluster.codes_offset = codes_offset;
+        cluster.ids.resize(count);
+        cluster.norms.resize(count);
+        std::vector<uint64_t> offsets(count);
+        if (!take(cluster.centroid.data(), vector_size) ||
+            !take(cluster.ids.data(), count * sizeof(uint32_t)) ||
+            !take(offsets.data(), count * sizeof(uint64_t)) ||
+            !take(cluster.norms.data(), count * sizeof(float)) ||
+            codes_offset + static_cast<uint64_t>(count) * header.code_size > quant_offset_ + quant_size_) {
+            logger_.error("Corrupt quantized index directory");
+            return false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t slot = vector_map_.find(cluster.ids[i]);
+            if (slot != VectorIndex::NO_SLOT && vector_map_.offset(slot) == offsets[i] &&
+                vector_map_.cluster(slot) == cluster_id) {
+                coded.push_back(slot);
+            } else {
+                stale.push_back({cluster_id, offsets[i], vectorSlotSize()});
             }
         }
-        
-        // Log progress for large vector maps
-        if (num_vectors > CHUNK_SIZE && i % 1000 == 0) {
-            logger_.debug("Read " + std::to_string(i) + "/" + std::to_string(num_vectors) + " vectors");
+    }
+    
+    for (uint32_t slot : coded) {
+        vector_map_.setQuantized(slot, true);
+    }
+    // Slots of vectors deleted or moved since the build stay out of use
+    // while this index is current
+    for (const FreedSpace& space : stale) {
+        if (carveFreeSlot(space.cluster_id, space.offset)) {
+            quant_pinned_.push_back(space);
         }
     }
+    quantizer_ = std::move(quantizer);
+    quantized_clusters_ = std::move(clusters);
+    // The index's own type overrides what the caller asked for
+    options_.quantization = type;
     
-    logger_.debug("Read vector map: " + std::to_string(num_vectors) + " vectors");
+    logger_.info("Loaded " + quantizer_->getName() + " index covering " +
+                std::to_string(coded.size()) + " of " + std::to_string(vector_map_.size()) + " vectors");
     return true;
 }
 
-uint64_t VectorClusterStore::allocateVectorSpace(uint32_t cluster_id) {
-    // Append to the end of the data region. next_alloc_offset_ is a
-    // per-instance high-water mark (NOT a function-static — that old bug
-    // shared the offset across stores and reset it on reopen, clobbering
-    // existing vectors).
-    size_t vector_size = vector_dim_ * sizeof(float);
-
-    // Lazily initialize from data_offset_ on first use of a fresh store.
-    if (next_alloc_offset_ < data_offset_) {
-        next_alloc_offset_ = data_offset_;
+void VectorClusterStore::retireQuantizedIndex() {
+    // The header keeps naming the old index until the next checkpoint
+    if (quant_offset_ != 0) {
+        freeSpace(UINT32_MAX, quant_offset_, quant_size_);
     }
+    pending_free_.insert(pending_free_.end(), quant_pinned_.begin(), quant_pinned_.end());
+    quant_pinned_.clear();
+}
 
-    // Ensure block alignment
-    uint64_t aligned_offset =
-        ((next_alloc_offset_ + block_size_ - 1) / block_size_) * block_size_;
-
-    // Advance the high-water mark past this vector
-    next_alloc_offset_ = aligned_offset + vector_size;
-
-    return aligned_offset;
+void VectorClusterStore::dropQuantizedIndex() {
+    retireQuantizedIndex();
+    quantizer_.reset();
+    quantized_clusters_.clear();
+    quant_offset_ = 0;
+    quant_size_ = 0;
+    vector_map_.clearQuantized();
 }
 
 bool VectorClusterStore::writeVector(uint64_t offset, const Vector& vector) {
@@ -1191,6 +5097,9 @@ bool VectorClusterStore::writeAligned(const void* buffer, size_t size, uint64_t
     if (fd_ < 0) {
         return false;
     }
+    if (cache_) {
+        cache_->invalidate(offset, size);
+    }
     
     if (is_direct_io_) {
         // For direct I/O, we need to ensure alignment
@@ -1211,6 +5120,7 @@ bool VectorClusterStore::writeAligned(const void* buffer, size_t size, uint64_t
         // If we're not at block boundary, we need to read existing data first
         if (offset_adjustment > 0 || (size % block_size_) != 0) {
             ssize_t bytes_read = pread(fd_, aligned_buffer, aligned_size, aligned_offset);
+            metrics_.countRead(std::max<ssize_t>(bytes_read, 0));
             if (bytes_read < 0) {
                 logger_.error("Failed to read for read-modify-write: " + std::string(strerror(errno)));
                 free(aligned_buffer);
@@ -1223,6 +5133,7 @@ bool VectorClusterStore::writeAligned(const void* buffer, size_t size, uint64_t
         
         // Write aligned buffer
         ssize_t bytes_written = pwrite(fd_, aligned_buffer, aligned_size, aligned_offset);
+        metrics_.countWrite(std::max<ssize_t>(bytes_written, 0));
         
         // Free aligned buffer
         free(aligned_buffer);
@@ -1240,6 +5151,7 @@ bool VectorClusterStore::writeAligned(const void* buffer, size_t size, uint64_t
     } else {
         // Standard write
         ssize_t bytes_written = pwrite(fd_, buffer, size, offset);
+        metrics_.countWrite(std::max<ssize_t>(bytes_written, 0));
         
         if (bytes_written < 0) {
             logger_.error("Write failed: " + std::string(strerror(errno)));
@@ -1250,6 +5162,8 @@ bool VectorClusterStore::writeAligned(const void* buffer, size_t size, uint64_t
             return false;
         }
         
+        // Written data is readable through the mapping (same page cache)
+        file_end_ = std::max<uint64_t>(file_end_, offset + size);
         return true;
     }
 }
@@ -1275,6 +5189,7 @@ bool VectorClusterStore::readAligned(void* buffer, size_t size, uint64_t offset)
         
         // Read aligned data
         ssize_t bytes_read = pread(fd_, aligned_buffer, aligned_size, aligned_offset);
+        metrics_.countRead(std::max<ssize_t>(bytes_read, 0));
         
         if (bytes_read < 0) {
             logger_.error("Aligned read failed: " + std::string(strerror(errno)));
@@ -1290,12 +5205,19 @@ bool VectorClusterStore::readAligned(void* buffer, size_t size, uint64_t offset)
         // Copy to output buffer
         memcpy(buffer, static_cast<char*>(aligned_buffer) + offset_adjustment, size);
         
-        // Free aligned bree(aligned_buffer);
+        // Free aligned buffer
+        free(aligned_buffer);
         
         return true;
     } else {
+        if (const char* mapped = mappedSpan(offset, size)) {
+            memcpy(buffer, mapped, size);
+            return true;
+        }
+        
         // Standard read
         ssize_t bytes_read = pread(fd_, buffer, size, offset);
+        metrics_.countRead(std::max<ssize_t>(bytes_read, 0));
         
         if (bytes_read < 0) {
             logger_.error("Read failed: " + std::string(strerror(errno)));
@@ -1310,26 +5232,82 @@ bool VectorClusterStore::readAligned(void* buffer, size_t size, uint64_t offset)
     }
 }
 
-float VectorClusterStore::calculateCosineSimilarity(const Vector& v1, const Vector& v2) {
-    if (v1.size() != v2.size()) {
-        return 0.0f;
+bool VectorClusterStore::prepareSpan(uint64_t offset, size_t size, AlignedBuffer& buffer,
+                                     uint64_t& read_offset, size_t& read_size) {
+    // Direct I/O needs block-aligned offset, length and memory; buffered I/O
+    // reads the span as is
+    read_offset = offset;
+    read_size = size;
+    if (is_direct_io_) {
+        read_offset = (offset / block_size_) * block_size_;
+        read_size = ((size + (offset - read_offset) + block_size_ - 1) / block_size_) * block_size_;
+    }
+    
+    if (buffer.size < read_size) {
+        void* grown = allocateAlignedBuffer(read_size);
+        if (!grown) {
+            return false;
+        }
+        free(buffer.data);
+        buffer.data = grown;
+        buffer.size = read_size;
+    }
+    return true;
+}
+
+const char* VectorClusterStore::readSpan(uint64_t offset, size_t size, AlignedBuffer& buffer) {
+    if (fd_ < 0) {
+        return nullptr;
+    }
+    
+    // Mapped: score straight out of the page cache
+    if (const char* mapped = mappedSpan(offset, size)) {
+        return mapped;
     }
     
-    float dot_product = 0.0f;
-    float norm1 = 0.0f;
-    float norm2 = 0.0f;
+    uint64_t read_offset;
+    size_t read_size;
+    if (!prepareSpan(offset, size, buffer, read_offset, read_size)) {
+        return nullptr;
+    }
+    const size_t adjustment = offset - read_offset;
     
-    for (size_t i = 0; i < v1.size(); i++) {
-        dot_product += v1[i] * v2[i];
-        norm1 += v1[i] * v1[i];
-        norm2 += v2[i] * v2[i];
+    ssize_t bytes_read = pread(fd_, buffer.data, read_size, read_offset);
+    metrics_.countRead(std::max<ssize_t>(bytes_read, 0));
+    if (bytes_read < 0) {
+        logger_.error("Read failed: " + std::string(strerror(errno)));
+        return nullptr;
+    }
+    // A block-rounded read may run past the end of a file; only the
+    // requested bytes have to be there
+    if (static_cast<size_t>(bytes_read) < adjustment + size) {
+        logger_.warning("Partial read: " + std::to_string(bytes_read) + "/" +
+                       std::to_string(read_size) + " bytes");
+        return nullptr;
     }
     
-    if (norm1 == 0.0f || norm2 == 0.0f) {
+    return static_cast<const char*>(buffer.data) + adjustment;
+}
+
+float VectorClusterStore::scoreCandidate(const float* query, float query_norm,
+                                         const float* vector, float vector_norm) const {
+    if (query_norm == 0.0f) {
+        return 0.0f;
+    }
+    if (vector_norm > 0.0f) {
+        return dotProduct(query, vector, vector_dim_) / (query_norm * vector_norm);
+    }
+    // Norm not recorded (store written before norms were kept, or a zero
+    // vector): fall back to the full computation
+    return cosineSimilarity(query, vector, vector_dim_);
+}
+
+float VectorClusterStore::calculateCosineSimilarity(const Vector& v1, const Vector& v2) {
+    if (v1.size() != v2.size()) {
         return 0.0f;
     }
     
-    return dot_product / (std::sqrt(norm1) * std::sqrt(norm2));
+    return cosineSimilarity(v1.data(), v2.data(), v1.size());
 }
 
 float VectorClusterStore::calculateL2Distance(const Vector& v1, const Vector& v2) {
@@ -1337,11 +5315,5 @@ float VectorClusterStore::calculateL2Distance(const Vector& v1, const Vector& v2
         return std::numeric_limits<float>::max();
     }
     
-    float sum = 0.0f;
-    for (size_t i = 0; i < v1.size(); i++) {
-        float diff = v1[i] - v2[i];
-        sum += diff * diff;
-    }
-    
-    return std::sqrt(sum);
+    return std::sqrt(l2DistanceSquared(v1.data(), v2.data(), v1.size()));
 }
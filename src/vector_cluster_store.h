@@ -2,12 +2,167 @@
 #define VECTOR_CLUSTER_STORE_H
 
 #include "clustering_interface.h"
+#include "cluster_cache.h"
+#include "quantizer.h"
+#include "store_metrics.h"
+#include "vector_index.h"
 #include <string>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iosfwd>
+#include <map>
+#include <set>
 #include <unordered_map>
+#include <unordered_set>
 
 class Logger;
+class IoUringEngine;
+class ThreadPool;
+
+// When writes reach stable storage (StoreOptions::durability)
+enum class Durability {
+    NONE,    // whenever the OS writes them back
+    GROUP,   // a store thread syncs them in groups
+    PER_OP   // each write call syncs before it returns
+};
+
+// Options passed to initialize. Format options are recorded in the store
+// header when it is created, and for an existing store the recorded values
+// win; I/O options apply to each open.
+struct StoreOptions {
+    // Format: L2-normalize vectors in storeVector so cosine similarity
+    // reduces to a dot product. retrieveVector then returns the normalized
+    // vector.
+    bool normalize_vectors = false;
+    
+    // I/O: open the device with O_DIRECT (openDeviceWithDirectIO), falling
+    // back to buffered I/O where that isn't supported
+    bool direct_io = false;
+    // I/O: with direct_io, issue search reads through io_uring with up to
+    // io_queue_depth in flight. Falls back to pread if the kernel doesn't
+    // allow io_uring.
+    bool use_io_uring = true;
+    uint32_t io_queue_depth = 32;
+    // I/O: open with buffered I/O and map the data region read-only
+    // (openDeviceWithMmap). Searches and retrievals then read vectors
+    // straight out of the page cache, with no copy or syscall per read.
+    // Takes the place of direct_io, which bypasses that cache.
+    bool use_mmap = false;
+    // I/O: keep up to cache_bytes of the most used cluster extents in
+    // memory (see ClusterCache) and serve searches and retrievals from
+    // them. Meant for direct_io, whose reads skip the page cache; ignored
+    // with use_mmap. 0 disables the cache.
+    uint64_t cache_bytes = 0;
+    
+    // Threads one search or maintenance pass may use, counting the caller.
+    // 1 keeps everything on the calling thread; 0 means one per hardware
+    // thread. With several, a search splits its candidate reads across the
+    // store's worker pool (a single-threaded scan uses io_uring instead).
+    uint32_t worker_threads = 1;
+    
+    // Format: compact codes performMaintenance builds for each cluster.
+    // Searches scan the codes first and re-rank the best
+    // k * rerank_factor candidates, plus vectors stored since the last
+    // maintenance, at full precision. The type is recorded with the codes;
+    // a store that has them keeps its type.
+    QuantizationType quantization = QuantizationType::NONE;
+    uint32_t pq_subvectors = 0;   // PQ only; 0 picks vector_dim / 8
+    // I/O: candidates re-ranked per result
+    uint32_t rerank_factor = 8;
+    
+    // Run compactStorage on a store thread every compaction_interval_ms,
+    // relocating up to compaction_batch vectors each time. Each step holds
+    // the store lock only for its own moves, so searches keep running.
+    bool background_compaction = false;
+    uint32_t compaction_interval_ms = 1000;
+    uint32_t compaction_batch = 1024;
+    
+    // Run maintenanceStep on a store thread every maintenance_interval_ms,
+    // splitting or merging up to maintenance_clusters_per_step clusters each
+    // time, instead of leaving cluster sizes to performMaintenance. A
+    // cluster is split once it holds more than split_ratio times the mean
+    // cluster size, and merged away into its neighbours below merge_ratio
+    // times it. The thread reads and writes at most maintenance_io_budget
+    // bytes per second on average (0: no limit), waiting longer after a
+    // step that moved a lot.
+    bool background_maintenance = false;
+    uint32_t maintenance_interval_ms = 1000;
+    uint32_t maintenance_clusters_per_step = 4;
+    uint64_t maintenance_io_budget = 32 * 1024 * 1024;
+    float split_ratio = 2.0f;
+    float merge_ratio = 0.25f;
+    
+    // Have performMaintenance retrain the centroids on a random sample of
+    // the stored vectors (k-means++ seeding, then mini-batch k-means) before
+    // reassigning every vector, instead of refining them with one Lloyd pass
+    bool train_on_maintenance = false;
+    
+    // I/O: open the device read-only, for query replicas. The store must
+    // exist; writes are refused, nothing is written back to the device and
+    // no store threads run. The maps on a device with a live writer change
+    // under the replica, so it loads the writer's saveIndex snapshots
+    // instead (loadIndex, then applyIndexDelta to follow it).
+    bool read_only = false;
+    // On a writer replicas follow: space freed since each of the last
+    // snapshot_retention saveIndex snapshots is not reused, so a replica
+    // still on one of them reads the vectors it names. The hold is kept in
+    // memory only; reopening the writer lifts it. 0 reuses freed space after
+    // the next checkpoint.
+    uint32_t snapshot_retention = 0;
+
+    // I/O: how much a power failure may lose. With NONE, writes that the
+    // OS hasn't written back yet (a process crash loses nothing). PER_OP
+    // has storeVector, storeVectors, deleteVector and the background moves
+    // fdatasync before they return. GROUP has a store thread fdatasync once
+    // group_commit_ops vectors stored, deleted or moved are waiting, or
+    // group_commit_ms after the first of them, so at most that window is
+    // lost; sync() commits it early. With either, a checkpoint is synced
+    // before the store moves on from the one it replaces.
+    Durability durability = Durability::NONE;
+    uint32_t group_commit_ms = 10;
+    uint32_t group_commit_ops = 1024;
+
+    // Top-level metadata keys indexed for SearchParams::filter. They are
+    // extracted as each vector is stored, and from the vector map's heap
+    // when the store opens; nothing about them is recorded in the store,
+    // so each open names the fields it filters on.
+    std::vector<AttributeField> attributes;
+};
+
+// Per-query controls for findSimilarVectors. Zero leaves a control at its
+// default, so a default-constructed SearchParams searches the same way the
+// two-argument findSimilarVectors does.
+struct SearchParams {
+    // Scan at most this many clusters, nearest centroid first
+    uint32_t nprobe = 0;
+    // Stop adding clusters once their members reach this many vectors
+    // (by default max(k * 20, 200); with nprobe set, no limit)
+    uint32_t max_candidates = 0;
+    // Skip clusters whose centroid is more than (1 + prune_ratio) times as
+    // far from the query as the nearest centroid
+    float prune_ratio = 0.0f;
+    // Only vectors whose attributes (StoreOptions::attributes) meet the
+    // filter are read and scored, and only they count toward
+    // max_candidates and the default budget
+    AttributeFilter filter;
+    // Stop reading after this many microseconds and return the best
+    // results found so far. The nearest clusters are read first.
+    uint64_t deadline_us = 0;
+};
+
+// What one search did
+struct SearchStats {
+    uint32_t clusters_scanned = 0;
+    uint64_t vectors_scanned = 0;   // read and scored at full precision
+    uint64_t codes_scored = 0;      // quantized codes scored
+    bool deadline_reached = false;  // the deadline cut the search short
+};
 
 class VectorClusterStore {
 public:
@@ -18,19 +173,56 @@ public:
     bool initialize(const std::string& device_path, 
                     const std::string& strategy_name,
                     uint32_t vector_dim,
-                    uint32_t max_clusters = 100);
+                    uint32_t max_clusters = 100,
+                    const StoreOptions& options = StoreOptions());
     
     // Open and close the device
     bool openDevice(bool readOnly = false);
     bool openDeviceWithDirectIO(bool readOnly = false);
+    bool openDeviceWithMmap(bool readOnly = false);
     void closeDevice();
     
     // Store a vector with optional metadata
     bool storeVector(uint32_t vector_id, const Vector& vector, 
                     const std::string& metadata = "");
     
+    // Store a batch of vectors. `data` holds vector_ids.size() rows of
+    // vector_dim floats (row-major). Vector data is written with a single
+    // contiguous write and store metadata is flushed once for the batch.
+    // An id the batch holds more than once is stored from its last row,
+    // as storing the rows one after another would leave it.
+    bool storeVectors(const std::vector<uint32_t>& vector_ids, const float* data,
+                      const std::vector<std::string>& metadata = {});
+    bool storeVectors(const std::vector<uint32_t>& vector_ids,
+                      const std::vector<Vector>& vectors,
+                      const std::vector<std::string>& metadata = {});
+    
+    // Batched ingest. Between beginBatch() and commitBatch(), storeVector,
+    // storeVectors and deleteVector skip the per-call header / vector map /
+    // cluster map rewrite; commitBatch() persists them once.
+    bool beginBatch();
+    bool commitBatch();
+
+    // Make every write returned so far durable (fdatasync), whatever
+    // options.durability is. Writes in an open batch are only durable once
+    // commitBatch returns. Once an fdatasync has failed this returns false
+    // for good, as do write calls with durability on: the writes it covered
+    // may be lost, and a later sync succeeding wouldn't change that.
+    bool sync();
+
+    // Check a store's checksums without loading it: each header copy, the
+    // maps it names and the write-ahead log records that follow the
+    // checkpoint (with the vectors they wrote). Stores older than version 3
+    // only have the vector map's and the log's. Call on a store that isn't
+    // open; device_path is opened read-only. One line per region goes to
+    // report. True if the latest checkpoint is intact, so opening won't
+    // fall back to the one before it.
+    bool verifyChecksums(const std::string& device_path, std::vector<std::string>& report);
+
     // Retrieve a vector by ID
     bool retrieveVector(uint32_t vector_id, Vector& vector);
+    // The same into vector_dim floats at vector (a caller's buffer)
+    bool retrieveVector(uint32_t vector_id, float* vector);
     
     // Get metadata for a vector by ID
     std::string getVectorMetadata(uint32_t vector_id);
@@ -38,6 +230,23 @@ public:
     // Find similar vectors to the query
     std::vector<std::pair<uint32_t, float>> findSimilarVectors(
         const Vector& query, uint32_t k = 10);
+    // findSimilarVectors with per-query controls; fills stats if given
+    std::vector<std::pair<uint32_t, float>> findSimilarVectors(
+        const Vector& query, uint32_t k, const SearchParams& params,
+        SearchStats* stats = nullptr);
+    
+    // findSimilarVectors for many queries at once. `queries` holds count
+    // rows of vector_dim floats (row-major). Centroids are ranked for all
+    // queries in one pass and each cluster any query needs is read once,
+    // so overlapping queries share the I/O. Results are in query order.
+    // Batches always score full-precision vectors, not quantized codes.
+    // params apply to each query, its deadline to the batch as a whole.
+    std::vector<std::vector<std::pair<uint32_t, float>>> findSimilarVectorsBatch(
+        const float* queries, size_t count, uint32_t k = 10,
+        const SearchParams& params = SearchParams());
+    std::vector<std::vector<std::pair<uint32_t, float>>> findSimilarVectorsBatch(
+        const std::vector<Vector>& queries, uint32_t k = 10,
+        const SearchParams& params = SearchParams());
     
     // Delete a vector by ID
     bool deleteVector(uint32_t vector_id);
@@ -45,9 +254,75 @@ public:
     // Perform maintenance (rebalance clusters, optimize storage)
     bool performMaintenance();
     
-    // Save and load index data
-    bool saveIndex(const std::string& filename);
+    // Train the clustering model's centroids on a sample (count rows of
+    // vector_dim floats), e.g. before a bulk load so ingest order doesn't
+    // decide the clusters. A store that already holds vectors then runs
+    // maintenance, moving each vector to its new cluster.
+    bool train(const float* sample, size_t count);
+    bool train(const std::vector<Vector>& sample);
+    
+    // One bounded round of incremental maintenance: split up to max_clusters
+    // clusters that outgrew options.split_ratio times the mean cluster size,
+    // handing the half of a two-way k-means further from the rest to an
+    // empty cluster, or merge away clusters that shrank below merge_ratio
+    // times it, each member going to its nearest other cluster. Members a
+    // neighbouring centroid is nearer to move there instead. Vectors are
+    // read and placed under a shared lock, so searches keep running; the
+    // moved copies are written and published under one exclusive lock, so
+    // a search sees each cluster either before or after the step. Returns
+    // the number of vectors moved; io_bytes, if given, gets the bytes read
+    // and written.
+    size_t maintenanceStep(size_t max_clusters = 4, uint64_t* io_bytes = nullptr);
+    
+    // Close holes left by deletes and moves: relocate up to max_moves
+    // vectors into free slots nearer the front of their cluster's extent
+    // (or into it, for members left in earlier extents). Vectors the
+    // quantized index covers stay put until maintenance re-encodes them.
+    // Once there is nothing left to move, checkpoints so the vacated space
+    // becomes reusable. Returns the number of vectors moved.
+    size_t compactStorage(size_t max_moves = SIZE_MAX);
+    
+    // Save and load index data: the clustering model in filename, the
+    // vector map in filename.vmap. Given the name of an earlier snapshot,
+    // saveIndex also writes filename.delta, the changes since that one. A
+    // read-only store loads the index without writing it to the device.
+    bool saveIndex(const std::string& filename, const std::string& base_filename = "");
     bool loadIndex(const std::string& filename);
+    // Apply filename.delta to the snapshot it was saved against, which
+    // this store must hold (from loadIndex or the previous delta)
+    bool applyIndexDelta(const std::string& filename);
+    
+    // Dimension of stored vectors (read from the header on existing stores)
+    uint32_t getVectorDim() const { return vector_dim_; }
+    
+    // Effective store options (read from the header on existing stores)
+    const StoreOptions& getOptions() const { return options_; }
+    
+    // Bytes of the data region allocated so far (up to its high-water
+    // mark), free space inside it included
+    uint64_t getDataSize() const;
+    
+    // Vectors in each cluster that has any
+    std::unordered_map<uint32_t, uint32_t> getClusterSizes() const;
+    // Centroid of each cluster that has vectors
+    std::unordered_map<uint32_t, Vector> getClusterCentroids() const;
+    
+    // Number of stored vectors, and their ids in no particular order
+    size_t getVectorCount() const;
+    std::vector<uint32_t> getVectorIds() const;
+    
+    // Hits and misses of the cluster cache (options_.cache_bytes); all
+    // zero without one
+    CacheStats getCacheStats() const;
+    
+    // Operation counts, latency percentiles and I/O since the store was
+    // opened, and the same in the Prometheus text format, every metric
+    // name starting with prefix
+    StoreStats getStats() const;
+    std::string getStatsPrometheus(const std::string& prefix = "vcs") const;
+    
+    // "io_uring", "mmap" or "pread": how search candidates are read
+    const char* getIoEngineName() const;
     
     // Debug information
     void printStoreInfo() const;
@@ -64,23 +339,172 @@ private:
     // Vector metadata
     uint32_t vector_dim_;
     uint32_t next_vector_id_;
+    StoreOptions options_;
+    // Set by openDeviceWithDirectIO when io_uring is requested and usable.
+    // The engine is single-submitter, so searches (which only hold the
+    // store lock shared) take io_engine_mutex_ to use it.
+    std::unique_ptr<IoUringEngine> io_engine_;
+    mutable std::mutex io_engine_mutex_;
+    // Read-only mapping of the data region (options_.use_mmap), from the
+    // page holding data_offset_. It reaches past the end of a growing file
+    // so appends rarely force a remap; only offsets below file_end_ are
+    // read through it, the rest fall back to pread.
+    char* data_map_;
+    uint64_t data_map_offset_;
+    size_t data_map_size_;
+    uint64_t file_end_;
+    // Copies of popular cluster extents (options_.cache_bytes); every
+    // writeAligned drops those it overlaps
+    std::unique_ptr<ClusterCache> cache_;
+    // Workers for intra-operation parallelism (options_.worker_threads)
+    std::unique_ptr<ThreadPool> thread_pool_;
+    // What getStats() reports; readAligned, writeAligned, readSpan and the
+    // io_uring scan count the I/O, each public operation times itself
+    StoreMetrics metrics_;
+    // Vector map entries carry each vector's norm (STORE_FLAG_ENTRY_NORMS)
+    bool entry_norms_;
     // High-water mark for vector-data allocation. Was a function-static in
     // allocateVectorSpace, which (a) leaked across multiple store
     // instances in one process and (b) reset to data_offset_ on reopen,
     // overwriting existing vectors. Now per-instance + recomputed from the
-    // loaded vector map so reopened stores append after existing data.
+    // loaded extents and vector map so reopened stores append after
+    // existing data.
     uint64_t next_alloc_offset_;
     
+    // Per-cluster allocation. Each cluster appends into its current extent
+    // of fixed-size slots, so its members sit together on the device. The
+    // extent's start/capacity are mirrored into the cluster's ClusterInfo
+    // and persist with the cluster map; used is rebuilt from the vector map
+    // on load. A full extent grows in place if it is the last one in the
+    // data region, otherwise the cluster moves on to a new extent of up to
+    // twice the size and earlier members stay put until maintenance or
+    // compactStorage moves them.
+    struct ClusterExtent {
+        uint64_t start_offset = 0;
+        uint32_t capacity = 0;  // slots
+        uint32_t used = 0;      // slots handed out
+        // Slots below used that are free again; the lowest is reused first
+        std::set<uint32_t> free_slots;
+        // Members may sit outside this extent
+        bool scattered = false;
+    };
+    std::unordered_map<uint32_t, ClusterExtent> cluster_extents_;
+    
+    // Free space in the data region outside the current extents, as
+    // start -> end. Reserving an extent or index takes the first range that
+    // fits before bumping next_alloc_offset_.
+    std::map<uint64_t, uint64_t> free_space_;
+    // Space freed since the last checkpoint. The maps on the device (and
+    // the log replayed over them) may still refer to it, so it only joins
+    // free_space_ or its extent's free_slots once a checkpoint has
+    // superseded them. cluster_id is UINT32_MAX for space no extent owns.
+    struct FreedSpace {
+        uint32_t cluster_id;
+        uint64_t offset;
+        uint64_t size;
+    };
+    std::vector<FreedSpace> pending_free_;
+    // Slots the current quantized index's directory still names. Reusing
+    // one could make a later load trust a stale code, so they wait until
+    // the index is replaced or dropped.
+    std::vector<FreedSpace> quant_pinned_;
+    // With options_.snapshot_retention: space freed since each snapshot
+    // still held, oldest first, released from the front as saveIndex adds
+    // snapshots. The back is filling.
+    std::deque<std::vector<FreedSpace>> snapshot_held_;
+    // crc of the snapshot vector map this store's index came from (by
+    // loadIndex or applyIndexDelta), 0 if none
+    uint32_t snapshot_crc_;
+    
+    // Quantized index (options_.quantization), built by maintenance and
+    // stored in the data region at quant_offset_: a header, the quantizer
+    // parameters and a directory, then each cluster's codes back to back.
+    // The directory is held in memory; codes are read per search.
+    struct QuantizedCluster {
+        Vector centroid;           // codes encode the residual from this
+        uint64_t codes_offset = 0; // ids.size() * code size bytes
+        std::vector<uint32_t> ids;
+        std::vector<float> norms;  // full-precision norms
+    };
+    std::unique_ptr<Quantizer> quantizer_;
+    std::unordered_map<uint32_t, QuantizedCluster> quantized_clusters_;
+    uint64_t quant_offset_;  // 0 = no index
+    uint64_t quant_size_;
+    
+    // Batch state: while batch_active_ is set, metadata writes are deferred
+    // and metadata_dirty_ records that a flush is owed at commitBatch().
+    bool batch_active_;
+    bool metadata_dirty_;
+    
     // Layout information
+    uint32_t store_version_;      // StoreHeader::version, 0 if no store
     uint64_t header_offset_;      // Store header
     uint64_t cluster_map_offset_; // Cluster metadata section
     uint64_t vector_map_offset_;  // Vector ID to location mapping
+    uint64_t cluster_map_capacity_;
+    uint64_t vector_map_capacity_;
     uint64_t data_offset_;        // Start of actual vector data
+    uint64_t wal_offset_;         // Write-ahead log region (0 = no WAL)
+    uint64_t wal_size_;
+
+    // Version 3 stores keep two copies of the header and of each map. A
+    // checkpoint writes the copy not in use and then makes it current, so
+    // a torn write only ever hits the copy being replaced.
+    // cluster_map_offset_ and vector_map_offset_ are the current copy's.
+    uint32_t metadata_slot_;          // current copy, 0 or 1
+    uint64_t checkpoint_sequence_;    // the current copy's
+    uint64_t cluster_map_offsets_[2];
+    uint64_t vector_map_offsets_[2];
+    // Bytes of each map in the current copy and their crc32s
+    uint64_t cluster_map_size_;
+    uint32_t cluster_map_crc_;
+    uint64_t vector_map_size_;
+    uint32_t vector_map_crc_;
+
+    // Write-ahead log state. Single-vector mutations append a record at
+    // wal_tail_ instead of rewriting the vector and cluster maps; a
+    // checkpoint (flushMetadata) rewrites the maps and starts a new log
+    // generation, which invalidates every record of the previous one.
+    uint64_t wal_generation_;
+    uint64_t wal_sequence_;       // Sequence number of the next record
+    uint64_t wal_tail_;           // Device offset of the next record
+    uint32_t wal_records_;        // Records in the current generation
     
     // In-memory data structures
     std::shared_ptr<ClusteringStrategy> clustering_;
-    std::unordered_map<uint32_t, VectorEntry> vector_map_;
-    std::mutex store_mutex_;
+    VectorIndex vector_map_;
+    // Guards the index's metadata, which getVectorMetadata loads under a
+    // shared store lock
+    mutable std::mutex metadata_mutex_;
+    // Reader-writer lock: retrievals, searches and the print helpers hold
+    // it shared, everything that changes the store holds it exclusively
+    mutable std::shared_mutex store_mutex_;
+    // Background threads (options_.background_compaction and
+    // background_maintenance), woken early by background_stop_
+    std::thread compaction_thread_;
+    std::thread maintenance_thread_;
+    std::mutex background_mutex_;
+    std::condition_variable background_cv_;
+    bool background_stop_;
+    // Group commit (Durability::GROUP): the sync thread fdatasyncs once
+    // writes_logged_ runs group_commit_ops ahead of writes_synced_, or
+    // group_commit_ms after oldest_unsynced_
+    std::thread sync_thread_;
+    std::mutex sync_mutex_;
+    std::condition_variable sync_cv_;
+    uint64_t writes_logged_;
+    uint64_t writes_synced_;
+    std::chrono::steady_clock::time_point oldest_unsynced_;
+    bool sync_stop_;
+    // An fdatasync failed. The kernel may have dropped the dirty pages it
+    // was writing, so a later sync can't vouch for them: the writes stay
+    // unsynced and every sync (and write, with durability on) fails from
+    // then on.
+    bool sync_failed_;
+    // Checkpoints written since open. Space freed before one can be handed
+    // out again after it, so a vector read before then may have been
+    // replaced in place.
+    uint64_t checkpoint_count_;
     Logger& logger_;
     
     // Signature for identifying our store format
@@ -98,27 +522,454 @@ private:
         uint64_t vector_map_offset;
         uint64_t data_offset;
         char strategy_name[32]; // Clustering strategy name
-        uint8_t reserved[432];  // Reserved space (padding to 512 bytes)
+        // Version 2 fields (zero in version 1 stores)
+        uint64_t wal_offset;    // Write-ahead log region, 0 if none
+        uint64_t wal_size;
+        uint32_t flags;         // STORE_FLAG_* bits
+        uint64_t quant_offset;  // Quantized index, 0 if none
+        uint64_t quant_size;
+        // Version 3 fields. cluster_map_offset and vector_map_offset are
+        // this copy's maps; the log replayed over them starts at
+        // wal_generation / wal_sequence.
+        uint64_t checkpoint_sequence;   // higher is newer
+        uint64_t cluster_map_offsets[2];
+        uint64_t vector_map_offsets[2];
+        uint64_t cluster_map_capacity;  // bytes per copy
+        uint64_t vector_map_capacity;
+        uint64_t cluster_map_size;      // bytes written to this copy
+        uint64_t vector_map_size;
+        uint32_t cluster_map_crc;       // crc32 of those bytes
+        uint32_t vector_map_crc;
+        uint64_t wal_generation;
+        uint64_t wal_sequence;
+        uint32_t slot;                  // which copy this is
+        uint32_t header_crc;            // of the header, this field zeroed
+        uint8_t reserved[280];  // Reserved space (padding to 512 bytes)
+    };
+    static_assert(sizeof(StoreHeader) == 512, "StoreHeader must fill exactly one 512-byte block");
+
+    // Version 3 layout: the header copies, HEADER_COPY_SPACING apart so no
+    // device block holds both, then both cluster maps, both vector maps,
+    // the log and the data. Versions 1 and 2 have one header at 0 and one
+    // of each map, rewritten in place; they keep that layout.
+    static constexpr uint32_t STORE_VERSION = 3;
+    static constexpr uint64_t HEADER_COPY_SPACING = 4096;
+    static constexpr uint64_t CLUSTER_MAP_CAPACITY = 50 * 1024 * 1024;
+    static constexpr uint64_t VECTOR_MAP_CAPACITY = 10 * 1024 * 1024;
+    
+    // StoreHeader::flags
+    static constexpr uint32_t STORE_FLAG_NORMALIZED = 1u << 0;   // vectors stored L2-normalized
+    static constexpr uint32_t STORE_FLAG_ENTRY_NORMS = 1u << 1;  // vector map entries include norm
+    
+    // Vector map layout: VectorMapHeader, entry_count fixed-width
+    // VectorMapRecords, then the metadata heap (each record's metadata, in
+    // record order). The table loads with one read and the heap is read
+    // per entry on demand. crc covers the records. Maps written before
+    // this format start with a bare uint32 count instead of the signature
+    // and are still read (see readLegacyVectorMap).
+    static constexpr char VECTOR_MAP_SIGNATURE[8] = {'V', 'C', 'S', 'V', 'M', 'A', 'P', '2'};
+    struct VectorMapHeader {
+        char signature[8];        // VCSVMAP2
+        uint32_t entry_count;
+        uint32_t record_size;     // sizeof(VectorMapRecord) when written
+        uint64_t heap_size;
+        uint32_t crc;
+        uint8_t reserved[36];
+    };
+    static_assert(sizeof(VectorMapHeader) == 64, "VectorMapHeader layout changed");
+    struct VectorMapRecord {
+        uint32_t vector_id;
+        uint32_t cluster_id;
+        uint64_t offset;
+        float norm;               // 0 if not known
+        uint32_t metadata_size;
+    };
+    static_assert(sizeof(VectorMapRecord) == 24, "VectorMapRecord layout changed");
+    
+    // Quantized index layout: QuantHeader, quantizer parameters, directory
+    // (per cluster: id, count, codes offset, centroid, ids, offsets, norms),
+    // then the codes. The crc covers parameters and directory.
+    static constexpr char QUANT_SIGNATURE[8] = {'V', 'C', 'S', 'Q', 'N', 'T', '0', '1'};
+    struct QuantHeader {
+        char signature[8];        // VCSQNT01
+        uint32_t type;            // QuantizationType
+        uint32_t vector_dim;
+        uint32_t code_size;
+        uint32_t cluster_count;
+        uint64_t params_size;
+        uint64_t directory_size;
+        uint32_t crc;
+        uint8_t reserved[468];
+    };
+    static_assert(sizeof(QuantHeader) == 512, "QuantHeader must fill exactly one 512-byte block");
+    // Vectors sampled to train the quantizer
+    static constexpr size_t QUANT_TRAIN_SAMPLES = 65536;
+    
+    // Write-ahead log layout: one header block at wal_offset_, then records
+    static constexpr char WAL_SIGNATURE[8] = {'V', 'C', 'S', 'W', 'A', 'L', '0', '1'};
+    static constexpr uint32_t WAL_RECORD_MAGIC = 0x52434C57;  // "WLCR"
+    static constexpr uint64_t WAL_REGION_SIZE = 8 * 1024 * 1024;
+    // Checkpoint after this many records to bound replay time on reopen
+    static constexpr uint32_t WAL_CHECKPOINT_RECORDS = 8192;
+    
+    struct WalHeader {
+        char signature[8];            // VCSWAL01
+        uint64_t generation;          // Only records of this generation are live
+        uint64_t checkpoint_sequence; // First sequence number of this generation
+        uint8_t reserved[488];
+    };
+    static_assert(sizeof(WalHeader) == 512, "WalHeader must fill exactly one 512-byte block");
+    
+    // Snapshot delta (filename.delta): DeltaHeader, the serialized model,
+    // upserted entries encoded as in the .vmap, then the deleted ids. Each
+    // crc is of a snapshot's whole .vmap file.
+    static constexpr char DELTA_SIGNATURE[8] = {'V', 'C', 'S', 'D', 'E', 'L', 'T', '1'};
+    struct DeltaHeader {
+        char signature[8];        // VCSDELT1
+        uint32_t base_crc;        // snapshot the delta applies to
+        uint32_t crc;             // snapshot it produces
+        uint64_t model_size;
+        uint32_t upserts;
+        uint32_t deletes;
+    };
+    
+    enum WalRecordType : uint8_t {
+        WAL_INSERT = 1,   // vector written at offset, entry added to the map
+        WAL_DELETE = 2,   // entry removed from the map
+        WAL_MOVE = 3      // vector relocated to offset / cluster_id
+    };
+    
+    // Fixed part of a log record, followed by metadata_size bytes of metadata.
+    // crc covers the whole record (with crc itself zeroed) plus the metadata,
+    // and on version 3 stores the crc32 of the vector an insert or move
+    // wrote, so a record whose vector never reached the device ends the log
+    // like a torn one. Version 3 stores read the generation from the store
+    // header; the WalHeader is only kept up for tools.
+    struct WalRecord {
+        uint32_t magic;
+        uint32_t crc;
+        uint64_t generation;
+        uint64_t sequence;
+        uint8_t type;
+        uint8_t pad[3];
+        uint32_t vector_id;
+        uint32_t cluster_id;
+        uint32_t metadata_size;
+        uint64_t offset;
+    };
+    static_assert(sizeof(WalRecord) == 48, "WalRecord layout changed");
+    
+    // Extent sizing, in vector slots
+    static constexpr uint32_t CLUSTER_EXTENT_INITIAL_CAPACITY = 64;
+    static constexpr uint32_t CLUSTER_EXTENT_MAX_GROWTH = 65536;
+    
+    // Upper bound on a single staged write of vector data
+    static constexpr size_t MAX_WRITE_SPAN = 16 * 1024 * 1024;
+    
+    // Search reads candidates in coalesced runs: up to SCAN_READ_SPAN bytes
+    // per read, reading through gaps of up to SCAN_MAX_GAP bytes rather
+    // than issuing another read
+    static constexpr size_t SCAN_READ_SPAN = 4 * 1024 * 1024;
+    static constexpr size_t SCAN_MAX_GAP = 64 * 1024;
+    // With io_uring, bytes of candidate data read ahead at once
+    static constexpr size_t ASYNC_SCAN_INFLIGHT_BYTES = 32 * 1024 * 1024;
+    // With a worker pool, runs are cut smaller so each thread gets a few of
+    // them, but no smaller than PARALLEL_SCAN_MIN_SPAN
+    static constexpr size_t PARALLEL_SCAN_RUNS_PER_THREAD = 4;
+    static constexpr size_t PARALLEL_SCAN_MIN_SPAN = 256 * 1024;
+    // Clusters ranked at first when picking a search's scan set; a set that
+    // needs more ranks four times as many, so the strategy only has to
+    // order the clusters near the query
+    static constexpr uint32_t CLUSTER_RANK_BATCH = 64;
+    // Vectors each maintenance read task copies
+    static constexpr size_t MAINTENANCE_READ_GRAIN = 256;
+    // Lloyd iterations of the two-way k-means that splits a cluster
+    static constexpr uint32_t SPLIT_ITERATIONS = 8;
+    // Nearest centroids ranked to find where a split or merged cluster's
+    // member goes
+    static constexpr uint32_t REASSIGN_CANDIDATES = 8;
+    // train_on_maintenance samples this many vectors per cluster, and at
+    // least TRAINING_SAMPLE_MIN
+    static constexpr size_t TRAINING_SAMPLE_PER_CLUSTER = 64;
+    static constexpr size_t TRAINING_SAMPLE_MIN = 16384;
+    
+    using SearchClock = std::chrono::steady_clock;
+    
+    // What a scan needs of a candidate, gathered from the index so the
+    // candidates can be sorted by offset without touching the index again
+    struct ScanEntry {
+        uint64_t offset;
+        uint32_t vector_id;
+        float norm;
+    };
+    
+    // A search's SearchParams::filter, resolved against the attribute
+    // index, with each cluster's matching members as they get counted
+    struct SearchFilter {
+        AttributeIndex::Compiled compiled;
+        std::unordered_map<uint32_t, size_t> matching;
+    };
+    
+    // A coalesced read covering scan entries [first, last]
+    struct ScanRun {
+        size_t first;
+        size_t last;
+        uint64_t start;
+        uint64_t end;
+    };
+    
+    // Block-aligned scratch buffer that only grows; reused across the reads
+    // of one operation so each read is a single syscall with no allocation
+    struct AlignedBuffer {
+        void* data = nullptr;
+        size_t size = 0;
+        AlignedBuffer() = default;
+        AlignedBuffer(const AlignedBuffer&) = delete;
+        AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+        ~AlignedBuffer() { free(data); }
     };
     
     // Internal methods
+    // The store's header; on version 3 stores the intact copy with the
+    // latest checkpoint whose maps match their checksums. False, with
+    // store_version_ left 0, if there is no store; with it set if there is
+    // one that can't be opened.
     bool readHeader();
+    void applyHeader(const StoreHeader& header);
+    // Writes the current copy (metadata_slot_) on version 3 stores
     bool writeHeader();
+    // Whether a version 3 header copy is one, read from slot, with its crc
+    bool headerCopyValid(const StoreHeader& header, uint32_t slot) const;
+    // Whether the maps a version 3 header copy names match its checksums;
+    // the mismatch, if any, goes to problem
+    bool mapsIntact(const StoreHeader& header, std::string& problem);
     bool writeClusterMap();
     bool readClusterMap();
     bool writeVectorMap();
     bool readVectorMap();
+    bool readLegacyVectorMap(uint32_t num_vectors);
+    // An entry's metadata, read from the vector map's heap if it isn't
+    // loaded yet. Safe under a shared store lock.
+    std::string entryMetadata(uint32_t slot);
+    
+    // Persist header, vector map and cluster map and start a new WAL
+    // generation (a checkpoint), or defer if batching
+    bool flushMetadata();
+    // flushMetadata on a version 3 store: the maps go to the copy not in
+    // use, then its header makes it current, each synced before the next
+    // unless options_.durability is NONE
+    bool writeCheckpoint();
+    // fdatasync, counted in the metrics
+    bool syncDevice();
+    // What options_.durability asks of count writes just logged: a sync
+    // now, or a place in the group the sync thread commits next
+    bool commitWrites(size_t count);
+    // Every write logged so far is on stable storage
+    void markSynced();
+    void groupCommitLoop(int fd);
+    // False, logging why, on a read-only store
+    bool checkWritable(const char* operation) const;
+    // One snapshot vector map entry, as saveIndex writes it, folded into crc
+    void writeSnapshotEntry(std::ostream& out, uint32_t& crc, uint32_t vector_id, uint32_t cluster_id,
+                            uint64_t offset, const std::string& metadata) const;
+    bool readSnapshotEntry(std::istream& in, uint32_t& crc, VectorEntry& entry) const;
     
+    // Write-ahead log
+    bool writeWalHeader();
+    bool replayWal();
+    bool appendWalRecords(WalRecordType type, const std::vector<VectorEntry>& entries);
+    // Whether a record of this type covers the vector it wrote
+    bool walCoversData(uint8_t type) const {
+        return store_version_ >= 3 && (type == WAL_INSERT || type == WAL_MOVE);
+    }
+    // VectorEntry::data_crc of vector_dim floats about to be logged; 0 if
+    // no record will cover them
+    uint32_t walDataCrc(const float* data) const;
+    // A record's crc (its crc field taken as zero), given its metadata and
+    // the crc of its vector
+    uint32_t walRecordCrc(WalRecord record, const char* metadata, uint32_t data_crc) const;
+    // Length of the live record at pos in log (the record area, read
+    // whole), next in sequence in generation wal_generation_; 0 at the end
+    // of the log: a torn record, one from an older generation or out of
+    // sequence. vector gets the data of a record that covers it.
+    size_t walRecordAt(const std::vector<char>& log, size_t pos, WalRecord& record, Vector& vector);
+    // Make one or more single-vector mutations durable: append them to the
+    // WAL if the store has one, checkpointing when the log fills, otherwise
+    // rewrite the metadata regions
+    bool persistOperations(WalRecordType type, const std::vector<VectorEntry>& entries);
+    
+    // Lowest free slot in the cluster's extent, reserving or growing the
+    // extent as needed
     uint64_t allocateVectorSpace(uint32_t cluster_id);
+    uint64_t reserveExtent(uint32_t capacity);
+    // Give a cluster without members an extent with room for count vectors
+    void reserveEmptyExtent(uint32_t cluster_id, uint32_t count);
+    // Block-aligned space in the data region
+    uint64_t reserveSpace(uint64_t bytes);
+    // Bytes per vector slot (vector size rounded up to the block size)
+    uint64_t vectorSlotSize() const;
+    // Recompute extent fill levels and the allocation high-water mark from
+    // the clustering model and vector map
+    void rebuildClusterExtents();
+    // Free a vector's slot (pending until the next checkpoint)
+    void freeVectorSlot(uint32_t slot);
+    void freeSpace(uint32_t cluster_id, uint64_t offset, uint64_t size);
+    // Make pending_free_ reusable; called once a checkpoint is written
+    void releasePendingSpace();
+    void releaseSpace(const FreedSpace& space);
+    // The current extent covering offset, trying cluster_id's first
+    ClusterExtent* extentContaining(uint32_t cluster_id, uint64_t offset);
+    void addFreeRange(uint64_t start, uint64_t end);
+    // Take bytes from the first free range that fits, or return 0
+    uint64_t takeFreeRange(uint64_t bytes);
+    // Remove [start, end) from free space if it is all free
+    bool carveFreeRange(uint64_t start, uint64_t end);
+    // Remove a slot from free space, wherever it is kept
+    bool carveFreeSlot(uint32_t cluster_id, uint64_t offset);
+    // Bytes free now and waiting on a checkpoint
+    uint64_t freeBytes() const;
+    uint64_t pendingFreeBytes() const;
+    // Hand the current index's region and pinned slots to pending_free_
+    void retireQuantizedIndex();
+    void compactionLoop(uint32_t interval_ms, size_t batch);
+    void maintenanceLoop();
+    void stopBackgroundThreads();
+    // Whether a cluster's members exactly fill the front of its current extent
+    bool isClusterCompact(uint32_t cluster_id, const std::vector<uint32_t>& members) const;
+    // Copy a cluster's members (index slots) into a fresh extent, in
+    // device order
+    bool compactCluster(uint32_t cluster_id, std::vector<uint32_t>& members);
+    // VectorSource for the clustering model: every stored vector, read
+    // from the data region on the pool
+    bool streamVectors(const VectorVisitor& visit);
+    // Up to count stored vectors picked at random, as rows of sample
+    bool sampleVectors(size_t count, std::vector<float>& sample);
+    // Train the model on sample; store lock held exclusively
+    bool trainModel(const float* sample, size_t count);
+    // performMaintenance with the store lock held exclusively
+    bool maintain();
+    // Remove a stored vector from the model, passing it its data. removed,
+    // if given, receives that data (empty if it couldn't be read).
+    void removeFromModel(uint32_t slot, Vector* removed = nullptr);
+    // Put a vector removeFromModel took out back into the model, in the
+    // cluster the index has it in (an overwrite that failed)
+    void restoreToModel(uint32_t slot, const Vector& vector);
+    // Train options_.quantization on the clusters' members and write a new
+    // quantized index (made current by the next checkpoint)
+    bool buildQuantizedIndex(std::unordered_map<uint32_t, std::vector<uint32_t>>& members);
+    // Load the index at quant_offset_ and mark the entries it still covers
+    bool readQuantizedIndex();
+    void dropQuantizedIndex();
+    // Best k * rerank_factor coded candidates from the scan clusters, for
+    // full-precision scoring. Code chunks not started by the deadline are
+    // skipped; stats gets the codes scored.
+    void collectQuantizedCandidates(const float* query, const std::vector<uint32_t>& scan_clusters,
+                                    uint32_t k, SearchClock::time_point deadline,
+                                    const SearchFilter* filter,
+                                    std::vector<ScanEntry>& scan, SearchStats& stats);
+    ScanEntry scanEntry(uint32_t slot) const {
+        return {vector_map_.offset(slot), vector_map_.id(slot), vector_map_.norm(slot)};
+    }
     bool writeVector(uint64_t offset, const Vector& vector);
     bool readVector(uint64_t offset, Vector& vector);
     
     // Aligned I/O helpers
     void* allocateAlignedBuffer(size_t size);
+    // Read [offset, offset + size) into buffer with one read, growing the
+    // buffer if needed. Returns a pointer to the first requested byte
+    // (inside buffer), or nullptr on failure.
+    const char* readSpan(uint64_t offset, size_t size, AlignedBuffer& buffer);
+    // Block-align [offset, offset + size) as the open mode requires and grow
+    // buffer to hold it
+    bool prepareSpan(uint64_t offset, size_t size, AlignedBuffer& buffer,
+                     uint64_t& read_offset, size_t& read_size);
+    // Reopen the device if it was closed under a loaded store; lock is
+    // held shared on entry and on return
+    bool ensureDeviceOpen(std::shared_lock<std::shared_mutex>& lock);
+    // Clusters a search for k results scans, nearest-first. ranked holds
+    // the `requested` nearest clusters; more are ranked if the scan set
+    // needs them. With a filter, clusters count only their matching
+    // members, and those with none are left out.
+    std::vector<uint32_t> chooseScanClusters(const float* query, std::vector<uint32_t> ranked,
+                                             uint32_t requested, uint32_t k,
+                                             const SearchParams& params, SearchFilter* filter) const;
+    // The scan set from the clusters in ordered_clusters (nearest first);
+    // exhausted says it took all of them and would take more
+    std::vector<uint32_t> selectScanClusters(const float* query,
+                                             const std::vector<uint32_t>& ordered_clusters,
+                                             uint32_t k, const SearchParams& params,
+                                             SearchFilter* filter, bool& exhausted) const;
+    // params.filter resolved for one search. False (logged) if it names a
+    // field the store doesn't index or tests one with the wrong type.
+    bool compileFilter(const SearchParams& params, SearchFilter& filter) const;
+    // Members of the cluster meeting the filter, counted on first use
+    size_t matchingMembers(uint32_t cluster_id, SearchFilter& filter) const;
+    bool meetsFilter(const SearchFilter* filter, uint32_t slot) const {
+        return !filter || vector_map_.matches(filter->compiled, slot);
+    }
+    // Clusters to rank before the first chooseScanClusters pass
+    static uint32_t initialRankCount(const SearchParams& params) {
+        return params.nprobe > 0 ? params.nprobe : CLUSTER_RANK_BATCH;
+    }
+    // When a search with params has to stop; time_point::max() for never
+    static SearchClock::time_point searchDeadline(const SearchParams& params);
+    // Group entries (sorted by offset) into coalesced reads of at most
+    // span_limit bytes
+    std::vector<ScanRun> buildScanRuns(const std::vector<ScanEntry>& scan,
+                                       size_t span_limit) const;
+    // Score the given entries (sorted by offset) against the query, reading
+    // them in coalesced runs, and keep the best k in top. No run is started
+    // after the deadline.
+    size_t scanCandidates(const float* query, float query_norm,
+                          const std::vector<ScanEntry>& scan, uint32_t k,
+                          SearchClock::time_point deadline,
+                          std::vector<std::pair<uint32_t, float>>& top,
+                          AlignedBuffer& buffer);
+    // scanCandidates via io_uring: all runs queued up front (within
+    // ASYNC_SCAN_INFLIGHT_BYTES), each scored as its read completes
+    size_t scanRunsAsync(const float* query, float query_norm,
+                         const std::vector<ScanEntry>& scan,
+                         const std::vector<ScanRun>& runs, uint32_t k,
+                         SearchClock::time_point deadline,
+                         std::vector<std::pair<uint32_t, float>>& top);
+    // scanCandidates on the worker pool: runs handed out to the pool's
+    // threads, each with its own buffer and top-k, merged into top at the end
+    size_t scanRunsParallel(const float* query, float query_norm,
+                            const std::vector<ScanEntry>& scan,
+                            const std::vector<ScanRun>& runs, uint32_t k,
+                            SearchClock::time_point deadline,
+                            std::vector<std::pair<uint32_t, float>>& top);
+    void scoreRun(const float* query, float query_norm,
+                  const std::vector<ScanEntry>& scan, const ScanRun& run,
+                  const char* data, uint32_t k, std::vector<std::pair<uint32_t, float>>& top);
+    // The cache's copies of the clusters' current extents, sorted by
+    // start, reading in those it admits (not after the deadline)
+    std::vector<std::shared_ptr<const ClusterCache::Extent>> cachedExtents(
+        const std::vector<uint32_t>& clusters, SearchClock::time_point deadline, AlignedBuffer& buffer);
+    // The vector at offset in one of extents (from cachedExtents), or null
+    const float* cachedVector(const std::vector<std::shared_ptr<const ClusterCache::Extent>>& extents,
+                              uint64_t offset) const;
+    
+    // Open the device the way options_ asks for
+    bool openConfiguredDevice();
+    // (Re)map the data region once the layout is known
+    bool mapDataRegion();
+    void unmapDataRegion();
+    // Remap if allocation has run past the end of the mapping
+    void extendDataMap();
+    // Pointer to [offset, offset + size) in the mapping, or nullptr
+    const char* mappedSpan(uint64_t offset, size_t size) const;
+    // Hint the kernel to read the scan clusters' extents ahead
+    void adviseClusterExtents(const std::vector<uint32_t>& clusters) const;
     bool writeAligned(const void* buffer, size_t size, uint64_t offset);
     bool readAligned(void* buffer, size_t size, uint64_t offset);
     
     // Utility functions
+    // Cosine similarity of a candidate against the query, given the query
+    // norm (computed once per search) and the candidate's stored norm; an
+    // unknown norm (0) falls back to computing it.
+    float scoreCandidate(const float* query, float query_norm,
+                         const float* vector, float vector_norm) const;
     float calculateCosineSimilarity(const Vector& v1, const Vector& v2);
     static float calculateL2Distance(const Vector& v1, const Vector& v2);
 };
@@ -0,0 +1,208 @@
+#include "vector_index.h"
+#include <algorithm>
+
+namespace {
+const std::vector<uint32_t> NO_MEMBERS;
+}
+
+VectorIndex::VectorIndex() : arena_garbage_(0) {}
+
+void VectorIndex::clear() {
+    ids_.clear();
+    clusters_.clear();
+    offsets_.clear();
+    norms_.clear();
+    quantized_.clear();
+    metadata_.clear();
+    member_positions_.clear();
+    slots_.clear();
+    members_.clear();
+    arena_.clear();
+    arena_garbage_ = 0;
+    attributes_.clear();
+}
+
+void VectorIndex::reserve(size_t count) {
+    ids_.reserve(count);
+    clusters_.reserve(count);
+    offsets_.reserve(count);
+    norms_.reserve(count);
+    quantized_.reserve(count);
+    metadata_.reserve(count);
+    member_positions_.reserve(count);
+    slots_.reserve(count);
+    attributes_.reserve(count);
+}
+
+uint32_t VectorIndex::find(uint32_t vector_id) const {
+    auto it = slots_.find(vector_id);
+    return it != slots_.end() ? it->second : NO_SLOT;
+}
+
+uint32_t VectorIndex::insert(uint32_t vector_id, uint32_t cluster_id, uint64_t offset, float norm) {
+    uint32_t slot = find(vector_id);
+    if (slot != NO_SLOT) {
+        setCluster(slot, cluster_id);
+        offsets_[slot] = offset;
+        norms_[slot] = norm;
+        quantized_[slot] = 0;
+        releaseMetadata(slot);
+        attributes_.clearRow(slot);
+        return slot;
+    }
+
+    slot = static_cast<uint32_t>(ids_.size());
+    ids_.push_back(vector_id);
+    clusters_.push_back(cluster_id);
+    offsets_.push_back(offset);
+    norms_.push_back(norm);
+    quantized_.push_back(0);
+    metadata_.emplace_back();
+    member_positions_.push_back(0);
+    attributes_.addRow();
+    slots_[vector_id] = slot;
+    addMember(slot);
+    return slot;
+}
+
+void VectorIndex::erase(uint32_t slot) {
+    removeMember(slot);
+    releaseMetadata(slot);
+    slots_.erase(ids_[slot]);
+
+    // Move the last slot into the hole
+    const uint32_t last = static_cast<uint32_t>(ids_.size() - 1);
+    if (slot != last) {
+        ids_[slot] = ids_[last];
+        clusters_[slot] = clusters_[last];
+        offsets_[slot] = offsets_[last];
+        norms_[slot] = norms_[last];
+        quantized_[slot] = quantized_[last];
+        metadata_[slot] = metadata_[last];
+        member_positions_[slot] = member_positions_[last];
+        attributes_.moveRow(last, slot);
+        slots_[ids_[slot]] = slot;
+        members_[clusters_[slot]][member_positions_[slot]] = slot;
+    }
+    ids_.pop_back();
+    clusters_.pop_back();
+    offsets_.pop_back();
+    norms_.pop_back();
+    quantized_.pop_back();
+    metadata_.pop_back();
+    member_positions_.pop_back();
+    attributes_.removeLastRow();
+
+    if (ids_.empty()) {
+        arena_.clear();
+        arena_garbage_ = 0;
+    }
+}
+
+void VectorIndex::setCluster(uint32_t slot, uint32_t cluster_id) {
+    if (clusters_[slot] == cluster_id) {
+        return;
+    }
+    removeMember(slot);
+    clusters_[slot] = cluster_id;
+    addMember(slot);
+}
+
+void VectorIndex::clearQuantized() {
+    std::fill(quantized_.begin(), quantized_.end(), 0);
+}
+
+const std::vector<uint32_t>& VectorIndex::members(uint32_t cluster_id) const {
+    auto it = members_.find(cluster_id);
+    return it != members_.end() ? it->second : NO_MEMBERS;
+}
+
+void VectorIndex::setMetadata(uint32_t slot, const std::string& metadata) {
+    loadMetadata(slot, metadata);
+    attributes_.extract(slot, metadata.data(), metadata.size());
+}
+
+void VectorIndex::loadMetadata(uint32_t slot, const std::string& metadata) {
+    releaseMetadata(slot);
+    if (metadata.empty()) {
+        return;
+    }
+    if (arena_garbage_ > ARENA_COMPACT_MIN_GARBAGE && arena_garbage_ > arena_.size() / 2) {
+        compactArena();
+    }
+    MetadataRef& ref = metadata_[slot];
+    ref.offset = arena_.size();
+    ref.size = static_cast<uint32_t>(metadata.size());
+    arena_.insert(arena_.end(), metadata.begin(), metadata.end());
+}
+
+void VectorIndex::setDeviceMetadata(uint32_t slot, uint64_t device_offset, uint32_t size) {
+    releaseMetadata(slot);
+    if (size == 0) {
+        return;
+    }
+    MetadataRef& ref = metadata_[slot];
+    ref.offset = device_offset;
+    ref.size = size;
+    ref.on_device = true;
+}
+
+std::string VectorIndex::metadata(uint32_t slot) const {
+    const MetadataRef& ref = metadata_[slot];
+    if (ref.on_device || ref.size == 0) {
+        return "";
+    }
+    return std::string(arena_.data() + ref.offset, ref.size);
+}
+
+VectorEntry VectorIndex::entry(uint32_t slot) const {
+    VectorEntry entry;
+    entry.vector_id = ids_[slot];
+    entry.cluster_id = clusters_[slot];
+    entry.offset = offsets_[slot];
+    entry.norm = norms_[slot];
+    entry.quantized = quantized_[slot] != 0;
+    entry.metadata = metadata(slot);
+    return entry;
+}
+
+void VectorIndex::addMember(uint32_t slot) {
+    std::vector<uint32_t>& list = members_[clusters_[slot]];
+    member_positions_[slot] = static_cast<uint32_t>(list.size());
+    list.push_back(slot);
+}
+
+void VectorIndex::removeMember(uint32_t slot) {
+    auto it = members_.find(clusters_[slot]);
+    std::vector<uint32_t>& list = it->second;
+    const uint32_t position = member_positions_[slot];
+    list[position] = list.back();
+    member_positions_[list[position]] = position;
+    list.pop_back();
+    if (list.empty()) {
+        members_.erase(it);
+    }
+}
+
+void VectorIndex::releaseMetadata(uint32_t slot) {
+    MetadataRef& ref = metadata_[slot];
+    if (!ref.on_device) {
+        arena_garbage_ += ref.size;
+    }
+    ref = MetadataRef();
+}
+
+void VectorIndex::compactArena() {
+    std::vector<char> compacted;
+    compacted.reserve(arena_.size() - arena_garbage_);
+    for (MetadataRef& ref : metadata_) {
+        if (ref.on_device || ref.size == 0) {
+            continue;
+        }
+        uint64_t offset = compacted.size();
+        compacted.insert(compacted.end(), arena_.begin() + ref.offset, arena_.begin() + ref.offset + ref.size);
+        ref.offset = offset;
+    }
+    arena_.swap(compacted);
+    arena_garbage_ = 0;
+}
@@ -0,0 +1,126 @@
+#ifndef VECTOR_INDEX_H
+#define VECTOR_INDEX_H
+
+#include "attribute_index.h"
+#include "clustering_interface.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// In-memory index of a store's vectors. Every vector has a slot, and its
+// fields sit in dense arrays indexed by slot, so scanning a cluster's
+// members touches only the fields the scan reads. An id -> slot table
+// serves point lookups and each cluster keeps the slots of its members.
+//
+// Metadata is kept out of the arrays: in one arena buffer once known, or
+// still in the vector map's heap on the device (setDeviceMetadata) until
+// the store loads it. The attribute fields it is given are extracted from
+// each vector's metadata into an AttributeIndex whose rows follow the slots.
+//
+// Erasing moves the last slot into the hole, so slots stay valid only
+// until the next insert or erase. Not thread-safe; the store's lock and
+// its metadata mutex guard it.
+class VectorIndex {
+public:
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    VectorIndex();
+
+    size_t size() const { return ids_.size(); }
+    bool empty() const { return ids_.empty(); }
+    void clear();
+    void reserve(size_t count);
+
+    // Slot of a vector, or NO_SLOT
+    uint32_t find(uint32_t vector_id) const;
+
+    // Add a vector, or replace the one with the same id in place. A
+    // replaced vector starts over without metadata or a quantized code.
+    uint32_t insert(uint32_t vector_id, uint32_t cluster_id, uint64_t offset, float norm);
+    void erase(uint32_t slot);
+
+    uint32_t id(uint32_t slot) const { return ids_[slot]; }
+    uint32_t cluster(uint32_t slot) const { return clusters_[slot]; }
+    uint64_t offset(uint32_t slot) const { return offsets_[slot]; }
+    float norm(uint32_t slot) const { return norms_[slot]; }
+    // The store's quantized index holds a code for this vector
+    bool quantized(uint32_t slot) const { return quantized_[slot] != 0; }
+
+    void setCluster(uint32_t slot, uint32_t cluster_id);
+    void setOffset(uint32_t slot, uint64_t offset) { offsets_[slot] = offset; }
+    void setQuantized(uint32_t slot, bool quantized) { quantized_[slot] = quantized ? 1 : 0; }
+    void clearQuantized();
+
+    // Member slots of a cluster, in no particular order
+    const std::vector<uint32_t>& members(uint32_t cluster_id) const;
+    // Every cluster with members
+    const std::unordered_map<uint32_t, std::vector<uint32_t>>& clusterMembers() const { return members_; }
+
+    // Fields indexed from metadata; drops every vector's attributes
+    void setAttributeFields(const std::vector<AttributeField>& fields) { attributes_.setFields(fields); }
+    const AttributeIndex& attributes() const { return attributes_; }
+    bool matches(const AttributeIndex::Compiled& filter, uint32_t slot) const {
+        return attributes_.matches(filter, slot);
+    }
+    // Index the attributes of metadata left on the device
+    void indexAttributes(uint32_t slot, const char* metadata, size_t size) {
+        attributes_.extract(slot, metadata, size);
+    }
+
+    // Metadata held in the arena, with its attributes indexed
+    void setMetadata(uint32_t slot, const std::string& metadata);
+    // Move device metadata, just read, into the arena. Its attributes were
+    // indexed with indexAttributes and are left alone.
+    void loadMetadata(uint32_t slot, const std::string& metadata);
+    // Metadata left on the device: size bytes at device_offset
+    void setDeviceMetadata(uint32_t slot, uint64_t device_offset, uint32_t size);
+    uint32_t metadataSize(uint32_t slot) const { return metadata_[slot].size; }
+    // Device offset of metadata not loaded yet, 0 once it is in the arena
+    uint64_t metadataDeviceOffset(uint32_t slot) const {
+        return metadata_[slot].on_device ? metadata_[slot].offset : 0;
+    }
+    // Arena metadata; empty for metadata still on the device
+    std::string metadata(uint32_t slot) const;
+    // metadataSize() bytes of arena metadata, or nullptr if it's on the device
+    const char* metadataData(uint32_t slot) const {
+        return metadata_[slot].on_device ? nullptr : arena_.data() + metadata_[slot].offset;
+    }
+
+    // A copy of the slot's fields, with its metadata if it is in the arena
+    VectorEntry entry(uint32_t slot) const;
+
+private:
+    struct MetadataRef {
+        uint64_t offset = 0;  // into arena_, or on the device if on_device
+        uint32_t size = 0;
+        bool on_device = false;
+    };
+
+    // Compact the arena once dead bytes pass both this size and half of it
+    static constexpr size_t ARENA_COMPACT_MIN_GARBAGE = 1024 * 1024;
+
+    std::vector<uint32_t> ids_;
+    std::vector<uint32_t> clusters_;
+    std::vector<uint64_t> offsets_;
+    std::vector<float> norms_;
+    std::vector<uint8_t> quantized_;
+    std::vector<MetadataRef> metadata_;
+    std::vector<uint32_t> member_positions_;  // slot's index in its cluster's list
+
+    std::unordered_map<uint32_t, uint32_t> slots_;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> members_;
+
+    std::vector<char> arena_;
+    size_t arena_garbage_;
+
+    AttributeIndex attributes_;
+
+    void addMember(uint32_t slot);
+    void removeMember(uint32_t slot);
+    void releaseMetadata(uint32_t slot);
+    void compactArena();
+};
+
+#endif // VECTOR_INDEX_H
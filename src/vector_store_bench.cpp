@@ -0,0 +1,752 @@
+// Search quality and latency benchmark.
+//
+// Loads a base set and a query set (SIFT/GIST .fvecs, SIFT1B .bvecs, GloVe
+// .txt, or seeded synthetic clusters), computes the exact top-k of every
+// query by brute force, builds a store once and then reopens it for each
+// I/O mode and worker thread count in the sweep. For each nprobe setting
+// and number of client threads, it reports recall@k, QPS and latency
+// percentiles as JSON, so runs can be diffed and tracked for regressions:
+//
+//     vector_store_bench --base sift_base.fvecs --query sift_query.fvecs
+//         --groundtruth sift_cosine_gt.ivecs --nprobe 1,4,16,0
+//         --threads 1,8 --io buffered,direct,mmap --output sift.json
+//
+// The store ranks by cosine similarity, so the ground truth is computed
+// with it too; the datasets' own (L2) ground truth files don't apply.
+// --groundtruth caches ours: loaded when the file exists, else written.
+// Progress goes to stderr; the JSON to --output, or stdout.
+
+#include "vector_cluster_store.h"
+#include "distance.h"
+#include "logger.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+// Row-major vectors, as the dataset files and storeVectors have them
+struct Dataset {
+    size_t rows = 0;
+    uint32_t dim = 0;
+    std::vector<float> data;
+
+    const float* row(size_t i) const { return data.data() + i * dim; }
+};
+
+struct BenchConfig {
+    std::string base_path;
+    std::string query_path;
+    std::string groundtruth_path;
+    std::string store_path = "vector_store_bench.bin";
+    std::string output_path;
+    // Synthetic data when no --base is given
+    size_t synthetic_vectors = 100000;
+    size_t synthetic_queries = 1000;
+    uint32_t synthetic_dim = 128;
+    uint32_t seed = 42;
+    size_t max_base = 0;        // 0: the whole file
+    size_t max_queries = 0;
+    uint32_t k = 10;
+    uint32_t clusters = 0;      // 0: about sqrt(base rows)
+    std::vector<uint32_t> nprobes = {1, 2, 4, 8, 16, 32, 0};
+    std::vector<uint32_t> threads = {1};
+    std::vector<uint32_t> workers = {1};
+    std::vector<std::string> io_modes = {"buffered", "direct", "mmap"};
+    uint64_t cache_mb = 0;      // cluster cache for the direct mode
+    size_t warmup = 100;        // queries run before each measurement
+    uint32_t runs = 1;          // passes over the queries measured
+    bool reuse_store = false;
+};
+
+class Timer {
+public:
+    Timer() : start_(std::chrono::steady_clock::now()) {}
+
+    double elapsedSeconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() &&
+           text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// .fvecs, .bvecs and .ivecs: each row is an int32 dimension followed by
+// that many values (float, uint8 and int32 respectively)
+template <typename Value>
+bool readVecs(const std::string& path, size_t limit, uint32_t& dim, std::vector<Value>& values, size_t& rows) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return false;
+    }
+    rows = 0;
+    int32_t row_dim = 0;
+    while ((limit == 0 || rows < limit) && file.read(reinterpret_cast<char*>(&row_dim), sizeof(row_dim))) {
+        if (row_dim <= 0 || (rows > 0 && static_cast<uint32_t>(row_dim) != dim)) {
+            std::cerr << path << ": bad dimension " << row_dim << " in row " << rows << std::endl;
+            return false;
+        }
+        dim = static_cast<uint32_t>(row_dim);
+        values.resize((rows + 1) * dim);
+        if (!file.read(reinterpret_cast<char*>(values.data() + rows * dim), dim * sizeof(Value))) {
+            std::cerr << path << ": truncated row " << rows << std::endl;
+            return false;
+        }
+        rows++;
+    }
+    return rows > 0;
+}
+
+// GloVe's text format: a word, then the vector's values, on each line
+bool readGloveText(const std::string& path, size_t limit, Dataset& dataset) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    std::vector<float> row;
+    while ((limit == 0 || dataset.rows < limit) && std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string word;
+        fields >> word;
+        row.clear();
+        float value;
+        while (fields >> value) {
+            row.push_back(value);
+        }
+        if (row.empty()) {
+            continue;
+        }
+        if (dataset.dim == 0) {
+            dataset.dim = static_cast<uint32_t>(row.size());
+        } else if (row.size() != dataset.dim) {
+            std::cerr << path << ": row " << dataset.rows << " has " << row.size()
+                      << " values, expected " << dataset.dim << std::endl;
+            return false;
+        }
+        dataset.data.insert(dataset.data.end(), row.begin(), row.end());
+        dataset.rows++;
+    }
+    return dataset.rows > 0;
+}
+
+bool loadDataset(const std::string& path, size_t limit, Dataset& dataset) {
+    if (endsWith(path, ".fvecs")) {
+        return readVecs(path, limit, dataset.dim, dataset.data, dataset.rows);
+    }
+    if (endsWith(path, ".bvecs")) {
+        std::vector<uint8_t> bytes;
+        if (!readVecs(path, limit, dataset.dim, bytes, dataset.rows)) {
+            return false;
+        }
+        dataset.data.assign(bytes.begin(), bytes.end());
+        return true;
+    }
+    if (endsWith(path, ".txt")) {
+        return readGloveText(path, limit, dataset);
+    }
+    std::cerr << "Unknown dataset format (expected .fvecs, .bvecs or .txt): " << path << std::endl;
+    return false;
+}
+
+// Overlapping Gaussian blobs, fewer than the store has clusters, so that
+// neighbours straddle cluster boundaries as they do in real data. Queries
+// are drawn the same way: near the base vectors, not copies of them.
+void generateSynthetic(const BenchConfig& config, Dataset& base, Dataset& queries) {
+    const size_t num_centres = std::max<size_t>(1, config.synthetic_vectors / 2000);
+    std::mt19937 gen(config.seed);
+    std::normal_distribution<float> centre_dist(0.0f, 1.0f);
+    std::normal_distribution<float> offset_dist(0.0f, 0.6f);
+    std::uniform_int_distribution<size_t> pick(0, num_centres - 1);
+
+    std::vector<float> centres(num_centres * config.synthetic_dim);
+    for (float& value : centres) {
+        value = centre_dist(gen);
+    }
+    auto fill = [&](Dataset& dataset, size_t rows) {
+        dataset.rows = rows;
+        dataset.dim = config.synthetic_dim;
+        dataset.data.resize(rows * config.synthetic_dim);
+        for (size_t i = 0; i < rows; i++) {
+            const float* centre = centres.data() + pick(gen) * config.synthetic_dim;
+            for (uint32_t j = 0; j < config.synthetic_dim; j++) {
+                dataset.data[i * config.synthetic_dim + j] = centre[j] + offset_dist(gen);
+            }
+        }
+    };
+    fill(base, config.synthetic_vectors);
+    fill(queries, config.synthetic_queries);
+}
+
+// Run body(i) for i in [0, count) on threads threads
+template <typename Body>
+void parallelFor(size_t count, unsigned threads, Body body) {
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) {
+        pool.emplace_back([&] {
+            for (size_t i = next++; i < count; i = next++) {
+                body(i);
+            }
+        });
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+unsigned hardwareThreads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Exact top-k ids of each query by cosine similarity, which is how the
+// store ranks. k columns per query.
+std::vector<uint32_t> bruteForceGroundTruth(const Dataset& base, const Dataset& queries, uint32_t k) {
+    std::vector<float> norms(base.rows);
+    for (size_t i = 0; i < base.rows; i++) {
+        norms[i] = std::sqrt(dotProduct(base.row(i), base.row(i), base.dim));
+    }
+    std::vector<uint32_t> truth(queries.rows * k);
+    parallelFor(queries.rows, hardwareThreads(), [&](size_t q) {
+        const float* query = queries.row(q);
+        const float query_norm = std::sqrt(dotProduct(query, query, queries.dim));
+        // Min-heap of the k best (similarity, id) so far
+        std::vector<std::pair<float, uint32_t>> top;
+        top.reserve(k + 1);
+        auto worse = [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) {
+            return a.first > b.first;
+        };
+        for (size_t i = 0; i < base.rows; i++) {
+            const float denominator = query_norm * norms[i];
+            const float similarity = denominator > 0.0f ? dotProduct(query, base.row(i), base.dim) / denominator : 0.0f;
+            if (top.size() < k) {
+                top.push_back({similarity, static_cast<uint32_t>(i)});
+                std::push_heap(top.begin(), top.end(), worse);
+            } else if (similarity > top.front().first) {
+                std::pop_heap(top.begin(), top.end(), worse);
+                top.back() = {similarity, static_cast<uint32_t>(i)};
+                std::push_heap(top.begin(), top.end(), worse);
+            }
+        }
+        std::sort_heap(top.begin(), top.end(), worse);
+        for (size_t j = 0; j < top.size(); j++) {
+            truth[q * k + j] = top[j].second;
+        }
+    });
+    return truth;
+}
+
+bool loadGroundTruth(const std::string& path, size_t queries, uint32_t k, std::vector<uint32_t>& truth) {
+    if (!std::ifstream(path)) {
+        return false;   // not computed yet
+    }
+    uint32_t dim = 0;
+    size_t rows = 0;
+    std::vector<int32_t> ids;
+    if (!readVecs(path, queries, dim, ids, rows)) {
+        return false;
+    }
+    if (rows < queries || dim < k) {
+        std::cerr << path << " has " << rows << " rows of " << dim << " ids; need " << queries
+                  << " of at least " << k << std::endl;
+        return false;
+    }
+    truth.resize(queries * k);
+    for (size_t q = 0; q < queries; q++) {
+        for (uint32_t j = 0; j < k; j++) {
+            truth[q * k + j] = static_cast<uint32_t>(ids[q * dim + j]);
+        }
+    }
+    return true;
+}
+
+bool saveGroundTruth(const std::string& path, const std::vector<uint32_t>& truth, uint32_t k) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    const int32_t dim = static_cast<int32_t>(k);
+    for (size_t q = 0; q < truth.size() / k; q++) {
+        file.write(reinterpret_cast<const char*>(&dim), sizeof(dim));
+        file.write(reinterpret_cast<const char*>(truth.data() + q * k), k * sizeof(uint32_t));
+    }
+    return static_cast<bool>(file);
+}
+
+StoreOptions storeOptions(const BenchConfig& config, const std::string& io_mode, uint32_t workers) {
+    StoreOptions options;
+    options.direct_io = io_mode == "direct";
+    options.use_mmap = io_mode == "mmap";
+    options.cache_bytes = options.direct_io ? config.cache_mb * 1024 * 1024 : 0;
+    options.worker_threads = workers;
+    return options;
+}
+
+// Load base into a fresh store: train on a sample, then one batch
+bool buildStore(Logger& logger, const BenchConfig& config, const Dataset& base, double& seconds) {
+    std::remove(config.store_path.c_str());
+    VectorClusterStore store(logger);
+    if (!store.initialize(config.store_path, "kmeans", base.dim, config.clusters,
+                          storeOptions(config, "buffered", 0))) {
+        std::cerr << "Failed to create store " << config.store_path << std::endl;
+        return false;
+    }
+    Timer timer;
+
+    // A fixed-seed sample, so reruns train the same clusters
+    const size_t sample_size = std::min(base.rows, static_cast<size_t>(config.clusters) * 256);
+    std::vector<size_t> order(base.rows);
+    for (size_t i = 0; i < base.rows; i++) {
+        order[i] = i;
+    }
+    std::mt19937 gen(config.seed);
+    std::shuffle(order.begin(), order.end(), gen);
+    std::vector<float> sample(sample_size * base.dim);
+    for (size_t i = 0; i < sample_size; i++) {
+        std::memcpy(sample.data() + i * base.dim, base.row(order[i]), base.dim * sizeof(float));
+    }
+    if (!store.train(sample.data(), sample_size)) {
+        std::cerr << "Training failed" << std::endl;
+        return false;
+    }
+
+    const size_t chunk = 10000;
+    if (!store.beginBatch()) {
+        return false;
+    }
+    for (size_t start = 0; start < base.rows; start += chunk) {
+        const size_t count = std::min(chunk, base.rows - start);
+        std::vector<uint32_t> ids(count);
+        for (size_t i = 0; i < count; i++) {
+            ids[i] = static_cast<uint32_t>(start + i);
+        }
+        if (!store.storeVectors(ids, base.row(start))) {
+            std::cerr << "Storing vectors " << start << ".." << start + count << " failed" << std::endl;
+            return false;
+        }
+        std::cerr << "\rStored " << start + count << "/" << base.rows << std::flush;
+    }
+    std::cerr << std::endl;
+    if (!store.commitBatch()) {
+        return false;
+    }
+    seconds = timer.elapsedSeconds();
+    return true;
+}
+
+// Nearest-rank percentile of sorted values
+double percentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(q * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+struct RunResult {
+    std::string io_mode;
+    std::string io_engine;
+    uint32_t workers = 0;
+    uint32_t threads = 0;
+    uint32_t nprobe = 0;
+    size_t queries = 0;
+    double recall = 0;
+    double qps = 0;
+    double mean_us = 0;
+    double p50_us = 0;
+    double p95_us = 0;
+    double p99_us = 0;
+    double max_us = 0;
+    double clusters_scanned = 0;   // per query
+    double vectors_scanned = 0;
+    double codes_scored = 0;
+};
+
+RunResult runQueries(VectorClusterStore& store, const BenchConfig& config, const Dataset& queries,
+                     const std::vector<uint32_t>& truth, uint32_t nprobe, uint32_t threads) {
+    SearchParams params;
+    params.nprobe = nprobe;
+    auto search = [&](size_t q, SearchStats* stats) {
+        Vector query(queries.row(q), queries.row(q) + queries.dim);
+        return store.findSimilarVectors(query, config.k, params, stats);
+    };
+
+    for (size_t q = 0; q < std::min(config.warmup, queries.rows); q++) {
+        search(q, nullptr);
+    }
+
+    const size_t total = queries.rows * config.runs;
+    std::vector<double> latencies(total);
+    std::vector<SearchStats> stats(total);
+    std::vector<std::vector<std::pair<uint32_t, float>>> results(queries.rows);
+    Timer wall;
+    parallelFor(total, threads, [&](size_t i) {
+        const size_t q = i % queries.rows;
+        const auto start = std::chrono::steady_clock::now();
+        auto found = search(q, &stats[i]);
+        latencies[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        if (i < queries.rows) {
+            results[q] = std::move(found);
+        }
+    });
+    const double seconds = wall.elapsedSeconds();
+
+    RunResult result;
+    result.threads = threads;
+    result.nprobe = nprobe;
+    result.queries = total;
+    result.qps = total / seconds;
+
+    size_t hits = 0;
+    for (size_t q = 0; q < queries.rows; q++) {
+        std::unordered_set<uint32_t> expected(truth.begin() + q * config.k, truth.begin() + (q + 1) * config.k);
+        for (const auto& match : results[q]) {
+            hits += expected.count(match.first);
+        }
+    }
+    result.recall = static_cast<double>(hits) / (queries.rows * config.k);
+
+    double sum = 0;
+    for (size_t i = 0; i < total; i++) {
+        sum += latencies[i];
+        result.clusters_scanned += stats[i].clusters_scanned;
+        result.vectors_scanned += stats[i].vectors_scanned;
+        result.codes_scored += stats[i].codes_scored;
+    }
+    result.mean_us = sum / total;
+    result.clusters_scanned /= total;
+    result.vectors_scanned /= total;
+    result.codes_scored /= total;
+    std::sort(latencies.begin(), latencies.end());
+    result.p50_us = percentile(latencies, 0.50);
+    result.p95_us = percentile(latencies, 0.95);
+    result.p99_us = percentile(latencies, 0.99);
+    result.max_us = latencies.back();
+    return result;
+}
+
+std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+std::string jsonNumber(double value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.6g", std::isfinite(value) ? value : 0.0);
+    return text;
+}
+
+void writeJson(std::ostream& out, const BenchConfig& config, const Dataset& base, const Dataset& queries,
+               double groundtruth_seconds, double build_seconds, const std::vector<RunResult>& results) {
+    out << "{\n";
+    out << "  \"benchmark\": \"vector_store_bench\",\n";
+    out << "  \"dataset\": {\n";
+    out << "    \"base\": " << jsonString(config.base_path.empty() ? "synthetic" : config.base_path) << ",\n";
+    out << "    \"query\": " << jsonString(config.query_path.empty() ? "synthetic" : config.query_path) << ",\n";
+    out << "    \"base_vectors\": " << base.rows << ",\n";
+    out << "    \"queries\": " << queries.rows << ",\n";
+    out << "    \"dim\": " << base.dim << ",\n";
+    out << "    \"seed\": " << config.seed << "\n";
+    out << "  },\n";
+    out << "  \"config\": {\n";
+    out << "    \"k\": " << config.k << ",\n";
+    out << "    \"clusters\": " << config.clusters << ",\n";
+    out << "    \"runs\": " << config.runs << ",\n";
+    out << "    \"warmup\": " << config.warmup << ",\n";
+    out << "    \"cache_mb\": " << config.cache_mb << ",\n";
+    out << "    \"distance_kernel\": " << jsonString(distanceKernelName()) << ",\n";
+    out << "    \"hardware_threads\": " << hardwareThreads() << "\n";
+    out << "  },\n";
+    out << "  \"groundtruth_seconds\": " << jsonNumber(groundtruth_seconds) << ",\n";
+    out << "  \"build_seconds\": " << jsonNumber(build_seconds) << ",\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const RunResult& r = results[i];
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\"io\": " << jsonString(r.io_mode)
+            << ", \"io_engine\": " << jsonString(r.io_engine)
+            << ", \"workers\": " << r.workers
+            << ", \"threads\": " << r.threads
+            << ", \"nprobe\": " << r.nprobe
+            << ", \"queries\": " << r.queries
+            << ", \"recall\": " << jsonNumber(r.recall)
+            << ", \"qps\": " << jsonNumber(r.qps)
+            << ", \"latency_us\": {\"mean\": " << jsonNumber(r.mean_us)
+            << ", \"p50\": " << jsonNumber(r.p50_us)
+            << ", \"p95\": " << jsonNumber(r.p95_us)
+            << ", \"p99\": " << jsonNumber(r.p99_us)
+            << ", \"max\": " << jsonNumber(r.max_us) << "}"
+            << ", \"clusters_scanned\": " << jsonNumber(r.clusters_scanned)
+            << ", \"vectors_scanned\": " << jsonNumber(r.vectors_scanned)
+            << ", \"codes_scored\": " << jsonNumber(r.codes_scored) << "}";
+    }
+    out << "\n  ]\n";
+    out << "}\n";
+}
+
+bool parseList(const std::string& text, std::vector<uint32_t>& values) {
+    values.clear();
+    std::istringstream items(text);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        try {
+            values.push_back(static_cast<uint32_t>(std::stoul(item)));
+        } catch (const std::exception&) {
+            std::cerr << "Not a number: " << item << std::endl;
+            return false;
+        }
+    }
+    return !values.empty();
+}
+
+bool parseList(const std::string& text, std::vector<std::string>& values) {
+    values.clear();
+    std::istringstream items(text);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        if (item != "buffered" && item != "direct" && item != "mmap") {
+            std::cerr << "Unknown I/O mode: " << item << " (buffered, direct or mmap)" << std::endl;
+            return false;
+        }
+        values.push_back(item);
+    }
+    return !values.empty();
+}
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --base FILE          Base vectors (.fvecs, .bvecs or GloVe .txt); synthetic if omitted" << std::endl;
+    std::cout << "  --query FILE         Query vectors, same formats (required with --base)" << std::endl;
+    std::cout << "  --groundtruth FILE   Cosine ground truth cache (.ivecs): read if present, else written" << std::endl;
+    std::cout << "  --max-base N         Use the first N base vectors" << std::endl;
+    std::cout << "  --max-queries N      Use the first N queries" << std::endl;
+    std::cout << "  --synthetic N        Synthetic base vectors (default: 100000)" << std::endl;
+    std::cout << "  --synthetic-queries N  Synthetic queries (default: 1000)" << std::endl;
+    std::cout << "  --dim N              Synthetic dimension (default: 128)" << std::endl;
+    std::cout << "  --seed N             Seed for synthetic data and training (default: 42)" << std::endl;
+    std::cout << "  --store PATH         Store file (default: vector_store_bench.bin)" << std::endl;
+    std::cout << "  --reuse-store        Search an existing store instead of rebuilding it" << std::endl;
+    std::cout << "  --clusters N         Clusters (default: about sqrt of the base size)" << std::endl;
+    std::cout << "  -k N                 Neighbours per query and recall@k (default: 10)" << std::endl;
+    std::cout << "  --nprobe LIST        Clusters to scan, 0 for the default budget (default: 1,2,4,8,16,32,0)" << std::endl;
+    std::cout << "  --threads LIST       Client threads issuing queries (default: 1)" << std::endl;
+    std::cout << "  --workers LIST       Store worker_threads per search (default: 1)" << std::endl;
+    std::cout << "  --io LIST            buffered, direct, mmap (default: all three)" << std::endl;
+    std::cout << "  --cache-mb N         Cluster cache for direct I/O (default: 0)" << std::endl;
+    std::cout << "  --warmup N           Queries run before each measurement (default: 100)" << std::endl;
+    std::cout << "  --runs N             Passes over the queries measured (default: 1)" << std::endl;
+    std::cout << "  --output FILE        Write the JSON here instead of stdout" << std::endl;
+    std::cout << "  -h, --help           Show this help message" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "--reuse-store") {
+            config.reuse_store = true;
+        } else if (!has_value) {
+            std::cerr << "Unknown option or missing value: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        } else if (arg == "--base") {
+            config.base_path = argv[++i];
+        } else if (arg == "--query") {
+            config.query_path = argv[++i];
+        } else if (arg == "--groundtruth") {
+            config.groundtruth_path = argv[++i];
+        } else if (arg == "--store") {
+            config.store_path = argv[++i];
+        } else if (arg == "--output") {
+            config.output_path = argv[++i];
+        } else if (arg == "--max-base") {
+            config.max_base = std::stoul(argv[++i]);
+        } else if (arg == "--max-queries") {
+            config.max_queries = std::stoul(argv[++i]);
+        } else if (arg == "--synthetic") {
+            config.synthetic_vectors = std::stoul(argv[++i]);
+        } else if (arg == "--synthetic-queries") {
+            config.synthetic_queries = std::stoul(argv[++i]);
+        } else if (arg == "--dim") {
+            config.synthetic_dim = std::stoul(argv[++i]);
+        } else if (arg == "--seed") {
+            config.seed = std::stoul(argv[++i]);
+        } else if (arg == "--clusters") {
+            config.clusters = std::stoul(argv[++i]);
+        } else if (arg == "-k") {
+            config.k = std::stoul(argv[++i]);
+        } else if (arg == "--nprobe") {
+            if (!parseList(argv[++i], config.nprobes)) return 1;
+        } else if (arg == "--threads") {
+            if (!parseList(argv[++i], config.threads)) return 1;
+        } else if (arg == "--workers") {
+            if (!parseList(argv[++i], config.workers)) return 1;
+        } else if (arg == "--io") {
+            if (!parseList(argv[++i], config.io_modes)) return 1;
+        } else if (arg == "--cache-mb") {
+            config.cache_mb = std::stoull(argv[++i]);
+        } else if (arg == "--warmup") {
+            config.warmup = std::stoul(argv[++i]);
+        } else if (arg == "--runs") {
+            config.runs = std::max(1ul, std::stoul(argv[++i]));
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.k == 0) {
+        std::cerr << "-k must be at least 1" << std::endl;
+        return 1;
+    }
+    for (uint32_t& threads : config.threads) {
+        threads = std::max(1u, threads);
+    }
+
+    Dataset base;
+    Dataset queries;
+    if (config.base_path.empty()) {
+        std::cerr << "Generating " << config.synthetic_vectors << " synthetic vectors of dimension "
+                  << config.synthetic_dim << "..." << std::endl;
+        generateSynthetic(config, base, queries);
+    } else {
+        if (config.query_path.empty()) {
+            std::cerr << "--base needs --query" << std::endl;
+            return 1;
+        }
+        std::cerr << "Loading " << config.base_path << "..." << std::endl;
+        if (!loadDataset(config.base_path, config.max_base, base) ||
+            !loadDataset(config.query_path, config.max_queries, queries)) {
+            return 1;
+        }
+        if (queries.dim != base.dim) {
+            std::cerr << "Query dimension " << queries.dim << " != base dimension " << base.dim << std::endl;
+            return 1;
+        }
+    }
+    if (config.max_queries > 0 && queries.rows > config.max_queries) {
+        queries.rows = config.max_queries;
+        queries.data.resize(queries.rows * queries.dim);
+    }
+    if (config.k > base.rows) {
+        std::cerr << "-k " << config.k << " exceeds the " << base.rows << " base vectors" << std::endl;
+        return 1;
+    }
+    if (config.clusters == 0) {
+        config.clusters = std::max<uint32_t>(1, static_cast<uint32_t>(std::sqrt(base.rows)));
+    }
+    std::cerr << base.rows << " base vectors, " << queries.rows << " queries, dimension " << base.dim << std::endl;
+
+    // Ground truth
+    std::vector<uint32_t> truth;
+    double groundtruth_seconds = 0;
+    if (config.groundtruth_path.empty() ||
+        !loadGroundTruth(config.groundtruth_path, queries.rows, config.k, truth)) {
+        std::cerr << "Computing exact top-" << config.k << " by brute force..." << std::endl;
+        Timer timer;
+        truth = bruteForceGroundTruth(base, queries, config.k);
+        groundtruth_seconds = timer.elapsedSeconds();
+        if (!config.groundtruth_path.empty() && !saveGroundTruth(config.groundtruth_path, truth, config.k)) {
+            std::cerr << "Could not write " << config.groundtruth_path << std::endl;
+        }
+    }
+
+    Logger logger("vector_store_bench.log", LogLevel::WARNING, false);
+
+    double build_seconds = 0;
+    if (!config.reuse_store) {
+        std::cerr << "Building store " << config.store_path << " with " << config.clusters << " clusters..." << std::endl;
+        if (!buildStore(logger, config, base, build_seconds)) {
+            return 1;
+        }
+        std::cerr << "Built in " << std::setprecision(2) << build_seconds << " s" << std::endl;
+    }
+
+    std::vector<RunResult> results;
+    std::cerr << std::fixed;
+    for (const std::string& io_mode : config.io_modes) {
+        for (uint32_t workers : config.workers) {
+            VectorClusterStore store(logger);
+            if (!store.initialize(config.store_path, "kmeans", base.dim, config.clusters,
+                                  storeOptions(config, io_mode, workers))) {
+                std::cerr << "Failed to open " << config.store_path << " for " << io_mode << " I/O" << std::endl;
+                return 1;
+            }
+            if (store.getVectorCount() != base.rows) {
+                std::cerr << config.store_path << " holds " << store.getVectorCount() << " vectors, expected "
+                          << base.rows << "; rebuild it without --reuse-store" << std::endl;
+                return 1;
+            }
+            for (uint32_t nprobe : config.nprobes) {
+                for (uint32_t threads : config.threads) {
+                    RunResult result = runQueries(store, config, queries, truth, nprobe, threads);
+                    result.io_mode = io_mode;
+                    result.io_engine = store.getIoEngineName();
+                    result.workers = workers;
+                    std::cerr << io_mode << " (" << result.io_engine << ") workers=" << workers
+                              << " threads=" << threads << " nprobe=" << nprobe << ": recall@" << config.k
+                              << " " << std::setprecision(4) << result.recall << ", " << std::setprecision(0)
+                              << result.qps << " QPS, p50 " << std::setprecision(1) << result.p50_us
+                              << " us, p99 " << result.p99_us << " us" << std::endl;
+                    results.push_back(result);
+                }
+            }
+        }
+    }
+
+    if (config.output_path.empty()) {
+        writeJson(std::cout, config, base, queries, groundtruth_seconds, build_seconds, results);
+    } else {
+        std::ofstream out(config.output_path);
+        writeJson(out, config, base, queries, groundtruth_seconds, build_seconds, results);
+        if (!out) {
+            std::cerr << "Could not write " << config.output_path << std::endl;
+            return 1;
+        }
+        std::cerr << "Results written to " << config.output_path << std::endl;
+    }
+    return 0;
+}
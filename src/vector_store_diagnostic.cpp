@@ -17,7 +17,10 @@ struct StoreHeader {
     uint64_t vector_map_offset;
     uint64_t data_offset;
     char strategy_name[32]; // Clustering strategy name
-    uint8_t reserved[432];  // Reserved space (padding to 512 bytes)
+    // Version 2 fields (zero in version 1 stores)
+    uint64_t wal_offset;    // Write-ahead log region, 0 if none
+    uint64_t wal_size;
+    uint8_t reserved[408];  // Reserved space (padding to 512 bytes)
 };
 
 class VectorStoreDiagnostic {
@@ -78,6 +81,10 @@ public:
         std::cout << "Cluster map offset: 0x" << std::hex << header.cluster_map_offset << std::dec << std::endl;
         std::cout << "Vector map offset: 0x" << std::hex << header.vector_map_offset << std::dec << std::endl;
         std::cout << "Data offset: 0x" << std::hex << header.data_offset << std::dec << std::endl;
+        if (header.version >= 2) {
+            std::cout << "WAL offset: 0x" << std::hex << header.wal_offset << std::dec
+                      << " (" << header.wal_size / (1024*1024) << " MB)" << std::endl;
+        }
         std::cout << "Strategy name: " << std::string(header.strategy_name, 32) << std::endl;
         
         // Validate offsets
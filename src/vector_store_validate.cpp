@@ -7,18 +7,36 @@
 #include <string>
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cout << "Usage: " << argv[0] << " <vector_store_file>" << std::endl;
+    const bool checksums_only = argc == 3 && std::string(argv[1]) == "--checksums";
+    if (argc != 2 && !checksums_only) {
+        std::cout << "Usage: " << argv[0] << " [--checksums] <vector_store_file>" << std::endl;
         std::cout << "This tool validates an existing vector store without modifying it." << std::endl;
+        std::cout << "--checksums only verifies the stored checksums, without loading the store." << std::endl;
         return 1;
     }
 
-    std::string store_path = argv[1];
+    std::string store_path = argv[argc - 1];
     
     std::cout << "=== Vector Store Validation Test ===" << std::endl;
     std::cout << "Store file: " << store_path << std::endl;
     
     Logger logger("validation.log");
+    
+    // Headers, maps and log records against their checksums
+    {
+        std::vector<std::string> report;
+        VectorClusterStore checker(logger);
+        const bool intact = checker.verifyChecksums(store_path, report);
+        std::cout << "\n=== Checksums ===" << std::endl;
+        for (const std::string& line : report) {
+            std::cout << "   " << line << std::endl;
+        }
+        std::cout << (intact ? "✅ Latest checkpoint intact" : "❌ Latest checkpoint damaged") << std::endl;
+        if (checksums_only) {
+            return intact ? 0 : 1;
+        }
+    }
+    
     VectorClusterStore store(logger);
     
     // Initialize with placeholder dimensions - the store will read the actual dimensions from the header
@@ -36,6 +36,20 @@ class TestBasicObjects:
         logger = vector_cluster_store_py.Logger(temp_log_path)
         assert logger is not None
 
+    def test_logger_filters_by_level(self, temp_store_path, temp_log_path):
+        """Test that the logger writes only enabled levels, and everything before flush()."""
+        import vector_cluster_store_py
+        logger = vector_cluster_store_py.Logger(temp_log_path, vector_cluster_store_py.LogLevel.WARNING, False)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 10)
+        assert store.retrieve_vector(12345) == []
+        logger.flush()
+        with open(temp_log_path) as f:
+            lines = f.read().splitlines()
+        assert any("[ERROR] Vector 12345 not found" in line for line in lines)
+        assert not any("[INFO]" in line or "[DEBUG]" in line for line in lines)
+        assert logger.get_level() == vector_cluster_store_py.LogLevel.WARNING
+
     def test_create_store(self, temp_log_path):
         """Test VectorClusterStore object creation."""
         import vector_cluster_store_py
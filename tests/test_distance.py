@@ -0,0 +1,67 @@
+"""
+Tests for the SIMD distance kernels.
+"""
+import json
+import os
+import subprocess
+import sys
+
+import numpy as np
+import pytest
+
+# Scores every distance function over dims 1..70 and prints them as JSON.
+# The vectors start one float into their arrays, so the loads are
+# unaligned, and every dim exercises a different tail (masked lanes,
+# remainder loops).
+KERNEL_SCRIPT = """
+import json
+import numpy as np
+import vector_cluster_store_py as vcs
+
+rng = np.random.default_rng(7)
+results = []
+for dim in range(1, 71):
+    rows = rng.normal(0, 1, (2, dim + 1)).astype(np.float32)
+    a, b = rows[0][1:], rows[1][1:]
+    codes = rng.integers(0, 256, dim + 1, dtype=np.uint8)[1:]
+    results.append([vcs.dot_product(a, b), vcs.l2_distance_squared(a, b),
+                    *vcs.dot_product_and_norms(a, b), vcs.dot_product_u8(a, codes),
+                    vcs.cosine_similarity(a, b)])
+print(json.dumps({"kernel": vcs.distance_kernel_name(), "results": results}))
+"""
+
+
+def run_kernel(kernel):
+    """Run KERNEL_SCRIPT in a process whose kernel is capped at `kernel`."""
+    env = dict(os.environ, VCS_DISTANCE_KERNEL=kernel, PYTHONPATH=os.pathsep.join(sys.path))
+    out = subprocess.run([sys.executable, "-c", KERNEL_SCRIPT], env=env,
+                         capture_output=True, text=True, check=True)
+    return json.loads(out.stdout)
+
+
+class TestDistanceKernels:
+    """Test each SIMD kernel against the scalar one."""
+
+    def test_scalar_matches_numpy(self):
+        """Test the scalar kernel, which the others are checked against."""
+        scalar = run_kernel("scalar")
+        assert scalar["kernel"] == "scalar"
+
+        rng = np.random.default_rng(7)
+        for dim, row in zip(range(1, 71), scalar["results"]):
+            vectors = rng.normal(0, 1, (2, dim + 1)).astype(np.float32)
+            a, b = vectors[0][1:].astype(np.float64), vectors[1][1:].astype(np.float64)
+            codes = rng.integers(0, 256, dim + 1, dtype=np.uint8)[1:].astype(np.float64)
+            cosine = a @ b / (np.linalg.norm(a) * np.linalg.norm(b))
+            expected = [a @ b, ((a - b) ** 2).sum(), a @ b, a @ a, b @ b, a @ codes, cosine]
+            np.testing.assert_allclose(row, expected, rtol=1e-4, atol=1e-4)
+
+    @pytest.mark.parametrize("kernel", ["avx512", "avx2", "neon"])
+    def test_kernel_matches_scalar(self, kernel):
+        """Test a SIMD kernel over every tail length, where the CPU has it."""
+        simd = run_kernel(kernel)
+        if simd["kernel"] != kernel:
+            pytest.skip(f"{kernel} not available here (got {simd['kernel']})")
+
+        scalar = run_kernel("scalar")
+        np.testing.assert_allclose(simd["results"], scalar["results"], rtol=1e-5, atol=1e-4)
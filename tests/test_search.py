@@ -2,6 +2,7 @@
 Tests for similarity search functionality.
 """
 import numpy as np
+import pytest
 
 
 class TestSimilaritySearch:
@@ -88,6 +89,174 @@ class TestSimilaritySearch:
             for i in range(len(similarities) - 1):
                 assert similarities[i] >= similarities[i + 1]
 
+    def test_search_matches_exhaustive_top_k(self, initialized_store):
+        """Test that the top k agrees with scoring every vector (small store, fully scanned)."""
+        store, _ = initialized_store
+
+        vecs = np.random.normal(0, 1, (50, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+        assert store.store_vectors(list(range(50)), vecs)
+
+        query = np.random.normal(0, 1, 768).astype(np.float32)
+        query /= np.linalg.norm(query)
+
+        results = store.find_similar_vectors(query.tolist(), 5)
+        expected = np.argsort(-(vecs @ query))[:5]
+
+        assert [r[0] for r in results] == expected.tolist()
+
+    def test_concurrent_searches_with_writer(self, initialized_store):
+        """Test that searches from several threads run alongside inserts."""
+        from concurrent.futures import ThreadPoolExecutor
+
+        store, _ = initialized_store
+
+        vecs = np.random.normal(0, 1, (80, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+        assert store.store_vectors(list(range(60)), vecs[:60])
+
+        def search(i):
+            return store.find_similar_vectors(vecs[i].tolist(), 3)[0][0] == i
+
+        def insert():
+            return all(store.store_vector(i, vecs[i].tolist(), "") for i in range(60, 80))
+
+        with ThreadPoolExecutor(max_workers=4) as pool:
+            writer = pool.submit(insert)
+            hits = list(pool.map(search, range(60)))
+
+        assert writer.result()
+        assert all(hits)
+
+    def test_parallel_search_matches_exhaustive_top_k(self, temp_store_path, temp_log_path):
+        """Test that a search split over worker threads returns the same top k."""
+        import vector_cluster_store_py
+
+        options = vector_cluster_store_py.StoreOptions()
+        options.worker_threads = 4
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 4, options)
+
+        vecs = np.random.normal(0, 1, (300, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+        assert store.store_vectors(list(range(300)), vecs)
+
+        query = np.random.normal(0, 1, 768).astype(np.float32)
+        query /= np.linalg.norm(query)
+
+        # k * 20 covers all 300 vectors, so the whole store is scanned
+        results = store.find_similar_vectors(query.tolist(), 15)
+        expected = np.argsort(-(vecs @ query))[:15]
+
+        assert [r[0] for r in results] == expected.tolist()
+
+    def test_batch_search_matches_single_queries(self, initialized_store):
+        """Test that a batch of queries returns what each query returns on its own."""
+        store, _ = initialized_store
+
+        vecs = np.random.normal(0, 1, (120, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+        assert store.store_vectors(list(range(120)), vecs)
+
+        queries = vecs[:8] + np.random.normal(0, 0.05, (8, 768)).astype(np.float32)
+        batch = store.find_similar_vectors_batch(queries, 5)
+
+        assert len(batch) == 8
+        for query, results in zip(queries, batch):
+            single = store.find_similar_vectors(query.tolist(), 5)
+            assert [r[0] for r in results] == [r[0] for r in single]
+            assert np.allclose([r[1] for r in results], [r[1] for r in single])
+
+    def test_batch_search_rejects_wrong_dimension(self, initialized_store):
+        """Test that a batch with the wrong query dimension returns no results."""
+        store, _ = initialized_store
+
+        assert store.find_similar_vectors_batch(np.zeros((2, 16), dtype=np.float32), 5) == []
+
+    def test_search_params_bound_the_scan(self, temp_store_path, temp_log_path):
+        """Test that SearchParams limit the clusters scanned and the stats report it."""
+        import vector_cluster_store_py
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 8)
+
+        vecs = np.random.normal(0, 1, (400, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+        assert store.store_vectors(list(range(400)), vecs)
+        query = vecs[7].tolist()
+
+        results, stats = store.find_similar_vectors_with_stats(query, 5)
+        assert results[0][0] == 7
+        assert stats.vectors_scanned >= 200
+        assert not stats.deadline_reached
+
+        params = vector_cluster_store_py.SearchParams()
+        params.nprobe = 1
+        results, stats = store.find_similar_vectors_with_stats(query, 5, params)
+        assert stats.clusters_scanned == 1
+
+        params = vector_cluster_store_py.SearchParams()
+        params.max_candidates = 400
+        _, stats = store.find_similar_vectors_with_stats(query, 5, params)
+        assert stats.vectors_scanned == 400
+        assert stats.clusters_scanned >= 1
+
+        # A deadline returns whatever was scored in time, best first
+        params = vector_cluster_store_py.SearchParams()
+        params.deadline_us = 1
+        results, stats = store.find_similar_vectors_with_stats(query, 5, params)
+        assert len(results) <= 5
+        assert stats.vectors_scanned <= 400
+
+    def test_hierarchical_strategy_finds_stored_vectors(self, temp_store_path, temp_log_path):
+        """Test that the two-level centroid index still finds each stored vector."""
+        import vector_cluster_store_py
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        # Enough clusters that the centroids get a coarse level
+        assert store.initialize(temp_store_path, "hierarchical_kmeans", 768, 300)
+
+        vecs = np.random.normal(0, 1, (3000, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+        assert store.store_vectors(list(range(3000)), vecs)
+
+        hits = sum(store.find_similar_vectors(vecs[i].tolist(), 5)[0][0] == i
+                   for i in range(0, 3000, 30))
+        assert hits >= 80
+
+    @pytest.mark.parametrize("quantization", ["SQ8", "PQ"])
+    def test_quantized_search_reranks_to_exact_scores(self, temp_store_path, temp_log_path,
+                                                       quantization):
+        """Test that a quantized store finds each vector and returns exact similarities."""
+        import vector_cluster_store_py
+
+        options = vector_cluster_store_py.StoreOptions()
+        options.quantization = getattr(vector_cluster_store_py.QuantizationType, quantization)
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 128, 4, options)
+
+        vecs = np.random.normal(0, 1, (400, 128)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+        assert store.store_vectors(list(range(400)), vecs)
+        # Maintenance builds the codes
+        assert store.perform_maintenance()
+        # Stored after the build, so searched uncoded
+        extra = np.random.normal(0, 1, 128).astype(np.float32)
+        extra /= np.linalg.norm(extra)
+        assert store.store_vector(400, extra.tolist())
+
+        for i in [0, 123, 399]:
+            results = store.find_similar_vectors(vecs[i].tolist(), 5)
+            assert results[0][0] == i
+            assert abs(results[0][1] - 1.0) < 1e-4
+        assert store.find_similar_vectors(extra.tolist(), 1)[0][0] == 400
+
 
 class TestIndexPersistence:
     """Test index save/load functionality."""
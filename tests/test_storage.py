@@ -2,6 +2,7 @@
 Tests for vector storage operations.
 """
 import numpy as np
+import pytest
 
 
 class TestVectorStorage:
@@ -103,3 +104,795 @@ class TestMaintenance:
 
         # Perform maintenance (should not raise)
         store.perform_maintenance()
+
+    def test_vectors_intact_after_compaction(self, temp_store_path, temp_log_path):
+        """Test that maintenance compaction moves vectors without changing them."""
+        import vector_cluster_store_py
+
+        vecs = np.random.normal(0, 1, (200, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 10)
+        assert store.store_vectors(list(range(200)), vecs)
+        for i in range(0, 200, 7):
+            assert store.delete_vector(i)
+        assert store.perform_maintenance()
+
+        for i in (1, 50, 199):
+            assert np.allclose(store.retrieve_vector(i), vecs[i], atol=1e-6)
+        del store
+
+        reopened = vector_cluster_store_py.VectorClusterStore(logger)
+        assert reopened.initialize(temp_store_path, "kmeans", 768, 10)
+        for i in (1, 50, 199):
+            assert np.allclose(reopened.retrieve_vector(i), vecs[i], atol=1e-6)
+        assert reopened.find_similar_vectors(vecs[50].tolist(), 1)[0][0] == 50
+
+    def test_rebalance_after_reopen_and_overwrite(self, temp_store_path, temp_log_path):
+        """Test that the model rebalances from the device after reopening, overwrites included."""
+        import vector_cluster_store_py
+
+        vecs = np.random.normal(0, 1, (300, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 8)
+        assert store.store_vectors(list(range(200)), vecs[:200])
+        assert store.perform_maintenance()
+        del store
+
+        # Centroids are rebuilt from the vectors on the device, not a copy
+        # kept with the model
+        reopened = vector_cluster_store_py.VectorClusterStore(logger)
+        assert reopened.initialize(temp_store_path, "kmeans", 768, 8)
+        for i in range(100):
+            assert reopened.store_vector(i, vecs[200 + i].tolist())
+        assert reopened.perform_maintenance()
+
+        for i in (0, 99):
+            assert reopened.find_similar_vectors(vecs[200 + i].tolist(), 1)[0][0] == i
+        assert reopened.find_similar_vectors(vecs[150].tolist(), 1)[0][0] == 150
+
+
+    def test_churn_reuses_freed_space(self, temp_store_path, temp_log_path):
+        """Test that deleting and re-storing vectors reuses space rather than growing the store."""
+        import vector_cluster_store_py
+
+        vecs = np.random.normal(0, 1, (600, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 8)
+        assert store.store_vectors(list(range(200)), vecs[:200])
+        assert store.perform_maintenance()
+
+        sizes = []
+        for round in range(4):
+            replacement = vecs[200 + 100 * round:300 + 100 * round]
+            for i in range(100):
+                assert store.delete_vector(i)
+            while store.compact_storage(32) > 0:
+                pass
+            store.compact_storage()
+            assert store.store_vectors(list(range(100)), replacement)
+            sizes.append(store.get_data_size())
+        assert sizes[-1] <= sizes[0]
+
+        assert np.allclose(store.retrieve_vector(7), vecs[507], atol=1e-6)
+        assert np.allclose(store.retrieve_vector(150), vecs[150], atol=1e-6)
+        del store
+
+        reopened = vector_cluster_store_py.VectorClusterStore(logger)
+        assert reopened.initialize(temp_store_path, "kmeans", 768, 8)
+        assert np.allclose(reopened.retrieve_vector(7), vecs[507], atol=1e-6)
+        assert reopened.find_similar_vectors(vecs[150].tolist(), 1)[0][0] == 150
+
+    def test_failed_compaction_frees_its_extent(self, temp_store_path, temp_log_path):
+        """Test that maintenance passes whose compaction can't be written don't grow the store."""
+        import os
+        import resource
+        import signal
+        import vector_cluster_store_py
+
+        vecs = np.random.normal(0, 1, (400, 32)).astype(np.float32)
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 32, 4)
+        for i in range(400):
+            assert store.store_vector(i, vecs[i])
+        for i in range(0, 400, 3):
+            assert store.delete_vector(i)
+
+        # The compacted copies can't be written once the file may not grow
+        limits = resource.getrlimit(resource.RLIMIT_FSIZE)
+        handler = signal.signal(signal.SIGXFSZ, signal.SIG_IGN)
+        resource.setrlimit(resource.RLIMIT_FSIZE, (os.path.getsize(temp_store_path), limits[1]))
+        try:
+            store.perform_maintenance()
+            size = store.get_data_size()
+            for _ in range(20):
+                store.perform_maintenance()
+            assert store.get_data_size() == size
+        finally:
+            resource.setrlimit(resource.RLIMIT_FSIZE, limits)
+            signal.signal(signal.SIGXFSZ, handler)
+
+        assert store.perform_maintenance()
+        assert np.allclose(store.retrieve_vector(1), vecs[1], atol=1e-6)
+
+    def test_background_compaction(self, temp_store_path, temp_log_path):
+        """Test that a store compacting on its own thread keeps serving searches."""
+        import vector_cluster_store_py
+
+        vecs = np.random.normal(0, 1, (300, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+
+        options = vector_cluster_store_py.StoreOptions()
+        options.background_compaction = True
+        options.compaction_interval_ms = 5
+        options.compaction_batch = 16
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 8, options)
+        assert store.store_vectors(list(range(300)), vecs)
+        for i in range(0, 300, 2):
+            assert store.delete_vector(i)
+        for _ in range(50):
+            assert store.find_similar_vectors(vecs[101].tolist(), 1)[0][0] == 101
+        for i in range(1, 300, 50):
+            assert np.allclose(store.retrieve_vector(i), vecs[i], atol=1e-6)
+
+
+    @pytest.mark.parametrize("when", ["before_load", "on_maintenance"])
+    def test_training_balances_ingest_ordered_clusters(self, temp_store_path, temp_log_path, when):
+        """Test that k-means training undoes the skew of source-ordered ingest."""
+        import vector_cluster_store_py
+
+        # 8 sources whose vectors arrive one source at a time
+        centers = np.random.normal(0, 4, (8, 768)).astype(np.float32)
+        vecs = np.repeat(centers, 100, axis=0) + np.random.normal(0, 1, (800, 768)).astype(np.float32)
+
+        options = vector_cluster_store_py.StoreOptions()
+        options.train_on_maintenance = when == "on_maintenance"
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 8, options)
+        if when == "before_load":
+            assert store.train(vecs[::4])
+        assert store.store_vectors(list(range(800)), vecs)
+        assert store.perform_maintenance()
+
+        assert max(store.get_cluster_sizes().values()) <= 200
+        assert store.find_similar_vectors(vecs[555].tolist(), 1)[0][0] == 555
+
+    def test_maintenance_steps_split_oversized_clusters(self, temp_store_path, temp_log_path):
+        """Test that incremental maintenance steps even out ingest-ordered clusters."""
+        import vector_cluster_store_py
+
+        centers = np.random.normal(0, 4, (8, 768)).astype(np.float32)
+        vecs = np.repeat(centers, 100, axis=0) + np.random.normal(0, 1, (800, 768)).astype(np.float32)
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 8)
+        assert store.store_vectors(list(range(800)), vecs)
+        before = max(store.get_cluster_sizes().values())
+
+        for _ in range(100):
+            if store.maintenance_step() == 0:
+                break
+        sizes = store.get_cluster_sizes()
+        assert max(sizes.values()) < before
+        assert max(sizes.values()) <= 200
+        assert store.find_similar_vectors(vecs[555].tolist(), 1)[0][0] == 555
+        del store
+
+        # The moves are logged, so a reopened store has the same clusters
+        reopened = vector_cluster_store_py.VectorClusterStore(logger)
+        assert reopened.initialize(temp_store_path, "kmeans", 768, 8)
+        assert reopened.get_cluster_sizes() == sizes
+        assert np.allclose(reopened.retrieve_vector(321), vecs[321], atol=1e-6)
+
+
+class TestBatchIngest:
+    """Test batched ingest via store_vectors and begin/commit_batch."""
+
+    def test_store_vectors_batch(self, initialized_store):
+        """Test storing a 2-D array of vectors in one call."""
+        store, _ = initialized_store
+
+        vecs = np.random.normal(0, 1, (20, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+        ids = list(range(100, 120))
+        metadata = [f"batch_{i}" for i in ids]
+
+        assert store.store_vectors(ids, vecs, metadata) is True
+
+        for row, vid in enumerate(ids):
+            retrieved = store.retrieve_vector(vid)
+            assert np.allclose(retrieved, vecs[row], atol=1e-6)
+            assert store.get_vector_metadata(vid) == f"batch_{vid}"
+
+    def test_store_vectors_rejects_wrong_shape(self, initialized_store):
+        """Test that a dimension mismatch is rejected."""
+        store, _ = initialized_store
+
+        vecs = np.zeros((3, 10), dtype=np.float32)
+        assert store.store_vectors([1, 2, 3], vecs) is False
+
+    def test_begin_commit_batch(self, initialized_store):
+        """Test that stores inside a batch are visible and persisted on commit."""
+        store, _ = initialized_store
+
+        assert store.begin_batch() is True
+        for i in range(5):
+            vec = np.random.normal(0, 1, 768)
+            vec = (vec / np.linalg.norm(vec)).tolist()
+            assert store.store_vector(i, vec, f"vec_{i}") is True
+        assert store.commit_batch() is True
+
+        for i in range(5):
+            assert len(store.retrieve_vector(i)) == 768
+
+    def test_commit_without_batch_fails(self, initialized_store):
+        """Test that commit_batch requires an open batch."""
+        store, _ = initialized_store
+        assert store.commit_batch() is False
+
+    def test_store_vectors_repeated_ids_keep_last_row(self, temp_store_path, temp_log_path, tmp_path):
+        """Test that an id repeated in a batch is stored once, from its last row."""
+        import vector_cluster_store_py
+
+        vecs = np.random.normal(0, 1, (30, 32)).astype(np.float32)
+        ids = list(range(20)) + [3, 25, 7, 3]
+        rows = np.concatenate([vecs[:20], vecs[20:24]])
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 32, 4)
+        assert store.store_vectors(ids, rows, [f"row_{i}" for i in range(len(ids))])
+        assert np.allclose(store.retrieve_vector(3), vecs[23], atol=1e-6)
+        assert store.get_vector_metadata(3) == "row_23"
+        assert np.allclose(store.retrieve_vector(7), vecs[22], atol=1e-6)
+        assert sum(store.get_cluster_sizes().values()) == 21
+
+        # Same model as the batch without the rows that get replaced
+        expected = vector_cluster_store_py.VectorClusterStore(logger)
+        assert expected.initialize(str(tmp_path / "expected.bin"), "kmeans", 32, 4)
+        keep = [i for i in range(len(ids)) if ids[i] not in ids[i + 1:]]
+        assert expected.store_vectors([ids[i] for i in keep], rows[keep])
+        centroids = store.get_cluster_centroids()
+        for cluster_id, centroid in expected.get_cluster_centroids().items():
+            assert np.allclose(centroids[cluster_id], centroid, atol=1e-5)
+
+    def test_failed_overwrite_keeps_model(self, temp_store_path, temp_log_path):
+        """Test that overwrites whose data can't be written leave the model as it was."""
+        import os
+        import resource
+        import signal
+        import vector_cluster_store_py
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 32, 4)
+        data_offset = os.path.getsize(temp_store_path)
+
+        vecs = np.random.normal(0, 1, (60, 32)).astype(np.float32)
+        assert store.store_vectors(list(range(40)), vecs[:40])
+        sizes = store.get_cluster_sizes()
+        centroids = store.get_cluster_centroids()
+
+        # Writes into the data region fail once the file may not grow past it
+        limits = resource.getrlimit(resource.RLIMIT_FSIZE)
+        handler = signal.signal(signal.SIGXFSZ, signal.SIG_IGN)
+        resource.setrlimit(resource.RLIMIT_FSIZE, (data_offset, limits[1]))
+        try:
+            assert not store.store_vector(5, vecs[50])
+            assert not store.store_vectors([7, 45, 12, 46], vecs[50:54])
+        finally:
+            resource.setrlimit(resource.RLIMIT_FSIZE, limits)
+            signal.signal(signal.SIGXFSZ, handler)
+
+        assert store.get_cluster_sizes() == sizes
+        after = store.get_cluster_centroids()
+        assert after.keys() == centroids.keys()
+        for cluster_id, centroid in centroids.items():
+            assert np.allclose(after[cluster_id], centroid, atol=1e-4)
+        assert np.allclose(store.retrieve_vector(5), vecs[5], atol=1e-6)
+        assert len(store.retrieve_vector(45)) == 0
+
+
+class TestPersistence:
+    """Test that single-vector mutations survive reopening the store."""
+
+    def test_reopen_after_store_and_delete(self, temp_store_path, temp_log_path):
+        """Test that logged inserts and deletes are replayed on reopen."""
+        import vector_cluster_store_py
+
+        vecs = np.random.normal(0, 1, (10, 768))
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 10)
+        for i in range(10):
+            assert store.store_vector(i, vecs[i].tolist(), f"vec_{i}")
+        assert store.delete_vector(3)
+        del store
+
+        reopened = vector_cluster_store_py.VectorClusterStore(logger)
+        assert reopened.initialize(temp_store_path, "kmeans", 768, 10)
+        assert len(reopened.retrieve_vector(3)) == 0
+        for i in (0, 5, 9):
+            assert np.allclose(reopened.retrieve_vector(i), vecs[i], atol=1e-6)
+            assert reopened.get_vector_metadata(i) == f"vec_{i}"
+
+    def test_metadata_survives_checkpoints_without_being_read(self, temp_store_path, temp_log_path):
+        """Test that metadata left on the device at open is carried through later checkpoints."""
+        import vector_cluster_store_py
+
+        vecs = np.random.normal(0, 1, (50, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 5)
+        assert store.store_vectors(list(range(50)), vecs, [f"vec_{i}" for i in range(50)])
+        del store
+
+        # Only one entry's metadata is read before the map is rewritten
+        reopened = vector_cluster_store_py.VectorClusterStore(logger)
+        assert reopened.initialize(temp_store_path, "kmeans", 768, 5)
+        assert reopened.get_vector_metadata(10) == "vec_10"
+        assert reopened.store_vector(20, vecs[20].tolist(), "changed")
+        assert reopened.perform_maintenance()
+        del reopened
+
+        again = vector_cluster_store_py.VectorClusterStore(logger)
+        assert again.initialize(temp_store_path, "kmeans", 768, 5)
+        assert again.get_vector_metadata(20) == "changed"
+        for i in (0, 10, 49):
+            assert again.get_vector_metadata(i) == f"vec_{i}"
+
+
+class TestNormalizedStorage:
+    """Test the normalize_vectors store option."""
+
+    def test_vectors_stored_normalized(self, temp_store_path, temp_log_path):
+        """Test that vectors come back unit length and search still ranks them."""
+        import vector_cluster_store_py
+
+        options = vector_cluster_store_py.StoreOptions()
+        options.normalize_vectors = True
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 10, options)
+
+        vecs = np.random.normal(0, 3, (20, 768))
+        for i in range(20):
+            assert store.store_vector(i, vecs[i].tolist(), "")
+
+        retrieved = np.array(store.retrieve_vector(4))
+        assert np.isclose(np.linalg.norm(retrieved), 1.0, atol=1e-5)
+        assert np.allclose(retrieved, vecs[4] / np.linalg.norm(vecs[4]), atol=1e-5)
+
+        results = store.find_similar_vectors(vecs[4].tolist(), 1)
+        assert results[0][0] == 4
+        assert np.isclose(results[0][1], 1.0, atol=1e-4)
+
+    def test_option_recorded_in_store(self, temp_store_path, temp_log_path):
+        """Test that reopening uses the option the store was created with."""
+        import vector_cluster_store_py
+
+        options = vector_cluster_store_py.StoreOptions()
+        options.normalize_vectors = True
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 10, options)
+        del store
+
+        reopened = vector_cluster_store_py.VectorClusterStore(logger)
+        assert reopened.initialize(temp_store_path, "kmeans", 768, 10)
+        assert reopened.get_options().normalize_vectors is True
+
+
+class TestDirectIO:
+    """Test opening a store with O_DIRECT and the io_uring read engine."""
+
+    def test_direct_io_roundtrip_and_search(self, temp_store_path, temp_log_path):
+        """Test that a direct I/O store stores, retrieves and searches correctly."""
+        import vector_cluster_store_py
+
+        options = vector_cluster_store_py.StoreOptions()
+        options.direct_io = True
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 10, options)
+        # io_uring where the kernel allows it, pread otherwise
+        assert store.get_io_engine_name() in ("io_uring", "pread")
+
+        vecs = np.random.normal(0, 1, (40, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+        assert store.store_vectors(list(range(40)), vecs)
+
+        assert np.allclose(store.retrieve_vector(17), vecs[17], atol=1e-6)
+        assert store.find_similar_vectors(vecs[17].tolist(), 3)[0][0] == 17
+
+
+class TestMmap:
+    """Test reading a store through a read-only mapping of its data region."""
+
+    def test_mmap_roundtrip_search_and_reopen(self, temp_store_path, temp_log_path):
+        """Test that a mapped store stores, retrieves and searches, before and after reopening."""
+        import vector_cluster_store_py
+
+        options = vector_cluster_store_py.StoreOptions()
+        options.use_mmap = True
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 768, 10, options)
+        assert store.get_io_engine_name() == "mmap"
+
+        vecs = np.random.normal(0, 1, (40, 768)).astype(np.float32)
+        vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+        assert store.store_vectors(list(range(40)), vecs)
+        assert store.store_vector(40, vecs[0].tolist())
+
+        assert np.allclose(store.retrieve_vector(17), vecs[17], atol=1e-6)
+        assert np.allclose(store.retrieve_vector(40), vecs[0], atol=1e-6)
+        assert store.find_similar_vectors(vecs[17].tolist(), 3)[0][0] == 17
+        assert store.perform_maintenance()
+        del store
+
+        reopened = vector_cluster_store_py.VectorClusterStore(logger)
+        assert reopened.initialize(temp_store_path, "kmeans", 768, 10, options)
+        assert reopened.get_io_engine_name() == "mmap"
+        assert np.allclose(reopened.retrieve_vector(23), vecs[23], atol=1e-6)
+        assert reopened.find_similar_vectors(vecs[23].tolist(), 3)[0][0] == 23
+
+
+class TestClusterCache:
+    """Test the in-memory cache of cluster extents for direct I/O stores."""
+
+    def test_cache_hits_repeated_searches_and_follows_writes(self, temp_store_path, temp_log_path):
+        """Test that repeated searches hit the cache and writes are seen through it."""
+        import vector_cluster_store_py
+
+        options = vector_cluster_store_py.StoreOptions()
+        options.direct_io = True
+        options.cache_bytes = 16 << 20
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 64, 4, options)
+
+        vecs = np.random.normal(0, 1, (200, 64)).astype(np.float32)
+        assert store.store_vectors(list(range(200)), vecs)
+        store.compact_storage()
+
+        expected = [i for i, _ in store.find_similar_vectors(vecs[10].tolist(), 5)]
+        for _ in range(3):
+            assert [i for i, _ in store.find_similar_vectors(vecs[10].tolist(), 5)] == expected
+        stats = store.get_cache_stats()
+        assert stats.hits > 0
+        assert 0 < stats.bytes <= options.cache_bytes
+
+        replacement = np.random.normal(0, 1, 64).astype(np.float32)
+        assert store.store_vector(10, replacement.tolist())
+        assert np.allclose(store.retrieve_vector(10), replacement, atol=1e-6)
+        assert store.find_similar_vectors(replacement.tolist(), 1)[0][0] == 10
+
+
+class TestStoreMetrics:
+    """Test the per-operation statistics and their Prometheus dump."""
+
+    def test_stats_count_operations_and_io(self, temp_store_path, temp_log_path):
+        """Test that each operation is counted, timed and charged its I/O."""
+        import vector_cluster_store_py
+
+        options = vector_cluster_store_py.StoreOptions()
+        options.direct_io = True
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 64, 4, options)
+
+        vecs = np.random.normal(0, 1, (100, 64)).astype(np.float32)
+        assert store.store_vectors(list(range(100)), vecs)
+        for i in range(10):
+            assert store.store_vector(100 + i, vecs[i])
+            assert len(store.retrieve_vector(i)) == 64
+        for i in range(20):
+            assert store.find_similar_vectors(vecs[i].tolist(), 5)
+        store.find_similar_vectors_batch(vecs[:4], 5)
+
+        stats = store.get_stats()
+        assert stats.store_batch.count == 1
+        assert stats.store.count == 10 and stats.store.writes > 0
+        assert stats.retrieve.count == 10 and stats.retrieve.reads > 0
+        assert stats.search.count == 20 and stats.search_batch.count == 1
+        assert stats.queries == 24
+        assert stats.clusters_probed > 0 and stats.vectors_scored > 0
+        assert 0 < stats.search.p50_us <= stats.search.p99_us <= stats.search.max_us
+
+        text = store.get_stats_prometheus()
+        assert 'vcs_operation_duration_seconds_count{operation="search"} 20' in text
+        assert "vcs_vectors 110" in text
+
+
+class TestFilteredSearch:
+    """Test searches restricted by attributes indexed from the metadata."""
+
+    def test_filter_restricts_results_and_survives_reopen(self, temp_store_path, temp_log_path):
+        """Test that filtered searches return only matching vectors, before and after reopening."""
+        import json
+        import vector_cluster_store_py as vcs
+
+        options = vcs.StoreOptions()
+        options.attributes = [vcs.AttributeField("tenant", vcs.AttributeType.STRING),
+                              vcs.AttributeField("year", vcs.AttributeType.INT)]
+
+        logger = vcs.Logger(temp_log_path)
+        store = vcs.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 64, 8, options)
+
+        vecs = np.random.normal(0, 1, (300, 64)).astype(np.float32)
+        metadata = [json.dumps({"tenant": "t%d" % (i % 3), "year": 2000 + i % 10}) for i in range(300)]
+        assert store.store_vectors(list(range(300)), vecs, metadata)
+
+        def matches(i):
+            return i % 3 == 1 and 2003 <= 2000 + i % 10 <= 2006
+
+        params = vcs.SearchParams()
+        params.filter.equals("tenant", "t1").range("year", 2003, 2006)
+        results = store.find_similar_vectors(vecs[4].tolist(), 10, params)
+        assert results[0][0] == 4
+        assert len(results) == 10
+        assert all(matches(i) for i, _ in results)
+
+        # Overwriting a vector re-indexes its new metadata
+        assert store.store_vector(4, vecs[4].tolist(), json.dumps({"tenant": "t2", "year": 2004}))
+        assert all(i != 4 for i, _ in store.find_similar_vectors(vecs[4].tolist(), 10, params))
+
+        unknown = vcs.SearchParams()
+        unknown.filter.equals("colour", "red")
+        assert store.find_similar_vectors(vecs[0].tolist(), 10, unknown) == []
+        assert store.perform_maintenance()
+        del store
+
+        reopened = vcs.VectorClusterStore(logger)
+        assert reopened.initialize(temp_store_path, "kmeans", 64, 8, options)
+        other = vcs.SearchParams()
+        other.filter.one_of("tenant", ["t0", "t2"])
+        results = reopened.find_similar_vectors(vecs[4].tolist(), 5, other)
+        assert results[0][0] == 4
+        assert all(i % 3 != 1 or i == 4 for i, _ in results)
+
+
+class TestReadOnlyReplica:
+    """Test replicas that open a writer's device read-only and follow its snapshots."""
+
+    def test_replica_follows_snapshot_deltas(self, temp_store_path, temp_log_path, tmp_path):
+        """Test that a replica loads a snapshot, refuses writes and catches up through deltas."""
+        import vector_cluster_store_py
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        writer_options = vector_cluster_store_py.StoreOptions()
+        writer_options.snapshot_retention = 2
+        writer = vector_cluster_store_py.VectorClusterStore(logger)
+        assert writer.initialize(temp_store_path, "kmeans", 64, 8, writer_options)
+
+        vecs = np.random.normal(0, 1, (200, 64)).astype(np.float32)
+        assert writer.store_vectors(list(range(200)), vecs)
+        snap0, snap1 = str(tmp_path / "snap0"), str(tmp_path / "snap1")
+        assert writer.save_index(snap0)
+
+        replica_options = vector_cluster_store_py.StoreOptions()
+        replica_options.read_only = True
+        replica = vector_cluster_store_py.VectorClusterStore(logger)
+        assert replica.initialize(temp_store_path, "kmeans", 64, 8, replica_options)
+        assert replica.load_index(snap0)
+        assert not replica.store_vector(500, vecs[0].tolist())
+        assert not replica.delete_vector(1)
+
+        for i in range(20):
+            assert writer.delete_vector(i)
+        assert writer.store_vectors(list(range(200, 250)), np.random.normal(0, 1, (50, 64)).astype(np.float32))
+        assert writer.perform_maintenance()
+        assert writer.save_index(snap1, snap0)
+
+        # Until it applies the delta the replica still reads snapshot 0
+        assert np.allclose(replica.retrieve_vector(5), vecs[5], atol=1e-6)
+        assert replica.apply_index_delta(snap1)
+        assert replica.retrieve_vector(5) == []
+        assert np.allclose(replica.retrieve_vector(230), writer.retrieve_vector(230), atol=1e-6)
+        assert replica.find_similar_vectors(vecs[100].tolist(), 1)[0][0] == 100
+        assert not replica.apply_index_delta(snap1)
+
+    def test_bad_snapshot_leaves_replica_index(self, temp_store_path, temp_log_path, tmp_path):
+        """Test that a truncated snapshot fails to load without touching the loaded index."""
+        import shutil
+        import vector_cluster_store_py
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        writer_options = vector_cluster_store_py.StoreOptions()
+        writer_options.snapshot_retention = 2
+        writer = vector_cluster_store_py.VectorClusterStore(logger)
+        assert writer.initialize(temp_store_path, "kmeans", 64, 8, writer_options)
+
+        vecs = np.random.normal(0, 1, (200, 64)).astype(np.float32)
+        assert writer.store_vectors(list(range(200)), vecs)
+        snap0, snap1, bad = str(tmp_path / "snap0"), str(tmp_path / "snap1"), str(tmp_path / "bad")
+        assert writer.save_index(snap0)
+        assert writer.store_vectors(list(range(200, 250)), np.random.normal(0, 1, (50, 64)).astype(np.float32))
+        assert writer.save_index(snap1, snap0)
+
+        replica_options = vector_cluster_store_py.StoreOptions()
+        replica_options.read_only = True
+        replica = vector_cluster_store_py.VectorClusterStore(logger)
+        assert replica.initialize(temp_store_path, "kmeans", 64, 8, replica_options)
+        assert replica.load_index(snap0)
+
+        # The model is whole but the vector map stops halfway
+        shutil.copy(snap1, bad)
+        with open(snap1 + ".vmap", "rb") as f:
+            vmap = f.read()
+        with open(bad + ".vmap", "wb") as f:
+            f.write(vmap[:len(vmap) // 2])
+        assert not replica.load_index(bad)
+        assert sum(replica.get_cluster_sizes().values()) == 200
+        assert replica.find_similar_vectors(vecs[42].tolist(), 1)[0][0] == 42
+        assert replica.apply_index_delta(snap1)
+        assert sum(replica.get_cluster_sizes().values()) == 250
+
+        # A truncated model fails the load too
+        with open(snap1, "rb") as f:
+            model = f.read()
+        with open(bad, "wb") as f:
+            f.write(model[:len(model) // 2])
+        assert not replica.load_index(bad)
+
+
+class TestShardedStore:
+    """Test a store spread over several files."""
+
+    def test_sharded_store_spreads_searches_and_reopens(self, temp_store_path, temp_log_path):
+        """Test that vectors spread over the shards, are found from any of them, and survive reopening."""
+        import os
+        import vector_cluster_store_py
+
+        paths = [temp_store_path] + [temp_store_path + ".shard%d" % i for i in (1, 2)]
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        try:
+            store = vector_cluster_store_py.ShardedVectorStore(logger)
+            assert store.initialize(paths, "kmeans", 64, 12)
+            assert store.get_shard_count() == 3
+
+            vecs = np.random.normal(0, 1, (300, 64)).astype(np.float32)
+            vecs /= np.linalg.norm(vecs, axis=1, keepdims=True)
+            assert store.store_vectors(list(range(300)), vecs)
+            assert store.store_vector(300, vecs[5].tolist(), "extra")
+
+            sizes = store.get_shard_sizes()
+            assert sum(sizes) == 301
+            assert all(size > 0 for size in sizes)
+            for i in (0, 150, 299):
+                assert store.find_similar_vectors(vecs[i].tolist(), 3)[0][0] == i
+            results = store.find_similar_vectors_batch(vecs[:8], 2)
+            assert [r[0][0] for r in results] == list(range(8))
+            assert store.get_vector_metadata(300) == "extra"
+            assert store.delete_vector(300)
+            assert store.retrieve_vector(300) == []
+            del store
+
+            reopened = vector_cluster_store_py.ShardedVectorStore(logger)
+            assert reopened.initialize(paths, "kmeans", 64, 12)
+            assert sum(reopened.get_shard_sizes()) == 300
+            assert np.allclose(reopened.retrieve_vector(42), vecs[42], atol=1e-6)
+            assert reopened.find_similar_vectors(vecs[42].tolist(), 3)[0][0] == 42
+        finally:
+            for path in paths[1:]:
+                if os.path.exists(path):
+                    os.unlink(path)
+
+
+class TestNumpyArrays:
+    """Test the calls that take and return NumPy arrays."""
+
+    def test_array_calls_match_list_calls(self, temp_store_path, temp_log_path):
+        """Test that vectors stored and searched as arrays give the same answers as lists."""
+        import vector_cluster_store_py
+
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 64, 4)
+
+        vecs = np.random.normal(0, 1, (100, 64)).astype(np.float32)
+        for i in range(100):
+            assert store.store_vector(i, vecs[i])
+        assert store.store_vector(100, vecs[0].astype(np.float64), "converted")
+        assert not store.store_vector(101, vecs[0][:32])
+        assert store.get_vector_metadata(100) == "converted"
+
+        vector = store.retrieve_vector_array(17)
+        assert vector.dtype == np.float32 and vector.shape == (64,)
+        assert np.allclose(vector, vecs[17], atol=1e-6)
+        assert store.retrieve_vector_array(9999).shape == (0,)
+
+        ids, scores = store.find_similar_vectors_array(vecs[17], 5)
+        assert ids.dtype == np.int64 and scores.dtype == np.float32
+        expected = store.find_similar_vectors(vecs[17].tolist(), 5)
+        assert ids.tolist() == [i for i, _ in expected]
+        assert np.allclose(scores, [s for _, s in expected], atol=1e-6)
+
+        ids, scores = store.find_similar_vectors_batch_array(vecs[:8], 3)
+        assert ids.shape == (8, 3) and scores.shape == (8, 3)
+        assert ids[:, 0].tolist() == list(range(8))
+
+        # Fewer results than k are padded
+        ids, scores = store.find_similar_vectors_batch_array(vecs[:2], 200)
+        assert ids.shape == (2, 200)
+        assert (ids[:, 101:] == -1).all()
+        assert np.isneginf(scores[:, 101:]).all()
+
+
+class TestDurability:
+    """Test the durability levels and the A/B metadata checkpoints."""
+
+    def test_durability_levels_and_torn_header(self, temp_store_path, temp_log_path):
+        """Test sync counts per level, and that a torn header copy falls back to the other."""
+        import vector_cluster_store_py
+
+        vecs = np.random.normal(0, 1, (40, 32)).astype(np.float32)
+        logger = vector_cluster_store_py.Logger(temp_log_path)
+
+        options = vector_cluster_store_py.StoreOptions()
+        options.durability = vector_cluster_store_py.Durability.PER_OP
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 32, 4, options)
+        syncs = store.get_stats().syncs
+        for i in range(10):
+            assert store.store_vector(i, vecs[i])
+        assert store.get_stats().syncs - syncs == 10
+        assert store.perform_maintenance()
+        del store
+
+        options.durability = vector_cluster_store_py.Durability.GROUP
+        options.group_commit_ops = 64
+        store = vector_cluster_store_py.VectorClusterStore(logger)
+        assert store.initialize(temp_store_path, "kmeans", 32, 4, options)
+        for i in range(10, 40):
+            assert store.store_vector(i, vecs[i])
+        syncs = store.get_stats().syncs
+        assert store.sync()
+        assert store.get_stats().syncs == syncs + 1
+        assert store.perform_maintenance()
+        del store
+
+        intact, report = vector_cluster_store_py.VectorClusterStore(logger).verify_checksums(
+            temp_store_path)
+        assert intact and any("header copy A" in line for line in report)
+
+        # Tear the newest of the two header copies (4 KiB apart)
+        with open(temp_store_path, "r+b") as f:
+            sequences = []
+            for copy in (0, 4096):
+                f.seek(copy + 128)
+                sequences.append(int.from_bytes(f.read(8), "little"))
+            f.seek((0 if sequences[0] > sequences[1] else 4096) + 100)
+            f.write(b"\x5a" * 200)
+
+        reopened = vector_cluster_store_py.VectorClusterStore(logger)
+        assert reopened.initialize(temp_store_path, "kmeans", 32, 4)
+        for i in (0, 9, 20, 39):
+            assert np.allclose(reopened.retrieve_vector(i), vecs[i], atol=1e-6)
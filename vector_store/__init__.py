@@ -1,5 +1,5 @@
 # Vector Store Python Package
-from vector_cluster_store_py import VectorClusterStore, Logger
+from vector_cluster_store_py import VectorClusterStore, Logger, LogLevel
 
 __version__ = '0.3.2'
 